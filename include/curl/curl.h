@@ -421,7 +421,9 @@ typedef enum {
   CURLE_FTP_WEIRD_PASV_REPLY,    /* 13 */
   CURLE_FTP_WEIRD_227_FORMAT,    /* 14 */
   CURLE_FTP_CANT_GET_HOST,       /* 15 */
-  CURLE_OBSOLETE16,              /* 16 - NOT USED */
+  CURLE_HTTP2,                   /* 16 - A problem in the http2 framing layer.
+                                    [was obsoleted in August 2007 for 7.17.0,
+                                    reused in 2013 for 7.30.0] */
   CURLE_FTP_COULDNT_SET_TYPE,    /* 17 */
   CURLE_PARTIAL_FILE,            /* 18 */
   CURLE_FTP_COULDNT_RETR_FILE,   /* 19 */
@@ -515,6 +517,8 @@ typedef enum {
   CURLE_RTSP_SESSION_ERROR,      /* 86 - mismatch of RTSP Session Ids */
   CURLE_FTP_BAD_FILE_LIST,       /* 87 - unable to parse FTP file list */
   CURLE_CHUNK_FAILED,            /* 88 - chunk callback reported error */
+  CURLE_NO_CONNECTION_AVAILABLE, /* 89 - No connection available, the
+                                    session will be queued */
   CURL_LAST /* never use! */
 } CURLcode;
 
@@ -525,6 +529,9 @@ typedef enum {
 #define CURLE_OBSOLETE10 CURLE_FTP_ACCEPT_FAILED
 #define CURLE_OBSOLETE12 CURLE_FTP_ACCEPT_TIMEOUT
 
+/* Previously obsoletes error code re-used in 7.30.0 */
+#define CURLE_OBSOLETE16 CURLE_HTTP2
+
 /*  compatibility with older names */
 #define CURLOPT_ENCODING CURLOPT_ACCEPT_ENCODING
 
@@ -1536,6 +1543,51 @@ typedef enum {
   /* set the SMTP auth originator */
   CINIT(MAIL_AUTH, OBJECTPOINT, 217),
 
+  /* Number of seconds permanent redirects are kept in a shared redirect
+     cache, see CURL_LOCK_DATA_REDIRECT */
+  CINIT(REDIR_CACHE_TIMEOUT, LONG, 218),
+
+  /* Number of seconds an outdated DNS cache entry may still be used while
+     it is looked up again in the background */
+  CINIT(DNS_CACHE_STALE, LONG, 219),
+
+  /* Number of seconds failed name lookups are kept in the DNS cache */
+  CINIT(DNS_NEGATIVE_TIMEOUT, LONG, 220),
+
+  /* Number of sessions kept in the SSL session ID cache */
+  CINIT(SSL_SESSIONID_CACHE_SIZE, LONG, 221),
+
+  /* File to keep the SSL sessions in between the runs of a program */
+  CINIT(SSL_SESSIONID_FILE, OBJECTPOINT, 222),
+
+  /* Send the first data with the SYN, using TCP Fast Open */
+  CINIT(TCP_FASTOPEN, LONG, 223),
+
+  /* Socket buffer sizes, in bytes */
+  CINIT(SOCK_RCVBUF, LONG, 224),
+  CINIT(SOCK_SNDBUF, LONG, 225),
+
+  /* Most bytes to keep unsent in the socket send buffer */
+  CINIT(TCP_NOTSENT_LOWAT, LONG, 226),
+
+  /* Name of the TCP congestion control algorithm to use */
+  CINIT(TCP_CONGESTION, OBJECTPOINT, 227),
+
+  /* Send ACKs at once instead of delaying them */
+  CINIT(TCP_QUICKACK, LONG, 228),
+
+  /* Microseconds to busy poll the device for data when reading */
+  CINIT(SOCK_BUSY_POLL, LONG, 229),
+
+  /* Group of the multi handle whose speed limits the transfer shares */
+  CINIT(RATE_GROUP, LONG, 230),
+
+  /* Priority of the transfer among the others of the multi handle */
+  CINIT(PRIORITY, LONG, 231),
+
+  /* Weight of the transfer within its rate group, 1 - 256 */
+  CINIT(RATE_WEIGHT, LONG, 232),
+
   CURLOPT_LASTENTRY /* the last unused */
 } CURLoption;
 
@@ -1588,6 +1640,7 @@ enum {
                              for us! */
   CURL_HTTP_VERSION_1_0,  /* please use HTTP 1.0 in the request */
   CURL_HTTP_VERSION_1_1,  /* please use HTTP 1.1 in the request */
+  CURL_HTTP_VERSION_2_0,  /* please use HTTP 2.0 in the request */
 
   CURL_HTTP_VERSION_LAST /* *ILLEGAL* http version */
 };
@@ -1997,11 +2050,32 @@ typedef enum {
   CURLINFO_PRIMARY_PORT     = CURLINFO_LONG   + 40,
   CURLINFO_LOCAL_IP         = CURLINFO_STRING + 41,
   CURLINFO_LOCAL_PORT       = CURLINFO_LONG   + 42,
+  CURLINFO_REDIRECT_CACHE_HITS   = CURLINFO_LONG + 43,
+  CURLINFO_REDIRECT_CACHE_MISSES = CURLINFO_LONG + 44,
+  CURLINFO_HTTP_CACHE       = CURLINFO_LONG   + 45,
+  CURLINFO_PIPELINE_POSITION = CURLINFO_LONG  + 46,
+  CURLINFO_CONN_REQUESTS    = CURLINFO_LONG   + 47,
+  CURLINFO_CONN_MAX_PIPELINE = CURLINFO_LONG  + 48,
+  CURLINFO_DNS_CACHE_HITS   = CURLINFO_LONG   + 49,
+  CURLINFO_DNS_CACHE_STALE  = CURLINFO_LONG   + 50,
+  CURLINFO_DNS_CACHE_MISSES = CURLINFO_LONG   + 51,
+  CURLINFO_NUM_TUNNELS      = CURLINFO_LONG   + 52,
+  CURLINFO_NUM_TUNNELS_REUSED = CURLINFO_LONG + 53,
+  CURLINFO_SOCK_RCVBUF      = CURLINFO_LONG   + 54,
+  CURLINFO_SOCK_SNDBUF      = CURLINFO_LONG   + 55,
+  CURLINFO_TCP_NOTSENT_LOWAT = CURLINFO_LONG  + 56,
+  CURLINFO_TCP_CONGESTION   = CURLINFO_STRING + 57,
   /* Fill in new entries below here! */
 
-  CURLINFO_LASTONE          = 42
+  CURLINFO_LASTONE          = 57
 } CURLINFO;
 
+/* the outcomes CURLINFO_HTTP_CACHE returns */
+#define CURL_HTTPCACHE_NONE        0 /* the HTTP cache was not used */
+#define CURL_HTTPCACHE_MISS        1 /* nothing usable was stored */
+#define CURL_HTTPCACHE_HIT         2 /* served without network traffic */
+#define CURL_HTTPCACHE_REVALIDATED 3 /* stored response confirmed by 304 */
+
 /* CURLINFO_RESPONSE_CODE is the new name for the option previously known as
    CURLINFO_HTTP_CODE */
 #define CURLINFO_HTTP_CODE CURLINFO_RESPONSE_CODE
@@ -2041,6 +2115,8 @@ typedef enum {
   CURL_LOCK_DATA_DNS,
   CURL_LOCK_DATA_SSL_SESSION,
   CURL_LOCK_DATA_CONNECT,
+  CURL_LOCK_DATA_REDIRECT,
+  CURL_LOCK_DATA_HTTP_CACHE,
   CURL_LOCK_DATA_LAST
 } curl_lock_data;
 
@@ -2150,6 +2226,7 @@ typedef struct {
 #define CURL_VERSION_CURLDEBUG (1<<13) /* debug memory tracking supported */
 #define CURL_VERSION_TLSAUTH_SRP (1<<14) /* TLS-SRP auth is supported */
 #define CURL_VERSION_NTLM_WB   (1<<15) /* NTLM delegating to winbind helper */
+#define CURL_VERSION_HTTP2     (1<<16) /* HTTP2 support built-in */
 
  /*
  * NAME curl_version_info()
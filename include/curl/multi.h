@@ -76,6 +76,9 @@ typedef enum {
   CURLMSG_NONE, /* first, not used */
   CURLMSG_DONE, /* This easy handle has completed. 'result' contains
                    the CURLcode of the transfer */
+  CURLMSG_PREFETCH, /* A name given to curl_multi_prefetch() has been
+                       resolved or failed to. 'easy_handle' is NULL and
+                       'whatever' points to a struct curl_prefetch */
   CURLMSG_LAST /* last, not used */
 } CURLMSG;
 
@@ -89,6 +92,12 @@ struct CURLMsg {
 };
 typedef struct CURLMsg CURLMsg;
 
+/* what the CURLMSG_PREFETCH message points to */
+struct curl_prefetch {
+  const char *name; /* the "host:port" string as given */
+  CURLcode result;  /* CURLE_OK if the name was resolved */
+};
+
 /* Based on poll(2) structure and values.
  * We don't use pollfd and POLL* constants explicitly
  * to cover platforms without poll(). */
@@ -338,6 +347,26 @@ typedef enum {
   /* maximum number of entries in the connection cache */
   CINIT(MAXCONNECTS, LONG, 6),
 
+  /* maximum number of (pipelining) connections to one host */
+  CINIT(MAX_HOST_CONNECTIONS, LONG, 7),
+
+  /* maximum number of requests in a pipeline */
+  CINIT(MAX_PIPELINE_LENGTH, LONG, 8),
+
+  /* a connection with a content-length longer than this
+     will not be considered for pipelining */
+  CINIT(CONTENT_LENGTH_PENALTY_SIZE, OFF_T, 9),
+
+  /* a connection with a chunk length longer than this
+     will not be considered for pipelining */
+  CINIT(CHUNK_LENGTH_PENALTY_SIZE, OFF_T, 10),
+
+  /* maximum number of threads doing name resolves for the handles */
+  CINIT(MAX_RESOLVER_THREADS, LONG, 11),
+
+  /* name servers to use for the names given to curl_multi_prefetch() */
+  CINIT(PREFETCH_DNS_SERVERS, OBJECTPOINT, 12),
+
   CURLMOPT_LASTENTRY /* the last unused */
 } CURLMoption;
 
@@ -365,6 +394,54 @@ CURL_EXTERN CURLMcode curl_multi_setopt(CURLM *multi_handle,
 CURL_EXTERN CURLMcode curl_multi_assign(CURLM *multi_handle,
                                         curl_socket_t sockfd, void *sockp);
 
+/*
+ * Name:    curl_multi_prefetch()
+ *
+ * Desc:    Starts resolving the "host:port" names in the list and stores the
+ *          results in the DNS caches of the multi handle and its easy
+ *          handles, for the transfers that will need them later. A
+ *          CURLMSG_PREFETCH message is posted for every name when it is
+ *          done.
+ *
+ * Returns: CURLM error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_prefetch(CURLM *multi_handle,
+                                          struct curl_slist *names);
+
+/* what curl_multi_rategroup_stats() fills in */
+struct curl_rategroup_stats {
+  curl_off_t sent;     /* bytes sent by the transfers of the group */
+  curl_off_t received; /* bytes received by the transfers of the group */
+  long waits;          /* times a transfer was held back by the limits */
+};
+
+/*
+ * Name:    curl_multi_rategroup()
+ *
+ * Desc:    Sets the total upload and download speed limits, in bytes per
+ *          second, of the easy handles in the multi handle that have
+ *          CURLOPT_RATE_GROUP set to 'group'. Group 0 is all the easy
+ *          handles of the multi handle. 0 means no limit.
+ *
+ * Returns: CURLM error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_rategroup(CURLM *multi_handle, long group,
+                                           curl_off_t max_send_speed,
+                                           curl_off_t max_recv_speed);
+
+/*
+ * Name:    curl_multi_rategroup_stats()
+ *
+ * Desc:    Fills in how much the easy handles of the group have transferred
+ *          since curl_multi_rategroup() was first called for it.
+ *
+ * Returns: CURLM error code.
+ */
+CURL_EXTERN CURLMcode curl_multi_rategroup_stats(CURLM *multi_handle,
+                                                 long group,
+                                                 struct curl_rategroup_stats
+                                                 *stats);
+
 #ifdef __cplusplus
 } /* end of extern "C" */
 #endif
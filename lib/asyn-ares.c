@@ -250,9 +250,8 @@ int Curl_resolver_getsock(struct connectdata *conn,
  * return number of sockets it worked on
  */
 
-static int waitperform(struct connectdata *conn, int timeout_ms)
+static int waitperform(ares_channel channel, int timeout_ms)
 {
-  struct SessionHandle *data = conn->data;
   int nfds;
   int bitmask;
   ares_socket_t socks[ARES_GETSOCK_MAXNUM];
@@ -260,8 +259,7 @@ static int waitperform(struct connectdata *conn, int timeout_ms)
   int i;
   int num = 0;
 
-  bitmask = ares_getsock((ares_channel)data->state.resolver, socks,
-                         ARES_GETSOCK_MAXNUM);
+  bitmask = ares_getsock(channel, socks, ARES_GETSOCK_MAXNUM);
 
   for(i=0; i < ARES_GETSOCK_MAXNUM; i++) {
     pfd[i].events = 0;
@@ -288,12 +286,11 @@ static int waitperform(struct connectdata *conn, int timeout_ms)
   if(!nfds)
     /* Call ares_process() unconditonally here, even if we simply timed out
        above, as otherwise the ares name resolve won't timeout! */
-    ares_process_fd((ares_channel)data->state.resolver, ARES_SOCKET_BAD,
-                    ARES_SOCKET_BAD);
+    ares_process_fd(channel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);
   else {
     /* move through the descriptors and ask for processing on them */
     for(i=0; i < num; i++)
-      ares_process_fd((ares_channel)data->state.resolver,
+      ares_process_fd(channel,
                       pfd[i].revents & (POLLRDNORM|POLLIN)?
                       pfd[i].fd:ARES_SOCKET_BAD,
                       pfd[i].revents & (POLLWRNORM|POLLOUT)?
@@ -318,7 +315,7 @@ CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
 
   *dns = NULL;
 
-  waitperform(conn, 0);
+  waitperform((ares_channel)data->state.resolver, 0);
 
   if(res && !res->num_pending) {
     (void)Curl_addrinfo_callback(conn, res->last_status, res->temp_ai);
@@ -340,6 +337,16 @@ CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
   return CURLE_OK;
 }
 
+/*
+ * Curl_resolver_notfound() is TRUE for the ares errors that mean the name has
+ * no addresses.
+ */
+bool Curl_resolver_notfound(int status)
+{
+  return ((status == ARES_ENOTFOUND) || (status == ARES_ENODATA))?
+    TRUE:FALSE;
+}
+
 /*
  * Curl_resolver_wait_resolv()
  *
@@ -386,7 +393,7 @@ CURLcode Curl_resolver_wait_resolv(struct connectdata *conn,
     else
       timeout_ms = 1000;
 
-    waitperform(conn, timeout_ms);
+    waitperform((ares_channel)data->state.resolver, timeout_ms);
     Curl_resolver_is_resolved(conn,&temp_entry);
 
     if(conn->async.done)
@@ -505,6 +512,31 @@ static void query_completed_cb(void *arg,  /* (struct connectdata *) */
     res->last_status = status;
 }
 
+#ifdef ENABLE_IPV6 /* CURLRES_IPV6 */
+/* the PF_* family to resolve names to for a CURL_IPRESOLVE_* version */
+static int ares_family(long ip_version)
+{
+  int family;
+
+  switch(ip_version) {
+  default:
+#if ARES_VERSION >= 0x010601
+    family = PF_UNSPEC; /* supported by c-ares since 1.6.1, so for older
+                           c-ares versions this just falls through and defaults
+                           to PF_INET */
+    break;
+#endif
+  case CURL_IPRESOLVE_V4:
+    family = PF_INET;
+    break;
+  case CURL_IPRESOLVE_V6:
+    family = PF_INET6;
+    break;
+  }
+  return family;
+}
+#endif /* CURLRES_IPV6 */
+
 /*
  * Curl_resolver_getaddrinfo() - when using ares
  *
@@ -540,21 +572,7 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
     /* This must be an IPv6 address literal.  */
     return Curl_ip2addr(AF_INET6, &in6, hostname, port);
 
-  switch(conn->ip_version) {
-  default:
-#if ARES_VERSION >= 0x010601
-    family = PF_UNSPEC; /* supported by c-ares since 1.6.1, so for older
-                           c-ares versions this just falls through and defaults
-                           to PF_INET */
-    break;
-#endif
-  case CURL_IPRESOLVE_V4:
-    family = PF_INET;
-    break;
-  case CURL_IPRESOLVE_V6:
-    family = PF_INET6;
-    break;
-  }
+  family = ares_family(conn->ip_version);
 #endif /* CURLRES_IPV6 */
 
   bufp = strdup(hostname);
@@ -610,6 +628,149 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
   return NULL; /* no struct yet */
 }
 
+/* a lookup that no connection waits for, on a channel of its own */
+struct ares_refresh {
+  ares_channel channel;
+  struct ResolverResults res;
+  int port;
+};
+
+/*
+ * refresh_completed_cb() is called by ares when one of the host queries of
+ * a lookup started by refresh_start() is completed.
+ */
+static void refresh_completed_cb(void *arg,  /* (struct ares_refresh *) */
+                                 int status,
+#ifdef HAVE_CARES_CALLBACK_TIMEOUTS
+                                 int timeouts,
+#endif
+                                 struct hostent *hostent)
+{
+  struct ares_refresh *r = (struct ares_refresh *)arg;
+
+#ifdef HAVE_CARES_CALLBACK_TIMEOUTS
+  (void)timeouts; /* ignored */
+#endif
+
+  if(ARES_EDESTRUCTION == status)
+    /* the lookup is being freed */
+    return;
+
+  r->res.num_pending--;
+
+  if(CURL_ASYNC_SUCCESS == status)
+    compound_results(&r->res, Curl_he2ai(hostent, r->port));
+  /* A successful result overwrites any previous error */
+  if(r->res.last_status != ARES_SUCCESS)
+    r->res.last_status = status;
+}
+
+/*
+ * Start a lookup of the name on a copy of the channel of the handle, so
+ * that it may outlive the handle and its sockets are its own.
+ */
+static void *refresh_start(struct SessionHandle *data, const char *hostname,
+                           int port, long ip_version)
+{
+  struct ares_refresh *r = calloc(1, sizeof(struct ares_refresh));
+  int family = PF_INET;
+
+  if(!r)
+    return NULL;
+  if(ares_dup(&r->channel, (ares_channel)data->state.resolver) !=
+     ARES_SUCCESS) {
+    free(r);
+    return NULL;
+  }
+  r->port = port;
+  r->res.last_status = ARES_ENOTFOUND;
+
+#ifdef ENABLE_IPV6 /* CURLRES_IPV6 */
+  family = ares_family(ip_version);
+  if((family == PF_UNSPEC) && !Curl_ipv6works())
+    family = PF_INET;
+  if(family == PF_UNSPEC) {
+    r->res.num_pending = 2;
+    ares_gethostbyname(r->channel, hostname, PF_INET, refresh_completed_cb,
+                       r);
+    ares_gethostbyname(r->channel, hostname, PF_INET6, refresh_completed_cb,
+                       r);
+  }
+  else
+#else
+  (void)ip_version;
+#endif /* CURLRES_IPV6 */
+  {
+    r->res.num_pending = 1;
+    ares_gethostbyname(r->channel, hostname, family, refresh_completed_cb, r);
+  }
+
+  return r;
+}
+
+void *Curl_resolver_refresh(struct connectdata *conn,
+                            const char *hostname, int port)
+{
+  return refresh_start(conn->data, hostname, port, conn->ip_version);
+}
+
+void *Curl_resolver_prefetch(struct SessionHandle *data,
+                             const char *hostname, int port)
+{
+  return refresh_start(data, hostname, port, CURL_IPRESOLVE_WHATEVER);
+}
+
+bool Curl_resolver_refresh_done(void *refresh, Curl_addrinfo **addr,
+                                time_t *expires)
+{
+  struct ares_refresh *r = (struct ares_refresh *)refresh;
+
+  *addr = NULL;
+  *expires = 0; /* ares doesn't tell */
+  if(r->res.num_pending)
+    waitperform(r->channel, 0);
+  if(r->res.num_pending)
+    return FALSE;
+
+  if(r->res.last_status == ARES_SUCCESS)
+    *addr = r->res.temp_ai;
+  else if(r->res.temp_ai)
+    Curl_freeaddrinfo(r->res.temp_ai);
+  r->res.temp_ai = NULL;
+  return TRUE;
+}
+
+int Curl_resolver_refresh_getsock(void *refresh, curl_socket_t *socks,
+                                  int numsocks, long *timeout_ms)
+{
+  struct ares_refresh *r = (struct ares_refresh *)refresh;
+  struct timeval maxtime;
+  struct timeval timebuf;
+  struct timeval *timeout;
+
+  if(!r->res.num_pending) {
+    *timeout_ms = 0;
+    return GETSOCK_BLANK;
+  }
+
+  maxtime.tv_sec = CURL_TIMEOUT_RESOLVE;
+  maxtime.tv_usec = 0;
+  timeout = ares_timeout(r->channel, &maxtime, &timebuf);
+  *timeout_ms = (timeout->tv_sec * 1000) + (timeout->tv_usec/1000);
+
+  return ares_getsock(r->channel, (ares_socket_t *)socks, numsocks);
+}
+
+void Curl_resolver_refresh_free(void *refresh)
+{
+  struct ares_refresh *r = (struct ares_refresh *)refresh;
+
+  ares_destroy(r->channel);
+  if(r->res.temp_ai)
+    Curl_freeaddrinfo(r->res.temp_ai);
+  free(r);
+}
+
 CURLcode Curl_set_dns_servers(struct SessionHandle *data,
                               char *servers)
 {
@@ -0,0 +1,1766 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef __VMS
+#include <in.h>
+#include <inet.h>
+#endif
+
+/***********************************************************************
+ * Only for builds using the built-in stub resolver
+ * And only for functions that fulfill the asynch resolver backend API
+ * as defined in asyn.h, nothing else belongs in this file!
+ **********************************************************************/
+
+#ifdef CURLRES_STUB
+
+#include "urldata.h"
+#include "sendf.h"
+#include "hostip.h"
+#include "strerror.h"
+#include "multiif.h"
+#include "inet_pton.h"
+#include "connect.h"
+#include "select.h"
+#include "progress.h"
+#include "rawstr.h"
+#include "nonblock.h"
+#include "sockaddr.h"
+#include "sslgen.h"
+#include "warnless.h"
+
+/* The query ids are all that keeps a spoofed answer from being accepted, so
+   they come from the SSL library, the Windows crypto API or a random
+   device. Without any of them the ids would be guessable. */
+#if defined(USE_SSLEAY) || defined(USE_GNUTLS) || defined(USE_NSS) || \
+    defined(USE_DARWINSSL)
+#define STUB_SSL_RANDOM
+#elif defined(WIN32)
+#include <wincrypt.h>
+#elif !defined(RANDOM_FILE)
+#error "the stub resolver needs a random source, set RANDOM_FILE"
+#endif
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+/* The last #include file should be: */
+#include "memdebug.h"
+
+/*
+ * The stub resolver sends the queries for a name straight to the name
+ * servers listed in resolv.conf (or set with CURLOPT_DNS_SERVERS) and reads
+ * the answers from non-blocking sockets that are waited for like any other
+ * socket of a transfer. An A and an AAAA query are sent at the same time. An
+ * answer that doesn't fit in a UDP datagram is fetched again over TCP.
+ *
+ * The hosts file is checked before any query is sent.
+ */
+
+#ifndef RESOLV_CONF
+#define RESOLV_CONF "/etc/resolv.conf"
+#endif
+#ifndef HOSTS_FILE
+#define HOSTS_FILE "/etc/hosts"
+#endif
+
+#define STUB_PORT      53
+#define STUB_MAXNS     3     /* name servers used, like res_init() does */
+#define STUB_MAXSEARCH 6     /* search domains used, like res_init() does */
+#define STUB_TIMEOUT   5000  /* default milliseconds to wait for an answer */
+#define STUB_ATTEMPTS  2     /* default rounds over all the name servers */
+#define STUB_MAXTIMEOUT 30   /* largest resolv.conf timeout, in seconds */
+#define STUB_MAXATTEMPTS 5   /* largest resolv.conf number of attempts */
+#define STUB_UDPSIZE   512   /* largest answer sent over UDP */
+#define STUB_QUERYSIZE (12 + 256 + 4) /* header, name and question */
+
+#define DNS_TYPE_A     1
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_AAAA  28
+#define DNS_CLASS_IN   1
+
+#define DNS_RCODE_NXDOMAIN 3
+
+/* lookup status codes, kept in conn->async.status */
+#define STUB_SUCCESS   CURL_ASYNC_SUCCESS
+#define STUB_ENOTFOUND 1 /* the name doesn't exist */
+#define STUB_ENODATA   2 /* the name has no addresses */
+#define STUB_ESERVFAIL 3 /* the name servers failed to answer */
+#define STUB_ETIMEOUT  4 /* no name server answered in time */
+#define STUB_ENOMEM    5 /* out of memory */
+#define STUB_EBADNAME  6 /* the name can't be put in a query */
+#define STUB_ENORANDOM 7 /* no random data for the query id */
+
+struct stub_server {
+  struct Curl_sockaddr_storage addr;
+  curl_socklen_t addrlen;
+};
+
+/* the resolver setup of an easy handle */
+struct stub_config {
+  struct stub_server server[STUB_MAXNS];
+  int nservers;
+  char *search[STUB_MAXSEARCH];
+  int nsearch;
+  int ndots;
+  long timeout;   /* milliseconds to wait for an answer from a server */
+  int attempts;   /* number of rounds over all the servers */
+  bool custom;    /* the servers were set with CURLOPT_DNS_SERVERS */
+  bool loaded;    /* resolv.conf has been read */
+};
+
+/* one query, for either the A or the AAAA records of a name */
+struct stub_query {
+  curl_socket_t sock;
+  unsigned short qtype;
+  unsigned char msg[2 + STUB_QUERYSIZE]; /* TCP length prefix and query */
+  size_t msglen;  /* size of the query, without the length prefix */
+  int server;     /* index of the server asked */
+  int sent;       /* number of times the query has been sent */
+  struct timeval start; /* when the query was last sent */
+  bool tcp;       /* asking over TCP after a truncated UDP answer */
+  bool connected; /* the TCP connection is established */
+  unsigned char *tcpbuf; /* TCP answer read so far */
+  size_t tcplen;  /* bytes in tcpbuf */
+  size_t tcpsize; /* length of the full TCP answer, once known */
+  bool done;
+  int status;     /* STUB_* code, once done */
+  Curl_addrinfo *ai; /* addresses in the answer */
+  long ttl;       /* lowest time to live of the records used */
+};
+
+/* a lookup of a name, for a connection or one that nobody waits for */
+struct stub_lookup {
+  struct stub_query query[2];
+  int nqueries;
+  int step;       /* index of the name to ask for next, see stub_qname() */
+  char qname[256];
+  char *hostname; /* the name looked up */
+  int port;
+  struct stub_config *cfg; /* the resolver setup used */
+  bool owncfg;    /* cfg is a copy that belongs to the lookup */
+  unsigned char ids[2 * 2 * (STUB_MAXSEARCH + 1)]; /* random query ids */
+  bool done;
+  int status;     /* STUB_* code, once done */
+  Curl_addrinfo *ai; /* the addresses found, once done */
+  time_t expires; /* when the addresses expire, 0 if not known */
+};
+
+static void destroy_async_data(struct Curl_async *async);
+
+/*
+ * Curl_resolver_global_init()
+ * Called from curl_global_init() to initialize global resolver environment.
+ * Does nothing here.
+ */
+int Curl_resolver_global_init(void)
+{
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_global_cleanup()
+ * Called from curl_global_cleanup() to destroy global resolver environment.
+ * Does nothing here.
+ */
+void Curl_resolver_global_cleanup(void)
+{
+}
+
+/*
+ * Curl_resolver_init()
+ * Called from curl_easy_init() -> Curl_open() to initialize resolver
+ * URL-state specific environment ('resolver' member of the UrlState
+ * structure). resolv.conf is read on the first lookup.
+ */
+CURLcode Curl_resolver_init(void **resolver)
+{
+  struct stub_config *cfg = calloc(1, sizeof(struct stub_config));
+  if(!cfg)
+    return CURLE_OUT_OF_MEMORY;
+  *resolver = cfg;
+  return CURLE_OK;
+}
+
+/* forget the search domains */
+static void free_search(struct stub_config *cfg)
+{
+  int i;
+  for(i = 0; i < cfg->nsearch; i++)
+    Curl_safefree(cfg->search[i]);
+  cfg->nsearch = 0;
+}
+
+/*
+ * Curl_resolver_cleanup()
+ * Called from curl_easy_cleanup() -> Curl_close() to cleanup resolver
+ * URL-state specific environment ('resolver' member of the UrlState
+ * structure).
+ */
+void Curl_resolver_cleanup(void *resolver)
+{
+  struct stub_config *cfg = (struct stub_config *)resolver;
+  if(cfg) {
+    free_search(cfg);
+    free(cfg);
+  }
+}
+
+/*
+ * Curl_resolver_duphandle()
+ * Called from curl_easy_duphandle() to duplicate resolver URL-state specific
+ * environment ('resolver' member of the UrlState structure). Only the
+ * servers set with CURLOPT_DNS_SERVERS are copied, the new handle reads
+ * resolv.conf again.
+ */
+int Curl_resolver_duphandle(void **to, void *from)
+{
+  struct stub_config *src = (struct stub_config *)from;
+  struct stub_config *cfg;
+  CURLcode rc = Curl_resolver_init(to);
+  if(rc)
+    return rc;
+  cfg = (struct stub_config *)*to;
+  if(src->custom) {
+    memcpy(cfg->server, src->server, sizeof(cfg->server));
+    cfg->nservers = src->nservers;
+    cfg->custom = TRUE;
+  }
+  return CURLE_OK;
+}
+
+/*
+ * Parse a name server address, with an optional port number in
+ * "host:port" or "[host]:port" style. Returns FALSE if it isn't a numerical
+ * address.
+ */
+static bool parse_server(const char *str, size_t len, bool port_ok,
+                         struct stub_server *srv)
+{
+  char host[64];
+  const char *port = NULL;
+  const char *end = str + len;
+  unsigned long portnum = STUB_PORT;
+  struct sockaddr_in *sa4;
+#ifdef ENABLE_IPV6
+  struct sockaddr_in6 *sa6;
+#endif
+
+  if(port_ok && (*str == '[')) {
+    const char *close = memchr(str, ']', len);
+    if(!close)
+      return FALSE;
+    str++;
+    if(close + 1 < end) {
+      if(close[1] != ':')
+        return FALSE;
+      port = close + 2;
+    }
+    len = close - str;
+  }
+  else if(port_ok) {
+    const char *colon = memchr(str, ':', len);
+    /* a single colon separates the port number from an IPv4 address */
+    if(colon && !memchr(colon + 1, ':', end - colon - 1)) {
+      port = colon + 1;
+      len = colon - str;
+    }
+  }
+
+  if(port) {
+    char *rest;
+    char num[8];
+    size_t numlen = end - port;
+    if(!numlen || (numlen >= sizeof(num)))
+      return FALSE;
+    memcpy(num, port, numlen);
+    num[numlen] = 0;
+    portnum = strtoul(num, &rest, 10);
+    if(*rest || !portnum || (portnum > 0xffff))
+      return FALSE;
+  }
+
+  if(!len || (len >= sizeof(host)))
+    return FALSE;
+  memcpy(host, str, len);
+  host[len] = 0;
+
+  memset(srv, 0, sizeof(*srv));
+  sa4 = &srv->addr.buffer.sa_in;
+  if(Curl_inet_pton(AF_INET, host, &sa4->sin_addr) > 0) {
+    sa4->sin_family = AF_INET;
+    sa4->sin_port = htons(curlx_ultous(portnum));
+    srv->addrlen = sizeof(struct sockaddr_in);
+    return TRUE;
+  }
+#ifdef ENABLE_IPV6
+  else {
+    /* a scope id is not supported, ignore it */
+    char *scope = strchr(host, '%');
+    if(scope)
+      *scope = 0;
+    sa6 = &srv->addr.buffer.sa_in6;
+    if(Curl_inet_pton(AF_INET6, host, &sa6->sin6_addr) > 0) {
+      sa6->sin6_family = AF_INET6;
+      sa6->sin6_port = htons(curlx_ultous(portnum));
+      srv->addrlen = sizeof(struct sockaddr_in6);
+      return TRUE;
+    }
+  }
+#endif
+  return FALSE;
+}
+
+/* read a "name:number" option from a resolv.conf options line */
+static void parse_option(struct stub_config *cfg, const char *opt)
+{
+  if(checkprefix("ndots:", opt))
+    cfg->ndots = curlx_sltosi(strtol(opt + 6, NULL, 10));
+  else if(checkprefix("timeout:", opt)) {
+    long secs = strtol(opt + 8, NULL, 10);
+    if(secs > 0)
+      cfg->timeout = (secs > STUB_MAXTIMEOUT ? STUB_MAXTIMEOUT : secs) * 1000;
+  }
+  else if(checkprefix("attempts:", opt)) {
+    long num = strtol(opt + 9, NULL, 10);
+    if(num > 0)
+      cfg->attempts = (int)(num > STUB_MAXATTEMPTS ? STUB_MAXATTEMPTS : num);
+  }
+  if(cfg->ndots < 0)
+    cfg->ndots = 0;
+}
+
+/*
+ * Read the name servers, the search domains and the options from
+ * resolv.conf. Servers set with CURLOPT_DNS_SERVERS are kept. Without any
+ * name server, the local host is asked like res_init() does.
+ */
+static void read_resolv_conf(struct stub_config *cfg)
+{
+  char line[512];
+  FILE *file;
+  int nservers = 0;
+
+  cfg->ndots = 1;
+  cfg->timeout = STUB_TIMEOUT;
+  cfg->attempts = STUB_ATTEMPTS;
+  free_search(cfg);
+
+  file = fopen(RESOLV_CONF, "r");
+  if(file) {
+    while(fgets(line, sizeof(line), file)) {
+      char *word;
+      char *value;
+      char *ptr = line;
+
+      while(*ptr && ISSPACE(*ptr))
+        ptr++;
+      word = ptr;
+      while(*ptr && !ISSPACE(*ptr))
+        ptr++;
+      if(*ptr)
+        *ptr++ = 0;
+
+      if(!strcmp(word, "nameserver")) {
+        if(!cfg->custom && (nservers < STUB_MAXNS)) {
+          while(*ptr && ISSPACE(*ptr))
+            ptr++;
+          value = ptr;
+          while(*ptr && !ISSPACE(*ptr))
+            ptr++;
+          if(parse_server(value, ptr - value, FALSE,
+                          &cfg->server[nservers]))
+            nservers++;
+        }
+      }
+      else if(!strcmp(word, "search") || !strcmp(word, "domain")) {
+        /* the last one of these lines is used */
+        free_search(cfg);
+        for(;;) {
+          while(*ptr && ISSPACE(*ptr))
+            ptr++;
+          value = ptr;
+          while(*ptr && !ISSPACE(*ptr))
+            ptr++;
+          if((ptr == value) || (cfg->nsearch == STUB_MAXSEARCH))
+            break;
+          if(*ptr)
+            *ptr++ = 0;
+          cfg->search[cfg->nsearch] = strdup(value);
+          if(!cfg->search[cfg->nsearch])
+            break;
+          cfg->nsearch++;
+        }
+      }
+      else if(!strcmp(word, "options")) {
+        for(;;) {
+          while(*ptr && ISSPACE(*ptr))
+            ptr++;
+          value = ptr;
+          while(*ptr && !ISSPACE(*ptr))
+            ptr++;
+          if(ptr == value)
+            break;
+          if(*ptr)
+            *ptr++ = 0;
+          parse_option(cfg, value);
+        }
+      }
+    }
+    fclose(file);
+  }
+
+  if(!cfg->custom) {
+    if(!nservers) {
+      /* ask the local host */
+      parse_server("127.0.0.1", 9, FALSE, &cfg->server[0]);
+      nservers = 1;
+    }
+    cfg->nservers = nservers;
+  }
+  cfg->loaded = TRUE;
+}
+
+/*
+ * Look for the name in the hosts file. Returns the addresses of all the
+ * entries for it, in the order of the file.
+ */
+static Curl_addrinfo *hosts_lookup(const char *name, int port, int pf)
+{
+  char line[512];
+  FILE *file;
+  Curl_addrinfo *head = NULL;
+  Curl_addrinfo *tail = NULL;
+
+  file = fopen(HOSTS_FILE, "r");
+  if(!file)
+    return NULL;
+
+  while(fgets(line, sizeof(line), file)) {
+    char *addr;
+    char *ptr = strchr(line, '#');
+    unsigned char buf[16];
+    int af = AF_INET;
+    bool match = FALSE;
+
+    if(ptr)
+      *ptr = 0;
+    ptr = line;
+    while(*ptr && ISSPACE(*ptr))
+      ptr++;
+    addr = ptr;
+    while(*ptr && !ISSPACE(*ptr))
+      ptr++;
+    if((ptr == addr) || !*ptr)
+      continue;
+    *ptr++ = 0;
+
+    /* the names and aliases of the entry */
+    for(;;) {
+      char *host;
+      while(*ptr && ISSPACE(*ptr))
+        ptr++;
+      host = ptr;
+      while(*ptr && !ISSPACE(*ptr))
+        ptr++;
+      if(ptr == host)
+        break;
+      if(*ptr)
+        *ptr++ = 0;
+      if(Curl_raw_equal(host, name)) {
+        match = TRUE;
+        break;
+      }
+    }
+    if(!match)
+      continue;
+
+    if(Curl_inet_pton(AF_INET, addr, buf) <= 0) {
+#ifdef ENABLE_IPV6
+      if(Curl_inet_pton(AF_INET6, addr, buf) <= 0)
+        continue;
+      af = AF_INET6;
+#else
+      continue;
+#endif
+    }
+
+    if(((af == AF_INET) && (pf != PF_INET6)) ||
+       ((af != AF_INET) && (pf != PF_INET))) {
+      Curl_addrinfo *ai = Curl_ip2addr(af, buf, name, port);
+      if(!ai)
+        break;
+      if(tail)
+        tail->ai_next = ai;
+      else
+        head = ai;
+      tail = ai;
+    }
+  }
+  fclose(file);
+  return head;
+}
+
+/*
+ * Get the name to ask for in the given step of the search order. Names with
+ * at least 'ndots' dots are tried as they are before the search domains are
+ * appended, other names are tried with the search domains first. Names
+ * ending with a dot are only tried as they are. Returns FALSE when there are
+ * no more names to try.
+ */
+static bool stub_qname(struct stub_config *cfg, const char *name, int step,
+                       char *buf, size_t len)
+{
+  size_t namelen = strlen(name);
+  const char *ptr;
+  int dots = 0;
+  int nsteps = cfg->nsearch + 1;
+  int asis;
+
+  for(ptr = name; *ptr; ptr++)
+    if(*ptr == '.')
+      dots++;
+
+  if(namelen && (name[namelen - 1] == '.'))
+    nsteps = 1;
+
+  if(step >= nsteps)
+    return FALSE;
+
+  asis = (dots >= cfg->ndots) ? 0 : nsteps - 1;
+  if(step == asis)
+    snprintf(buf, len, "%s", name);
+  else {
+    int domain = (step < asis) ? step : step - 1;
+    snprintf(buf, len, "%s.%s", name, cfg->search[domain]);
+  }
+  return TRUE;
+}
+
+/*
+ * Create a standard recursive query for 'qname' in 'buf'. Returns the size
+ * of the query or 0 if the name can't be put in a query.
+ */
+static size_t stub_mkquery(unsigned char *buf, unsigned short id,
+                           const char *qname, unsigned short qtype)
+{
+  unsigned char *ptr = buf + 12;
+  const char *label = qname;
+
+  memset(buf, 0, 12);
+  buf[0] = (unsigned char)(id >> 8);
+  buf[1] = (unsigned char)(id & 0xff);
+  buf[2] = 0x01; /* recursion desired */
+  buf[5] = 1;    /* one question */
+
+  while(*label) {
+    const char *dot = strchr(label, '.');
+    size_t len = dot ? (size_t)(dot - label) : strlen(label);
+    if(!len || (len > 63) || ((ptr - buf) + len + 1 > 12 + 255 - 1))
+      return 0;
+    *ptr++ = (unsigned char)len;
+    memcpy(ptr, label, len);
+    ptr += len;
+    if(!dot)
+      break;
+    label = dot + 1;
+  }
+  if(ptr == buf + 12)
+    /* there was no label */
+    return 0;
+  *ptr++ = 0;
+  *ptr++ = (unsigned char)(qtype >> 8);
+  *ptr++ = (unsigned char)(qtype & 0xff);
+  *ptr++ = 0;
+  *ptr++ = DNS_CLASS_IN;
+  return ptr - buf;
+}
+
+/*
+ * Read a possibly compressed name at '*pos' in the message into 'out', and
+ * move '*pos' past it. Returns FALSE if the name is malformed.
+ */
+static bool stub_readname(const unsigned char *msg, size_t len, size_t *pos,
+                          char *out, size_t outlen)
+{
+  size_t p = *pos;
+  size_t o = 0;
+  int jumps = 0;
+  bool jumped = FALSE;
+
+  for(;;) {
+    unsigned int c;
+    if(p >= len)
+      return FALSE;
+    c = msg[p];
+    if((c & 0xc0) == 0xc0) {
+      if(p + 1 >= len)
+        return FALSE;
+      if(!jumped)
+        *pos = p + 2;
+      jumped = TRUE;
+      /* pointers must not loop */
+      if(++jumps > 32)
+        return FALSE;
+      p = ((c & 0x3f) << 8) | msg[p + 1];
+    }
+    else if(c & 0xc0)
+      return FALSE;
+    else if(!c) {
+      if(!jumped)
+        *pos = p + 1;
+      if(!o)
+        out[o++] = '.';
+      out[o] = 0;
+      return TRUE;
+    }
+    else {
+      if((p + 1 + c > len) || (o + c + 2 > outlen))
+        return FALSE;
+      if(o)
+        out[o++] = '.';
+      memcpy(&out[o], &msg[p + 1], c);
+      o += c;
+      p += 1 + c;
+    }
+  }
+}
+
+/* compare two names, ignoring case and a trailing dot */
+static bool stub_samename(const char *a, const char *b)
+{
+  size_t alen = strlen(a);
+  size_t blen = strlen(b);
+  if(alen && (a[alen - 1] == '.'))
+    alen--;
+  if(blen && (b[blen - 1] == '.'))
+    blen--;
+  return (alen == blen) && Curl_raw_nequal(a, b, alen);
+}
+
+#define DNS_GET16(p) (unsigned short)(((p)[0] << 8) | (p)[1])
+#define DNS_GET32(p) (((unsigned long)(p)[0] << 24) | \
+                      ((unsigned long)(p)[1] << 16) | \
+                      ((unsigned long)(p)[2] << 8) | (unsigned long)(p)[3])
+
+/* the answer parsing outcome */
+#define ANSWER_DONE     0 /* the query is done, see q->status */
+#define ANSWER_IGNORE   1 /* not an answer to the query */
+#define ANSWER_TRUNC    2 /* truncated, ask again over TCP */
+#define ANSWER_NEXT     3 /* ask the next server */
+
+/*
+ * Parse an answer to the query. The addresses of the records for the name,
+ * or for the name it is an alias for, are added to the query.
+ */
+static int stub_answer(struct stub_lookup *lookup, struct stub_query *q,
+                       const unsigned char *msg, size_t len)
+{
+  char name[256];
+  char want[256];
+  size_t pos = 12;
+  unsigned int ancount;
+  unsigned int i;
+  Curl_addrinfo *tail = NULL;
+  long ttl = -1;
+
+  if((len < 12) || memcmp(msg, q->msg + 2, 2) || !(msg[2] & 0x80) ||
+     (DNS_GET16(msg + 4) != 1))
+    return ANSWER_IGNORE;
+
+  /* the question must be the one we asked */
+  if(!stub_readname(msg, len, &pos, name, sizeof(name)) ||
+     !stub_samename(name, lookup->qname) || (pos + 4 > len) ||
+     (DNS_GET16(msg + pos) != q->qtype) ||
+     (DNS_GET16(msg + pos + 2) != DNS_CLASS_IN))
+    return ANSWER_IGNORE;
+  pos += 4;
+
+  if((msg[2] & 0x02) && !q->tcp)
+    return ANSWER_TRUNC;
+
+  switch(msg[3] & 0x0f) {
+  case 0:
+    break;
+  case DNS_RCODE_NXDOMAIN:
+    q->status = STUB_ENOTFOUND;
+    return ANSWER_DONE;
+  default:
+    /* server failure, not implemented or refused */
+    return ANSWER_NEXT;
+  }
+
+  strcpy(want, name);
+  ancount = DNS_GET16(msg + 6);
+  for(i = 0; i < ancount; i++) {
+    unsigned short type;
+    unsigned short class;
+    unsigned short rdlen;
+    long rttl;
+
+    if(!stub_readname(msg, len, &pos, name, sizeof(name)) ||
+       (pos + 10 > len))
+      break;
+    type = DNS_GET16(msg + pos);
+    class = DNS_GET16(msg + pos + 2);
+    rttl = (long)(DNS_GET32(msg + pos + 4) & 0x7fffffff);
+    rdlen = DNS_GET16(msg + pos + 8);
+    pos += 10;
+    if(pos + rdlen > len)
+      break;
+
+    if((class == DNS_CLASS_IN) && stub_samename(name, want)) {
+      Curl_addrinfo *ai = NULL;
+      if(type == DNS_TYPE_CNAME) {
+        /* the records that follow are for the canonical name */
+        size_t cpos = pos;
+        if(!stub_readname(msg, len, &cpos, want, sizeof(want)))
+          break;
+      }
+      else if((type == DNS_TYPE_A) && (q->qtype == DNS_TYPE_A) &&
+              (rdlen == 4))
+        ai = Curl_ip2addr(AF_INET, msg + pos, lookup->hostname,
+                          lookup->port);
+#ifdef ENABLE_IPV6
+      else if((type == DNS_TYPE_AAAA) && (q->qtype == DNS_TYPE_AAAA) &&
+              (rdlen == 16))
+        ai = Curl_ip2addr(AF_INET6, msg + pos, lookup->hostname,
+                          lookup->port);
+#endif
+      else {
+        pos += rdlen;
+        continue;
+      }
+
+      if((type != DNS_TYPE_CNAME) && !ai) {
+        q->status = STUB_ENOMEM;
+        return ANSWER_DONE;
+      }
+      if(ai) {
+        if(tail)
+          tail->ai_next = ai;
+        else
+          q->ai = ai;
+        tail = ai;
+      }
+      if((ttl < 0) || (rttl < ttl))
+        ttl = rttl;
+    }
+    pos += rdlen;
+  }
+
+  q->ttl = ttl;
+  q->status = q->ai ? STUB_SUCCESS : STUB_ENODATA;
+  return ANSWER_DONE;
+}
+
+/* stop using the current socket of the query */
+static void query_close(struct stub_query *q)
+{
+  if(q->sock != CURL_SOCKET_BAD) {
+    sclose(q->sock);
+    q->sock = CURL_SOCKET_BAD;
+  }
+  Curl_safefree(q->tcpbuf);
+  q->tcplen = 0;
+  q->tcpsize = 0;
+  q->connected = FALSE;
+}
+
+/* the query is done */
+static void query_done(struct stub_query *q, int status)
+{
+  query_close(q);
+  q->status = status;
+  q->done = TRUE;
+}
+
+/*
+ * Send the query to its current server, over a new socket. UDP sockets are
+ * connected so that only answers from the server are received.
+ */
+static void query_send(struct stub_config *cfg, struct stub_query *q)
+{
+  struct stub_server *srv = &cfg->server[q->server];
+  ssize_t n;
+
+  query_close(q);
+  q->start = Curl_tvnow();
+  q->sent++;
+
+  q->sock = socket(srv->addr.buffer.sa.sa_family,
+                   q->tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if(q->sock == CURL_SOCKET_BAD)
+    return; /* retried on the next server when the attempt times out */
+  curlx_nonblock(q->sock, TRUE);
+
+  if(connect(q->sock, &srv->addr.buffer.sa, srv->addrlen)) {
+    int error = SOCKERRNO;
+    if(q->tcp && ((error == EINPROGRESS) || (error == EWOULDBLOCK)))
+      return; /* the query is sent when the connection is established */
+    query_close(q);
+    return;
+  }
+
+  if(q->tcp) {
+    q->connected = TRUE;
+    n = swrite(q->sock, q->msg, q->msglen + 2);
+    if(n != (ssize_t)(q->msglen + 2))
+      query_close(q);
+  }
+  else {
+    n = swrite(q->sock, q->msg + 2, q->msglen);
+    if(n != (ssize_t)q->msglen)
+      query_close(q);
+  }
+}
+
+/* ask the next server, or give up when all attempts are made */
+static void query_next(struct stub_config *cfg, struct stub_query *q,
+                       int status)
+{
+  if(q->sent >= cfg->nservers * cfg->attempts)
+    query_done(q, status);
+  else {
+    q->server = (q->server + 1) % cfg->nservers;
+    q->tcp = FALSE;
+    query_send(cfg, q);
+  }
+}
+
+/* act on an answer to the query */
+static void query_answer(struct SessionHandle *data,
+                         struct stub_lookup *lookup, struct stub_query *q,
+                         const unsigned char *msg, size_t len)
+{
+  switch(stub_answer(lookup, q, msg, len)) {
+  case ANSWER_DONE:
+    query_done(q, q->status);
+    break;
+  case ANSWER_TRUNC:
+    /* ask the same server again over TCP, without counting an attempt */
+    infof(data, "DNS answer for %s truncated, retrying over TCP\n",
+          lookup->qname);
+    q->tcp = TRUE;
+    q->sent--;
+    query_send(lookup->cfg, q);
+    break;
+  case ANSWER_NEXT:
+    query_next(lookup->cfg, q, STUB_ESERVFAIL);
+    break;
+  default:
+    break;
+  }
+}
+
+/* read what has arrived for the query over TCP */
+static void query_read_tcp(struct SessionHandle *data,
+                           struct stub_lookup *lookup, struct stub_query *q)
+{
+  if(!q->connected) {
+    int error = 0;
+    curl_socklen_t errlen = sizeof(error);
+    if(Curl_socket_ready(CURL_SOCKET_BAD, q->sock, 0) <= 0)
+      return;
+    if(getsockopt(q->sock, SOL_SOCKET, SO_ERROR, (void *)&error, &errlen) ||
+       error) {
+      query_next(lookup->cfg, q, STUB_ESERVFAIL);
+      return;
+    }
+    q->connected = TRUE;
+    if(swrite(q->sock, q->msg, q->msglen + 2) != (ssize_t)(q->msglen + 2)) {
+      query_next(lookup->cfg, q, STUB_ESERVFAIL);
+      return;
+    }
+  }
+
+  for(;;) {
+    ssize_t n;
+    size_t want;
+    if(!q->tcpbuf) {
+      /* two bytes of length first, then the answer */
+      q->tcpbuf = malloc(2 + 0xffff);
+      if(!q->tcpbuf) {
+        query_done(q, STUB_ENOMEM);
+        return;
+      }
+      q->tcpsize = 2;
+    }
+    want = q->tcpsize - q->tcplen;
+    n = sread(q->sock, q->tcpbuf + q->tcplen, want);
+    if(n < 0) {
+      int error = SOCKERRNO;
+      if((error != EAGAIN) && (error != EWOULDBLOCK) && (error != EINTR))
+        query_next(lookup->cfg, q, STUB_ESERVFAIL);
+      return;
+    }
+    if(!n) {
+      query_next(lookup->cfg, q, STUB_ESERVFAIL);
+      return;
+    }
+    q->tcplen += n;
+    if(q->tcplen < q->tcpsize)
+      continue;
+    if(q->tcpsize == 2) {
+      q->tcpsize = 2 + DNS_GET16(q->tcpbuf);
+      if(q->tcpsize > 2)
+        continue;
+    }
+    query_answer(data, lookup, q, q->tcpbuf + 2, q->tcplen - 2);
+    return;
+  }
+}
+
+/* read and handle all the answers that have arrived for the query */
+static void query_read(struct SessionHandle *data,
+                       struct stub_lookup *lookup, struct stub_query *q)
+{
+  unsigned char buf[STUB_UDPSIZE];
+
+  if(q->tcp) {
+    query_read_tcp(data, lookup, q);
+    return;
+  }
+
+  while(!q->done && !q->tcp && (q->sock != CURL_SOCKET_BAD)) {
+    ssize_t n = sread(q->sock, buf, sizeof(buf));
+    if(n < 0) {
+      int error = SOCKERRNO;
+      if((error != EAGAIN) && (error != EWOULDBLOCK) && (error != EINTR))
+        /* most likely an ICMP port unreachable */
+        query_next(lookup->cfg, q, STUB_ESERVFAIL);
+      return;
+    }
+    query_answer(data, lookup, q, buf, (size_t)n);
+  }
+}
+
+/* gets random data for the query ids, returns FALSE if there is none */
+static bool stub_random(struct SessionHandle *data, unsigned char *rnd,
+                        size_t len)
+{
+#if defined(STUB_SSL_RANDOM)
+  Curl_ssl_random(data, rnd, len);
+#elif defined(WIN32)
+  HCRYPTPROV prov;
+  BOOL ok = FALSE;
+
+  (void)data;
+  if(CryptAcquireContext(&prov, NULL, NULL, PROV_RSA_FULL,
+                         CRYPT_VERIFYCONTEXT)) {
+    ok = CryptGenRandom(prov, (DWORD)len, rnd);
+    CryptReleaseContext(prov, 0);
+  }
+  if(!ok)
+    return FALSE;
+#else
+  ssize_t nread = -1;
+  int fd = open(RANDOM_FILE, O_RDONLY);
+
+  (void)data;
+  if(fd != -1) {
+    nread = read(fd, rnd, len);
+    close(fd);
+  }
+  if(nread != (ssize_t)len)
+    return FALSE;
+#endif
+  return TRUE;
+}
+
+/*
+ * Copy the resolver setup of a handle for a lookup that may outlive it.
+ * Returns NULL if out of memory.
+ */
+static struct stub_config *config_dup(const struct stub_config *src)
+{
+  struct stub_config *cfg = malloc(sizeof(struct stub_config));
+  int i;
+
+  if(!cfg)
+    return NULL;
+  memcpy(cfg, src, sizeof(struct stub_config));
+  for(i = 0; i < src->nsearch; i++) {
+    cfg->search[i] = strdup(src->search[i]);
+    if(!cfg->search[i]) {
+      cfg->nsearch = i;
+      Curl_resolver_cleanup(cfg);
+      return NULL;
+    }
+  }
+  return cfg;
+}
+
+/*
+ * Create a lookup of the addresses of the PF_* family for the name, with
+ * the given resolver setup. Returns NULL if out of memory.
+ */
+static struct stub_lookup *lookup_new(struct stub_config *cfg,
+                                      const char *hostname, int port, int pf)
+{
+  struct stub_lookup *lookup = calloc(1, sizeof(struct stub_lookup));
+  int i;
+
+  if(!lookup)
+    return NULL;
+  lookup->hostname = strdup(hostname);
+  if(!lookup->hostname) {
+    free(lookup);
+    return NULL;
+  }
+  lookup->port = port;
+  lookup->cfg = cfg;
+  if(pf != PF_INET6)
+    lookup->query[lookup->nqueries++].qtype = DNS_TYPE_A;
+  if(pf != PF_INET)
+    lookup->query[lookup->nqueries++].qtype = DNS_TYPE_AAAA;
+  for(i = 0; i < lookup->nqueries; i++)
+    lookup->query[i].sock = CURL_SOCKET_BAD;
+  return lookup;
+}
+
+/* stop the lookup, done or not, and free it */
+static void lookup_free(struct stub_lookup *lookup)
+{
+  int i;
+  for(i = 0; i < lookup->nqueries; i++) {
+    query_close(&lookup->query[i]);
+    if(lookup->query[i].ai)
+      Curl_freeaddrinfo(lookup->query[i].ai);
+  }
+  if(lookup->ai)
+    Curl_freeaddrinfo(lookup->ai);
+  if(lookup->owncfg)
+    Curl_resolver_cleanup(lookup->cfg);
+  free(lookup->hostname);
+  free(lookup);
+}
+
+/*
+ * Send the queries for the next name in the search order. Returns
+ * STUB_EBADNAME if there is no name left to try.
+ */
+static int lookup_start(struct SessionHandle *data,
+                        struct stub_lookup *lookup)
+{
+  int i;
+
+  for(;;) {
+    const unsigned char *rnd;
+    if(!stub_qname(lookup->cfg, lookup->hostname, lookup->step++,
+                   lookup->qname, sizeof(lookup->qname)))
+      return STUB_EBADNAME;
+    /* each name of the search order has its own ids */
+    rnd = &lookup->ids[(lookup->step - 1) * 2 * 2];
+    for(i = 0; i < lookup->nqueries; i++) {
+      struct stub_query *q = &lookup->query[i];
+      unsigned short id = (unsigned short)((rnd[i * 2] << 8) |
+                                           rnd[i * 2 + 1]);
+      q->msglen = stub_mkquery(q->msg + 2, id, lookup->qname, q->qtype);
+      if(!q->msglen)
+        break;
+      q->msg[0] = (unsigned char)(q->msglen >> 8);
+      q->msg[1] = (unsigned char)(q->msglen & 0xff);
+    }
+    if(i == lookup->nqueries)
+      break;
+    /* a name too long for a query, try the next one */
+  }
+
+  infof(data, "Asking DNS for %s\n", lookup->qname);
+  for(i = 0; i < lookup->nqueries; i++) {
+    struct stub_query *q = &lookup->query[i];
+    if(q->ai) {
+      Curl_freeaddrinfo(q->ai);
+      q->ai = NULL;
+    }
+    q->done = FALSE;
+    q->tcp = FALSE;
+    q->sent = 0;
+    q->server = 0;
+    q->ttl = -1;
+    query_send(lookup->cfg, q);
+  }
+  return STUB_SUCCESS;
+}
+
+/*
+ * Get the random query ids of the lookup, all of them at once as the lookup
+ * may go on without a handle, and send the first queries.
+ */
+static int lookup_begin(struct SessionHandle *data,
+                        struct stub_lookup *lookup)
+{
+  if(!stub_random(data, lookup->ids, sizeof(lookup->ids)))
+    return STUB_ENORANDOM;
+  return lookup_start(data, lookup);
+}
+
+/* the milliseconds left until the first query attempt times out */
+static long lookup_timeleft(struct stub_lookup *lookup, struct timeval *now)
+{
+  long left = lookup->cfg->timeout;
+  int i;
+  for(i = 0; i < lookup->nqueries; i++) {
+    struct stub_query *q = &lookup->query[i];
+    if(!q->done) {
+      long ms = lookup->cfg->timeout - Curl_tvdiff(*now, q->start);
+      if(ms < left)
+        left = ms;
+    }
+  }
+  return (left < 0) ? 0 : left;
+}
+
+/*
+ * Handle the answers and time-outs of the lookup. Returns TRUE when the
+ * lookup is done, with its result in the status, ai and expires fields.
+ * 'data' is only used for logging and may be NULL.
+ */
+static bool lookup_perform(struct SessionHandle *data,
+                           struct stub_lookup *lookup)
+{
+  struct timeval now;
+  Curl_addrinfo *tail = NULL;
+  int status = STUB_ENODATA;
+  long ttl = -1;
+  int i;
+
+  if(lookup->done)
+    return TRUE;
+
+  for(;;) {
+    bool again = TRUE;
+    bool pending = FALSE;
+
+    now = Curl_tvnow();
+    for(i = 0; i < lookup->nqueries; i++) {
+      struct stub_query *q = &lookup->query[i];
+      if(!q->done && (q->sock != CURL_SOCKET_BAD))
+        query_read(data, lookup, q);
+      if(!q->done && (Curl_tvdiff(now, q->start) >= lookup->cfg->timeout))
+        query_next(lookup->cfg, q, STUB_ETIMEOUT);
+      if(!q->done)
+        pending = TRUE;
+    }
+    if(pending)
+      return FALSE;
+
+    /* all queries for this name are done, the name doesn't exist or has no
+       addresses unless one of them found some */
+    for(i = 0; i < lookup->nqueries; i++) {
+      struct stub_query *q = &lookup->query[i];
+      if(q->status == STUB_SUCCESS)
+        status = STUB_SUCCESS;
+      else if((q->status != STUB_ENOTFOUND) && (q->status != STUB_ENODATA))
+        again = FALSE;
+    }
+    if(status == STUB_SUCCESS)
+      break;
+    if(again) {
+      int rc = lookup_start(data, lookup);
+      if(rc == STUB_SUCCESS)
+        /* try the next name of the search order */
+        continue;
+      if(rc != STUB_EBADNAME) {
+        /* the next name could not be asked for */
+        status = rc;
+        break;
+      }
+    }
+
+    status = lookup->query[0].status;
+    for(i = 1; i < lookup->nqueries; i++)
+      if(lookup->query[i].status > status)
+        /* the most severe error */
+        status = lookup->query[i].status;
+    break;
+  }
+
+  if(status == STUB_SUCCESS) {
+    /* IPv4 addresses first, like the queries */
+    for(i = 0; i < lookup->nqueries; i++) {
+      struct stub_query *q = &lookup->query[i];
+      if(!q->ai)
+        continue;
+      if(tail)
+        tail->ai_next = q->ai;
+      else
+        lookup->ai = q->ai;
+      tail = q->ai;
+      while(tail->ai_next)
+        tail = tail->ai_next;
+      q->ai = NULL;
+      if((q->ttl >= 0) && ((ttl < 0) || (q->ttl < ttl)))
+        ttl = q->ttl;
+    }
+    if(ttl >= 0)
+      lookup->expires = now.tv_sec + ttl;
+  }
+
+  for(i = 0; i < lookup->nqueries; i++)
+    query_close(&lookup->query[i]);
+  lookup->status = status;
+  lookup->done = TRUE;
+  return TRUE;
+}
+
+/*
+ * Get the sockets of the lookup that are waited for, and how long until one
+ * of its attempts times out. Returns a sockets-in-use bitmap.
+ */
+static int lookup_getsock(struct stub_lookup *lookup, curl_socket_t *socks,
+                          int numsocks, long *timeout_ms)
+{
+  struct timeval now;
+  int bitmap = GETSOCK_BLANK;
+  int num = 0;
+  int i;
+
+  for(i = 0; (i < lookup->nqueries) && (num < numsocks); i++) {
+    struct stub_query *q = &lookup->query[i];
+    if(q->done || (q->sock == CURL_SOCKET_BAD))
+      continue;
+    socks[num] = q->sock;
+    if(q->tcp && !q->connected)
+      bitmap |= GETSOCK_WRITESOCK(num);
+    else
+      bitmap |= GETSOCK_READSOCK(num);
+    num++;
+  }
+
+  now = Curl_tvnow();
+  *timeout_ms = lookup_timeleft(lookup, &now);
+
+  return bitmap;
+}
+
+/*
+ * Handle the answers and time-outs of the lookup of the connection. Returns
+ * TRUE when it is complete, with the result passed to
+ * Curl_addrinfo_callback().
+ */
+static bool conn_perform(struct connectdata *conn)
+{
+  struct stub_lookup *lookup = (struct stub_lookup *)conn->async.os_specific;
+  Curl_addrinfo *ai;
+
+  if(!lookup)
+    return TRUE;
+  if(!lookup_perform(conn->data, lookup))
+    return FALSE;
+
+  ai = lookup->ai;
+  lookup->ai = NULL;
+  conn->async.expires = lookup->expires;
+  (void)Curl_addrinfo_callback(conn, lookup->status, ai);
+  return TRUE;
+}
+
+/*
+ * destroy_async_data() cleans up async resolver data.
+ */
+static void destroy_async_data(struct Curl_async *async)
+{
+  if(async->hostname)
+    free(async->hostname);
+
+  if(async->os_specific) {
+    lookup_free((struct stub_lookup *)async->os_specific);
+    async->os_specific = NULL;
+  }
+
+  async->hostname = NULL;
+}
+
+/*
+ * Cancel all possibly still on-going resolves for this connection.
+ */
+void Curl_resolver_cancel(struct connectdata *conn)
+{
+  destroy_async_data(&conn->async);
+}
+
+/*
+ * Curl_resolver_getsock() is called when someone from the outside world
+ * (using curl_multi_fdset()) wants to get our fd_set setup. It returns the
+ * sockets of the queries and asks to be called again when the current
+ * attempt times out.
+ *
+ * Returns: sockets-in-use-bitmap
+ */
+int Curl_resolver_getsock(struct connectdata *conn,
+                          curl_socket_t *socks,
+                          int numsocks)
+{
+  struct stub_lookup *lookup = (struct stub_lookup *)conn->async.os_specific;
+  long milli;
+  int bitmap;
+
+  if(!lookup)
+    return GETSOCK_BLANK;
+
+  bitmap = lookup_getsock(lookup, socks, numsocks, &milli);
+  Curl_expire(conn->data, milli ? milli : 1);
+
+  return bitmap;
+}
+
+/* describe a lookup status code */
+static const char *stub_strerror(int status)
+{
+  switch(status) {
+  case STUB_ENOTFOUND:
+    return "Domain name not found";
+  case STUB_ENODATA:
+    return "No address for the name";
+  case STUB_ESERVFAIL:
+    return "Could not contact DNS servers";
+  case STUB_ETIMEOUT:
+    return "Timeout while contacting DNS servers";
+  case STUB_ENOMEM:
+    return "Out of memory";
+  case STUB_EBADNAME:
+    return "Misformatted domain name";
+  case STUB_ENORANDOM:
+    return "No random data for the query id";
+  default:
+    return "Unknown error";
+  }
+}
+
+/*
+ * Curl_resolver_is_resolved() is called repeatedly to check if a previous
+ * name resolve request has completed. It should also make sure to time-out if
+ * the operation seems to take too long.
+ *
+ * Returns normal CURLcode errors.
+ */
+CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
+                                   struct Curl_dns_entry **dns)
+{
+  struct SessionHandle *data = conn->data;
+
+  *dns = NULL;
+
+  if(!conn->async.done) {
+    if(!conn_perform(conn))
+      return CURLE_OK;
+    destroy_async_data(&conn->async);
+  }
+
+  if(!conn->async.dns) {
+    failf(data, "Could not resolve %s: %s (%s)",
+          conn->bits.proxy?"proxy":"host",
+          conn->bits.proxy?conn->proxy.dispname:conn->host.dispname,
+          stub_strerror(conn->async.status));
+    return conn->bits.proxy?CURLE_COULDNT_RESOLVE_PROXY:
+      CURLE_COULDNT_RESOLVE_HOST;
+  }
+  *dns = conn->async.dns;
+
+  return CURLE_OK;
+}
+
+/*
+ * Curl_resolver_notfound() is TRUE when the name servers said that the name
+ * doesn't exist or has no addresses.
+ */
+bool Curl_resolver_notfound(int status)
+{
+  return ((status == STUB_ENOTFOUND) || (status == STUB_ENODATA))?
+    TRUE:FALSE;
+}
+
+/*
+ * Curl_resolver_wait_resolv()
+ *
+ * waits for a resolve to finish. This function should be avoided since using
+ * this risk getting the multi interface to "hang".
+ *
+ * If 'entry' is non-NULL, make it point to the resolved dns entry
+ *
+ * Returns CURLE_COULDNT_RESOLVE_HOST if the host was not resolved, and
+ * CURLE_OPERATION_TIMEDOUT if a time-out occurred.
+ */
+CURLcode Curl_resolver_wait_resolv(struct connectdata *conn,
+                                   struct Curl_dns_entry **entry)
+{
+  CURLcode rc = CURLE_OK;
+  struct SessionHandle *data = conn->data;
+  long timeout;
+  struct timeval now = Curl_tvnow();
+
+  timeout = Curl_timeleft(data, &now, TRUE);
+  if(!timeout)
+    timeout = CURL_TIMEOUT_RESOLVE * 1000; /* default name resolve timeout */
+
+  /* Wait for the name resolve query to complete. */
+  while(!conn->async.done) {
+    struct stub_lookup *lookup =
+      (struct stub_lookup *)conn->async.os_specific;
+    struct pollfd pfd[2];
+    unsigned int num = 0;
+    long timeout_ms;
+    int i;
+
+    if(conn_perform(conn)) {
+      destroy_async_data(&conn->async);
+      break;
+    }
+
+    for(i = 0; i < lookup->nqueries; i++) {
+      struct stub_query *q = &lookup->query[i];
+      if(q->done || (q->sock == CURL_SOCKET_BAD))
+        continue;
+      pfd[num].fd = q->sock;
+      pfd[num].events = (short)((q->tcp && !q->connected) ?
+                                (POLLWRNORM|POLLOUT) : (POLLRDNORM|POLLIN));
+      pfd[num].revents = 0;
+      num++;
+    }
+
+    /* wait no longer than a second to make sure the progress callback gets
+       called frequent enough */
+    timeout_ms = lookup_timeleft(lookup, &now);
+    if(timeout_ms > 1000)
+      timeout_ms = 1000;
+    if(timeout_ms > timeout)
+      timeout_ms = timeout;
+    if(num)
+      (void)Curl_poll(pfd, num, (int)timeout_ms);
+    else
+      Curl_wait_ms((int)timeout_ms);
+
+    if(Curl_pgrsUpdate(conn)) {
+      rc = CURLE_ABORTED_BY_CALLBACK;
+      timeout = -1; /* trigger the cancel below */
+    }
+    else {
+      struct timeval now2 = Curl_tvnow();
+      long timediff = Curl_tvdiff(now2, now); /* spent time */
+      timeout -= timediff?timediff:1; /* always deduct at least 1 */
+      now = now2; /* for next loop */
+    }
+    if(timeout < 0) {
+      destroy_async_data(&conn->async);
+      break;
+    }
+  }
+
+  /* Operation complete, if the lookup was successful we now have the entry
+     in the cache. */
+
+  if(entry)
+    *entry = conn->async.dns;
+
+  if(!conn->async.dns) {
+    /* a name was not resolved */
+    if((timeout < 0) || (conn->async.status == STUB_ETIMEOUT)) {
+      if(conn->bits.proxy) {
+        failf(data, "Resolving proxy timed out: %s", conn->proxy.dispname);
+        rc = CURLE_COULDNT_RESOLVE_PROXY;
+      }
+      else {
+        failf(data, "Resolving host timed out: %s", conn->host.dispname);
+        rc = CURLE_COULDNT_RESOLVE_HOST;
+      }
+    }
+    else if(conn->async.done) {
+      if(conn->bits.proxy) {
+        failf(data, "Could not resolve proxy: %s (%s)", conn->proxy.dispname,
+              stub_strerror(conn->async.status));
+        rc = CURLE_COULDNT_RESOLVE_PROXY;
+      }
+      else {
+        failf(data, "Could not resolve host: %s (%s)", conn->host.dispname,
+              stub_strerror(conn->async.status));
+        rc = CURLE_COULDNT_RESOLVE_HOST;
+      }
+    }
+    else
+      rc = CURLE_OPERATION_TIMEDOUT;
+
+    /* close the connection, since we can't return failure here without
+       cleaning up this connection properly */
+    conn->bits.close = TRUE;
+  }
+
+  return rc;
+}
+
+/* the PF_* family to look up addresses of for a CURL_IPRESOLVE_* version */
+static int stub_family(long ip_version)
+{
+#ifdef ENABLE_IPV6
+  int pf;
+
+  switch(ip_version) {
+  case CURL_IPRESOLVE_V4:
+    pf = PF_INET;
+    break;
+  case CURL_IPRESOLVE_V6:
+    pf = PF_INET6;
+    break;
+  default:
+    pf = PF_UNSPEC;
+    break;
+  }
+
+  if((pf != PF_INET) && !Curl_ipv6works())
+    /* the stack seems to be a non-ipv6 one */
+    pf = PF_INET;
+  return pf;
+#else
+  (void)ip_version;
+  return PF_INET;
+#endif
+}
+
+/*
+ * Get the addresses of the name without asking the name servers, if it is
+ * a numerical address or is in the hosts file.
+ */
+static Curl_addrinfo *local_lookup(const char *hostname, int port, int pf)
+{
+  struct in_addr in;
+#ifdef ENABLE_IPV6
+  struct in6_addr in6;
+#endif
+
+  /* First check if this is an IPv4 address string */
+  if(Curl_inet_pton(AF_INET, hostname, &in) > 0)
+    /* This is a dotted IP address 123.123.123.123-style */
+    return Curl_ip2addr(AF_INET, &in, hostname, port);
+
+#ifdef ENABLE_IPV6
+  /* check if this is an IPv6 address string */
+  if(Curl_inet_pton(AF_INET6, hostname, &in6) > 0)
+    /* This is an IPv6 address literal */
+    return Curl_ip2addr(AF_INET6, &in6, hostname, port);
+#endif
+
+  return hosts_lookup(hostname, port, pf);
+}
+
+/*
+ * Curl_resolver_getaddrinfo() - when using the stub resolver
+ *
+ * Returns name information about the given hostname and port number. If
+ * successful, the 'hostent' is returned and the forth argument will point to
+ * memory we need to free after use. That memory *MUST* be freed with
+ * Curl_freeaddrinfo(), nothing else.
+ */
+Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
+                                         const char *hostname,
+                                         int port,
+                                         int *waitp)
+{
+  struct SessionHandle *data = conn->data;
+  struct stub_config *cfg = (struct stub_config *)data->state.resolver;
+  struct stub_lookup *lookup;
+  Curl_addrinfo *ai;
+  int pf = stub_family(conn->ip_version);
+  int rc;
+
+  *waitp = 0; /* default to synchronous response */
+
+  ai = local_lookup(hostname, port, pf);
+  if(ai)
+    return ai;
+
+  if(!cfg->loaded)
+    read_resolv_conf(cfg);
+
+  lookup = lookup_new(cfg, hostname, port, pf);
+  if(!lookup)
+    return NULL;
+
+  Curl_safefree(conn->async.hostname);
+  conn->async.hostname = strdup(hostname);
+  if(!conn->async.hostname) {
+    lookup_free(lookup);
+    return NULL;
+  }
+  conn->async.port = port;
+  conn->async.done = FALSE;   /* not done */
+  conn->async.status = 0;     /* clear */
+  conn->async.dns = NULL;     /* clear */
+  conn->async.expires = 0;
+  conn->async.os_specific = lookup;
+
+  rc = lookup_begin(data, lookup);
+  if(rc != STUB_SUCCESS) {
+    failf(data, "Could not resolve %s: %s (%s)",
+          conn->bits.proxy?"proxy":"host", hostname, stub_strerror(rc));
+    destroy_async_data(&conn->async);
+    return NULL;
+  }
+
+  *waitp = 1; /* expect asynchronous response */
+  return NULL;
+}
+
+/*
+ * Start a lookup that no connection waits for. It uses a copy of the
+ * resolver setup of the handle, as the handle may be gone before the lookup
+ * is done, and goes on each time Curl_resolver_refresh_done() is called.
+ */
+static void *refresh_start(struct SessionHandle *data, const char *hostname,
+                           int port, long ip_version)
+{
+  struct stub_config *cfg = (struct stub_config *)data->state.resolver;
+  struct stub_lookup *lookup;
+  int pf = stub_family(ip_version);
+
+  if(!cfg->loaded)
+    read_resolv_conf(cfg);
+
+  cfg = config_dup(cfg);
+  if(!cfg)
+    return NULL;
+  lookup = lookup_new(cfg, hostname, port, pf);
+  if(!lookup) {
+    Curl_resolver_cleanup(cfg);
+    return NULL;
+  }
+  lookup->owncfg = TRUE;
+
+  lookup->ai = local_lookup(hostname, port, pf);
+  if(lookup->ai) {
+    lookup->status = STUB_SUCCESS;
+    lookup->done = TRUE;
+  }
+  else if(lookup_begin(data, lookup) != STUB_SUCCESS) {
+    lookup_free(lookup);
+    return NULL;
+  }
+
+  return lookup;
+}
+
+void *Curl_resolver_refresh(struct connectdata *conn,
+                            const char *hostname, int port)
+{
+  return refresh_start(conn->data, hostname, port, conn->ip_version);
+}
+
+void *Curl_resolver_prefetch(struct SessionHandle *data,
+                             const char *hostname, int port)
+{
+  return refresh_start(data, hostname, port, CURL_IPRESOLVE_WHATEVER);
+}
+
+bool Curl_resolver_refresh_done(void *refresh, Curl_addrinfo **addr,
+                                time_t *expires)
+{
+  struct stub_lookup *lookup = (struct stub_lookup *)refresh;
+
+  *addr = NULL;
+  *expires = 0;
+  if(!lookup_perform(NULL, lookup))
+    return FALSE;
+
+  *addr = lookup->ai;
+  *expires = lookup->expires;
+  lookup->ai = NULL;
+  return TRUE;
+}
+
+int Curl_resolver_refresh_getsock(void *refresh, curl_socket_t *socks,
+                                  int numsocks, long *timeout_ms)
+{
+  struct stub_lookup *lookup = (struct stub_lookup *)refresh;
+
+  if(lookup->done) {
+    *timeout_ms = 0;
+    return GETSOCK_BLANK;
+  }
+  return lookup_getsock(lookup, socks, numsocks, timeout_ms);
+}
+
+void Curl_resolver_refresh_free(void *refresh)
+{
+  lookup_free((struct stub_lookup *)refresh);
+}
+
+/*
+ * Use the given comma separated list of name servers instead of the ones in
+ * resolv.conf. NULL or an empty string goes back to resolv.conf.
+ */
+CURLcode Curl_set_dns_servers(struct SessionHandle *data,
+                              char *servers)
+{
+  struct stub_config *cfg = (struct stub_config *)data->state.resolver;
+  struct stub_server server[STUB_MAXNS];
+  int nservers = 0;
+  char *ptr = servers;
+
+  if(!servers || !*servers) {
+    cfg->custom = FALSE;
+    cfg->loaded = FALSE;
+    return CURLE_OK;
+  }
+
+  while(*ptr) {
+    char *end = strchr(ptr, ',');
+    size_t len = end ? (size_t)(end - ptr) : strlen(ptr);
+    if(nservers == STUB_MAXNS)
+      break;
+    if(!parse_server(ptr, len, TRUE, &server[nservers]))
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    nservers++;
+    if(!end)
+      break;
+    ptr = end + 1;
+  }
+  if(!nservers)
+    return CURLE_BAD_FUNCTION_ARGUMENT;
+
+  memcpy(cfg->server, server, nservers * sizeof(struct stub_server));
+  cfg->nservers = nservers;
+  cfg->custom = TRUE;
+  return CURLE_OK;
+}
+
+#endif /* CURLRES_STUB */
@@ -65,9 +65,12 @@
 #include "strerror.h"
 #include "url.h"
 #include "multiif.h"
+#include "multihandle.h"
+#include "select.h"
 #include "inet_pton.h"
 #include "inet_ntop.h"
 #include "curl_threads.h"
+#include "connect.h"
 
 #define _MPRINTF_REPLACE /* use our functions only */
 #include <curl/mprintf.h>
@@ -146,19 +149,28 @@ void Curl_resolver_cancel(struct connectdata *conn)
   destroy_async_data(&conn->async);
 }
 
-/* This function is used to init a threaded resolve */
-static bool init_resolve_thread(struct connectdata *conn,
-                                const char *hostname, int port,
-                                const struct addrinfo *hints);
-
-
-/* Data for synchronization between resolver thread and its parent */
-struct thread_sync_data {
-  curl_mutex_t * mtx;
-  int done;
+/*
+ * The name lookups are done by a pool of worker threads that belongs to the
+ * multi handle. The threads are started as lookups get queued, up to the
+ * CURLMOPT_MAX_RESOLVER_THREADS limit, and are then kept around for the
+ * following lookups until the multi handle is cleaned up.
+ */
 
-  char * hostname;        /* hostname to resolve, Curl_async.hostname
-                             duplicate */
+/* milliseconds between the checks of a lookup that nobody waits for, the
+   threads have no socket to tell when it is done */
+#define REFRESH_POLL_INTERVAL 50
+
+/* A name lookup. Lookups of the same name and port with the same hints that
+   are started while one is already queued or running share that one. */
+struct resolve_job {
+  struct resolve_job *next;   /* next job in the queue */
+  char *key;                  /* identifies the job in pool->inflight */
+  size_t keylen;
+  int refs;                   /* the pool while it isn't done, and each
+                                 connection waiting for it */
+  bool done;
+
+  char *hostname;             /* hostname to resolve */
   int port;
   int sock_error;
   Curl_addrinfo *res;
@@ -167,175 +179,443 @@ struct thread_sync_data {
 #endif
 };
 
+struct Curl_resolver_pool {
+  curl_mutex_t mtx;           /* protects all the pool and job fields */
+  curl_cond_t work;           /* signaled when a job is queued or on quit */
+  curl_cond_t resolved;       /* signaled when a job is done */
+  struct resolve_job *queue;  /* jobs not started yet, the oldest first */
+  struct resolve_job *queue_tail;
+  int queued;                 /* number of jobs in the queue */
+  struct curl_hash inflight;  /* key => job, for the jobs not done */
+  curl_thread_t *threads;
+  int nthreads;               /* number of threads started */
+  int maxthreads;
+  int idle;                   /* number of threads waiting for a job */
+  int waiting;                /* number of blocking waits for a result */
+  int users;                  /* the multi handle and each existing job */
+  bool quit;
+};
+
 struct thread_data {
-  curl_thread_t thread_hnd;
+  struct Curl_resolver_pool *pool;
+  struct resolve_job *job;
   unsigned int poll_interval;
   long interval_end;
-  struct thread_sync_data tsd;
 };
 
-static struct thread_sync_data *conn_thread_sync_data(struct connectdata *conn)
+/* the jobs are owned by the pool, not the hash */
+static void inflight_dtor(void *job)
 {
-  return &(((struct thread_data *)conn->async.os_specific)->tsd);
+  (void)job;
 }
 
-#define CONN_THREAD_SYNC_DATA(conn) &(((conn)->async.os_specific)->tsd);
+static void pool_free(struct Curl_resolver_pool *pool)
+{
+  Curl_hash_clean(&pool->inflight);
+  Curl_cond_destroy(&pool->work);
+  Curl_cond_destroy(&pool->resolved);
+  Curl_mutex_destroy(&pool->mtx);
+  Curl_safefree(pool->threads);
+  free(pool);
+}
 
-/* Destroy resolver thread synchronization data */
-static
-void destroy_thread_sync_data(struct thread_sync_data * tsd)
+static struct Curl_resolver_pool *pool_create(void)
 {
-  if(tsd->mtx) {
-    Curl_mutex_destroy(tsd->mtx);
-    free(tsd->mtx);
+  struct Curl_resolver_pool *pool = calloc(1,
+                                           sizeof(struct Curl_resolver_pool));
+  if(!pool)
+    return NULL;
+
+  if(Curl_hash_init(&pool->inflight, 97, Curl_hash_str,
+                    Curl_str_key_compare, inflight_dtor)) {
+    free(pool);
+    return NULL;
   }
+  Curl_mutex_init(&pool->mtx);
+  Curl_cond_init(&pool->work);
+  Curl_cond_init(&pool->resolved);
+  pool->users = 1; /* the multi handle */
+
+  return pool;
+}
 
-  if(tsd->hostname)
-    free(tsd->hostname);
+/*
+ * Drop a reference to a job. The pool must be locked. Returns TRUE when this
+ * made the pool unused, the caller must then free it after unlocking it.
+ */
+static bool job_release(struct Curl_resolver_pool *pool,
+                        struct resolve_job *job)
+{
+  if(--job->refs)
+    return FALSE;
 
-  if(tsd->res)
-    Curl_freeaddrinfo(tsd->res);
+  if(job->res)
+    Curl_freeaddrinfo(job->res);
+  free(job->hostname);
+  free(job->key);
+  free(job);
 
-  memset(tsd,0,sizeof(*tsd));
+  return (--pool->users == 0)?TRUE:FALSE;
 }
 
-/* Initialize resolver thread synchronization data */
-static
-int init_thread_sync_data(struct thread_sync_data * tsd,
-                           const char * hostname,
-                           int port,
-                           const struct addrinfo *hints)
+/* The job has been resolved or dropped. The pool must be locked. */
+static void job_done(struct Curl_resolver_pool *pool, struct resolve_job *job)
 {
-  memset(tsd, 0, sizeof(*tsd));
+  int i;
+
+  Curl_hash_delete(&pool->inflight, job->key, job->keylen+1);
+  job->done = TRUE;
+  /* wake every blocking wait, each checks if its own job is the one */
+  for(i = 0; i < pool->waiting; i++)
+    Curl_cond_signal(&pool->resolved);
+  /* the pool never holds the last user reference */
+  (void)job_release(pool, job);
+}
 
-  tsd->port = port;
-#ifdef CURLRES_IPV6
-  DEBUGASSERT(hints);
-  tsd->hints = *hints;
-#else
-  (void) hints;
-#endif
+#ifdef HAVE_GETADDRINFO
 
-  tsd->mtx = malloc(sizeof(curl_mutex_t));
-  if(tsd->mtx == NULL)
-    goto err_exit;
+/*
+ * getaddrinfo_job() resolves a name with getaddrinfo().
+ */
+static void getaddrinfo_job(struct resolve_job *job)
+{
+  char   service [NI_MAXSERV];
+  int rc;
 
-  Curl_mutex_init(tsd->mtx);
+  snprintf(service, sizeof(service), "%d", job->port);
 
-  tsd->sock_error = CURL_ASYNC_SUCCESS;
+  rc = Curl_getaddrinfo_ex(job->hostname, service, &job->hints, &job->res);
 
-  /* Copying hostname string because original can be destroyed by parent
-   * thread during gethostbyname execution.
-   */
-  tsd->hostname = strdup(hostname);
-  if(!tsd->hostname)
-    goto err_exit;
+  if(rc != 0)
+    /* the EAI_* code, Curl_resolver_notfound() looks at it */
+    job->sock_error = rc;
+}
 
-  return 1;
+#else /* HAVE_GETADDRINFO */
 
- err_exit:
-  /* Memory allocation failed */
-  destroy_thread_sync_data(tsd);
-  return 0;
+/*
+ * gethostbyname_job() resolves a name with the thread-safe gethostbyname.
+ */
+static void gethostbyname_job(struct resolve_job *job)
+{
+  job->res = Curl_ipv4_resolve_r(job->hostname, job->port);
+
+  if(!job->res) {
+    job->sock_error = SOCKERRNO;
+    if(job->sock_error == 0)
+      job->sock_error = RESOLVER_ENOMEM;
+  }
 }
 
-static int getaddrinfo_complete(struct connectdata *conn)
+#endif /* HAVE_GETADDRINFO */
+
+/*
+ * resolver_thread() runs the queued jobs one by one until the pool quits.
+ */
+static unsigned int CURL_STDCALL resolver_thread(void *arg)
 {
-  struct thread_sync_data *tsd = conn_thread_sync_data(conn);
-  int rc;
+  struct Curl_resolver_pool *pool = (struct Curl_resolver_pool *)arg;
 
-  rc = Curl_addrinfo_callback(conn, tsd->sock_error, tsd->res);
-  /* The tsd->res structure has been copied to async.dns and perhaps the DNS
-     cache.  Set our copy to NULL so destroy_thread_sync_data doesn't free it.
-  */
-  tsd->res = NULL;
+  Curl_mutex_acquire(&pool->mtx);
+  for(;;) {
+    struct resolve_job *job;
 
-  return rc;
+    while(!pool->queue && !pool->quit) {
+      pool->idle++;
+      Curl_cond_wait(&pool->work, &pool->mtx);
+      pool->idle--;
+    }
+    if(pool->quit)
+      break;
+
+    job = pool->queue;
+    pool->queue = job->next;
+    if(!pool->queue)
+      pool->queue_tail = NULL;
+    pool->queued--;
+
+    /* the job is not touched by anyone else until it is done */
+    Curl_mutex_release(&pool->mtx);
+#ifdef HAVE_GETADDRINFO
+    getaddrinfo_job(job);
+#else
+    gethostbyname_job(job);
+#endif
+    Curl_mutex_acquire(&pool->mtx);
+
+    job_done(pool, job);
+  }
+  Curl_mutex_release(&pool->mtx);
+
+  return 0;
+}
+
+/*
+ * Curl_resolver_pool_destroy() stops the threads of a resolver pool. Lookups
+ * still in the queue fail. The pool itself is freed once no connection uses
+ * any of its lookups anymore.
+ */
+void Curl_resolver_pool_destroy(struct Curl_resolver_pool *pool)
+{
+  int i;
+  bool unused;
+
+  if(!pool)
+    return;
+
+  Curl_mutex_acquire(&pool->mtx);
+  pool->quit = TRUE;
+  for(i = 0; i < pool->nthreads; i++)
+    Curl_cond_signal(&pool->work);
+  Curl_mutex_release(&pool->mtx);
+
+  /* wait for the lookups in progress */
+  for(i = 0; i < pool->nthreads; i++)
+    Curl_thread_join(&pool->threads[i]);
+
+  Curl_mutex_acquire(&pool->mtx);
+  while(pool->queue) {
+    struct resolve_job *job = pool->queue;
+    pool->queue = job->next;
+    job->sock_error = RESOLVER_ENOMEM;
+    job_done(pool, job);
+  }
+  pool->queue_tail = NULL;
+  pool->queued = 0;
+  unused = (--pool->users == 0)?TRUE:FALSE;
+  Curl_mutex_release(&pool->mtx);
+
+  if(unused)
+    pool_free(pool);
 }
 
+/* Create the id of a lookup, the hints are part of it. */
+static char *create_job_key(const char *hostname, int port,
+                            const struct addrinfo *hints)
+{
+  char *key;
+  char *ptr;
 
 #ifdef HAVE_GETADDRINFO
+  key = aprintf("%s:%d:%d:%d", hostname, port,
+                hints->ai_family, hints->ai_socktype);
+#else
+  (void)hints;
+  key = aprintf("%s:%d", hostname, port);
+#endif
+  if(key) {
+    /* lower case the name part */
+    for(ptr = key; *ptr && (*ptr != ':'); ptr++)
+      *ptr = (char)TOLOWER(*ptr);
+  }
+  return key;
+}
 
 /*
- * getaddrinfo_thread() resolves a name and then exits.
- *
- * For builds without ARES, but with ENABLE_IPV6, create a resolver thread
- * and wait on it.
+ * Add a lookup to the queue of the pool, or attach to the one in progress for
+ * the same key. The pool must be locked. Returns the job or NULL on failure.
  */
-static unsigned int CURL_STDCALL getaddrinfo_thread (void *arg)
+static struct resolve_job *pool_lookup(struct Curl_resolver_pool *pool,
+                                       const char *hostname, int port,
+                                       const struct addrinfo *hints)
 {
-  struct thread_sync_data *tsd = (struct thread_sync_data*)arg;
-  char   service [NI_MAXSERV];
-  int rc;
+  struct resolve_job *job;
+  char *key = create_job_key(hostname, port, hints);
 
-  snprintf(service, sizeof(service), "%d", tsd->port);
+  if(!key)
+    return NULL;
 
-  rc = Curl_getaddrinfo_ex(tsd->hostname, service, &tsd->hints, &tsd->res);
+  job = Curl_hash_pick(&pool->inflight, key, strlen(key)+1);
+  if(job) {
+    /* the same lookup is already queued or running */
+    free(key);
+    job->refs++;
+    return job;
+  }
 
-  if(rc != 0) {
-    tsd->sock_error = SOCKERRNO?SOCKERRNO:rc;
-    if(tsd->sock_error == 0)
-      tsd->sock_error = RESOLVER_ENOMEM;
+  if((pool->idle < pool->queued + 1) && (pool->nthreads < pool->maxthreads)) {
+    /* no thread will be free to take this one, start another */
+    curl_thread_t *threads = realloc(pool->threads, (pool->nthreads + 1) *
+                                     sizeof(curl_thread_t));
+    if(threads) {
+      pool->threads = threads;
+      threads[pool->nthreads] = Curl_thread_create(resolver_thread, pool);
+      if(threads[pool->nthreads] != curl_thread_t_null)
+        pool->nthreads++;
+    }
+    if(!pool->nthreads) {
+      /* there's no thread to do the job */
+      free(key);
+      return NULL;
+    }
   }
 
-  Curl_mutex_acquire(tsd->mtx);
-  tsd->done = 1;
-  Curl_mutex_release(tsd->mtx);
+  job = calloc(1, sizeof(struct resolve_job));
+  if(!job) {
+    free(key);
+    return NULL;
+  }
+  job->key = key;
+  job->keylen = strlen(key);
+  job->port = port;
+  job->sock_error = CURL_ASYNC_SUCCESS;
+#ifdef HAVE_GETADDRINFO
+  DEBUGASSERT(hints);
+  job->hints = *hints;
+#endif
+  job->hostname = strdup(hostname);
+  if(!job->hostname ||
+     !Curl_hash_add(&pool->inflight, key, job->keylen+1, job)) {
+    Curl_safefree(job->hostname);
+    free(key);
+    free(job);
+    return NULL;
+  }
+  job->refs = 2; /* the pool and the connection */
+  pool->users++;
 
-  return 0;
+  if(pool->queue_tail)
+    pool->queue_tail->next = job;
+  else
+    pool->queue = job;
+  pool->queue_tail = job;
+  pool->queued++;
+  Curl_cond_signal(&pool->work);
+
+  return job;
 }
 
-#else /* HAVE_GETADDRINFO */
+/*
+ * Get the pool of the multi handle, create it if there is none yet.
+ */
+static struct Curl_resolver_pool *multi_pool(struct Curl_multi *multi)
+{
+  if(!multi)
+    return NULL;
+
+  if(!multi->resolver_pool)
+    multi->resolver_pool = pool_create();
+
+  return multi->resolver_pool;
+}
 
 /*
- * gethostbyname_thread() resolves a name and then exits.
+ * Queue a lookup in the pool. Returns the thread_data for it or NULL.
  */
-static unsigned int CURL_STDCALL gethostbyname_thread (void *arg)
+static struct thread_data *queue_lookup(struct Curl_multi *multi,
+                                        const char *hostname, int port,
+                                        const struct addrinfo *hints)
 {
-  struct thread_sync_data *tsd = (struct thread_sync_data *)arg;
+  struct Curl_resolver_pool *pool = multi_pool(multi);
+  struct thread_data *td;
 
-  tsd->res = Curl_ipv4_resolve_r(tsd->hostname, tsd->port);
+  if(!pool)
+    return NULL;
+
+  td = calloc(1, sizeof(struct thread_data));
+  if(!td)
+    return NULL;
+  td->pool = pool;
 
-  if(!tsd->res) {
-    tsd->sock_error = SOCKERRNO;
-    if(tsd->sock_error == 0)
-      tsd->sock_error = RESOLVER_ENOMEM;
+  Curl_mutex_acquire(&pool->mtx);
+  pool->maxthreads = (int)multi->max_resolver_threads;
+  td->job = pool_lookup(pool, hostname, port, hints);
+  Curl_mutex_release(&pool->mtx);
+
+  if(!td->job) {
+    free(td);
+    return NULL;
   }
+  return td;
+}
+
+/*
+ * Let go of the lookup, which continues for other users if there are any.
+ */
+static void release_lookup(struct thread_data *td)
+{
+  if(td->job) {
+    struct Curl_resolver_pool *pool = td->pool;
+    bool unused;
 
-  Curl_mutex_acquire(tsd->mtx);
-  tsd->done = 1;
-  Curl_mutex_release(tsd->mtx);
+    Curl_mutex_acquire(&pool->mtx);
+    unused = job_release(pool, td->job);
+    Curl_mutex_release(&pool->mtx);
 
-  return 0;
+    if(unused)
+      pool_free(pool);
+  }
+  free(td);
 }
 
-#endif /* HAVE_GETADDRINFO */
+/*
+ * Get the result of a finished lookup, returns the status of it.
+ */
+static int lookup_result(struct thread_data *td, Curl_addrinfo **res)
+{
+  struct resolve_job *job = td->job;
+  int status;
+
+  Curl_mutex_acquire(&td->pool->mtx);
+  status = job->sock_error;
+  if(job->refs > 1) {
+    /* others wait for the same lookup, use a copy */
+    *res = Curl_dupaddrinfo(job->res);
+    if(job->res && !*res)
+      status = RESOLVER_ENOMEM;
+  }
+  else {
+    *res = job->res;
+    job->res = NULL;
+  }
+  Curl_mutex_release(&td->pool->mtx);
+
+  return status;
+}
 
 /*
- * destroy_async_data() cleans up async resolver data and thread handle.
+ * getaddrinfo_complete() passes on the result of a finished lookup.
  */
-static void destroy_async_data (struct Curl_async *async)
+static int getaddrinfo_complete(struct connectdata *conn)
 {
-  if(async->hostname)
-    free(async->hostname);
+  struct thread_data *td = (struct thread_data *)conn->async.os_specific;
+  Curl_addrinfo *res;
+  int status = lookup_result(td, &res);
 
-  if(async->os_specific) {
-    struct thread_data *td = (struct thread_data*) async->os_specific;
+  /* The result is stored in async.dns and perhaps the DNS cache */
+  return Curl_addrinfo_callback(conn, status, res);
+}
 
-    if(td->thread_hnd != curl_thread_t_null)
-      Curl_thread_join(&td->thread_hnd);
+/* TRUE if the lookup of the connection is done */
+static bool resolve_done(struct thread_data *td)
+{
+  bool done;
 
-    destroy_thread_sync_data(&td->tsd);
+  Curl_mutex_acquire(&td->pool->mtx);
+  done = td->job->done;
+  Curl_mutex_release(&td->pool->mtx);
 
-    free(async->os_specific);
-  }
+  return done;
+}
+
+/*
+ * destroy_async_data() cleans up async resolver data and lets go of the
+ * lookup, which continues for other users if there are any.
+ */
+static void destroy_async_data (struct Curl_async *async)
+{
+  if(async->hostname)
+    free(async->hostname);
+
+  if(async->os_specific)
+    release_lookup((struct thread_data*) async->os_specific);
   async->hostname = NULL;
   async->os_specific = NULL;
 }
 
 /*
- * init_resolve_thread() starts a new thread that performs the actual
- * resolve. This function returns before the resolve is done.
+ * init_resolve_thread() queues the lookup in the resolver thread pool of the
+ * multi handle. This function returns before the resolve is done.
  *
  * Returns FALSE in case of failure, otherwise TRUE.
  */
@@ -343,39 +623,22 @@ static bool init_resolve_thread (struct connectdata *conn,
                                  const char *hostname, int port,
                                  const struct addrinfo *hints)
 {
-  struct thread_data *td = calloc(1, sizeof(struct thread_data));
   int err = RESOLVER_ENOMEM;
 
-  conn->async.os_specific = (void*) td;
-  if(!td)
-    goto err_exit;
-
   conn->async.port = port;
   conn->async.done = FALSE;
   conn->async.status = 0;
   conn->async.dns = NULL;
-  td->thread_hnd = curl_thread_t_null;
-
-  if(!init_thread_sync_data(&td->tsd, hostname, port, hints))
-    goto err_exit;
 
   Curl_safefree(conn->async.hostname);
   conn->async.hostname = strdup(hostname);
   if(!conn->async.hostname)
     goto err_exit;
 
-#ifdef HAVE_GETADDRINFO
-  td->thread_hnd = Curl_thread_create(getaddrinfo_thread, &td->tsd);
-#else
-  td->thread_hnd = Curl_thread_create(gethostbyname_thread, &td->tsd);
-#endif
-
-  if(!td->thread_hnd) {
-#ifndef _WIN32_WCE
-    err = errno;
-#endif
+  conn->async.os_specific = queue_lookup(conn->data->multi, hostname, port,
+                                         hints);
+  if(!conn->async.os_specific)
     goto err_exit;
-  }
 
   return TRUE;
 
@@ -410,6 +673,24 @@ static CURLcode resolver_error(struct connectdata *conn)
   return rc;
 }
 
+/*
+ * Curl_resolver_notfound() is TRUE for the getaddrinfo() errors that mean
+ * the name has no addresses. gethostbyname() doesn't tell why it failed.
+ */
+bool Curl_resolver_notfound(int status)
+{
+#ifdef HAVE_GETADDRINFO
+#ifdef EAI_NODATA
+  if(status == EAI_NODATA)
+    return TRUE;
+#endif
+  return (status == EAI_NONAME)?TRUE:FALSE;
+#else
+  (void)status;
+  return FALSE;
+#endif
+}
+
 /*
  * Curl_resolver_wait_resolv()
  *
@@ -424,15 +705,36 @@ CURLcode Curl_resolver_wait_resolv(struct connectdata *conn,
                                    struct Curl_dns_entry **entry)
 {
   struct thread_data   *td = (struct thread_data*) conn->async.os_specific;
+  struct Curl_resolver_pool *pool;
   CURLcode rc = CURLE_OK;
+  long timeout;
+  bool done;
 
   DEBUGASSERT(conn && td);
+  pool = td->pool;
+
+  /* wait for a thread of the pool to resolve the name */
+  Curl_mutex_acquire(&pool->mtx);
+  pool->waiting++;
+  timeout = Curl_timeleft(conn->data, NULL, TRUE);
+  while(!td->job->done && (timeout > 0)) {
+    Curl_cond_timedwait(&pool->resolved, &pool->mtx, timeout);
+    timeout = Curl_timeleft(conn->data, NULL, TRUE);
+  }
+  pool->waiting--;
+  done = td->job->done;
+  Curl_mutex_release(&pool->mtx);
+
+  if(!done) {
+    failf(conn->data, "Resolving timed out after %ld milliseconds",
+          Curl_tvdiff(Curl_tvnow(), conn->created));
+    conn->async.done = TRUE;
+    destroy_async_data(&conn->async);
+    conn->bits.close = TRUE;
+    return CURLE_OPERATION_TIMEDOUT;
+  }
 
-  /* wait for the thread to resolve the name */
-  if(Curl_thread_join(&td->thread_hnd))
-    rc = getaddrinfo_complete(conn);
-  else
-    DEBUGASSERT(0);
+  rc = getaddrinfo_complete(conn);
 
   conn->async.done = TRUE;
 
@@ -461,7 +763,6 @@ CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
 {
   struct SessionHandle *data = conn->data;
   struct thread_data   *td = (struct thread_data*) conn->async.os_specific;
-  int done = 0;
 
   *entry = NULL;
 
@@ -470,11 +771,7 @@ CURLcode Curl_resolver_is_resolved(struct connectdata *conn,
     return CURLE_COULDNT_RESOLVE_HOST;
   }
 
-  Curl_mutex_acquire(td->tsd.mtx);
-  done = td->tsd.done;
-  Curl_mutex_release(td->tsd.mtx);
-
-  if(done) {
+  if(resolve_done(td)) {
     getaddrinfo_complete(conn);
 
     if(!conn->async.dns) {
@@ -545,8 +842,63 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
   return Curl_ipv4_resolve_r(hostname, port);
 }
 
+/*
+ * Curl_resolver_refresh() - for platforms without getaddrinfo
+ */
+void *Curl_resolver_refresh(struct connectdata *conn,
+                            const char *hostname, int port)
+{
+  return queue_lookup(conn->data->multi, hostname, port, NULL);
+}
+
+/*
+ * Curl_resolver_prefetch() - for platforms without getaddrinfo
+ */
+void *Curl_resolver_prefetch(struct SessionHandle *data,
+                             const char *hostname, int port)
+{
+  return queue_lookup(data->multi, hostname, port, NULL);
+}
+
 #else /* !HAVE_GETADDRINFO */
 
+/*
+ * Set the hints for a lookup of addresses of the given CURL_IPRESOLVE_*
+ * version for sockets of the given type.
+ */
+static void lookup_hints(long ip_version, int socktype,
+                         struct addrinfo *hints)
+{
+  int pf = PF_INET;
+
+#ifdef CURLRES_IPV6
+  /*
+   * Check if a limited name resolve has been requested.
+   */
+  switch(ip_version) {
+  case CURL_IPRESOLVE_V4:
+    pf = PF_INET;
+    break;
+  case CURL_IPRESOLVE_V6:
+    pf = PF_INET6;
+    break;
+  default:
+    pf = PF_UNSPEC;
+    break;
+  }
+
+  if((pf != PF_INET) && !Curl_ipv6works())
+    /* the stack seems to be a non-ipv6 one */
+    pf = PF_INET;
+#else
+  (void)ip_version;
+#endif /* CURLRES_IPV6 */
+
+  memset(hints, 0, sizeof(*hints));
+  hints->ai_family = pf;
+  hints->ai_socktype = socktype;
+}
+
 /*
  * Curl_resolver_getaddrinfo() - for getaddrinfo
  */
@@ -560,7 +912,6 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
   Curl_addrinfo *res;
   int error;
   char sbuf[NI_MAXSERV];
-  int pf = PF_INET;
 #ifdef CURLRES_IPV6
   struct in6_addr in6;
 #endif /* CURLRES_IPV6 */
@@ -577,31 +928,9 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
   if(Curl_inet_pton (AF_INET6, hostname, &in6) > 0)
     /* This is an IPv6 address literal */
     return Curl_ip2addr(AF_INET6, &in6, hostname, port);
-
-  /*
-   * Check if a limited name resolve has been requested.
-   */
-  switch(conn->ip_version) {
-  case CURL_IPRESOLVE_V4:
-    pf = PF_INET;
-    break;
-  case CURL_IPRESOLVE_V6:
-    pf = PF_INET6;
-    break;
-  default:
-    pf = PF_UNSPEC;
-    break;
-  }
-
-  if((pf != PF_INET) && !Curl_ipv6works())
-    /* the stack seems to be a non-ipv6 one */
-    pf = PF_INET;
-
 #endif /* CURLRES_IPV6 */
 
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = pf;
-  hints.ai_socktype = conn->socktype;
+  lookup_hints(conn->ip_version, conn->socktype, &hints);
 
   snprintf(sbuf, sizeof(sbuf), "%d", port);
 
@@ -624,8 +953,70 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
   return res;
 }
 
+/*
+ * Curl_resolver_refresh() - for getaddrinfo
+ */
+void *Curl_resolver_refresh(struct connectdata *conn,
+                            const char *hostname, int port)
+{
+  struct addrinfo hints;
+
+  lookup_hints(conn->ip_version, conn->socktype, &hints);
+
+  return queue_lookup(conn->data->multi, hostname, port, &hints);
+}
+
+/*
+ * Curl_resolver_prefetch() - for getaddrinfo
+ */
+void *Curl_resolver_prefetch(struct SessionHandle *data,
+                             const char *hostname, int port)
+{
+  struct addrinfo hints;
+
+  /* the same lookup as for a TCP connection without IP version wishes, so
+     that transfers starting while it runs can wait for it */
+  lookup_hints(CURL_IPRESOLVE_WHATEVER, SOCK_STREAM, &hints);
+
+  return queue_lookup(data->multi, hostname, port, &hints);
+}
+
 #endif /* !HAVE_GETADDRINFO */
 
+bool Curl_resolver_refresh_done(void *refresh, Curl_addrinfo **addr,
+                                time_t *expires)
+{
+  struct thread_data *td = (struct thread_data *)refresh;
+
+  *addr = NULL;
+  *expires = 0; /* the system resolver doesn't tell */
+  if(!resolve_done(td))
+    return FALSE;
+
+  if(lookup_result(td, addr) != CURL_ASYNC_SUCCESS) {
+    if(*addr)
+      Curl_freeaddrinfo(*addr);
+    *addr = NULL;
+  }
+  return TRUE;
+}
+
+int Curl_resolver_refresh_getsock(void *refresh, curl_socket_t *socks,
+                                  int numsocks, long *timeout_ms)
+{
+  (void)socks;
+  (void)numsocks;
+  /* the threads have no socket to wait for, check again in a while */
+  *timeout_ms = resolve_done((struct thread_data *)refresh) ?
+    0 : REFRESH_POLL_INTERVAL;
+  return GETSOCK_BLANK;
+}
+
+void Curl_resolver_refresh_free(void *refresh)
+{
+  release_lookup((struct thread_data *)refresh);
+}
+
 CURLcode Curl_set_dns_servers(struct SessionHandle *data,
                               char *servers)
 {
@@ -30,12 +30,13 @@ struct hostent;
 struct SessionHandle;
 struct connectdata;
 struct Curl_dns_entry;
+struct Curl_multi;
 
 /*
  * This header defines all functions in the internal asynch resolver interface.
  * All asynch resolvers need to provide these functions.
- * asyn-ares.c and asyn-thread.c are the current implementations of asynch
- * resolver backends.
+ * asyn-ares.c, asyn-thread.c and asyn-stub.c are the current implementations
+ * of asynch resolver backends.
  */
 
 /*
@@ -144,6 +145,87 @@ Curl_addrinfo *Curl_resolver_getaddrinfo(struct connectdata *conn,
                                          int port,
                                          int *waitp);
 
+/*
+ * Curl_resolver_notfound()
+ *
+ * Returns TRUE if the status of a failed lookup says that the name has no
+ * addresses. Other failures, like out of memory or a name server that
+ * doesn't answer, may be gone on the next try and are not cached.
+ */
+bool Curl_resolver_notfound(int status);
+
+#ifdef CURLRES_THREADED
+struct Curl_resolver_pool;
+
+/*
+ * Curl_resolver_pool_destroy()
+ *
+ * Called from curl_multi_cleanup() to stop the resolver threads of the multi
+ * handle.
+ */
+void Curl_resolver_pool_destroy(struct Curl_resolver_pool *pool);
+#else
+#define Curl_resolver_pool_destroy(x) Curl_nop_stmt
+#endif
+
+#ifdef CURLRES_ASYNCH
+/*
+ * Curl_resolver_refresh()
+ *
+ * Starts a lookup of the name that no connection waits for, used to refresh
+ * an outdated DNS cache entry while it is still being used. Returns a handle
+ * for the lookup or NULL if it couldn't be started.
+ */
+void *Curl_resolver_refresh(struct connectdata *conn,
+                            const char *hostname, int port);
+
+/*
+ * Curl_resolver_prefetch()
+ *
+ * Starts a lookup of the name for curl_multi_prefetch(), with the resolver
+ * setup of the given handle of the multi handle. Returns a handle for the
+ * lookup, to be used like one returned by Curl_resolver_refresh(), or NULL if
+ * it couldn't be started.
+ */
+void *Curl_resolver_prefetch(struct SessionHandle *data,
+                             const char *hostname, int port);
+
+/*
+ * Curl_resolver_refresh_done()
+ *
+ * Returns TRUE if the lookup is done and then passes on its result in *addr,
+ * which is NULL if the name wasn't resolved, and the time the addresses
+ * expire at in *expires, 0 if the resolver doesn't tell. The result is only
+ * passed on once.
+ */
+bool Curl_resolver_refresh_done(void *refresh, Curl_addrinfo **addr,
+                                time_t *expires);
+
+/*
+ * Curl_resolver_refresh_getsock()
+ *
+ * Gets the sockets the lookup waits for, like Curl_resolver_getsock(), and
+ * in *timeout_ms the milliseconds after which it is to be checked again even
+ * if none of them is ready. Returns a sockets-in-use bitmap.
+ */
+int Curl_resolver_refresh_getsock(void *refresh, curl_socket_t *socks,
+                                  int numsocks, long *timeout_ms);
+
+/*
+ * Curl_resolver_refresh_free()
+ *
+ * Lets go of a lookup started with Curl_resolver_refresh() or
+ * Curl_resolver_prefetch(), done or not.
+ */
+void Curl_resolver_refresh_free(void *refresh);
+#else
+#define Curl_resolver_refresh(x,y,z) NULL
+#define Curl_resolver_prefetch(x,y,z) NULL
+#define Curl_resolver_refresh_done(x,y,z) (*(y) = NULL, *(z) = 0, TRUE)
+#define Curl_resolver_refresh_getsock(x,y,z,w) (*(w) = 0, 0)
+#define Curl_resolver_refresh_free(x) (void)(x)
+#endif
+
 #ifndef CURLRES_ASYNCH
 /* convert these functions if an asynch resolver isn't used */
 #define Curl_resolver_cancel(x) Curl_nop_stmt
@@ -34,6 +34,9 @@
 #include "bundles.h"
 #include "conncache.h"
 
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
 #include "curl_memory.h"
 /* The last #include file should be: */
 #include "memdebug.h"
@@ -75,24 +78,49 @@ void Curl_conncache_destroy(struct conncache *connc)
   }
 }
 
+/*
+ * The name of the bundle the connection belongs to. Connections to a HTTP
+ * proxy that are not tunnels can be used for any host, they are kept
+ * together. Tunnels and SOCKS connections are kept apart for every proxy and
+ * host and port they lead to. Returns a malloc()ed string, or NULL.
+ */
+static char *hashkey(struct connectdata *conn)
+{
+  if(conn->bits.httpproxy && !conn->bits.tunnel_proxy)
+    return aprintf("%s:%ld", conn->proxy.name, conn->port);
+  else if(conn->bits.proxy)
+    return aprintf("%s:%d/%s:%ld", conn->host.name, conn->remote_port,
+                   conn->proxy.name, conn->port);
+  return strdup(conn->host.name);
+}
+
 struct connectbundle *Curl_conncache_find_bundle(struct conncache *connc,
-                                                 char *hostname)
+                                                 struct connectdata *conn)
 {
   struct connectbundle *bundle = NULL;
 
-  if(connc)
-    bundle = Curl_hash_pick(connc->hash, hostname, strlen(hostname)+1);
+  if(connc) {
+    char *key = hashkey(conn);
+    if(key) {
+      bundle = Curl_hash_pick(connc->hash, key, strlen(key)+1);
+      free(key);
+    }
+  }
 
   return bundle;
 }
 
 static bool conncache_add_bundle(struct conncache *connc,
-                                 char *hostname,
+                                 struct connectdata *conn,
                                  struct connectbundle *bundle)
 {
-  void *p;
+  void *p = NULL;
+  char *key = hashkey(conn);
 
-  p = Curl_hash_add(connc->hash, hostname, strlen(hostname)+1, bundle);
+  if(key) {
+    p = Curl_hash_add(connc->hash, key, strlen(key)+1, bundle);
+    free(key);
+  }
 
   return p?TRUE:FALSE;
 }
@@ -129,15 +157,13 @@ CURLcode Curl_conncache_add_conn(struct conncache *connc,
   struct connectbundle *new_bundle = NULL;
   struct SessionHandle *data = conn->data;
 
-  bundle = Curl_conncache_find_bundle(data->state.conn_cache,
-                                      conn->host.name);
+  bundle = Curl_conncache_find_bundle(data->state.conn_cache, conn);
   if(!bundle) {
     result = Curl_bundle_create(data, &new_bundle);
     if(result != CURLE_OK)
       return result;
 
-    if(!conncache_add_bundle(data->state.conn_cache,
-                             conn->host.name, new_bundle)) {
+    if(!conncache_add_bundle(data->state.conn_cache, conn, new_bundle)) {
       Curl_bundle_destroy(new_bundle);
       return CURLE_OUT_OF_MEMORY;
     }
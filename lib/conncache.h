@@ -25,14 +25,17 @@
 struct conncache {
   struct curl_hash *hash;
   size_t num_connections;
+  unsigned short localport_next; /* the local port after the one last bound
+                                    to, see bindlocal() */
 };
 
 struct conncache *Curl_conncache_init(void);
 
 void Curl_conncache_destroy(struct conncache *connc);
 
+/* the bundle of the connections the given one can be swapped with, if any */
 struct connectbundle *Curl_conncache_find_bundle(struct conncache *connc,
-                                                 char *hostname);
+                                                 struct connectdata *conn);
 
 CURLcode Curl_conncache_add_conn(struct conncache *connc,
                                  struct connectdata *conn);
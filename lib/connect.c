@@ -76,6 +76,7 @@
 #include "warnless.h"
 #include "conncache.h"
 #include "multihandle.h"
+#include "socks.h"
 
 /* The last #include file should be: */
 #include "memdebug.h"
@@ -85,6 +86,11 @@
 #undef SO_NOSIGPIPE
 #endif
 
+#if defined(__linux__) && !defined(IP_BIND_ADDRESS_NO_PORT)
+/* Linux 4.2 and later, older C libraries lack the define */
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
 static bool verifyconnect(curl_socket_t sockfd, int *error);
 
 #ifdef __DragonFly__
@@ -254,6 +260,8 @@ static CURLcode bindlocal(struct connectdata *conn,
                                                 "random" */
   /* how many port numbers to try to bind to, increasing one at a time */
   int portnum = data->set.localportrange;
+  int portoffset = 0; /* the port tried is this far into the range */
+  struct conncache *connc = data->state.conn_cache;
   const char *dev = data->set.str[STRING_DEVICE];
   int error;
   char myhost[256] = "";
@@ -400,6 +408,33 @@ static CURLcode bindlocal(struct connectdata *conn,
     }
   }
 
+  if(port && (portnum > 1) && connc) {
+    /* Start where the previous search in the range ended, going round to
+       its start. The ports up to there were just handed out and are likely
+       to be taken still. */
+    unsigned short next = connc->localport_next;
+    if((next > data->set.localport) &&
+       ((int)(next - data->set.localport) < portnum)) {
+      portoffset = next - data->set.localport;
+      port = (unsigned short)(data->set.localport + portoffset);
+      if(sock->sa_family == AF_INET)
+        si4->sin_port = htons(port);
+#ifdef ENABLE_IPV6
+      else
+        si6->sin6_port = htons(port);
+#endif
+    }
+  }
+#ifdef IP_BIND_ADDRESS_NO_PORT
+  else if(!port && (conn->socktype == SOCK_STREAM)) {
+    /* Bound to an address only. Have connect() pick the port, it can then
+       use a port that is in use already to another remote end. */
+    int on = 1;
+    (void)setsockopt(sockfd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT,
+                     (void *)&on, sizeof(on));
+  }
+#endif
+
   for(;;) {
     if(bind(sockfd, sock, sizeof_sa) >= 0) {
       /* we succeeded to bind */
@@ -414,18 +449,23 @@ static CURLcode bindlocal(struct connectdata *conn,
       }
       infof(data, "Local port: %hu\n", port);
       conn->bits.bound = TRUE;
+      if(port && connc)
+        connc->localport_next = (unsigned short)(port + 1);
       return CURLE_OK;
     }
 
     if(--portnum > 0) {
       infof(data, "Bind to local port %hu failed, trying next\n", port);
-      port++; /* try next port */
+      /* try the next port, after the last one the first in the range */
+      if(++portoffset >= data->set.localportrange)
+        portoffset = 0;
+      port = (unsigned short)(data->set.localport + portoffset);
       /* We re-use/clobber the port variable here below */
       if(sock->sa_family == AF_INET)
-        si4->sin_port = ntohs(port);
+        si4->sin_port = htons(port);
 #ifdef ENABLE_IPV6
       else
-        si6->sin6_port = ntohs(port);
+        si6->sin6_port = htons(port);
 #endif
     }
     else
@@ -556,6 +596,7 @@ void Curl_persistconninfo(struct connectdata *conn)
   memcpy(conn->data->info.conn_local_ip, conn->local_ip, MAX_IPADR_LEN);
   conn->data->info.conn_primary_port = conn->primary_port;
   conn->data->info.conn_local_port = conn->local_port;
+  conn->data->info.conn_socktune = conn->socktune;
 }
 
 /* retrieves ip address and port from a sockaddr structure */
@@ -621,12 +662,24 @@ void Curl_updateconninfo(struct connectdata *conn, curl_socket_t sockfd)
 
   if(!conn->bits.reuse) {
 
-    len = sizeof(struct Curl_sockaddr_storage);
-    if(getpeername(sockfd, (struct sockaddr*) &ssrem, &len)) {
-      error = SOCKERRNO;
-      failf(data, "getpeername() failed with errno %d: %s",
-            error, Curl_strerror(conn, error));
-      return;
+    /* A TCP Fast Open socket may not have sent its SYN yet and then has no
+       peer. singleipconnect() stored its address before the connect. */
+    if(!conn->bits.tcp_fastopen) {
+      len = sizeof(struct Curl_sockaddr_storage);
+      if(getpeername(sockfd, (struct sockaddr*) &ssrem, &len)) {
+        error = SOCKERRNO;
+        failf(data, "getpeername() failed with errno %d: %s",
+              error, Curl_strerror(conn, error));
+        return;
+      }
+
+      if(!getaddressinfo((struct sockaddr*)&ssrem,
+                         conn->primary_ip, &conn->primary_port)) {
+        error = ERRNO;
+        failf(data, "ssrem inet_ntop() failed with errno %d: %s",
+              error, Curl_strerror(conn, error));
+        return;
+      }
     }
 
     len = sizeof(struct Curl_sockaddr_storage);
@@ -637,14 +690,6 @@ void Curl_updateconninfo(struct connectdata *conn, curl_socket_t sockfd)
       return;
     }
 
-    if(!getaddressinfo((struct sockaddr*)&ssrem,
-                        conn->primary_ip, &conn->primary_port)) {
-      error = ERRNO;
-      failf(data, "ssrem inet_ntop() failed with errno %d: %s",
-            error, Curl_strerror(conn, error));
-      return;
-    }
-
     if(!getaddressinfo((struct sockaddr*)&ssloc,
                        conn->local_ip, &conn->local_port)) {
       error = ERRNO;
@@ -659,6 +704,35 @@ void Curl_updateconninfo(struct connectdata *conn, curl_socket_t sockfd)
   Curl_persistconninfo(conn);
 }
 
+/*
+ * The TCP connection is there, do the proxy handshake that may follow on the
+ * first socket and mark the socket connected once that is done too. The
+ * second socket (FTP data) has its proxy handshake done by ftp.c.
+ */
+static CURLcode connected_proxy(struct connectdata *conn, int sockindex,
+                                bool *connected)
+{
+  bool done = TRUE;
+
+  if(sockindex == FIRSTSOCKET) {
+    CURLcode code = Curl_connected_proxy(conn, &done);
+    if(code)
+      return code;
+  }
+  if(!done)
+    return CURLE_OK; /* not yet */
+
+  conn->bits.tcpconnect[sockindex] = TRUE;
+
+  *connected = TRUE;
+  if(sockindex == FIRSTSOCKET)
+    Curl_pgrsTime(conn->data, TIMER_CONNECT); /* connect done */
+  Curl_verboseconnect(conn);
+  Curl_updateconninfo(conn, conn->sock[sockindex]);
+
+  return CURLE_OK;
+}
+
 /*
  * Curl_is_connected() checks if the socket has connected.
  */
@@ -696,6 +770,10 @@ CURLcode Curl_is_connected(struct connectdata *conn,
     return CURLE_OPERATION_TIMEDOUT;
   }
 
+  if(Curl_SOCKS_busy(conn, sockindex))
+    /* connected with TCP, the handshake with the SOCKS proxy goes on */
+    return connected_proxy(conn, sockindex, connected);
+
   /* check socket for connect */
   chk = checkconnect(sockfd);
   if(CHKCONN_IDLE == chk) {
@@ -714,19 +792,7 @@ CURLcode Curl_is_connected(struct connectdata *conn,
       /* we are connected with TCP, awesome! */
 
       /* see if we need to do any proxy magic first once we connected */
-      code = Curl_connected_proxy(conn);
-      if(code)
-        return code;
-
-      conn->bits.tcpconnect[sockindex] = TRUE;
-
-      *connected = TRUE;
-      if(sockindex == FIRSTSOCKET)
-        Curl_pgrsTime(data, TIMER_CONNECT); /* connect done */
-      Curl_verboseconnect(conn);
-      Curl_updateconninfo(conn, sockfd);
-
-      return CURLE_OK;
+      return connected_proxy(conn, sockindex, connected);
     }
     /* nope, not connected for real */
   }
@@ -816,6 +882,150 @@ static void nosigpipe(struct connectdata *conn,
 #define nosigpipe(x,y) Curl_nop_stmt
 #endif
 
+#ifdef TCP_FASTOPEN_CONNECT
+/*
+ * Ask for TCP Fast Open. connect() then returns at once if the kernel has a
+ * cookie from the server and the SYN goes out with the first data sent on
+ * the socket. Without a cookie it does a regular handshake that asks for
+ * one, to use next time. Only done when libcurl is the one to speak first,
+ * as the SYN would otherwise wait for data that never comes.
+ */
+static void tcpfastopen(struct connectdata *conn,
+                        curl_socket_t sockfd)
+{
+  struct SessionHandle *data = conn->data;
+  int onoff = 1;
+
+  if(!conn->bits.proxy && !(conn->handler->flags & PROTOPT_SSL) &&
+     !(conn->handler->protocol & CURLPROTO_HTTP))
+    return;
+
+  if(setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, (void *)&onoff,
+                sizeof(onoff)) < 0)
+    infof(data, "Could not set TCP_FASTOPEN_CONNECT: %s\n",
+          Curl_strerror(conn, SOCKERRNO));
+  else
+    conn->bits.tcp_fastopen = TRUE;
+}
+#else
+#define tcpfastopen(x,y) Curl_nop_stmt
+#endif
+
+static void setsockint(struct connectdata *conn, curl_socket_t sockfd,
+                       int level, int optname, long value, const char *what)
+{
+  int val = curlx_sltosi(value);
+
+  if(setsockopt(sockfd, level, optname, (void *)&val, sizeof(val)) < 0)
+    infof(conn->data, "Could not set %s: %s\n", what,
+          Curl_strerror(conn, SOCKERRNO));
+}
+
+static long getsockint(curl_socket_t sockfd, int level, int optname)
+{
+  int val = 0;
+  curl_socklen_t len = sizeof(val);
+
+  if(getsockopt(sockfd, level, optname, (void *)&val, &len) < 0)
+    return 0;
+  return val;
+}
+
+/*
+ * Apply the socket tuning asked for with CURLOPT_SOCK_RCVBUF and friends,
+ * before the connect so that the TCP window scale is based on the buffer
+ * sizes. What is in effect afterwards is read back for curl_easy_getinfo(),
+ * the system may round or cap the values.
+ */
+static void socktune(struct connectdata *conn, curl_socket_t sockfd)
+{
+  struct SessionHandle *data = conn->data;
+  struct socktune *tune = &conn->socktune;
+  const char *congestion = data->set.str[STRING_TCP_CONGESTION];
+  bool tcp = (conn->socktype == SOCK_STREAM)?TRUE:FALSE;
+
+  memset(tune, 0, sizeof(*tune));
+
+  if(!data->set.sock_rcvbuf && !data->set.sock_sndbuf &&
+     !data->set.tcp_notsent_lowat && !congestion &&
+     !data->set.tcp_quickack && !data->set.sock_busy_poll)
+    return;
+
+  if(data->set.sock_rcvbuf > 0)
+    setsockint(conn, sockfd, SOL_SOCKET, SO_RCVBUF, data->set.sock_rcvbuf,
+               "SO_RCVBUF");
+  if(data->set.sock_sndbuf > 0)
+    setsockint(conn, sockfd, SOL_SOCKET, SO_SNDBUF, data->set.sock_sndbuf,
+               "SO_SNDBUF");
+
+  if(data->set.sock_busy_poll > 0) {
+#ifdef SO_BUSY_POLL
+    setsockint(conn, sockfd, SOL_SOCKET, SO_BUSY_POLL,
+               data->set.sock_busy_poll, "SO_BUSY_POLL");
+#else
+    infof(data, "SO_BUSY_POLL is not supported\n");
+#endif
+  }
+
+  if(tcp && (data->set.tcp_notsent_lowat > 0)) {
+#ifdef TCP_NOTSENT_LOWAT
+    setsockint(conn, sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+               data->set.tcp_notsent_lowat, "TCP_NOTSENT_LOWAT");
+#else
+    infof(data, "TCP_NOTSENT_LOWAT is not supported\n");
+#endif
+  }
+
+  if(tcp && data->set.tcp_quickack) {
+#ifdef TCP_QUICKACK
+    setsockint(conn, sockfd, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+#else
+    infof(data, "TCP_QUICKACK is not supported\n");
+#endif
+  }
+
+  if(tcp && congestion) {
+#ifdef TCP_CONGESTION
+    if(setsockopt(sockfd, IPPROTO_TCP, TCP_CONGESTION, (void *)congestion,
+                  (curl_socklen_t)strlen(congestion)) < 0)
+      infof(data, "Could not set TCP congestion control %s: %s\n",
+            congestion, Curl_strerror(conn, SOCKERRNO));
+#else
+    infof(data, "TCP_CONGESTION is not supported\n");
+#endif
+  }
+
+  tune->rcvbuf = getsockint(sockfd, SOL_SOCKET, SO_RCVBUF);
+  tune->sndbuf = getsockint(sockfd, SOL_SOCKET, SO_SNDBUF);
+  if(tcp) {
+#ifdef TCP_NOTSENT_LOWAT
+    tune->notsent_lowat = getsockint(sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT);
+#endif
+#ifdef TCP_CONGESTION
+    {
+      curl_socklen_t len = sizeof(tune->congestion) - 1;
+      if(getsockopt(sockfd, IPPROTO_TCP, TCP_CONGESTION,
+                    (void *)tune->congestion, &len) < 0)
+        tune->congestion[0] = '\0';
+    }
+#endif
+  }
+}
+
+void Curl_quickack(struct connectdata *conn, curl_socket_t sockfd)
+{
+#ifdef TCP_QUICKACK
+  int on = 1;
+
+  if(conn->socktype == SOCK_STREAM)
+    (void)setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, (void *)&on,
+                     sizeof(on));
+#else
+  (void)conn;
+  (void)sockfd;
+#endif
+}
+
 #ifdef USE_WINSOCK
 /* When you run a program that uses the Windows Sockets API, you may
    experience slow performance when you copy data to a TCP server.
@@ -899,6 +1109,8 @@ singleipconnect(struct connectdata *conn,
   if(data->set.tcp_keepalive)
     tcpkeepalive(data, sockfd);
 
+  socktune(conn, sockfd);
+
   if(data->set.fsockopt) {
     /* activate callback for setting socket options */
     error = data->set.fsockopt(data->set.sockopt_client,
@@ -920,6 +1132,11 @@ singleipconnect(struct connectdata *conn,
     return res;
   }
 
+  conn->bits.tcp_fastopen = FALSE;
+  if(data->set.tcp_fastopen && !isconnected &&
+     (conn->socktype == SOCK_STREAM))
+    tcpfastopen(conn, sockfd);
+
   /* set socket non-blocking */
   curlx_nonblock(sockfd, TRUE);
 
@@ -69,6 +69,13 @@ void Curl_sndbufset(curl_socket_t sockfd);
 #define Curl_sndbufset(y) Curl_nop_stmt
 #endif
 
+/*
+ * TCP_QUICKACK only holds until the system goes back to delaying ACKs on its
+ * own, so it is set again after every read when CURLOPT_TCP_QUICKACK asks
+ * for it.
+ */
+void Curl_quickack(struct connectdata *conn, curl_socket_t sockfd);
+
 void Curl_updateconninfo(struct connectdata *conn, curl_socket_t sockfd);
 void Curl_persistconninfo(struct connectdata *conn);
 int Curl_closesocket(struct connectdata *conn, curl_socket_t sock);
@@ -477,6 +477,58 @@ Curl_addrinfo *Curl_str2addr(char *address, int port)
   return NULL; /* bad input format */
 }
 
+/*
+ * Curl_dupaddrinfo()
+ *
+ * Returns an allocated copy of a linked list of Curl_addrinfo structs, or
+ * NULL on out of memory. The copy is freed with Curl_freeaddrinfo().
+ */
+Curl_addrinfo *Curl_dupaddrinfo(const Curl_addrinfo *orig)
+{
+  Curl_addrinfo *cafirst = NULL;
+  Curl_addrinfo *calast = NULL;
+  Curl_addrinfo *ca;
+
+  for(; orig; orig = orig->ai_next) {
+    ca = malloc(sizeof(Curl_addrinfo));
+    if(!ca)
+      break;
+
+    *ca = *orig;
+    ca->ai_canonname = NULL;
+    ca->ai_addr = NULL;
+    ca->ai_next = NULL;
+
+    /* link it in first, so that it gets freed with the rest on failure */
+    if(!cafirst)
+      cafirst = ca;
+    if(calast)
+      calast->ai_next = ca;
+    calast = ca;
+
+    if(orig->ai_addr) {
+      ca->ai_addr = malloc(orig->ai_addrlen);
+      if(!ca->ai_addr)
+        break;
+      memcpy(ca->ai_addr, orig->ai_addr, orig->ai_addrlen);
+    }
+
+    if(orig->ai_canonname) {
+      ca->ai_canonname = strdup(orig->ai_canonname);
+      if(!ca->ai_canonname)
+        break;
+    }
+  }
+
+  if(orig) {
+    /* we stopped early, out of memory */
+    Curl_freeaddrinfo(cafirst);
+    cafirst = NULL;
+  }
+
+  return cafirst;
+}
+
 #if defined(CURLDEBUG) && defined(HAVE_FREEADDRINFO)
 /*
  * curl_dofreeaddrinfo()
@@ -868,6 +868,9 @@
 /* Define if you want to enable c-ares support */
 #cmakedefine USE_ARES ${USE_ARES}
 
+/* Define if you want to enable the built-in stub resolver */
+#cmakedefine USE_STUB_RESOLVER ${USE_STUB_RESOLVER}
+
 /* Define to disable non-blocking sockets. */
 #cmakedefine USE_BLOCKING_SOCKETS ${USE_BLOCKING_SOCKETS}
 
@@ -880,6 +883,9 @@
 /* if libSSH2 is in use */
 #cmakedefine USE_LIBSSH2 ${USE_LIBSSH2}
 
+/* if nghttp2 is in use */
+#cmakedefine USE_NGHTTP2 ${USE_NGHTTP2}
+
 /* If you want to build curl with the built-in manual */
 #cmakedefine USE_MANUAL ${USE_MANUAL}
 
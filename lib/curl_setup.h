@@ -539,6 +539,9 @@
 /* now undef the stock libc functions just to avoid them being used */
 #  undef HAVE_GETADDRINFO
 #  undef HAVE_GETHOSTBYNAME
+#elif defined(USE_STUB_RESOLVER)
+#  define CURLRES_ASYNCH
+#  define CURLRES_STUB
 #elif defined(USE_THREADS_POSIX) || defined(USE_THREADS_WIN32)
 #  define CURLRES_ASYNCH
 #  define CURLRES_THREADED
@@ -94,6 +94,29 @@ int Curl_thread_join(curl_thread_t *hnd)
   return ret;
 }
 
+void Curl_cond_timedwait(curl_cond_t *cond, curl_mutex_t *mtx, long ms)
+{
+  struct timespec abstime;
+#ifdef HAVE_CLOCK_GETTIME_MONOTONIC
+  /* the condition uses the default clock, which is the real time one */
+  clock_gettime(CLOCK_REALTIME, &abstime);
+#else
+  struct timeval now;
+  (void)gettimeofday(&now, NULL);
+  abstime.tv_sec = now.tv_sec;
+  abstime.tv_nsec = now.tv_usec * 1000;
+#endif
+
+  abstime.tv_sec += ms / 1000;
+  abstime.tv_nsec += (ms % 1000) * 1000000;
+  if(abstime.tv_nsec >= 1000000000) {
+    abstime.tv_sec++;
+    abstime.tv_nsec -= 1000000000;
+  }
+
+  (void)pthread_cond_timedwait(cond, mtx, &abstime);
+}
+
 #elif defined(USE_THREADS_WIN32)
 
 curl_thread_t Curl_thread_create(unsigned int (CURL_STDCALL *func) (void*),
@@ -126,4 +149,11 @@ int Curl_thread_join(curl_thread_t *hnd)
   return ret;
 }
 
+void Curl_cond_timedwait(curl_cond_t *cond, curl_mutex_t *mtx, long ms)
+{
+  LeaveCriticalSection(mtx);
+  (void)WaitForSingleObject(*cond, (DWORD)ms);
+  EnterCriticalSection(mtx);
+}
+
 #endif /* USE_THREADS_* */
@@ -7,7 +7,7 @@
  *                            | (__| |_| |  _ <| |___
  *                             \___|\___/|_| \_\_____|
  *
- * Copyright (C) 1998 - 2010, Daniel Stenberg, <daniel@haxx.se>, et al.
+ * Copyright (C) 1998 - 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
  *
  * This software is licensed as described in the file COPYING, which
  * you should have received as part of this distribution. The terms
@@ -32,6 +32,11 @@
 #  define Curl_mutex_acquire(m)  pthread_mutex_lock(m)
 #  define Curl_mutex_release(m)  pthread_mutex_unlock(m)
 #  define Curl_mutex_destroy(m)  pthread_mutex_destroy(m)
+#  define curl_cond_t            pthread_cond_t
+#  define Curl_cond_init(c)      pthread_cond_init(c, NULL)
+#  define Curl_cond_wait(c, m)   pthread_cond_wait(c, m)
+#  define Curl_cond_signal(c)    pthread_cond_signal(c)
+#  define Curl_cond_destroy(c)   pthread_cond_destroy(c)
 #elif defined(USE_THREADS_WIN32)
 #  define CURL_STDCALL           __stdcall
 #  define curl_mutex_t           CRITICAL_SECTION
@@ -41,6 +46,36 @@
 #  define Curl_mutex_acquire(m)  EnterCriticalSection(m)
 #  define Curl_mutex_release(m)  LeaveCriticalSection(m)
 #  define Curl_mutex_destroy(m)  DeleteCriticalSection(m)
+/* A semaphore works as a condition variable that may wake up spuriously,
+   which callers must handle anyway, and exists on all Windows versions */
+#  define curl_cond_t            HANDLE
+#  define Curl_cond_init(c)      (*(c) = CreateSemaphore(NULL, 0, 0x7fffffff, \
+                                                         NULL))
+#  define Curl_cond_wait(c, m)   (LeaveCriticalSection(m), \
+                                  WaitForSingleObject(*(c), INFINITE), \
+                                  EnterCriticalSection(m))
+#  define Curl_cond_signal(c)    ReleaseSemaphore(*(c), 1, NULL)
+#  define Curl_cond_destroy(c)   CloseHandle(*(c))
+#endif
+
+/* Atomic changes of a long, each a full memory barrier as well. Curl_atomic_inc
+   and Curl_atomic_dec return the new value. USE_ATOMICS is left undefined
+   where the compiler offers no such operations. */
+#if defined(USE_THREADS_POSIX) && \
+  (defined(__clang__) || (defined(__GNUC__) && \
+   ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 1)))))
+#  define USE_ATOMICS
+#  define Curl_atomic_inc(p)     __sync_add_and_fetch(p, 1L)
+#  define Curl_atomic_dec(p)     __sync_sub_and_fetch(p, 1L)
+#  define Curl_atomic_barrier()  __sync_synchronize()
+#elif defined(USE_THREADS_WIN32)
+#  define USE_ATOMICS
+#  define Curl_atomic_inc(p)     InterlockedIncrement(p)
+#  define Curl_atomic_dec(p)     InterlockedDecrement(p)
+#  define Curl_atomic_barrier()  do { \
+                                   LONG curl_barrier_; \
+                                   InterlockedExchange(&curl_barrier_, 0); \
+                                 } WHILE_FALSE
 #endif
 
 #if defined(USE_THREADS_POSIX) || defined(USE_THREADS_WIN32)
@@ -52,6 +87,10 @@ void Curl_thread_destroy(curl_thread_t hnd);
 
 int Curl_thread_join(curl_thread_t *hnd);
 
+/* wait on the condition for at most 'ms' milliseconds, the mutex is held
+   when called and when returning */
+void Curl_cond_timedwait(curl_cond_t *cond, curl_mutex_t *mtx, long ms);
+
 #endif /* USE_THREADS_POSIX || USE_THREADS_WIN32 */
 
 #endif /* HEADER_CURL_THREADS_H */
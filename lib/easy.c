@@ -250,6 +250,8 @@ CURLcode curl_global_init(long flags)
   idna_init();
 #endif
 
+  Curl_global_host_cache_ctor();
+
   if(Curl_resolver_global_init() != CURLE_OK) {
     DEBUGF(fprintf(stderr, "Error: resolver_global_init failed\n"));
     return CURLE_FAILED_INIT;
@@ -623,6 +625,7 @@ void curl_easy_reset(CURL *curl)
   data->state.path = NULL;
 
   Curl_safefree(data->state.proto.generic);
+  Curl_safefree(data->state.customheaders);
 
   /* zero out UserDefined data: */
   Curl_freeset(data);
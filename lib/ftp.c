@@ -899,6 +899,17 @@ static int ftp_domore_getsock(struct connectdata *conn, curl_socket_t *socks,
     return GETSOCK_READSOCK(0) | GETSOCK_READSOCK(1);
   }
 
+  /* the handshake with a SOCKS proxy over the data connection waits for
+     either direction */
+  if(Curl_SOCKS_busy(conn, SECONDARYSOCKET))
+    return Curl_SOCKS_getsock(conn, socks, numsocks, SECONDARYSOCKET);
+
+  /* the data connection is being made, unless a CONNECT has been sent over
+     it already and the proxy's response to that is waited for */
+  if(!conn->bits.tcpconnect[SECONDARYSOCKET] &&
+     (conn->tunnel_state[SECONDARYSOCKET] != TUNNEL_CONNECT))
+    return GETSOCK_WRITESOCK(0);
+
   return GETSOCK_READSOCK(0);
 }
 
@@ -1818,6 +1829,7 @@ static CURLcode ftp_state_pasv_resp(struct connectdata *conn,
   unsigned short connectport; /* the local port connect() should use! */
   unsigned short newport=0; /* remote port */
   bool connected;
+  bool proxy_handshake = FALSE;
 
   /* newhost must be able to hold a full IP-style address in ASCII, which
      in the IPv6 case means 5*8-1 = 39 letters */
@@ -2011,70 +2023,40 @@ static CURLcode ftp_state_pasv_resp(struct connectdata *conn,
     /* this just dumps information about this second connection */
     ftp_pasv_verbose(conn, conninfo, newhost, connectport);
 
-  switch(conn->proxytype) {
-    /* FIX: this MUST wait for a proper connect first if 'connected' is
-     * FALSE */
-  case CURLPROXY_SOCKS5:
-  case CURLPROXY_SOCKS5_HOSTNAME:
-    result = Curl_SOCKS5(conn->proxyuser, conn->proxypasswd, newhost, newport,
-                         SECONDARYSOCKET, conn);
-    break;
-  case CURLPROXY_SOCKS4:
-    result = Curl_SOCKS4(conn->proxyuser, newhost, newport,
-                         SECONDARYSOCKET, conn, FALSE);
-    break;
-  case CURLPROXY_SOCKS4A:
-    result = Curl_SOCKS4(conn->proxyuser, newhost, newport,
-                         SECONDARYSOCKET, conn, TRUE);
-    break;
-  case CURLPROXY_HTTP:
-  case CURLPROXY_HTTP_1_0:
-    /* do nothing here. handled later. */
-    break;
-  default:
-    failf(data, "unknown proxytype option given");
-    result = CURLE_COULDNT_CONNECT;
-    break;
-  }
-
-  if(result) {
-    if(ftpc->count1 == 0 && ftpcode == 229)
-      return ftp_epsv_disable(conn);
-    return result;
+  if(conn->bits.proxy) {
+    switch(conn->proxytype) {
+    case CURLPROXY_SOCKS5:
+    case CURLPROXY_SOCKS5_HOSTNAME:
+    case CURLPROXY_SOCKS4:
+    case CURLPROXY_SOCKS4A:
+      proxy_handshake = TRUE;
+      break;
+    case CURLPROXY_HTTP:
+    case CURLPROXY_HTTP_1_0:
+      proxy_handshake = conn->bits.tunnel_proxy;
+      break;
+    default:
+      failf(data, "unknown proxytype option given");
+      return CURLE_COULDNT_CONNECT;
+    }
   }
 
-  if(conn->bits.tunnel_proxy && conn->bits.httpproxy) {
-    /* FIX: this MUST wait for a proper connect first if 'connected' is
-     * FALSE */
-
-    /* BLOCKING */
-    /* We want "seamless" FTP operations through HTTP proxy tunnel */
-
-    /* Curl_proxyCONNECT is based on a pointer to a struct HTTP at the member
-     * conn->proto.http; we want FTP through HTTP and we have to change the
-     * member temporarily for connecting to the HTTP proxy. After
-     * Curl_proxyCONNECT we have to set back the member to the original struct
-     * FTP pointer
-     */
-    struct HTTP http_proxy;
-    struct FTP *ftp_save = data->state.proto.ftp;
-    memset(&http_proxy, 0, sizeof(http_proxy));
-    data->state.proto.http = &http_proxy;
-
-    result = Curl_proxyCONNECT(conn, SECONDARYSOCKET, newhost, newport);
+  if(proxy_handshake) {
+    /* We want "seamless" FTP operations through SOCKS proxies and HTTP proxy
+       tunnels. The handshake is done by ftp_do_more() once the connection to
+       the proxy is made, remember where to ask to go to until then. */
+    Curl_safefree(ftpc->newhost);
+    ftpc->newhost = strdup(newhost);
+    if(!ftpc->newhost)
+      return CURLE_OUT_OF_MEMORY;
+    ftpc->newport = newport;
+    conn->tunnel_state[SECONDARYSOCKET] = TUNNEL_INIT;
+    conn->socks_state[SECONDARYSOCKET].state = 0;
 
-    data->state.proto.ftp = ftp_save;
+    state(conn, FTP_STOP); /* this phase is completed */
+    conn->bits.tcpconnect[SECONDARYSOCKET] = FALSE;
 
-    if(result)
-      return result;
-
-    if(conn->tunnel_state[SECONDARYSOCKET] != TUNNEL_COMPLETE) {
-      /* the CONNECT procedure is not complete, the tunnel is not yet up */
-      state(conn, FTP_STOP); /* this phase is completed */
-      conn->bits.tcpconnect[SECONDARYSOCKET] = FALSE;
-
-      return result;
-    }
+    return result;
   }
 
   conn->bits.tcpconnect[SECONDARYSOCKET] = TRUE;
@@ -3659,6 +3641,69 @@ static CURLcode ftp_range(struct connectdata *conn)
 }
 
 
+/*
+ * ftp_proxy_connect()
+ *
+ * Does the handshake with the SOCKS proxy or sets up the HTTP proxy tunnel
+ * for the data connection, or goes on with it. *done is set TRUE once the
+ * data connection can be used.
+ */
+static CURLcode ftp_proxy_connect(struct connectdata *conn, bool *done)
+{
+  struct SessionHandle *data = conn->data;
+  struct ftp_conn *ftpc = &conn->proto.ftpc;
+  CURLcode result;
+  struct HTTP http_proxy;
+  struct FTP *ftp_save;
+
+  *done = TRUE;
+
+#ifdef CURL_DISABLE_PROXY
+  (void)ftpc;
+#endif
+
+  if(!conn->bits.proxy)
+    return CURLE_OK;
+
+  switch(conn->proxytype) {
+  case CURLPROXY_SOCKS5:
+  case CURLPROXY_SOCKS5_HOSTNAME:
+    return Curl_SOCKS5(conn->proxyuser, conn->proxypasswd, ftpc->newhost,
+                       ftpc->newport, SECONDARYSOCKET, conn, done);
+  case CURLPROXY_SOCKS4:
+    return Curl_SOCKS4(conn->proxyuser, ftpc->newhost, ftpc->newport,
+                       SECONDARYSOCKET, conn, FALSE, done);
+  case CURLPROXY_SOCKS4A:
+    return Curl_SOCKS4(conn->proxyuser, ftpc->newhost, ftpc->newport,
+                       SECONDARYSOCKET, conn, TRUE, done);
+  default:
+    break;
+  }
+
+  if(!conn->bits.tunnel_proxy || !conn->bits.httpproxy)
+    return CURLE_OK;
+
+  /* Curl_proxyCONNECT is based on a pointer to a struct HTTP at the member
+   * conn->proto.http; we want FTP through HTTP and we have to change the
+   * member temporarily for connecting to the HTTP proxy. After
+   * Curl_proxyCONNECT we have to set back the member to the original struct
+   * FTP pointer
+   */
+  ftp_save = data->state.proto.ftp;
+  memset(&http_proxy, 0, sizeof(http_proxy));
+  data->state.proto.http = &http_proxy;
+
+  result = Curl_proxyCONNECT(conn, SECONDARYSOCKET,
+                             ftpc->newhost, ftpc->newport);
+
+  data->state.proto.ftp = ftp_save;
+
+  /* the tunnel is up once the whole response has been read */
+  *done = (conn->tunnel_state[SECONDARYSOCKET] == TUNNEL_COMPLETE);
+
+  return result;
+}
+
 /*
  * ftp_do_more()
  *
@@ -3680,15 +3725,23 @@ static CURLcode ftp_do_more(struct connectdata *conn, bool *complete)
 
   /* if the second connection isn't done yet, wait for it */
   if(!conn->bits.tcpconnect[SECONDARYSOCKET]) {
-    if(conn->tunnel_state[SECONDARYSOCKET] == TUNNEL_CONNECT) {
-      /* As we're in TUNNEL_CONNECT state now, we know the proxy name and port
-         aren't used so we blank their arguments. TODO: make this nicer */
-      result = Curl_proxyCONNECT(conn, SECONDARYSOCKET, NULL, 0);
+    if((conn->tunnel_state[SECONDARYSOCKET] == TUNNEL_CONNECT) ||
+       Curl_SOCKS_busy(conn, SECONDARYSOCKET))
+      /* the proxy handshake has started, go on with what the socket lets
+         us do of it */
+      result = ftp_proxy_connect(conn, &connected);
+    else {
+      result = Curl_is_connected(conn, SECONDARYSOCKET, &connected);
 
-      return result;
+      if(!result && connected)
+        /* connected to the proxy, if there is one, now ask it to let the
+           data through */
+        result = ftp_proxy_connect(conn, &connected);
     }
-
-    result = Curl_is_connected(conn, SECONDARYSOCKET, &connected);
+    /* the proxy handshake must be done before the connection can be used */
+    if(result)
+      connected = FALSE;
+    conn->bits.tcpconnect[SECONDARYSOCKET] = connected;
 
     /* Ready to do more? */
     if(connected) {
@@ -4242,6 +4295,7 @@ static CURLcode ftp_disconnect(struct connectdata *conn, bool dead_connection)
     free(ftpc->server_os);
     ftpc->server_os = NULL;
   }
+  Curl_safefree(ftpc->newhost);
 
   Curl_pp_disconnect(pp);
 
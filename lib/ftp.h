@@ -144,6 +144,8 @@ struct ftp_conn {
                            data connection is established */
   curl_off_t retr_size_saved; /* Size of retrieved file saved */
   char * server_os;     /* The target server operating system. */
+  char *newhost;        /* where the data connection goes to */
+  unsigned short newport; /* through a proxy */
   curl_off_t known_filesize; /* file size is different from -1, if wildcard
                                 LIST parsing was done and wc_statemach set
                                 it */
@@ -63,6 +63,18 @@ CURLcode Curl_initinfo(struct SessionHandle *data)
   info->header_size = 0;
   info->request_size = 0;
   info->numconnects = 0;
+  info->redircache_hits = 0;
+  info->redircache_misses = 0;
+  info->httpcache = CURL_HTTPCACHE_NONE;
+  info->pipeline_position = 0;
+  info->conn_requests = 0;
+  info->conn_max_pipeline = 0;
+  info->dns_cache_hits = 0;
+  info->dns_cache_stale = 0;
+  info->dns_cache_misses = 0;
+  info->numtunnels = 0;
+  info->numtunnels_reused = 0;
+  memset(&info->conn_socktune, 0, sizeof(info->conn_socktune));
 
   info->conn_primary_ip[0] = '\0';
   info->conn_local_ip[0] = '\0';
@@ -110,6 +122,12 @@ static CURLcode getinfo_char(struct SessionHandle *data, CURLINFO info,
   case CURLINFO_RTSP_SESSION_ID:
     *param_charp = data->set.str[STRING_RTSP_SESSION_ID];
     break;
+  case CURLINFO_TCP_CONGESTION:
+    /* Return the congestion control algorithm of the latest connection, or
+       NULL if it wasn't tuned */
+    *param_charp = data->info.conn_socktune.congestion[0]?
+      data->info.conn_socktune.congestion:NULL;
+    break;
 
   default:
     return CURLE_BAD_FUNCTION_ARGUMENT;
@@ -196,6 +214,48 @@ static CURLcode getinfo_long(struct SessionHandle *data, CURLINFO info,
   case CURLINFO_RTSP_CSEQ_RECV:
     *param_longp = data->state.rtsp_CSeq_recv;
     break;
+  case CURLINFO_REDIRECT_CACHE_HITS:
+    *param_longp = data->info.redircache_hits;
+    break;
+  case CURLINFO_REDIRECT_CACHE_MISSES:
+    *param_longp = data->info.redircache_misses;
+    break;
+  case CURLINFO_HTTP_CACHE:
+    *param_longp = data->info.httpcache;
+    break;
+  case CURLINFO_PIPELINE_POSITION:
+    *param_longp = data->info.pipeline_position;
+    break;
+  case CURLINFO_CONN_REQUESTS:
+    *param_longp = data->info.conn_requests;
+    break;
+  case CURLINFO_CONN_MAX_PIPELINE:
+    *param_longp = data->info.conn_max_pipeline;
+    break;
+  case CURLINFO_DNS_CACHE_HITS:
+    *param_longp = data->info.dns_cache_hits;
+    break;
+  case CURLINFO_DNS_CACHE_STALE:
+    *param_longp = data->info.dns_cache_stale;
+    break;
+  case CURLINFO_DNS_CACHE_MISSES:
+    *param_longp = data->info.dns_cache_misses;
+    break;
+  case CURLINFO_NUM_TUNNELS:
+    *param_longp = data->info.numtunnels;
+    break;
+  case CURLINFO_NUM_TUNNELS_REUSED:
+    *param_longp = data->info.numtunnels_reused;
+    break;
+  case CURLINFO_SOCK_RCVBUF:
+    *param_longp = data->info.conn_socktune.rcvbuf;
+    break;
+  case CURLINFO_SOCK_SNDBUF:
+    *param_longp = data->info.conn_socktune.sndbuf;
+    break;
+  case CURLINFO_TCP_NOTSENT_LOWAT:
+    *param_longp = data->info.conn_socktune.notsent_lowat;
+    break;
 
   default:
     return CURLE_BAD_FUNCTION_ARGUMENT;
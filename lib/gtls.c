@@ -1055,6 +1055,32 @@ void Curl_gtls_session_free(void *ptr)
   free(ptr);
 }
 
+/* the session ids are the data of gnutls_session_get_data() already, their
+   lifetime is not known so the expiry the caller passes in is left as is */
+CURLcode Curl_gtls_session_export(void *ptr, size_t idsize,
+                                  unsigned char **blob, size_t *bloblen,
+                                  time_t *expires)
+{
+  *blob = malloc(idsize);
+  if(!*blob)
+    return CURLE_OUT_OF_MEMORY;
+  memcpy(*blob, ptr, idsize);
+  *bloblen = idsize;
+  (void)expires;
+  return CURLE_OK;
+}
+
+void *Curl_gtls_session_import(const unsigned char *blob, size_t bloblen,
+                               size_t *idsize)
+{
+  void *ptr = malloc(bloblen);
+  if(ptr) {
+    memcpy(ptr, blob, bloblen);
+    *idsize = bloblen;
+  }
+  return ptr;
+}
+
 size_t Curl_gtls_version(char *buffer, size_t size)
 {
   return snprintf(buffer, size, "GnuTLS/%s", gnutls_check_version(NULL));
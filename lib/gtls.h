@@ -43,6 +43,11 @@ void Curl_gtls_close_all(struct SessionHandle *data);
 void Curl_gtls_close(struct connectdata *conn, int sockindex);
 
 void Curl_gtls_session_free(void *ptr);
+CURLcode Curl_gtls_session_export(void *ptr, size_t idsize,
+                                  unsigned char **blob, size_t *bloblen,
+                                  time_t *expires);
+void *Curl_gtls_session_import(const unsigned char *blob, size_t bloblen,
+                               size_t *idsize);
 size_t Curl_gtls_version(char *buffer, size_t size);
 int Curl_gtls_shutdown(struct connectdata *conn, int sockindex);
 int Curl_gtls_seed(struct SessionHandle *data);
@@ -61,6 +66,8 @@ void Curl_gtls_md5sum(unsigned char *tmp, /* input */
 #define curlssl_connect Curl_gtls_connect
 #define curlssl_connect_nonblocking Curl_gtls_connect_nonblocking
 #define curlssl_session_free(x)  Curl_gtls_session_free(x)
+#define curlssl_session_export(a,b,c,d,e) Curl_gtls_session_export(a,b,c,d,e)
+#define curlssl_session_import(x,y,z) Curl_gtls_session_import(x,y,z)
 #define curlssl_close_all Curl_gtls_close_all
 #define curlssl_close Curl_gtls_close
 #define curlssl_shutdown(x,y) Curl_gtls_shutdown(x,y)
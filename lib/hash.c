@@ -185,6 +185,50 @@ Curl_hash_add(struct curl_hash *h, void *key, size_t key_len, void *p)
   return NULL; /* failure */
 }
 
+/*
+ * Curl_hash_resize() moves the entries of the hash to a table with the given
+ * number of slots, to keep the lists short when a hash grows large. Returns
+ * non-zero if out of memory, the hash is then left as it was.
+ */
+int Curl_hash_resize(struct curl_hash *h, int slots)
+{
+  struct curl_llist **table;
+  int i;
+
+  if(slots <= 0)
+    return 1;
+
+  table = malloc(slots * sizeof(struct curl_llist *));
+  if(!table)
+    return 1;
+
+  for(i = 0; i < slots; ++i) {
+    table[i] = Curl_llist_alloc((curl_llist_dtor) hash_element_dtor);
+    if(!table[i]) {
+      while(i--)
+        Curl_llist_destroy(table[i], NULL);
+      free(table);
+      return 1;
+    }
+  }
+
+  for(i = 0; i < h->slots; ++i) {
+    struct curl_llist *l = h->table[i];
+    while(l->head) {
+      struct curl_hash_element *he = l->head->ptr;
+      struct curl_llist *to = table[h->hash_func(he->key, he->key_len,
+                                                 slots)];
+      Curl_llist_move(l, l->head, to, to->tail);
+    }
+    Curl_llist_destroy(l, NULL);
+  }
+  free(h->table);
+
+  h->table = table;
+  h->slots = slots;
+  return 0;
+}
+
 /* remove the identified hash entry, returns non-zero on failure */
 int Curl_hash_delete(struct curl_hash *h, void *key, size_t key_len)
 {
@@ -300,16 +344,38 @@ size_t Curl_hash_str(void* key, size_t key_length, size_t slots_num)
 {
   const char* key_str = (const char *) key;
   const char *end = key_str + key_length;
-  unsigned long h = 5381;
+  unsigned long h = CURL_HASH_STR_INIT;
 
   while(key_str < end) {
-    h += h << 5;
-    h ^= (unsigned long) *key_str++;
+    h = CURL_HASH_STR_NEXT(h, *key_str);
+    key_str++;
   }
 
   return (h % slots_num);
 }
 
+/*
+ * Curl_hash_str_pick() is Curl_hash_pick() for a hash made with
+ * Curl_hash_str(), with the hash value of the key already computed by the
+ * caller with CURL_HASH_STR_NEXT().
+ */
+void *Curl_hash_str_pick(struct curl_hash *h, void *key, size_t key_len,
+                         unsigned long hv)
+{
+  struct curl_llist_element *le;
+  struct curl_hash_element *he;
+
+  DEBUGASSERT(h->hash_func == Curl_hash_str);
+
+  for(le = h->table[hv % h->slots]->head; le; le = le->next) {
+    he = le->ptr;
+    if(h->comp_func(he->key, he->key_len, key, key_len))
+      return he->ptr;
+  }
+
+  return NULL;
+}
+
 size_t Curl_str_key_compare(void*k1, size_t key1_len, void*k2, size_t key2_len)
 {
   char *key1 = (char *)k1;
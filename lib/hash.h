@@ -82,6 +82,7 @@ struct curl_hash *Curl_hash_alloc(int slots,
 void *Curl_hash_add(struct curl_hash *h, void *key, size_t key_len, void *p);
 int Curl_hash_delete(struct curl_hash *h, void *key, size_t key_len);
 void *Curl_hash_pick(struct curl_hash *, void * key, size_t key_len);
+int Curl_hash_resize(struct curl_hash *h, int slots);
 void Curl_hash_apply(struct curl_hash *h, void *user,
                      void (*cb)(void *user, void *ptr));
 int Curl_hash_count(struct curl_hash *h);
@@ -91,6 +92,16 @@ void Curl_hash_clean_with_criterium(struct curl_hash *h, void *user,
 void Curl_hash_destroy(struct curl_hash *h);
 
 size_t Curl_hash_str(void* key, size_t key_length, size_t slots_num);
+
+/* Curl_hash_str() computes the hash value of a key like this, a byte at a
+   time, before it fits it to the slots. Code that makes a key a byte at a
+   time can compute it on the way and look the key up with
+   Curl_hash_str_pick(). */
+#define CURL_HASH_STR_INIT 5381UL
+#define CURL_HASH_STR_NEXT(h,c) (((h) + ((h) << 5)) ^ (unsigned long)(c))
+
+void *Curl_hash_str_pick(struct curl_hash *h, void *key, size_t key_len,
+                         unsigned long hv);
 size_t Curl_str_key_compare(void*k1, size_t key1_len, void*k2,
                             size_t key2_len);
 
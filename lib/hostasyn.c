@@ -83,8 +83,7 @@ CURLcode Curl_addrinfo_callback(struct connectdata *conn,
     if(ai) {
       struct SessionHandle *data = conn->data;
 
-      if(data->share)
-        Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+      Curl_dnscache_lock(data);
 
       dns = Curl_cache_addr(data, ai,
                             conn->async.hostname,
@@ -94,14 +93,17 @@ CURLcode Curl_addrinfo_callback(struct connectdata *conn,
         Curl_freeaddrinfo(ai);
         rc = CURLE_OUT_OF_MEMORY;
       }
+      else if(conn->async.expires)
+        Curl_dnscache_expire(data->dns.hostcache, dns, conn->async.expires);
 
-      if(data->share)
-        Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+      Curl_dnscache_unlock(data);
     }
     else {
       rc = CURLE_OUT_OF_MEMORY;
     }
   }
+  else if(Curl_resolver_notfound(status))
+    Curl_cache_negative(conn->data, conn->async.hostname, conn->async.port);
 
   conn->async.dns = dns;
 
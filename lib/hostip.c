@@ -47,6 +47,10 @@
 #include <process.h>
 #endif
 
+#if defined(USE_THREADS_POSIX) && defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
 #include "urldata.h"
 #include "sendf.h"
 #include "hostip.h"
@@ -56,6 +60,8 @@
 #include "url.h"
 #include "inet_ntop.h"
 #include "warnless.h"
+#include "curl_threads.h"
+#include "select.h"
 
 #define _MPRINTF_REPLACE /* use our functions only */
 #include <curl/mprintf.h>
@@ -89,7 +95,10 @@
  * Windows, and then the name resolve will be done in a new thread, and the
  * supported API will be the same as for ares-builds.
  *
- * If any of the two previous are defined, CURLRES_ASYNCH is defined too. If
+ * CURLRES_STUB - is defined if libcurl is built to send the DNS queries
+ * itself, with the same API as for ares-builds.
+ *
+ * If any of the three previous are defined, CURLRES_ASYNCH is defined too. If
  * libcurl is not built to use an asynchronous resolver, CURLRES_SYNCH is
  * defined.
  *
@@ -101,49 +110,21 @@
  * hostip4.c  - ipv4-specific functions
  * hostip6.c  - ipv6-specific functions
  *
- * The two asynchronous name resolver backends are implemented in:
+ * The three asynchronous name resolver backends are implemented in:
  * asyn-ares.c   - functions for ares-using name resolves
  * asyn-thread.c - functions for threaded name resolves
+ * asyn-stub.c   - functions for name resolves with the built-in stub resolver
 
  * The hostip.h is the united header file for all this. It defines the
  * CURLRES_* defines based on the config*.h and curl_setup.h defines.
  */
 
 /* These two symbols are for the global DNS cache */
-static struct curl_hash hostname_cache;
+static struct Curl_dnscache hostname_cache;
 static int host_cache_initialized;
 
 static void freednsentry(void *freethis);
-
-/*
- * Curl_global_host_cache_init() initializes and sets up a global DNS cache.
- * Global DNS cache is general badness. Do not use. This will be removed in
- * a future version. Use the share interface instead!
- *
- * Returns a struct curl_hash pointer on success, NULL on failure.
- */
-struct curl_hash *Curl_global_host_cache_init(void)
-{
-  int rc = 0;
-  if(!host_cache_initialized) {
-    rc = Curl_hash_init(&hostname_cache, 7, Curl_hash_str,
-                        Curl_str_key_compare, freednsentry);
-    if(!rc)
-      host_cache_initialized = 1;
-  }
-  return rc?NULL:&hostname_cache;
-}
-
-/*
- * Destroy and cleanup the global DNS cache
- */
-void Curl_global_host_cache_dtor(void)
-{
-  if(host_cache_initialized) {
-    Curl_hash_clean(&hostname_cache);
-    host_cache_initialized = 0;
-  }
-}
+static int dnscache_init(struct Curl_dnscache *cache);
 
 /*
  * Return # of adresses in a Curl_addrinfo struct
@@ -194,62 +175,165 @@ Curl_printable_address(const Curl_addrinfo *ai, char *buf, size_t bufsize)
   return NULL;
 }
 
+/* the number of hash slots a DNS cache starts with, and the average number
+   of entries per slot that makes it grow to twice as many */
+#define HOSTCACHE_SLOTS 97
+#define HOSTCACHE_LOAD 2
+
+/* the longest name put in a hostcache id, no name in the DNS is longer */
+#define MAX_HOSTCACHE_NAME 255
+
+/* a hostcache id, made where it is needed without allocating */
+struct hostcache_id {
+  char *id;         /* points to 'buf' or, for longer names, allocated */
+  size_t len;       /* the length of the key, the zero included */
+  unsigned long hv; /* the hash value of the key */
+  char buf[MAX_HOSTCACHE_NAME + 13]; /* name, colon, port and zero */
+};
+
 /*
- * Return a hostcache id string for the provided host + port, to be used by
- * the DNS caching.
+ * Make the hostcache id for the provided host + port, to be used by the DNS
+ * caching. It is the lower cased name, a colon and the port number. The
+ * hash value of it is computed on the way so that looking a name up in the
+ * cache needs neither allocations nor printf. Only names longer than
+ * MAX_HOSTCACHE_NAME need an allocated id, free it with
+ * free_hostcache_id(). Returns FALSE if out of memory.
  */
-static char *
-create_hostcache_id(const char *name, int port)
-{
-  /* create and return the new allocated entry */
-  char *id = aprintf("%s:%d", name, port);
-  char *ptr = id;
-  if(ptr) {
-    /* lower case the name part */
-    while(*ptr && (*ptr != ':')) {
-      *ptr = (char)TOLOWER(*ptr);
-      ptr++;
-    }
+static bool
+create_hostcache_id(const char *name, int port, struct hostcache_id *key)
+{
+  char *ptr;
+  size_t namelen = strlen(name);
+  unsigned long hv = CURL_HASH_STR_INIT;
+  unsigned long num = (port < 0)?(unsigned long)-(port + 1) + 1:
+                                 (unsigned long)port;
+  char digits[12];
+  int ndigits = 0;
+
+  if(namelen > MAX_HOSTCACHE_NAME) {
+    key->id = malloc(namelen + sizeof(key->buf) - MAX_HOSTCACHE_NAME);
+    if(!key->id)
+      return FALSE;
   }
-  return id;
+  else
+    key->id = key->buf;
+  ptr = key->id;
+
+  while(*name) {
+    *ptr = (char)TOLOWER(*name);
+    hv = CURL_HASH_STR_NEXT(hv, *ptr);
+    name++;
+    ptr++;
+  }
+
+  *ptr = ':';
+  hv = CURL_HASH_STR_NEXT(hv, *ptr);
+  ptr++;
+  if(port < 0) {
+    *ptr = '-';
+    hv = CURL_HASH_STR_NEXT(hv, *ptr);
+    ptr++;
+  }
+
+  do {
+    digits[ndigits++] = (char)('0' + num % 10);
+    num /= 10;
+  } while(num);
+  while(ndigits) {
+    *ptr = digits[--ndigits];
+    hv = CURL_HASH_STR_NEXT(hv, *ptr);
+    ptr++;
+  }
+
+  /* the zero byte is part of the key */
+  *ptr = '\0';
+  hv = CURL_HASH_STR_NEXT(hv, *ptr);
+
+  key->len = ptr - key->id + 1;
+  key->hv = hv;
+
+  return TRUE;
 }
 
-struct hostcache_prune_data {
-  long cache_timeout;
-  time_t now;
-};
+static void free_hostcache_id(struct hostcache_id *key)
+{
+  if(key->id != key->buf)
+    free(key->id);
+}
 
 /*
- * This function is set as a callback to be called for every entry in the DNS
- * cache when we want to prune old unused entries.
- *
- * Returning non-zero means remove the entry, return 0 to keep it in the
- * cache.
+ * Curl_dnscache_expire() sets the time the entry expires at, before the
+ * cache timeout, and links it in the cache's list of such entries. This
+ * assumes that a lock has already been taken.
  */
-static int
-hostcache_timestamp_remove(void *datap, void *hc)
+void Curl_dnscache_expire(struct Curl_dnscache *cache,
+                          struct Curl_dns_entry *dns, time_t expires)
 {
-  struct hostcache_prune_data *data =
-    (struct hostcache_prune_data *) datap;
-  struct Curl_dns_entry *c = (struct Curl_dns_entry *) hc;
+  struct Curl_dns_entry *sooner;
+
+  if(dns->sooner) {
+    dns->sooner->later = dns->later;
+    dns->later->sooner = dns->sooner;
+    dns->sooner = dns->later = NULL;
+  }
+
+  dns->expires = expires;
+  if(!expires)
+    return;
+
+  /* entries mostly get the same times to live, so their place is at or near
+     the end */
+  sooner = cache->expiring.sooner;
+  while((sooner != &cache->expiring) && (sooner->expires > expires))
+    sooner = sooner->sooner;
 
-  return (data->now - c->timestamp >= data->cache_timeout);
+  dns->sooner = sooner;
+  dns->later = sooner->later;
+  sooner->later = dns;
+  dns->later->sooner = dns;
 }
 
 /*
  * Prune the DNS cache. This assumes that a lock has already been taken.
+ *
+ * The entries are linked oldest first, so only the ones that have timed out
+ * are looked at, no matter how many there are in the cache. The entries that
+ * expire before that, as the resolver told or because they hold a failed
+ * lookup, are linked in the order they expire, and only the expired ones of
+ * those are looked at. Outdated entries that are still in use are left for
+ * a later prune.
  */
 static void
-hostcache_prune(struct curl_hash *hostcache, long cache_timeout, time_t now)
+hostcache_prune(struct Curl_dnscache *hostcache, long cache_timeout,
+                long stale, time_t now)
 {
-  struct hostcache_prune_data user;
+  struct Curl_dns_entry *dns = hostcache->age.newer;
 
-  user.cache_timeout = cache_timeout;
-  user.now = now;
+  while(dns != &hostcache->age) {
+    struct Curl_dns_entry *newer = dns->newer;
+    /* an entry of the global cache holds one use of itself */
+    long uses = dns->global ? 1 : 0;
+
+    if(now - dns->timestamp < cache_timeout + stale)
+      break;
+    if(dns->inuse <= uses)
+      /* removing it from the hash unlinks it from the lists */
+      Curl_hash_delete(&hostcache->hash, dns->id, dns->idlen+1);
+    dns = newer;
+  }
 
-  Curl_hash_clean_with_criterium(hostcache,
-                                 (void *) &user,
-                                 hostcache_timestamp_remove);
+  dns = hostcache->expiring.later;
+  while((dns != &hostcache->expiring) && (dns->expires <= now)) {
+    struct Curl_dns_entry *later = dns->later;
+    long uses = dns->global ? 1 : 0;
+
+    /* failed lookups are not used once expired, addresses may still be
+       while they are refreshed */
+    if((!dns->addr || (now - dns->expires >= stale)) &&
+       (dns->inuse <= uses))
+      Curl_hash_delete(&hostcache->hash, dns->id, dns->idlen+1);
+    dns = later;
+  }
 }
 
 /*
@@ -265,44 +349,558 @@ void Curl_hostcache_prune(struct SessionHandle *data)
        we can't do it */
     return;
 
-  if(data->share)
-    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+  Curl_dnscache_lock(data);
 
   time(&now);
 
-  /* Remove outdated and unused entries from the hostcache */
-  hostcache_prune(data->dns.hostcache,
-                  data->set.dns_cache_timeout,
-                  now);
+  /* Remove outdated and unused entries from the hostcache, those that may
+     still be used while they are refreshed are kept */
+  hostcache_prune(data->dns.hostcache, data->set.dns_cache_timeout,
+                  data->set.dns_cache_stale, now);
+
+  Curl_dnscache_unlock(data);
+}
+
+/* the states of a DNS cache entry, see entry_state() */
+#define DNS_ENTRY_FRESH    0 /* use it */
+#define DNS_ENTRY_STALE    1 /* outdated, may be used while refreshed */
+#define DNS_ENTRY_OUTDATED 2 /* must not be used */
+
+static int entry_state(struct SessionHandle *data, struct Curl_dns_entry *dns,
+                       time_t now)
+{
+  time_t expires;
+
+  if(!dns->addr)
+    /* failed lookups are kept for their own short time */
+    return (now < dns->expires)?DNS_ENTRY_FRESH:DNS_ENTRY_OUTDATED;
+
+  if(data->set.dns_cache_timeout == -1)
+    /* cache forever */
+    return DNS_ENTRY_FRESH;
+
+  expires = dns->timestamp + data->set.dns_cache_timeout;
+  if(dns->expires && (dns->expires < expires))
+    expires = dns->expires;
+
+  if(now < expires)
+    return DNS_ENTRY_FRESH;
+  if(now < expires + data->set.dns_cache_stale)
+    return DNS_ENTRY_STALE;
+  return DNS_ENTRY_OUTDATED;
+}
+
+#if defined(USE_THREADS_POSIX) || defined(USE_THREADS_WIN32)
+/* the global DNS cache may be used by several threads at once, its writers
+   serialize on this */
+#define GLOBAL_DNS_MUTEX
+static curl_mutex_t global_dns_lock;
+#endif
+
+#if defined(GLOBAL_DNS_MUTEX) && defined(USE_ATOMICS)
+/*
+ * Lock-free reads of the global DNS cache
+ * =======================================
+ *
+ * Next to its hash, the global cache keeps an index of the entries that
+ * readers walk without taking any lock. Every slot of the index points to
+ * an array of entries that is never changed once published; a writer that
+ * adds or removes an entry, with the lock held, publishes a changed copy of
+ * the array in its place and retires the old one. When the index gets too
+ * full, the writer publishes a copy with twice as many slots and retires
+ * the old index with all its arrays.
+ *
+ * A reader announces itself in one of two counters, picked by the current
+ * epoch. Retired arrays and entries are reclaimed by the writer after it has
+ * moved on to the next epoch and the counter of the previous one has
+ * drained, as no reader can see them then.
+ *
+ * The cache holds one use of each of its entries. Readers add theirs with
+ * an atomic increment, and whoever drops the last use of an entry that has
+ * left the cache frees it.
+ */
+#define DNS_LOCKFREE
 
+struct dnsbucket {
+  struct dnsbucket *retired; /* next in the list of retired buckets */
+  size_t count;
+  struct Curl_dns_entry *entry[1]; /* 'count' entries */
+};
+
+struct dnsindex {
+  struct dnsindex *retired; /* next in the list of retired indexes */
+  size_t slots;
+  size_t count; /* number of entries in the buckets */
+  struct dnsbucket *slot[1]; /* 'slots' buckets */
+};
+
+static struct dnsindex *volatile global_dns_index;
+static volatile long global_dns_epoch;
+static volatile long global_dns_readers[2];
+/* retired indexes, buckets and entries, the entries linked with 'older' */
+static struct dnsindex *global_dns_old_index;
+static struct dnsbucket *global_dns_old_buckets;
+static struct Curl_dns_entry *global_dns_old_entries;
+
+#define dns_hold(d) Curl_atomic_inc(&(d)->inuse)
+#define dns_drop(d) Curl_atomic_dec(&(d)->inuse)
+#else
+#define dns_hold(d) (++(d)->inuse)
+#define dns_drop(d) (--(d)->inuse)
+#endif
+
+/*
+ * Curl_global_host_cache_init() initializes and sets up a global DNS cache.
+ * Global DNS cache is general badness. Do not use. This will be removed in
+ * a future version. Use the share interface instead!
+ *
+ * Returns a struct curl_hash pointer on success, NULL on failure.
+ */
+struct Curl_dnscache *Curl_global_host_cache_init(void)
+{
+  int rc = 0;
+#ifdef GLOBAL_DNS_MUTEX
+  Curl_mutex_acquire(&global_dns_lock);
+#endif
+  if(!host_cache_initialized) {
+    rc = dnscache_init(&hostname_cache);
+    if(!rc)
+      host_cache_initialized = 1;
+  }
+#ifdef GLOBAL_DNS_MUTEX
+  Curl_mutex_release(&global_dns_lock);
+#endif
+  return rc?NULL:&hostname_cache;
+}
+
+/*
+ * Set up the lock of the global DNS cache, done by curl_global_init()
+ */
+void Curl_global_host_cache_ctor(void)
+{
+#ifdef GLOBAL_DNS_MUTEX
+  Curl_mutex_init(&global_dns_lock);
+#endif
+}
+
+#ifdef DNS_LOCKFREE
+static void free_dns_entry(struct Curl_dns_entry *dns)
+{
+  Curl_freeaddrinfo(dns->addr);
+  free(dns);
+}
+
+static size_t index_slot(const struct dnsindex *index,
+                         const struct Curl_dns_entry *dns)
+{
+  return Curl_hash_str(dns->id, dns->idlen+1, index->slots);
+}
+
+static void bucket_retire(struct dnsbucket *bucket)
+{
+  if(bucket) {
+    bucket->retired = global_dns_old_buckets;
+    global_dns_old_buckets = bucket;
+  }
+}
+
+/* retire an index that readers may still be looking at, with its buckets */
+static void index_retire(struct dnsindex *index)
+{
+  size_t i;
+
+  for(i = 0; i < index->slots; i++)
+    bucket_retire(index->slot[i]);
+  index->retired = global_dns_old_index;
+  global_dns_old_index = index;
+}
+
+/* replace the bucket of a slot of the index, the lock held */
+static void index_publish(struct dnsindex *index, size_t slot,
+                          struct dnsbucket *bucket)
+{
+  struct dnsbucket *old = index->slot[slot];
+
+  /* the bucket is complete before any reader can find it */
+  Curl_atomic_barrier();
+  index->slot[slot] = bucket;
+
+  bucket_retire(old);
+}
+
+static struct dnsindex *index_alloc(size_t slots)
+{
+  struct dnsindex *index;
+  size_t i;
+
+  index = malloc(sizeof(struct dnsindex) +
+                 (slots - 1) * sizeof(struct dnsbucket *));
+  if(index) {
+    index->retired = NULL;
+    index->slots = slots;
+    index->count = 0;
+    for(i = 0; i < slots; i++)
+      index->slot[i] = NULL;
+  }
+  return index;
+}
+
+/*
+ * Replace the index with one with twice as many slots, or make the first
+ * one. Returns FALSE if out of memory, the index is then left as it was.
+ */
+static bool index_grow(void)
+{
+  struct dnsindex *old = global_dns_index;
+  struct dnsindex *index;
+  size_t *count;
+  size_t slots = old ? old->slots * 2 + 1 : HOSTCACHE_SLOTS;
+  size_t i;
+  size_t n;
+
+  index = index_alloc(slots);
+  if(!index)
+    return FALSE;
+
+  if(old) {
+    count = calloc(slots, sizeof(size_t));
+    if(!count) {
+      free(index);
+      return FALSE;
+    }
+
+    /* size the buckets first, then fill them */
+    for(i = 0; i < old->slots; i++)
+      for(n = 0; old->slot[i] && (n < old->slot[i]->count); n++)
+        count[index_slot(index, old->slot[i]->entry[n])]++;
+
+    for(i = 0; i < slots; i++) {
+      struct dnsbucket *bucket;
+      if(!count[i])
+        continue;
+      bucket = malloc(sizeof(struct dnsbucket) +
+                      (count[i] - 1) * sizeof(struct Curl_dns_entry *));
+      if(!bucket) {
+        while(i--)
+          free(index->slot[i]);
+        free(count);
+        free(index);
+        return FALSE;
+      }
+      bucket->retired = NULL;
+      bucket->count = 0;
+      index->slot[i] = bucket;
+    }
+    free(count);
+
+    for(i = 0; i < old->slots; i++)
+      for(n = 0; old->slot[i] && (n < old->slot[i]->count); n++) {
+        struct Curl_dns_entry *dns = old->slot[i]->entry[n];
+        struct dnsbucket *bucket = index->slot[index_slot(index, dns)];
+        bucket->entry[bucket->count++] = dns;
+      }
+    index->count = old->count;
+  }
+
+  /* the index is complete before any reader can find it */
+  Curl_atomic_barrier();
+  global_dns_index = index;
+
+  if(old)
+    index_retire(old);
+  return TRUE;
+}
+
+/*
+ * Add an entry of the global cache to the index. Without memory for the
+ * copy, the entry is only found by the readers that take the lock.
+ */
+static void index_add(struct Curl_dns_entry *dns)
+{
+  struct dnsindex *index = global_dns_index;
+  size_t slot;
+  struct dnsbucket *old;
+  size_t count;
+  struct dnsbucket *bucket;
+
+  if(!index || (index->count >= index->slots * HOSTCACHE_LOAD)) {
+    /* an index that can't grow still works, only slower */
+    if(index_grow())
+      index = global_dns_index;
+    else if(!index)
+      return;
+  }
+
+  slot = index_slot(index, dns);
+  old = index->slot[slot];
+  count = old?old->count:0;
+
+  bucket = malloc(sizeof(struct dnsbucket) +
+                  count * sizeof(struct Curl_dns_entry *));
+  if(!bucket)
+    return;
+  bucket->retired = NULL;
+  bucket->count = count + 1;
+  if(count)
+    memcpy(bucket->entry, old->entry, count * sizeof(struct Curl_dns_entry *));
+  bucket->entry[count] = dns;
+  index_publish(index, slot, bucket);
+  index->count++;
+}
+
+/*
+ * Remove an entry of the global cache from the index. Without memory for the
+ * copy, the whole slot is emptied.
+ */
+static void index_remove(struct Curl_dns_entry *dns)
+{
+  struct dnsindex *index = global_dns_index;
+  size_t slot;
+  struct dnsbucket *old;
+  struct dnsbucket *bucket = NULL;
+  size_t i;
+  size_t n;
+
+  if(!index)
+    return;
+  slot = index_slot(index, dns);
+  old = index->slot[slot];
+  if(!old)
+    return;
+  for(i = 0; i < old->count; i++)
+    if(old->entry[i] == dns)
+      break;
+  if(i == old->count)
+    return; /* not in the index */
+
+  if(old->count > 1) {
+    bucket = malloc(sizeof(struct dnsbucket) +
+                    (old->count - 2) * sizeof(struct Curl_dns_entry *));
+    if(bucket) {
+      bucket->retired = NULL;
+      bucket->count = 0;
+      for(n = 0; n < old->count; n++)
+        if(n != i)
+          bucket->entry[bucket->count++] = old->entry[n];
+    }
+  }
+  index->count -= old->count - (bucket ? bucket->count : 0);
+  index_publish(index, slot, bucket);
+}
+
+/*
+ * Free what has been retired from the index and the cache once no reader
+ * can use it anymore. The lock is held.
+ */
+static void global_reclaim(void)
+{
+  struct dnsindex *index = global_dns_old_index;
+  struct dnsbucket *bucket = global_dns_old_buckets;
+  struct Curl_dns_entry *dns = global_dns_old_entries;
+  long epoch;
+  int spins = 0;
+
+  if(!index && !bucket && !dns)
+    return;
+  global_dns_old_index = NULL;
+  global_dns_old_buckets = NULL;
+  global_dns_old_entries = NULL;
+
+  /* readers that start from now on count in the other counter and can't
+     find what has been retired, wait for the ones that could. The wait is
+     done with the lock held, as a writer coming after this one must not
+     start waiting before these readers are gone. A reader only looks one
+     name up, so spin a little and then sleep, in case its thread lost the
+     CPU. */
+  epoch = Curl_atomic_inc(&global_dns_epoch) - 1;
+  while(global_dns_readers[epoch & 1]) {
+    if(spins < 100)
+      spins++;
+    else
+      Curl_wait_ms(1);
+  }
+
+  while(index) {
+    struct dnsindex *next = index->retired;
+    free(index);
+    index = next;
+  }
+
+  while(bucket) {
+    struct dnsbucket *next = bucket->retired;
+    free(bucket);
+    bucket = next;
+  }
+
+  while(dns) {
+    struct Curl_dns_entry *next = dns->older;
+    dns->older = NULL;
+    /* drop the use the cache held */
+    if(!dns_drop(dns))
+      free_dns_entry(dns);
+    dns = next;
+  }
+}
+
+/*
+ * Look a name up in the global cache without taking the lock. Only a fresh
+ * entry is returned, with its use counted, anything else is for the caller
+ * to deal with the lock held.
+ */
+static struct Curl_dns_entry *global_fetch(struct SessionHandle *data,
+                                           const struct hostcache_id *key)
+{
+  struct Curl_dns_entry *dns = NULL;
+  struct dnsindex *index;
+  struct dnsbucket *bucket;
+  long epoch;
+  time_t now;
+  size_t i;
+
+  time(&now);
+
+  for(;;) {
+    epoch = global_dns_epoch;
+    Curl_atomic_inc(&global_dns_readers[epoch & 1]);
+    if(epoch == global_dns_epoch)
+      break;
+    /* a writer moved on meanwhile and may not wait for this counter */
+    Curl_atomic_dec(&global_dns_readers[epoch & 1]);
+  }
+
+  index = global_dns_index;
+  bucket = index ? index->slot[key->hv % index->slots] : NULL;
+  for(i = 0; bucket && (i < bucket->count); i++) {
+    struct Curl_dns_entry *e = bucket->entry[i];
+    if((e->idlen + 1 == key->len) && !memcmp(e->id, key->id, key->len)) {
+      if(e->addr && !e->refresh &&
+         (entry_state(data, e, now) == DNS_ENTRY_FRESH)) {
+        dns_hold(e);
+        dns = e;
+      }
+      break;
+    }
+  }
+
+  Curl_atomic_dec(&global_dns_readers[epoch & 1]);
+
+  return dns;
+}
+#endif /* DNS_LOCKFREE */
+
+/*
+ * Destroy and cleanup the global DNS cache
+ */
+void Curl_global_host_cache_dtor(void)
+{
+  if(host_cache_initialized) {
+    Curl_hash_clean(&hostname_cache.hash);
+#ifdef DNS_LOCKFREE
+    if(global_dns_index) {
+      index_retire(global_dns_index);
+      global_dns_index = NULL;
+    }
+    global_reclaim();
+#endif
+    host_cache_initialized = 0;
+  }
+#ifdef GLOBAL_DNS_MUTEX
+  Curl_mutex_destroy(&global_dns_lock);
+#endif
+}
+
+/*
+ * Curl_dnscache_lock() takes the lock of the DNS cache of the handle, the
+ * one of the share or of the global cache.
+ */
+void Curl_dnscache_lock(struct SessionHandle *data)
+{
+#ifdef GLOBAL_DNS_MUTEX
+  if(data->dns.hostcachetype == HCACHE_GLOBAL) {
+    Curl_mutex_acquire(&global_dns_lock);
+    return;
+  }
+#endif
+  if(data->share)
+    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+}
+
+void Curl_dnscache_unlock(struct SessionHandle *data)
+{
+#ifdef GLOBAL_DNS_MUTEX
+  if(data->dns.hostcachetype == HCACHE_GLOBAL) {
+#ifdef DNS_LOCKFREE
+    global_reclaim();
+#endif
+    Curl_mutex_release(&global_dns_lock);
+    return;
+  }
+#endif
   if(data->share)
     Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
 }
 
 /*
- * Check if the entry should be pruned. Assumes a locked cache.
+ * Check if the entry found in the DNS cache can be used. Assumes a locked
+ * cache.
+ *
+ * An outdated entry is used while a lookup started in the background
+ * refreshes it, if the handle allows that, and is replaced with the result
+ * once that is done. Returns the entry to use or NULL if the name has to be
+ * resolved. *stale is set TRUE if the returned entry is outdated.
  */
-static int
-remove_entry_if_stale(struct SessionHandle *data, struct Curl_dns_entry *dns)
+static struct Curl_dns_entry *
+check_entry(struct connectdata *conn, struct Curl_dns_entry *dns,
+            const char *hostname, int port, bool *stale)
 {
-  struct hostcache_prune_data user;
+  struct SessionHandle *data = conn->data;
+  struct Curl_dnscache *cache = data->dns.hostcache;
+  Curl_addrinfo *addr;
+  time_t expires;
+  time_t now;
+  int state;
+
+  *stale = FALSE;
+
+  if(dns->refresh &&
+     Curl_resolver_refresh_done(dns->refresh, &addr, &expires)) {
+    /* the refresh is done, replace the outdated entry */
+    Curl_hash_delete(&cache->hash, dns->id, dns->idlen+1);
+    if(!addr)
+      return NULL;
+    dns = Curl_cache_addr(data, addr, hostname, port);
+    if(!dns) {
+      Curl_freeaddrinfo(addr);
+      return NULL;
+    }
+    if(expires)
+      Curl_dnscache_expire(cache, dns, expires);
+    dns_drop(dns); /* not used until the caller says so */
+    return dns;
+  }
 
-  if(!dns || (data->set.dns_cache_timeout == -1) || !data->dns.hostcache)
-    /* cache forever means never prune, and NULL hostcache means
-       we can't do it */
-    return 0;
+  time(&now);
+  state = entry_state(data, dns, now);
 
-  time(&user.now);
-  user.cache_timeout = data->set.dns_cache_timeout;
+  if(state == DNS_ENTRY_FRESH)
+    return dns;
 
-  if(!hostcache_timestamp_remove(&user,dns) )
-    return 0;
+  if(state == DNS_ENTRY_STALE) {
+    if(!dns->refresh)
+      dns->refresh = Curl_resolver_refresh(conn, hostname, port);
+    if(dns->refresh) {
+      *stale = TRUE;
+      return dns;
+    }
+  }
 
-  Curl_hash_clean_with_criterium(data->dns.hostcache,
-                                 (void *) &user,
-                                 hostcache_timestamp_remove);
+  /* remove it (which may free it) and whatever else is outdated */
+  Curl_hash_delete(&cache->hash, dns->id, dns->idlen+1);
+  if(data->set.dns_cache_timeout != -1)
+    hostcache_prune(cache, data->set.dns_cache_timeout,
+                    data->set.dns_cache_stale, now);
 
-  return 1;
+  return NULL;
 }
 
 
@@ -315,63 +913,154 @@ sigjmp_buf curl_jmpenv;
 
 
 /*
- * Curl_cache_addr() stores a 'Curl_addrinfo' struct in the DNS cache.
- *
- * When calling Curl_resolv() has resulted in a response with a returned
- * address, we call this function to store the information in the dns
- * cache etc
+ * Curl_dnscache_add() stores a 'Curl_addrinfo' struct in the given DNS cache.
+ * This assumes that a lock has already been taken.
  *
  * Returns the Curl_dns_entry entry pointer or NULL if the storage failed.
  */
 struct Curl_dns_entry *
-Curl_cache_addr(struct SessionHandle *data,
-                Curl_addrinfo *addr,
-                const char *hostname,
-                int port)
+Curl_dnscache_add(struct Curl_dnscache *cache,
+                  Curl_addrinfo *addr,
+                  const char *hostname,
+                  int port)
 {
-  char *entry_id;
-  size_t entry_len;
+  struct hostcache_id key;
   struct Curl_dns_entry *dns;
   struct Curl_dns_entry *dns2;
 
   /* Create an entry id, based upon the hostname and port */
-  entry_id = create_hostcache_id(hostname, port);
-  /* If we can't create the entry id, fail */
-  if(!entry_id)
+  if(!create_hostcache_id(hostname, port, &key))
     return NULL;
-  entry_len = strlen(entry_id);
 
-  /* Create a new cache entry */
-  dns = calloc(1, sizeof(struct Curl_dns_entry));
+  /* Create a new cache entry, with room for a copy of the id */
+  dns = calloc(1, sizeof(struct Curl_dns_entry) + key.len);
   if(!dns) {
-    free(entry_id);
+    free_hostcache_id(&key);
     return NULL;
   }
 
   dns->inuse = 0;   /* init to not used */
   dns->addr = addr; /* this is the address(es) */
+  dns->id = (char *)(dns + 1);
+  dns->idlen = key.len - 1;
+  memcpy(dns->id, key.id, key.len);
+  free_hostcache_id(&key);
   time(&dns->timestamp);
   if(dns->timestamp == 0)
     dns->timestamp = 1;   /* zero indicates that entry isn't in hash table */
 
   /* Store the resolved data in our DNS cache. */
-  dns2 = Curl_hash_add(data->dns.hostcache, entry_id, entry_len+1,
-                       (void *)dns);
+  dns2 = Curl_hash_add(&cache->hash, dns->id, dns->idlen+1, (void *)dns);
   if(!dns2) {
     free(dns);
-    free(entry_id);
     return NULL;
   }
 
+  /* keep the lists short however many names get cached, a cache that can't
+     grow still works */
+  if(cache->hash.size > (size_t)cache->hash.slots * HOSTCACHE_LOAD)
+    (void)Curl_hash_resize(&cache->hash, cache->hash.slots * 2 + 1);
+
   dns = dns2;
   dns->inuse++;         /* mark entry as in-use */
 
-  /* free the allocated entry_id */
-  free(entry_id);
+#ifdef DNS_LOCKFREE
+  if(cache == &hostname_cache) {
+    /* the global cache holds a use of its own, see global_reclaim() */
+    dns->global = TRUE;
+    dns->inuse++;
+    index_add(dns);
+  }
+#endif
+
+  /* it is the newest entry in the cache */
+  dns->older = cache->age.older;
+  dns->newer = &cache->age;
+  dns->older->newer = dns;
+  dns->newer->older = dns;
 
   return dns;
 }
 
+/*
+ * Curl_cache_addr() stores a 'Curl_addrinfo' struct in the DNS cache.
+ *
+ * When calling Curl_resolv() has resulted in a response with a returned
+ * address, we call this function to store the information in the dns
+ * cache etc
+ *
+ * Returns the Curl_dns_entry entry pointer or NULL if the storage failed.
+ */
+struct Curl_dns_entry *
+Curl_cache_addr(struct SessionHandle *data,
+                Curl_addrinfo *addr,
+                const char *hostname,
+                int port)
+{
+  return Curl_dnscache_add(data->dns.hostcache, addr, hostname, port);
+}
+
+/*
+ * Curl_cache_negative() stores a failed lookup of the name in the DNS cache,
+ * if the handle wants failures to be cached. It takes and releases the lock
+ * of the cache.
+ */
+void Curl_cache_negative(struct SessionHandle *data,
+                         const char *hostname, int port)
+{
+  struct Curl_dns_entry *dns;
+
+  if(data->set.dns_negative_timeout <= 0)
+    return;
+
+  Curl_dnscache_lock(data);
+
+  dns = Curl_cache_addr(data, NULL, hostname, port);
+  if(dns) {
+    Curl_dnscache_expire(data->dns.hostcache, dns,
+                         dns->timestamp + data->set.dns_negative_timeout);
+    dns_drop(dns); /* nobody uses it */
+  }
+
+  Curl_dnscache_unlock(data);
+}
+
+/*
+ * Curl_cache_copy() stores a copy of the addresses in the given DNS cache,
+ * taking the lock of the cache of 'data' if there is a handle. The entry is
+ * not in use and expires at 'expires', unless that is 0. Returns FALSE if
+ * out of memory.
+ */
+bool Curl_cache_copy(struct SessionHandle *data, struct Curl_dnscache *cache,
+                     const Curl_addrinfo *addr, const char *hostname,
+                     int port, time_t expires)
+{
+  struct Curl_dns_entry *dns;
+  Curl_addrinfo *copy = Curl_dupaddrinfo(addr);
+
+  if(!copy)
+    return FALSE;
+
+  if(data)
+    Curl_dnscache_lock(data);
+
+  dns = Curl_dnscache_add(cache, copy, hostname, port);
+  if(dns) {
+    if(expires)
+      Curl_dnscache_expire(cache, dns, expires);
+    dns_drop(dns); /* nobody uses it */
+  }
+
+  if(data)
+    Curl_dnscache_unlock(data);
+
+  if(!dns) {
+    Curl_freeaddrinfo(copy);
+    return FALSE;
+  }
+  return TRUE;
+}
+
 /*
  * Curl_resolv() is the main name resolve function within libcurl. It resolves
  * a name and returns a pointer to the entry in the 'entry' argument (if one
@@ -398,45 +1087,69 @@ int Curl_resolv(struct connectdata *conn,
                 int port,
                 struct Curl_dns_entry **entry)
 {
-  char *entry_id = NULL;
+  struct hostcache_id key;
   struct Curl_dns_entry *dns = NULL;
-  size_t entry_len;
   struct SessionHandle *data = conn->data;
   CURLcode result;
   int rc = CURLRESOLV_ERROR; /* default to failure */
+  bool stale;
+  bool failed = FALSE;
 
   *entry = NULL;
 
   /* Create an entry id, based upon the hostname and port */
-  entry_id = create_hostcache_id(hostname, port);
-  /* If we can't create the entry id, fail */
-  if(!entry_id)
-    return rc;
-
-  entry_len = strlen(entry_id);
+  if(!create_hostcache_id(hostname, port, &key))
+    return CURLRESOLV_ERROR;
+
+#ifdef DNS_LOCKFREE
+  if(data->dns.hostcachetype == HCACHE_GLOBAL) {
+    dns = global_fetch(data, &key);
+    if(dns) {
+      free_hostcache_id(&key);
+      data->info.dns_cache_hits++;
+      *entry = dns;
+      return CURLRESOLV_RESOLVED;
+    }
+  }
+#endif
 
-  if(data->share)
-    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+  Curl_dnscache_lock(data);
 
   /* See if its already in our dns cache */
-  dns = Curl_hash_pick(data->dns.hostcache, entry_id, entry_len+1);
-
-  /* free the allocated entry_id again */
-  free(entry_id);
+  dns = Curl_hash_str_pick(&data->dns.hostcache->hash, key.id, key.len,
+                           key.hv);
+  free_hostcache_id(&key);
 
-  /* See whether the returned entry is stale. Done before we release lock */
-  if(remove_entry_if_stale(data, dns))
-    dns = NULL; /* the memory deallocation is being handled by the hash */
+  /* See whether the returned entry can be used. Done before we release
+     lock */
+  if(dns)
+    dns = check_entry(conn, dns, hostname, port, &stale);
 
   if(dns) {
-    dns->inuse++; /* we use it! */
-    rc = CURLRESOLV_RESOLVED;
+    if(stale)
+      data->info.dns_cache_stale++;
+    else
+      data->info.dns_cache_hits++;
+
+    if(dns->addr) {
+      dns_hold(dns); /* we use it! */
+      rc = CURLRESOLV_RESOLVED;
+    }
+    else {
+      /* the name failed to resolve a moment ago */
+      failed = TRUE;
+      dns = NULL;
+    }
   }
+  else
+    data->info.dns_cache_misses++;
 
-  if(data->share)
-    Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+  Curl_dnscache_unlock(data);
 
-  if(!dns) {
+  if(failed)
+    infof(data, "%s failed to resolve recently, not retried yet\n",
+          hostname);
+  else if(!dns) {
     /* The entry was not in the cache. Resolve it to IP address */
 
     Curl_addrinfo *addr;
@@ -471,16 +1184,16 @@ int Curl_resolv(struct connectdata *conn,
         else
           rc = CURLRESOLV_PENDING; /* no info yet */
       }
+      /* a synchronous resolve doesn't say why it failed, so the failure is
+         not cached */
     }
     else {
-      if(data->share)
-        Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+      Curl_dnscache_lock(data);
 
       /* we got a response, store it in the cache */
       dns = Curl_cache_addr(data, addr, hostname, port);
 
-      if(data->share)
-        Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+      Curl_dnscache_unlock(data);
 
       if(!dns)
         /* returned failure, bail out nicely */
@@ -686,8 +1399,17 @@ void Curl_resolv_unlock(struct SessionHandle *data, struct Curl_dns_entry *dns)
 {
   DEBUGASSERT(dns && (dns->inuse>0));
 
-  if(data->share)
-    Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+#ifdef DNS_LOCKFREE
+  if(dns->global) {
+    /* the last use of an entry of the global cache frees it, be it this one
+       or the one of the cache */
+    if(!dns_drop(dns))
+      free_dns_entry(dns);
+    return;
+  }
+#endif
+
+  Curl_dnscache_lock(data);
 
   dns->inuse--;
   /* only free if nobody is using AND it is not in hostcache (timestamp ==
@@ -697,8 +1419,7 @@ void Curl_resolv_unlock(struct SessionHandle *data, struct Curl_dns_entry *dns)
     free(dns);
   }
 
-  if(data->share)
-    Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+  Curl_dnscache_unlock(data);
 }
 
 /*
@@ -710,6 +1431,29 @@ static void freednsentry(void *freethis)
 
   /* mark the entry as not in hostcache */
   p->timestamp = 0;
+  if(p->refresh) {
+    Curl_resolver_refresh_free(p->refresh);
+    p->refresh = NULL;
+  }
+  if(p->older) {
+    p->older->newer = p->newer;
+    p->newer->older = p->older;
+    p->older = p->newer = NULL;
+  }
+  if(p->sooner) {
+    p->sooner->later = p->later;
+    p->later->sooner = p->sooner;
+    p->sooner = p->later = NULL;
+  }
+#ifdef DNS_LOCKFREE
+  if(p->global) {
+    /* readers may still be looking at it, it is freed later */
+    index_remove(p);
+    p->older = global_dns_old_entries;
+    global_dns_old_entries = p;
+    return;
+  }
+#endif
   if(p->inuse == 0) {
     Curl_freeaddrinfo(p->addr);
     free(p);
@@ -719,9 +1463,33 @@ static void freednsentry(void *freethis)
 /*
  * Curl_mk_dnscache() creates a new DNS cache and returns the handle for it.
  */
-struct curl_hash *Curl_mk_dnscache(void)
+static int dnscache_init(struct Curl_dnscache *cache)
 {
-  return Curl_hash_alloc(7, Curl_hash_str, Curl_str_key_compare, freednsentry);
+  cache->age.older = cache->age.newer = &cache->age;
+  cache->expiring.sooner = cache->expiring.later = &cache->expiring;
+  return Curl_hash_init(&cache->hash, HOSTCACHE_SLOTS, Curl_hash_str,
+                        Curl_str_key_compare, freednsentry);
+}
+
+struct Curl_dnscache *Curl_mk_dnscache(void)
+{
+  struct Curl_dnscache *cache = malloc(sizeof(struct Curl_dnscache));
+  if(cache && dnscache_init(cache)) {
+    free(cache);
+    cache = NULL;
+  }
+  return cache;
+}
+
+/*
+ * Curl_dnscache_destroy() frees a DNS cache and all its entries.
+ */
+void Curl_dnscache_destroy(struct Curl_dnscache *cache)
+{
+  if(cache) {
+    Curl_hash_clean(&cache->hash);
+    free(cache);
+  }
 }
 
 static int hostcache_inuse(void *data, void *hc)
@@ -740,13 +1508,14 @@ void Curl_hostcache_clean(struct SessionHandle *data)
    * still present in the cache with the inuse counter set to 1. Detect them
    * and cleanup!
    */
-  Curl_hash_clean_with_criterium(data->dns.hostcache, data, hostcache_inuse);
+  Curl_hash_clean_with_criterium(&data->dns.hostcache->hash, data,
+                                 hostcache_inuse);
 }
 
 void Curl_hostcache_destroy(struct SessionHandle *data)
 {
   Curl_hostcache_clean(data);
-  Curl_hash_destroy(data->dns.hostcache);
+  Curl_dnscache_destroy(data->dns.hostcache);
   data->dns.hostcachetype = HCACHE_NONE;
   data->dns.hostcache = NULL;
 }
@@ -768,8 +1537,7 @@ CURLcode Curl_loadhostpairs(struct SessionHandle *data)
                         address)) {
       struct Curl_dns_entry *dns;
       Curl_addrinfo *addr;
-      char *entry_id;
-      size_t entry_len;
+      struct hostcache_id key;
 
       addr = Curl_str2addr(address, port);
       if(!addr) {
@@ -778,33 +1546,26 @@ CURLcode Curl_loadhostpairs(struct SessionHandle *data)
       }
 
       /* Create an entry id, based upon the hostname and port */
-      entry_id = create_hostcache_id(hostname, port);
-      /* If we can't create the entry id, fail */
-      if(!entry_id) {
+      if(!create_hostcache_id(hostname, port, &key)) {
         Curl_freeaddrinfo(addr);
         return CURLE_OUT_OF_MEMORY;
       }
 
-      entry_len = strlen(entry_id);
-
-      if(data->share)
-        Curl_share_lock(data, CURL_LOCK_DATA_DNS, CURL_LOCK_ACCESS_SINGLE);
+      Curl_dnscache_lock(data);
 
       /* See if its already in our dns cache */
-      dns = Curl_hash_pick(data->dns.hostcache, entry_id, entry_len+1);
+      dns = Curl_hash_str_pick(&data->dns.hostcache->hash, key.id, key.len,
+                               key.hv);
+      free_hostcache_id(&key);
 
-      /* free the allocated entry_id again */
-      free(entry_id);
-
-      if(!dns)
+      if(!dns || !dns->addr)
         /* if not in the cache already, put this host in the cache */
         dns = Curl_cache_addr(data, addr, hostname, port);
       else
         /* this is a duplicate, free it again */
         Curl_freeaddrinfo(addr);
 
-      if(data->share)
-        Curl_share_unlock(data, CURL_LOCK_DATA_DNS);
+      Curl_dnscache_unlock(data);
 
       if(!dns) {
         Curl_freeaddrinfo(addr);
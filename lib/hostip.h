@@ -60,16 +60,40 @@ struct connectdata;
  *
  * Returns a struct curl_hash pointer on success, NULL on failure.
  */
-struct curl_hash *Curl_global_host_cache_init(void);
+struct Curl_dnscache *Curl_global_host_cache_init(void);
+void Curl_global_host_cache_ctor(void);
 void Curl_global_host_cache_dtor(void);
 
 struct Curl_dns_entry {
-  Curl_addrinfo *addr;
+  Curl_addrinfo *addr; /* NULL if the entry holds a failed lookup */
   /* timestamp == 0 -- entry not in hostcache
      timestamp != 0 -- entry is in hostcache */
   time_t timestamp;
+  time_t expires;  /* the entry must not be used after this time, set when
+                      the resolver knows the time to live, 0 otherwise */
+  void *refresh;   /* the lookup refreshing this outdated entry */
   long inuse;      /* use-counter, make very sure you decrease this
                       when you're done using the address you received */
+  bool global;     /* in the global DNS cache, which then holds one use of
+                      the entry itself, see hostip.c */
+  /* the entries of a cache are linked in the order they were added, which
+     is the order they get old in */
+  struct Curl_dns_entry *older;
+  struct Curl_dns_entry *newer;
+  /* the entries with an expiry time of their own are also linked in the
+     order they expire */
+  struct Curl_dns_entry *sooner;
+  struct Curl_dns_entry *later;
+  char *id;        /* the hash key, stored after the struct */
+  size_t idlen;
+};
+
+/* a DNS cache, shared by the handles of a multi or a share object */
+struct Curl_dnscache {
+  struct curl_hash hash; /* "host:port" => struct Curl_dns_entry */
+  struct Curl_dns_entry age; /* list head, age.newer is the oldest entry */
+  struct Curl_dns_entry expiring; /* list head, expiring.later is the entry
+                                     that expires first */
 };
 
 /*
@@ -126,11 +150,27 @@ void Curl_resolv_unlock(struct SessionHandle *data,
 void Curl_scan_cache_used(void *user, void *ptr);
 
 /* make a new dns cache and return the handle */
-struct curl_hash *Curl_mk_dnscache(void);
+struct Curl_dnscache *Curl_mk_dnscache(void);
+
+/* destroy a dns cache made with Curl_mk_dnscache() */
+void Curl_dnscache_destroy(struct Curl_dnscache *cache);
+
+/* store an address in the given dns cache, see Curl_cache_addr() */
+struct Curl_dns_entry *
+Curl_dnscache_add(struct Curl_dnscache *cache, Curl_addrinfo *addr,
+                  const char *hostname, int port);
+
+/* set the time an entry of the given dns cache expires at */
+void Curl_dnscache_expire(struct Curl_dnscache *cache,
+                          struct Curl_dns_entry *dns, time_t expires);
 
 /* prune old entries from the DNS cache */
 void Curl_hostcache_prune(struct SessionHandle *data);
 
+/* lock and unlock the DNS cache the handle uses */
+void Curl_dnscache_lock(struct SessionHandle *data);
+void Curl_dnscache_unlock(struct SessionHandle *data);
+
 /* Return # of adresses in a Curl_addrinfo struct */
 int Curl_num_addresses (const Curl_addrinfo *addr);
 
@@ -180,6 +220,23 @@ struct Curl_dns_entry *
 Curl_cache_addr(struct SessionHandle *data, Curl_addrinfo *addr,
                 const char *hostname, int port);
 
+/*
+ * Curl_cache_negative() stores a failed lookup of the name in the DNS cache
+ * if CURLOPT_DNS_NEGATIVE_TIMEOUT asks for that.
+ */
+void Curl_cache_negative(struct SessionHandle *data,
+                         const char *hostname, int port);
+
+/*
+ * Curl_cache_copy() stores a copy of the addresses in a DNS cache, for a
+ * name resolved ahead of the transfers. 'data' is a handle using the cache,
+ * to lock it, or NULL if the cache is not shared. 'expires' is when the
+ * addresses expire, 0 if not known.
+ */
+bool Curl_cache_copy(struct SessionHandle *data, struct Curl_dnscache *cache,
+                     const Curl_addrinfo *addr, const char *hostname,
+                     int port, time_t expires);
+
 #ifndef INADDR_NONE
 #define CURL_INADDR_NONE (in_addr_t) ~0
 #else
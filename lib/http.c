@@ -71,6 +71,8 @@
 #include "rawstr.h"
 #include "content_encoding.h"
 #include "http_proxy.h"
+#include "httpcache.h"
+#include "http2.h"
 #include "warnless.h"
 #include "non-ascii.h"
 
@@ -88,6 +90,8 @@ static int http_getsock_do(struct connectdata *conn,
                            curl_socket_t *socks,
                            int numsocks);
 static int http_should_fail(struct connectdata *conn);
+static CURLcode http_disconnect(struct connectdata *conn,
+                                bool dead_connection);
 
 #ifdef USE_SSL
 static CURLcode https_connecting(struct connectdata *conn, bool *done);
@@ -114,7 +118,7 @@ const struct Curl_handler Curl_handler_http = {
   http_getsock_do,                      /* doing_getsock */
   ZERO_NULL,                            /* domore_getsock */
   ZERO_NULL,                            /* perform_getsock */
-  ZERO_NULL,                            /* disconnect */
+  http_disconnect,                      /* disconnect */
   ZERO_NULL,                            /* readwrite */
   PORT_HTTP,                            /* defport */
   CURLPROTO_HTTP,                       /* protocol */
@@ -138,7 +142,7 @@ const struct Curl_handler Curl_handler_https = {
   http_getsock_do,                      /* doing_getsock */
   ZERO_NULL,                            /* domore_getsock */
   ZERO_NULL,                            /* perform_getsock */
-  ZERO_NULL,                            /* disconnect */
+  http_disconnect,                      /* disconnect */
   ZERO_NULL,                            /* readwrite */
   PORT_HTTPS,                           /* defport */
   CURLPROTO_HTTP | CURLPROTO_HTTPS,     /* protocol */
@@ -171,7 +175,7 @@ char *Curl_checkheaders(struct SessionHandle *data, const char *thisheader)
  * case of allocation failure. Returns an empty string if the header value
  * consists entirely of whitespace.
  */
-static char *copy_header_value(const char *h)
+char *Curl_copy_header_value(const char *h)
 {
   const char *start;
   const char *end;
@@ -1335,6 +1339,17 @@ static int http_getsock_do(struct connectdata *conn,
   return GETSOCK_WRITESOCK(0);
 }
 
+/*
+ * http_disconnect() frees the connection's HTTP/2 state, if any.
+ */
+static CURLcode http_disconnect(struct connectdata *conn,
+                                bool dead_connection)
+{
+  (void)dead_connection;
+  Curl_http2_cleanup(conn);
+  return CURLE_OK;
+}
+
 #ifdef USE_SSL
 static CURLcode https_connecting(struct connectdata *conn, bool *done)
 {
@@ -1404,6 +1419,8 @@ CURLcode Curl_http_done(struct connectdata *conn,
 
   Curl_unencode_cleanup(conn);
 
+  Curl_http2_done(conn, premature);
+
   /* set the proper values (possibly modified on POST) */
   conn->fread_func = data->set.fread_func; /* restore */
   conn->fread_in = data->set.in; /* restore */
@@ -1450,6 +1467,9 @@ CURLcode Curl_http_done(struct connectdata *conn,
     return CURLE_GOT_NOTHING;
   }
 
+  if(!premature)
+    return Curl_httpcache_done(conn);
+
   return CURLE_OK;
 }
 
@@ -1477,7 +1497,7 @@ static CURLcode expect100(struct SessionHandle *data,
   const char *ptr;
   data->state.expect100header = FALSE; /* default to false unless it is set
                                           to TRUE below */
-  if(use_http_1_1(data, conn)) {
+  if(use_http_1_1(data, conn) && (conn->httpversion != 20)) {
     /* if not doing HTTP 1.0 or disabled explicitly, we add a Expect:
        100-continue to the headers which actually speeds up post operations
        (as there is one packet coming back from the web server) */
@@ -1496,11 +1516,73 @@ static CURLcode expect100(struct SessionHandle *data,
   return result;
 }
 
+/* the conditions Curl_add_custom_headers() filters the custom headers by */
+#define CUSTOM_NOHOST   (1<<0) /* a Host: header is sent already */
+#define CUSTOM_FORMPOST (1<<1) /* formdata.c sends the Content-Type: */
+#define CUSTOM_AUTHNEG  (1<<2) /* zero length auth negotiation request */
+#define CUSTOM_TE       (1<<3) /* the Connection: header is made for TE: */
+
+/*
+ * A summary of the nodes of the list and the strings they point to. The
+ * application may add to or remove from the list it passed in, after it has
+ * been used, without setting it again. curl_slist_append() then returns the
+ * same head, but this changes.
+ */
+static size_t custom_headers_sig(const struct curl_slist *list,
+                                 size_t *count)
+{
+  size_t sig = 0;
+
+  *count = 0;
+  for(; list; list = list->next) {
+    sig = sig * 31 + (size_t)list;
+    sig = sig * 31 + (size_t)list->data;
+    (*count)++;
+  }
+  return sig;
+}
+
+/*
+ * Curl_add_custom_headers() adds the CURLOPT_HTTPHEADER lines to the
+ * request. The lines are mostly the same for every request made with the
+ * handle, so the rendered block is kept and copied into subsequent requests
+ * that are filtered with the same conditions, as long as the list still has
+ * the same nodes and strings.
+ */
 CURLcode Curl_add_custom_headers(struct connectdata *conn,
                                    Curl_send_buffer *req_buffer)
 {
+  struct SessionHandle *data = conn->data;
   char *ptr;
-  struct curl_slist *headers=conn->data->set.headers;
+  struct curl_slist *headers = data->set.headers;
+  size_t start = req_buffer->size_used;
+  int mask = 0;
+  size_t count;
+  size_t sig;
+
+  if(!headers)
+    return CURLE_OK;
+
+  if(conn->allocptr.host)
+    mask |= CUSTOM_NOHOST;
+  if(data->set.httpreq == HTTPREQ_POST_FORM)
+    mask |= CUSTOM_FORMPOST;
+  if(conn->bits.authneg)
+    mask |= CUSTOM_AUTHNEG;
+  if(conn->allocptr.te)
+    mask |= CUSTOM_TE;
+
+  sig = custom_headers_sig(headers, &count);
+
+  if(data->state.customheaders && (data->state.customheadersmask == mask) &&
+     (data->state.customheaderslist == headers) &&
+     (data->state.customheaderscount == count) &&
+     (data->state.customheaderssig == sig)) {
+    if(!data->state.customheaderslen)
+      return CURLE_OK;
+    return Curl_add_buffer(req_buffer, data->state.customheaders,
+                           data->state.customheaderslen);
+  }
 
   while(headers) {
     ptr = strchr(headers->data, ':');
@@ -1514,28 +1596,30 @@ CURLcode Curl_add_custom_headers(struct connectdata *conn,
       if(*ptr) {
         /* only send this if the contents was non-blank */
 
-        if(conn->allocptr.host &&
+        if((mask & CUSTOM_NOHOST) &&
            /* a Host: header was sent already, don't pass on any custom Host:
               header as that will produce *two* in the same request! */
            checkprefix("Host:", headers->data))
           ;
-        else if(conn->data->set.httpreq == HTTPREQ_POST_FORM &&
+        else if((mask & CUSTOM_FORMPOST) &&
                 /* this header (extended by formdata.c) is sent later */
                 checkprefix("Content-Type:", headers->data))
           ;
-        else if(conn->bits.authneg &&
+        else if((mask & CUSTOM_AUTHNEG) &&
                 /* while doing auth neg, don't allow the custom length since
                    we will force length zero then */
                 checkprefix("Content-Length", headers->data))
           ;
-        else if(conn->allocptr.te &&
+        else if((mask & CUSTOM_TE) &&
                 /* when asking for Transfer-Encoding, don't pass on a custom
                    Connection: */
                 checkprefix("Connection", headers->data))
           ;
         else {
-          CURLcode result = Curl_add_bufferf(req_buffer, "%s\r\n",
-                                             headers->data);
+          CURLcode result = Curl_add_buffer(req_buffer, headers->data,
+                                            strlen(headers->data));
+          if(!result)
+            result = Curl_add_buffer(req_buffer, "\r\n", 2);
           if(result)
             return result;
         }
@@ -1558,8 +1642,10 @@ CURLcode Curl_add_custom_headers(struct connectdata *conn,
 
             /* send no-value custom header if terminated by semicolon */
             *ptr = ':';
-            result = Curl_add_bufferf(req_buffer, "%s\r\n",
-                                             headers->data);
+            result = Curl_add_buffer(req_buffer, headers->data,
+                                     strlen(headers->data));
+            if(!result)
+              result = Curl_add_buffer(req_buffer, "\r\n", 2);
             if(result)
               return result;
           }
@@ -1568,6 +1654,22 @@ CURLcode Curl_add_custom_headers(struct connectdata *conn,
     }
     headers = headers->next;
   }
+
+  /* keep the rendered lines for the next request, a failure to do so is not
+     a problem for this one */
+  Curl_safefree(data->state.customheaders);
+  data->state.customheaderslen = req_buffer->size_used - start;
+  data->state.customheaders = malloc(data->state.customheaderslen + 1);
+  if(data->state.customheaders) {
+    if(data->state.customheaderslen)
+      memcpy(data->state.customheaders, req_buffer->buffer + start,
+             data->state.customheaderslen);
+    data->state.customheaders[data->state.customheaderslen] = 0;
+    data->state.customheadersmask = mask;
+    data->state.customheaderslist = data->set.headers;
+    data->state.customheaderscount = count;
+    data->state.customheaderssig = sig;
+  }
   return CURLE_OK;
 }
 
@@ -1790,6 +1892,9 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
       if(conn->bits.authneg)
         /* don't enable chunked during auth neg */
         ;
+      else if(conn->httpversion == 20)
+        /* HTTP/2 frames the body, the end of the stream ends it */
+        ;
       else if(use_http_1_1(data, conn)) {
         /* HTTP, upload, unknown file size and not HTTP 1.0 */
         data->req.upload_chunky = TRUE;
@@ -1819,7 +1924,7 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
        custom Host: header if this is NOT a redirect, as setting Host: in the
        redirected request is being out on thin ice. Except if the host name
        is the same as the first one! */
-    char *cookiehost = copy_header_value(ptr);
+    char *cookiehost = Curl_copy_header_value(ptr);
     if(!cookiehost)
       return CURLE_OUT_OF_MEMORY;
     if(!*cookiehost)
@@ -2098,9 +2203,19 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
   if(!req_buffer)
     return CURLE_OUT_OF_MEMORY;
 
+  if(data->state.reqsize_hint) {
+    /* allocate room for a request the size of the previous one up front
+       rather than growing the buffer repeatedly while adding to it */
+    req_buffer->buffer = malloc(data->state.reqsize_hint);
+    if(req_buffer->buffer)
+      req_buffer->size_max = data->state.reqsize_hint;
+  }
+
   /* add the main request stuff */
   /* GET/HEAD/POST/PUT */
-  result = Curl_add_bufferf(req_buffer, "%s ", request);
+  result = Curl_add_buffer(req_buffer, request, strlen(request));
+  if(!result)
+    result = Curl_add_buffer(req_buffer, " ", 1);
   if(result)
     return result;
 
@@ -2114,48 +2229,39 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
   if(result)
     return result;
 
-  result =
-    Curl_add_bufferf(req_buffer,
-                     "%s" /* ftp typecode (;type=x) */
-                     " HTTP/%s\r\n" /* HTTP version */
-                     "%s" /* proxyuserpwd */
-                     "%s" /* userpwd */
-                     "%s" /* range */
-                     "%s" /* user agent */
-                     "%s" /* host */
-                     "%s" /* accept */
-                     "%s" /* TE: */
-                     "%s" /* accept-encoding */
-                     "%s" /* referer */
-                     "%s" /* Proxy-Connection */
-                     "%s",/* transfer-encoding */
-
-                     ftp_typecode,
-                     httpstring,
-                     conn->allocptr.proxyuserpwd?
-                     conn->allocptr.proxyuserpwd:"",
-                     conn->allocptr.userpwd?conn->allocptr.userpwd:"",
-                     (data->state.use_range && conn->allocptr.rangeline)?
-                     conn->allocptr.rangeline:"",
-                     (data->set.str[STRING_USERAGENT] &&
-                      *data->set.str[STRING_USERAGENT] &&
-                      conn->allocptr.uagent)?
-                     conn->allocptr.uagent:"",
-                     (conn->allocptr.host?conn->allocptr.host:""),
-                     http->p_accept?http->p_accept:"",
-                     conn->allocptr.te?conn->allocptr.te:"",
-                     (data->set.str[STRING_ENCODING] &&
-                      *data->set.str[STRING_ENCODING] &&
-                      conn->allocptr.accept_encoding)?
-                     conn->allocptr.accept_encoding:"",
-                     (data->change.referer && conn->allocptr.ref)?
-                     conn->allocptr.ref:"" /* Referer: <data> */,
-                     (conn->bits.httpproxy &&
-                      !conn->bits.tunnel_proxy &&
-                      !Curl_checkheaders(data, "Proxy-Connection:"))?
-                     "Proxy-Connection: Keep-Alive\r\n":"",
-                     te
-      );
+  {
+    /* The rest of the request line and the headers that are already made
+       are copied into the buffer as they are, without the overhead of
+       formatting them with printf() */
+    const char *line[15];
+    size_t i;
+
+    line[0] = ftp_typecode;
+    line[1] = " HTTP/";
+    line[2] = httpstring; /* HTTP version */
+    line[3] = "\r\n";
+    line[4] = conn->allocptr.proxyuserpwd;
+    line[5] = conn->allocptr.userpwd;
+    line[6] = data->state.use_range?conn->allocptr.rangeline:NULL;
+    line[7] = (data->set.str[STRING_USERAGENT] &&
+               *data->set.str[STRING_USERAGENT])?conn->allocptr.uagent:NULL;
+    line[8] = conn->allocptr.host;
+    line[9] = http->p_accept;
+    line[10] = conn->allocptr.te; /* TE: */
+    line[11] = (data->set.str[STRING_ENCODING] &&
+                *data->set.str[STRING_ENCODING])?
+      conn->allocptr.accept_encoding:NULL;
+    line[12] = data->change.referer?conn->allocptr.ref:NULL;
+    line[13] = (conn->bits.httpproxy &&
+                !conn->bits.tunnel_proxy &&
+                !Curl_checkheaders(data, "Proxy-Connection:"))?
+      "Proxy-Connection: Keep-Alive\r\n":NULL;
+    line[14] = te; /* transfer-encoding */
+
+    for(i = 0; !result && (i < sizeof(line)/sizeof(line[0])); i++)
+      if(line[i] && *line[i])
+        result = Curl_add_buffer(req_buffer, line[i], strlen(line[i]));
+  }
 
   /*
    * Free userpwd now --- cannot reuse this for Negotiate and possibly NTLM
@@ -2188,14 +2294,15 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
       /* now loop through all cookies that matched */
       while(co) {
         if(co->value) {
-          if(0 == count) {
-            result = Curl_add_bufferf(req_buffer, "Cookie: ");
-            if(result)
-              break;
-          }
-          result = Curl_add_bufferf(req_buffer,
-                                    "%s%s=%s", count?"; ":"",
-                                    co->name, co->value);
+          result = count?Curl_add_buffer(req_buffer, "; ", 2):
+            Curl_add_buffer(req_buffer, "Cookie: ", 8);
+          if(!result)
+            result = Curl_add_buffer(req_buffer, co->name, strlen(co->name));
+          if(!result)
+            result = Curl_add_buffer(req_buffer, "=", 1);
+          if(!result)
+            result = Curl_add_buffer(req_buffer, co->value,
+                                     strlen(co->value));
           if(result)
             break;
           count++;
@@ -2227,11 +2334,28 @@ CURLcode Curl_http(struct connectdata *conn, bool *done)
     if(result)
       return result;
   }
+  else {
+    result = Curl_httpcache_conditions(data, req_buffer);
+    if(result)
+      return result;
+  }
 
   result = Curl_add_custom_headers(conn, req_buffer);
   if(result)
     return result;
 
+  /* the next request is likely to be about as large, with some room for the
+     few headers still to come */
+  data->state.reqsize_hint = req_buffer->size_used + 256;
+
+  if((data->set.httpversion == CURL_HTTP_VERSION_2_0) &&
+     (conn->httpversion != 20)) {
+    /* ask to continue with HTTP/2 on this connection */
+    result = Curl_http2_request_upgrade(req_buffer, conn);
+    if(result)
+      return result;
+  }
+
   http->postdata = NULL;  /* nothing to post at this point */
   Curl_pgrsSetUploadSize(data, 0); /* upload size is 0 atm */
 
@@ -2763,6 +2887,7 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
     size_t rest_length;
     size_t full_length;
     int writetype;
+    bool hide; /* don't pass this header on to the application */
 
     /* str_start is start of line within buf */
     k->str_start = k->str;
@@ -2865,12 +2990,23 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
           k->exp100 = EXP100_SEND_DATA;
           k->keepon |= KEEP_SEND;
         }
+
+        if((k->httpcode == 101) && (k->upgr101 == UPGR101_REQUESTED)) {
+          /* switching to HTTP/2, the rest of the buffer is HTTP/2 frames
+             and the real response arrives on the new stream */
+          k->upgr101 = UPGR101_RECEIVED;
+          result = Curl_http2_switched(conn, k->str, *nread);
+          if(result)
+            return result;
+          k->str += *nread;
+          *nread = 0;
+        }
       }
       else {
         k->header = FALSE; /* no more header to parse! */
 
         if((k->size == -1) && !k->chunk && !conn->bits.close &&
-           (conn->httpversion >= 11) &&
+           (conn->httpversion >= 11) && (conn->httpversion != 20) &&
            !(conn->handler->protocol & CURLPROTO_RTSP) &&
            data->set.httpreq != HTTPREQ_HEAD) {
           /* On HTTP 1.1, when connection is not to get closed, but no
@@ -2902,12 +3038,19 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
 
       headerlen = k->p - data->state.headerbuff;
 
-      result = Curl_client_write(conn, writetype,
-                                 data->state.headerbuff,
-                                 headerlen);
+      result = Curl_httpcache_header(conn, data->state.headerbuff,
+                                     headerlen, &hide);
       if(result)
         return result;
 
+      if(!hide) {
+        result = Curl_client_write(conn, writetype,
+                                   data->state.headerbuff,
+                                   headerlen);
+        if(result)
+          return result;
+      }
+
       data->info.header_size += (long)headerlen;
       data->req.headerbytecount += (long)headerlen;
 
@@ -2978,6 +3121,10 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
          * If we requested a "no body", this is a good time to get
          * out and return home.
          */
+        result = Curl_httpcache_headers_done(conn);
+        if(result)
+          return result;
+
         if(data->set.opt_no_body)
           *stop_reading = TRUE;
         else {
@@ -3220,7 +3367,7 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
     }
     /* check for Content-Type: header lines to get the MIME-type */
     else if(checkprefix("Content-Type:", k->p)) {
-      char *contenttype = copy_header_value(k->p);
+      char *contenttype = Curl_copy_header_value(k->p);
       if(!contenttype)
         return CURLE_OUT_OF_MEMORY;
       if(!*contenttype)
@@ -3426,7 +3573,7 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
             checkprefix("Location:", k->p) &&
             !data->req.location) {
       /* this is the URL that the server advises us to use instead */
-      char *location = copy_header_value(k->p);
+      char *location = Curl_copy_header_value(k->p);
       if(!location)
         return CURLE_OUT_OF_MEMORY;
       if(!*location)
@@ -3467,10 +3614,16 @@ CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
       Curl_debug(data, CURLINFO_HEADER_IN,
                  k->p, (size_t)k->hbuflen, conn);
 
-    result = Curl_client_write(conn, writetype, k->p, k->hbuflen);
+    result = Curl_httpcache_header(conn, k->p, k->hbuflen, &hide);
     if(result)
       return result;
 
+    if(!hide) {
+      result = Curl_client_write(conn, writetype, k->p, k->hbuflen);
+      if(result)
+        return result;
+    }
+
     data->info.header_size += (long)k->hbuflen;
     data->req.headerbytecount += (long)k->hbuflen;
 
@@ -34,6 +34,7 @@ bool Curl_compareheader(const char *headerline,  /* line to check */
                         const char *content); /* content string to find */
 
 char *Curl_checkheaders(struct SessionHandle *data, const char *thisheader);
+char *Curl_copy_header_value(const char *h);
 
 /* ------------------------------------------------------------------------- */
 /*
@@ -141,6 +142,29 @@ struct HTTP {
                         points to an allocated send_buffer struct */
 };
 
+/* the length of the packed SETTINGS payload we send in HTTP2-Settings: */
+#define H2_BINSETTINGS_LEN 80
+
+struct nghttp2_session;
+
+/* HTTP/2 state of a connection, see http2.c */
+struct http_conn {
+#ifdef USE_NGHTTP2
+  struct nghttp2_session *h2;
+  /* the functions the HTTP/2 frames are sent and received with */
+  ssize_t (*send_underlying)(struct connectdata *conn, int sockindex,
+                             const void *buf, size_t len, CURLcode *err);
+  ssize_t (*recv_underlying)(struct connectdata *conn, int sockindex,
+                             char *buf, size_t len, CURLcode *err);
+  struct curl_llist *streams; /* one entry for each request in flight */
+  char *inbuf; /* buffer to receive frames into */
+  unsigned char binsettings[H2_BINSETTINGS_LEN]; /* our packed SETTINGS */
+  size_t binlen; /* length of the binsettings data */
+#else
+  int unused; /* prevent a compiler warning */
+#endif
+};
+
 CURLcode Curl_http_readwrite_headers(struct SessionHandle *data,
                                      struct connectdata *conn,
                                      ssize_t *nread,
@@ -0,0 +1,974 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+/*
+ * HTTP/2 over cleartext, reached with the HTTP/1.1 upgrade ("h2c"), on top
+ * of nghttp2. Once the server has switched protocols the connection's send
+ * and recv functions are replaced with ones that turn the HTTP/1.1
+ * formatted requests the rest of libcurl produces into HTTP/2 streams, and
+ * hand back each stream's response in HTTP/1.1 format. Every transfer using
+ * the connection owns one stream.
+ *
+ * This is not multiplexing. Transfers share an upgraded connection just
+ * like a HTTP/1.1 one: multi.c serves them in the order of the connection's
+ * pipelines, so the responses are read one after the other. Response data
+ * received for a stream further back is kept until its transfer reads it,
+ * and the flow control windows are only opened again for data that has
+ * been read, so libcurl never buffers more than one stream window for a
+ * transfer that waits for its turn. HTTP/2 over TLS (ALPN) and stream
+ * priorities are not supported.
+ */
+
+#include "curl_setup.h"
+
+#ifdef USE_NGHTTP2
+#include <nghttp2/nghttp2.h>
+
+#include "urldata.h"
+#include "http2.h"
+#include "http.h"
+#include "sendf.h"
+#include "curl_base64.h"
+#include "llist.h"
+#include "strtoofft.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+/* The last #include file should be: */
+#include "memdebug.h"
+
+/* size of the buffer frames are received into */
+#define H2_BUFSIZE 16384
+
+/* the receive window of each stream, this is the maximum amount of response
+   data buffered for a transfer that doesn't read it */
+#define H2_STREAM_WINDOW (256*1024)
+
+/* the receive window of the whole connection, large enough to not let
+   buffered streams stall the one that is being read */
+#define H2_CONN_WINDOW (32*1024*1024)
+
+/* we don't want any streams opened by the server */
+#define H2_MAX_CONCURRENT_STREAMS 100
+
+/* the state of one request on a HTTP/2 connection */
+struct h2_stream {
+  struct SessionHandle *data; /* the transfer owning the stream */
+  int32_t id;                 /* stream id, -1 before it is assigned */
+  Curl_send_buffer *header_recvbuf; /* response headers in HTTP/1 format */
+  size_t nread_header_recvbuf; /* amount of header_recvbuf already read */
+  char *body;                 /* received response body not read yet */
+  size_t bodypos;             /* first unread byte in 'body' */
+  size_t bodylen;             /* end of the unread data in 'body' */
+  size_t bodysize;            /* allocated size of 'body' */
+  const char *upload_mem;     /* request body passed to http2_send() */
+  size_t upload_len;          /* bytes left in upload_mem */
+  curl_off_t upload_left;     /* request body left to send, -1 if unknown */
+  bool upload_done;           /* the entire request body has been passed */
+  bool informational;         /* the headers being received are 1xx ones */
+  bool bodystarted;           /* the final response headers are complete */
+  bool closed;                /* the stream is closed */
+  uint32_t error_code;        /* RST_STREAM error code of a closed stream */
+};
+
+static const nghttp2_settings_entry h2_settings[] = {
+  { NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, H2_MAX_CONCURRENT_STREAMS },
+  { NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, H2_STREAM_WINDOW },
+  { NGHTTP2_SETTINGS_ENABLE_PUSH, 0 }
+};
+
+#define H2_NUM_SETTINGS (sizeof(h2_settings)/sizeof(h2_settings[0]))
+
+/*
+ * Store nghttp2 version info in this buffer, Prefix with a space.  Return
+ * total length written.
+ */
+int Curl_http2_ver(char *p, size_t len)
+{
+  nghttp2_info *h2 = nghttp2_version(0);
+  return snprintf(p, len, " nghttp2/%s", h2->version_str);
+}
+
+/* TRUE if the connection is speaking HTTP/2 */
+static bool h2_active(const struct connectdata *conn)
+{
+  return ((conn->handler->protocol & CURLPROTO_HTTP) &&
+          conn->proto.httpc.h2) ? TRUE : FALSE;
+}
+
+static void h2_stream_dtor(void *user, void *element)
+{
+  struct h2_stream *stream = (struct h2_stream *)element;
+  (void)user;
+
+  if(stream->header_recvbuf) {
+    Curl_safefree(stream->header_recvbuf->buffer);
+    free(stream->header_recvbuf);
+  }
+  Curl_safefree(stream->body);
+  free(stream);
+}
+
+/* find the list element of the stream used by the given transfer */
+static struct curl_llist_element *h2_stream_find(struct connectdata *conn,
+                                                 struct SessionHandle *data)
+{
+  struct curl_llist_element *e;
+
+  for(e = conn->proto.httpc.streams->head; e; e = e->next) {
+    struct h2_stream *stream = (struct h2_stream *)e->ptr;
+    if(stream->data == data)
+      return e;
+  }
+  return NULL;
+}
+
+static struct h2_stream *h2_stream_get(struct connectdata *conn)
+{
+  struct curl_llist_element *e = h2_stream_find(conn, conn->data);
+  return e ? (struct h2_stream *)e->ptr : NULL;
+}
+
+/* create the stream for the current transfer of the connection */
+static struct h2_stream *h2_stream_new(struct connectdata *conn)
+{
+  struct http_conn *httpc = &conn->proto.httpc;
+  struct h2_stream *stream = calloc(1, sizeof(struct h2_stream));
+
+  if(!stream)
+    return NULL;
+
+  stream->data = conn->data;
+  stream->id = -1;
+  stream->upload_left = -1;
+  stream->header_recvbuf = Curl_add_buffer_init();
+  if(!stream->header_recvbuf ||
+     !Curl_llist_insert_next(httpc->streams, httpc->streams->tail, stream)) {
+    h2_stream_dtor(NULL, stream);
+    return NULL;
+  }
+  return stream;
+}
+
+static ssize_t send_callback(nghttp2_session *h2,
+                             const uint8_t *mem, size_t length, int flags,
+                             void *userp)
+{
+  struct connectdata *conn = (struct connectdata *)userp;
+  struct http_conn *httpc = &conn->proto.httpc;
+  ssize_t written;
+  CURLcode rc = CURLE_OK;
+  (void)h2;
+  (void)flags;
+
+  written = httpc->send_underlying(conn, FIRSTSOCKET, mem, length, &rc);
+
+  if(rc == CURLE_AGAIN)
+    return NGHTTP2_ERR_WOULDBLOCK;
+
+  if(written == -1) {
+    failf(conn->data, "Failed sending HTTP2 data");
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+  }
+
+  if(!written)
+    return NGHTTP2_ERR_WOULDBLOCK;
+
+  return written;
+}
+
+static int on_frame_recv(nghttp2_session *session, const nghttp2_frame *frame,
+                         void *userp)
+{
+  struct h2_stream *stream;
+  (void)userp;
+
+  if(frame->hd.type != NGHTTP2_HEADERS)
+    return 0;
+
+  stream = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+  if(!stream || stream->bodystarted)
+    /* not ours or trailers, which are ignored */
+    return 0;
+
+  /* the end of a header block */
+  if(Curl_add_buffer(stream->header_recvbuf, "\r\n", 2))
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+
+  if(stream->informational)
+    /* a 1xx response, the real one is still to come */
+    stream->informational = FALSE;
+  else
+    stream->bodystarted = TRUE;
+
+  return 0;
+}
+
+static int on_data_chunk_recv(nghttp2_session *session, uint8_t flags,
+                              int32_t stream_id,
+                              const uint8_t *mem, size_t len, void *userp)
+{
+  struct h2_stream *stream;
+  (void)flags;
+  (void)userp;
+
+  stream = nghttp2_session_get_stream_user_data(session, stream_id);
+  if(!stream) {
+    /* the transfer is gone, drop the data but keep the windows open */
+    nghttp2_session_consume(session, stream_id, len);
+    return 0;
+  }
+
+  if(stream->bodypos) {
+    /* move the unread data to the start of the buffer */
+    memmove(stream->body, stream->body + stream->bodypos,
+            stream->bodylen - stream->bodypos);
+    stream->bodylen -= stream->bodypos;
+    stream->bodypos = 0;
+  }
+
+  if(stream->bodylen + len > stream->bodysize) {
+    size_t newsize = stream->bodysize ? stream->bodysize : H2_BUFSIZE;
+    char *newbody;
+
+    while(newsize < stream->bodylen + len)
+      newsize *= 2;
+
+    newbody = realloc(stream->body, newsize);
+    if(!newbody)
+      return NGHTTP2_ERR_CALLBACK_FAILURE;
+    stream->body = newbody;
+    stream->bodysize = newsize;
+  }
+
+  memcpy(stream->body + stream->bodylen, mem, len);
+  stream->bodylen += len;
+
+  return 0;
+}
+
+static int on_stream_close(nghttp2_session *session, int32_t stream_id,
+                           uint32_t error_code, void *userp)
+{
+  struct h2_stream *stream;
+  (void)userp;
+
+  stream = nghttp2_session_get_stream_user_data(session, stream_id);
+  if(stream) {
+    stream->closed = TRUE;
+    stream->error_code = error_code;
+  }
+  return 0;
+}
+
+static int on_header(nghttp2_session *session, const nghttp2_frame *frame,
+                     const uint8_t *name, size_t namelen,
+                     const uint8_t *value, size_t valuelen,
+                     uint8_t flags, void *userp)
+{
+  struct h2_stream *stream;
+  CURLcode rc;
+  (void)flags;
+  (void)userp;
+
+  if(frame->hd.type != NGHTTP2_HEADERS)
+    return 0;
+
+  stream = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+  if(!stream || stream->bodystarted)
+    return 0;
+
+  if((namelen == 7) && !memcmp(":status", name, 7)) {
+    /* make it look like a HTTP/1 status line for the header parser */
+    rc = Curl_add_bufferf(stream->header_recvbuf, "HTTP/2.0 %.*s\r\n",
+                          (int)valuelen, value);
+    stream->informational = (valuelen == 3) && (value[0] == '1');
+  }
+  else {
+    rc = Curl_add_buffer(stream->header_recvbuf, name, namelen);
+    if(!rc)
+      rc = Curl_add_buffer(stream->header_recvbuf, ": ", 2);
+    if(!rc)
+      rc = Curl_add_buffer(stream->header_recvbuf, value, valuelen);
+    if(!rc)
+      rc = Curl_add_buffer(stream->header_recvbuf, "\r\n", 2);
+  }
+
+  return rc ? NGHTTP2_ERR_CALLBACK_FAILURE : 0;
+}
+
+/* provide the request body of a stream */
+static ssize_t data_source_read_callback(nghttp2_session *session,
+                                         int32_t stream_id,
+                                         uint8_t *buf, size_t length,
+                                         uint32_t *data_flags,
+                                         nghttp2_data_source *source,
+                                         void *userp)
+{
+  struct h2_stream *stream;
+  size_t nread;
+  (void)source;
+  (void)userp;
+
+  stream = nghttp2_session_get_stream_user_data(session, stream_id);
+  if(!stream)
+    return NGHTTP2_ERR_CALLBACK_FAILURE;
+
+  nread = CURLMIN(stream->upload_len, length);
+  if(nread) {
+    memcpy(buf, stream->upload_mem, nread);
+    stream->upload_mem += nread;
+    stream->upload_len -= nread;
+    if(stream->upload_left > 0)
+      stream->upload_left -= nread;
+  }
+
+  if(!stream->upload_left || (stream->upload_done && !stream->upload_len))
+    *data_flags = NGHTTP2_DATA_FLAG_EOF;
+  else if(!nread)
+    return NGHTTP2_ERR_DEFERRED;
+
+  return nread;
+}
+
+/* send everything nghttp2 has queued that the socket accepts */
+static CURLcode h2_session_send(struct connectdata *conn)
+{
+  int rv = nghttp2_session_send(conn->proto.httpc.h2);
+
+  if(rv) {
+    failf(conn->data, "nghttp2_session_send() failed: %s",
+          nghttp2_strerror(rv));
+    return CURLE_HTTP2;
+  }
+  return CURLE_OK;
+}
+
+/* pass received frames on to nghttp2 */
+static CURLcode h2_process(struct connectdata *conn,
+                           const char *mem, size_t len)
+{
+  ssize_t rv = nghttp2_session_mem_recv(conn->proto.httpc.h2,
+                                        (const uint8_t *)mem, len);
+  if(rv < 0) {
+    failf(conn->data, "nghttp2_session_mem_recv() failed: %s",
+          nghttp2_strerror((int)rv));
+    return CURLE_HTTP2;
+  }
+
+  /* acknowledge SETTINGS, answer PINGs and open windows */
+  return h2_session_send(conn);
+}
+
+/* copy buffered response data of the stream to 'mem' */
+static size_t h2_stream_read(struct connectdata *conn,
+                             struct h2_stream *stream,
+                             char *mem, size_t len)
+{
+  Curl_send_buffer *hbuf = stream->header_recvbuf;
+  size_t ncopy;
+
+  if(stream->nread_header_recvbuf < hbuf->size_used) {
+    ncopy = CURLMIN(len, hbuf->size_used - stream->nread_header_recvbuf);
+    memcpy(mem, hbuf->buffer + stream->nread_header_recvbuf, ncopy);
+    stream->nread_header_recvbuf += ncopy;
+    return ncopy;
+  }
+
+  if(!stream->bodystarted || (stream->bodypos == stream->bodylen))
+    return 0;
+
+  ncopy = CURLMIN(len, stream->bodylen - stream->bodypos);
+  memcpy(mem, stream->body + stream->bodypos, ncopy);
+  stream->bodypos += ncopy;
+  if(stream->bodypos == stream->bodylen)
+    stream->bodypos = stream->bodylen = 0;
+
+  /* the data has been read, let the server send more */
+  nghttp2_session_consume(conn->proto.httpc.h2, stream->id, ncopy);
+
+  return ncopy;
+}
+
+static ssize_t http2_recv(struct connectdata *conn, int sockindex,
+                          char *mem, size_t len, CURLcode *err)
+{
+  struct http_conn *httpc = &conn->proto.httpc;
+  struct SessionHandle *data = conn->data;
+  struct h2_stream *stream = h2_stream_get(conn);
+  ssize_t nread;
+  size_t ncopy;
+  (void)sockindex;
+
+  if(!stream) {
+    failf(data, "No HTTP2 stream for this transfer");
+    *err = CURLE_HTTP2;
+    return -1;
+  }
+
+  for(;;) {
+    ncopy = h2_stream_read(conn, stream, mem, len);
+    if(ncopy) {
+      /* a WINDOW_UPDATE may be due */
+      *err = h2_session_send(conn);
+      if(*err)
+        return -1;
+      return (ssize_t)ncopy;
+    }
+
+    if(stream->closed) {
+      if(stream->error_code) {
+        failf(data, "HTTP2 stream %d was not closed cleanly (error %u)",
+              stream->id, stream->error_code);
+        *err = CURLE_HTTP2;
+        return -1;
+      }
+      return 0; /* end of the response */
+    }
+
+    nread = httpc->recv_underlying(conn, FIRSTSOCKET, httpc->inbuf,
+                                   H2_BUFSIZE, err);
+    if(nread == -1)
+      return -1; /* including CURLE_AGAIN */
+
+    if(!nread) {
+      failf(data, "The server closed the HTTP2 connection in the middle "
+            "of stream %d", stream->id);
+      conn->bits.close = TRUE;
+      *err = CURLE_RECV_ERROR;
+      return -1;
+    }
+
+    *err = h2_process(conn, httpc->inbuf, (size_t)nread);
+    if(*err)
+      return -1;
+  }
+}
+
+/* find the end of the request headers in the HTTP/1 formatted request */
+static const char *header_end(const char *mem, size_t len)
+{
+  const char *p = mem;
+  const char *end = mem + len;
+
+  while((end - p) >= 4) {
+    if(!memcmp(p, "\r\n\r\n", 4))
+      return p + 4;
+    p++;
+  }
+  return NULL;
+}
+
+/* lowercase an ASCII header field name */
+static void lowercase(char *p, size_t len)
+{
+  for(; len; len--, p++) {
+    if((*p >= 'A') && (*p <= 'Z'))
+      *p = (char)(*p + ('a' - 'A'));
+  }
+}
+
+#define H2_NV(nv, n, nlen, v, vlen) do {      \
+    (nv).name = (uint8_t *)(n);               \
+    (nv).namelen = (nlen);                    \
+    (nv).value = (uint8_t *)(v);              \
+    (nv).valuelen = (vlen);                   \
+    (nv).flags = NGHTTP2_NV_FLAG_NONE;        \
+  } WHILE_FALSE
+
+/* headers that are specific to HTTP/1 connections, RFC 7540 8.1.2.2 */
+static bool h2_skip_header(const char *name, size_t namelen)
+{
+  static const char * const skip[] = {
+    "connection", "keep-alive", "proxy-connection", "transfer-encoding",
+    "upgrade", "http2-settings", "te"
+  };
+  size_t i;
+
+  for(i = 0; i < sizeof(skip)/sizeof(skip[0]); i++) {
+    if((strlen(skip[i]) == namelen) && !memcmp(skip[i], name, namelen))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+ * Turn the HTTP/1 formatted request headers in 'mem' into a new stream for
+ * the current transfer. Returns the number of bytes used from 'mem'.
+ */
+static ssize_t h2_submit(struct connectdata *conn, struct h2_stream *stream,
+                         const char *mem, size_t len, CURLcode *err)
+{
+  struct SessionHandle *data = conn->data;
+  struct http_conn *httpc = &conn->proto.httpc;
+  const char *end = header_end(mem, len);
+  char *hdbuf;
+  char *line;
+  char *hdend;
+  char *p;
+  nghttp2_nv *nva;
+  size_t nheader = 0;
+  size_t i = 0;
+  char scheme[16];
+  nghttp2_data_provider data_prd;
+  bool hasbody;
+  bool authority;
+  int32_t id;
+
+  if(!end) {
+    failf(data, "Incomplete request headers for HTTP2");
+    *err = CURLE_HTTP2;
+    return -1;
+  }
+
+  /* a modifiable zero terminated copy to lowercase the names in */
+  hdbuf = malloc(end - mem + 1);
+  if(!hdbuf) {
+    *err = CURLE_OUT_OF_MEMORY;
+    return -1;
+  }
+  memcpy(hdbuf, mem, end - mem);
+  hdbuf[end - mem] = '\0';
+  hdend = hdbuf + (end - mem) - 2; /* the final empty line */
+
+  for(p = hdbuf; p < hdend; p++)
+    if(*p == '\n')
+      nheader++;
+
+  /* the request line becomes three pseudo headers, plus :authority */
+  nva = malloc(sizeof(nghttp2_nv) * (nheader + 3));
+  if(!nva) {
+    free(hdbuf);
+    *err = CURLE_OUT_OF_MEMORY;
+    return -1;
+  }
+
+  /* the request line, "METHOD path HTTP/1.1" */
+  line = hdbuf;
+  p = memchr(line, ' ', hdend - line);
+  if(!p) {
+    free(nva);
+    free(hdbuf);
+    failf(data, "Malformed request line for HTTP2");
+    *err = CURLE_HTTP2;
+    return -1;
+  }
+  H2_NV(nva[i], ":method", 7, line, p - line);
+  i++;
+  line = p + 1;
+  p = strstr(line, "\r\n");
+  while(p > line && p[-1] != ' ')
+    p--;
+  H2_NV(nva[i], ":path", 5, line, (p > line) ? (size_t)(p - line - 1) : 0);
+  i++;
+
+  snprintf(scheme, sizeof(scheme), "%s", conn->handler->scheme);
+  lowercase(scheme, strlen(scheme));
+  H2_NV(nva[i], ":scheme", 7, scheme, strlen(scheme));
+  i++;
+
+  /* pseudo headers go first, nva[3] is kept for :authority */
+  i++;
+  authority = FALSE;
+
+  hasbody = ((data->set.httpreq == HTTPREQ_POST) ||
+             (data->set.httpreq == HTTPREQ_POST_FORM) ||
+             (data->set.httpreq == HTTPREQ_PUT)) ? TRUE : FALSE;
+
+  for(line = strstr(line, "\r\n") + 2; line < hdend;
+      line = strstr(line, "\r\n") + 2) {
+    char *colon = memchr(line, ':', hdend - line);
+    char *value;
+    char *eol = strstr(line, "\r\n");
+    size_t namelen;
+
+    if(!colon || (colon > eol))
+      continue; /* not a header */
+
+    namelen = colon - line;
+    value = colon + 1;
+    while((value < eol) && ((*value == ' ') || (*value == '\t')))
+      value++;
+
+    lowercase(line, namelen);
+
+    if((namelen == 4) && !memcmp(line, "host", 4)) {
+      H2_NV(nva[3], ":authority", 10, value, eol - value);
+      authority = TRUE;
+      continue;
+    }
+
+    if(h2_skip_header(line, namelen))
+      continue;
+
+    if((namelen == 14) && !memcmp(line, "content-length", 14)) {
+      stream->upload_left = curlx_strtoofft(value, NULL, 10);
+      if(!stream->upload_left)
+        hasbody = FALSE;
+    }
+
+    H2_NV(nva[i], line, namelen, value, eol - value);
+    i++;
+  }
+
+  if(!authority) {
+    memmove(&nva[3], &nva[4], (i - 4) * sizeof(nghttp2_nv));
+    i--;
+  }
+
+  data_prd.source.ptr = NULL;
+  data_prd.read_callback = data_source_read_callback;
+
+  id = nghttp2_submit_request(httpc->h2, NULL, nva, i,
+                              hasbody ? &data_prd : NULL, stream);
+  free(nva);
+  free(hdbuf);
+
+  if(id < 0) {
+    failf(data, "nghttp2_submit_request() failed: %s",
+          nghttp2_strerror(id));
+    *err = CURLE_HTTP2;
+    return -1;
+  }
+  stream->id = id;
+  if(!hasbody)
+    stream->upload_left = 0;
+
+  infof(data, "Using HTTP2 stream %d\n", id);
+
+  return end - mem;
+}
+
+static ssize_t http2_send(struct connectdata *conn, int sockindex,
+                          const void *mem, size_t len, CURLcode *err)
+{
+  struct http_conn *httpc = &conn->proto.httpc;
+  struct h2_stream *stream = h2_stream_get(conn);
+  ssize_t nsubmit = 0;
+  size_t nsent;
+  (void)sockindex;
+
+  if(!stream) {
+    /* a new request on the connection */
+    stream = h2_stream_new(conn);
+    if(!stream) {
+      *err = CURLE_OUT_OF_MEMORY;
+      return -1;
+    }
+    nsubmit = h2_submit(conn, stream, mem, len, err);
+    if(nsubmit < 0) {
+      Curl_llist_remove(httpc->streams, h2_stream_find(conn, conn->data),
+                        NULL);
+      return -1;
+    }
+    mem = (const char *)mem + nsubmit;
+    len -= nsubmit;
+  }
+  else if(stream->closed)
+    /* the server doesn't want the rest of the request body */
+    return (ssize_t)len;
+  else if(!stream->upload_left) {
+    failf(conn->data, "Sending more than the request body on HTTP2");
+    *err = CURLE_SEND_ERROR;
+    return -1;
+  }
+
+  if(len && stream->upload_left) {
+    /* request body, picked up by data_source_read_callback() */
+    stream->upload_mem = mem;
+    stream->upload_len = len;
+    nghttp2_session_resume_data(httpc->h2, stream->id);
+  }
+
+  *err = h2_session_send(conn);
+
+  nsent = len - stream->upload_len;
+  stream->upload_mem = NULL;
+  stream->upload_len = 0;
+
+  if(*err)
+    return -1;
+
+  if(!nsubmit && !nsent) {
+    /* the stream's window is full */
+    *err = CURLE_AGAIN;
+    return -1;
+  }
+
+  return nsubmit + (ssize_t)nsent;
+}
+
+/* set up the nghttp2 session of the connection */
+static CURLcode h2_init(struct connectdata *conn)
+{
+  struct http_conn *httpc = &conn->proto.httpc;
+  nghttp2_session_callbacks *callbacks;
+  nghttp2_option *option;
+  int rv;
+
+  httpc->inbuf = malloc(H2_BUFSIZE);
+  httpc->streams = Curl_llist_alloc(h2_stream_dtor);
+  if(!httpc->inbuf || !httpc->streams)
+    return CURLE_OUT_OF_MEMORY;
+
+  if(nghttp2_session_callbacks_new(&callbacks))
+    return CURLE_OUT_OF_MEMORY;
+  if(nghttp2_option_new(&option)) {
+    nghttp2_session_callbacks_del(callbacks);
+    return CURLE_OUT_OF_MEMORY;
+  }
+
+  nghttp2_session_callbacks_set_send_callback(callbacks, send_callback);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks,
+                                                       on_frame_recv);
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback(
+    callbacks, on_data_chunk_recv);
+  nghttp2_session_callbacks_set_on_stream_close_callback(callbacks,
+                                                         on_stream_close);
+  nghttp2_session_callbacks_set_on_header_callback(callbacks, on_header);
+
+  /* windows are only opened for data the transfers have read */
+  nghttp2_option_set_no_auto_window_update(option, 1);
+
+  rv = nghttp2_session_client_new2(&httpc->h2, callbacks, conn, option);
+
+  nghttp2_option_del(option);
+  nghttp2_session_callbacks_del(callbacks);
+
+  if(rv) {
+    failf(conn->data, "Couldn't initialize nghttp2: %s",
+          nghttp2_strerror(rv));
+    return CURLE_OUT_OF_MEMORY;
+  }
+  return CURLE_OK;
+}
+
+/*
+ * Append headers to ask for a HTTP/2 upgrade to the request. Only done for
+ * GET and HEAD requests on plain connections to the server.
+ */
+CURLcode Curl_http2_request_upgrade(Curl_send_buffer *req,
+                                    struct connectdata *conn)
+{
+  struct SessionHandle *data = conn->data;
+  struct http_conn *httpc = &conn->proto.httpc;
+  ssize_t binlen;
+  char *base64;
+  size_t blen;
+  size_t i;
+  CURLcode result;
+
+  if(((data->set.httpreq != HTTPREQ_GET) &&
+      (data->set.httpreq != HTTPREQ_HEAD)) ||
+     (conn->handler->flags & PROTOPT_SSL) ||
+     (conn->bits.httpproxy && !conn->bits.tunnel_proxy) ||
+     Curl_checkheaders(data, "Connection:") ||
+     Curl_checkheaders(data, "Upgrade:"))
+    return CURLE_OK;
+
+  binlen = nghttp2_pack_settings_payload(httpc->binsettings,
+                                         H2_BINSETTINGS_LEN,
+                                         h2_settings, H2_NUM_SETTINGS);
+  if(binlen <= 0) {
+    failf(data, "nghttp2 unexpectedly failed on pack_settings_payload");
+    return CURLE_FAILED_INIT;
+  }
+  httpc->binlen = binlen;
+
+  result = Curl_base64_encode(data, (const char *)httpc->binsettings,
+                              httpc->binlen, &base64, &blen);
+  if(result)
+    return result;
+
+  /* HTTP2-Settings is base64url encoded without padding */
+  for(i = 0; i < blen; i++) {
+    if(base64[i] == '+')
+      base64[i] = '-';
+    else if(base64[i] == '/')
+      base64[i] = '_';
+    else if(base64[i] == '=') {
+      base64[i] = '\0';
+      break;
+    }
+  }
+
+  result = Curl_add_bufferf(req,
+                            "Connection: Upgrade, HTTP2-Settings\r\n"
+                            "Upgrade: %s\r\n"
+                            "HTTP2-Settings: %s\r\n",
+                            NGHTTP2_CLEARTEXT_PROTO_VERSION_ID, base64);
+  free(base64);
+
+  if(!result)
+    data->req.upgr101 = UPGR101_REQUESTED;
+
+  return result;
+}
+
+/*
+ * The server responded 101 to the upgrade request: the connection speaks
+ * HTTP/2 from now on and the response to the request comes on stream 1.
+ */
+CURLcode Curl_http2_switched(struct connectdata *conn,
+                             const char *mem, size_t nread)
+{
+  struct SessionHandle *data = conn->data;
+  struct http_conn *httpc = &conn->proto.httpc;
+  struct h2_stream *stream;
+  CURLcode result;
+  int rv;
+
+  result = h2_init(conn);
+  if(result)
+    return result;
+
+  stream = h2_stream_new(conn);
+  if(!stream)
+    return CURLE_OUT_OF_MEMORY;
+
+  rv = nghttp2_session_upgrade2(httpc->h2, httpc->binsettings, httpc->binlen,
+                                data->set.httpreq == HTTPREQ_HEAD, stream);
+  if(rv) {
+    failf(data, "nghttp2_session_upgrade2() failed: %s",
+          nghttp2_strerror(rv));
+    return CURLE_HTTP2;
+  }
+  stream->id = 1;
+  stream->upload_left = 0;
+
+  rv = nghttp2_submit_settings(httpc->h2, NGHTTP2_FLAG_NONE,
+                               h2_settings, H2_NUM_SETTINGS);
+  if(!rv)
+    rv = nghttp2_session_set_local_window_size(httpc->h2, NGHTTP2_FLAG_NONE,
+                                               0, H2_CONN_WINDOW);
+  if(rv) {
+    failf(data, "nghttp2 failed to set up the connection: %s",
+          nghttp2_strerror(rv));
+    return CURLE_HTTP2;
+  }
+
+  /* all traffic goes through nghttp2 from now on */
+  httpc->recv_underlying = conn->recv[FIRSTSOCKET];
+  httpc->send_underlying = conn->send[FIRSTSOCKET];
+  conn->recv[FIRSTSOCKET] = http2_recv;
+  conn->send[FIRSTSOCKET] = http2_send;
+
+  infof(data, "Connection state changed (HTTP/2 confirmed)\n");
+  conn->httpversion = 20;
+  /* more transfers can use the connection at once */
+  conn->server_supports_pipelining = TRUE;
+
+  if(nread)
+    /* frames that arrived together with the 101 response */
+    return h2_process(conn, mem, nread);
+
+  return h2_session_send(conn);
+}
+
+bool Curl_http2_data_pending(const struct connectdata *conn)
+{
+  struct curl_llist_element *e;
+
+  if(!h2_active(conn))
+    return FALSE;
+
+  e = h2_stream_find((struct connectdata *)conn, conn->data);
+  if(e) {
+    struct h2_stream *stream = (struct h2_stream *)e->ptr;
+    if(stream->closed ||
+       (stream->nread_header_recvbuf < stream->header_recvbuf->size_used) ||
+       (stream->bodystarted && (stream->bodypos < stream->bodylen)))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+CURLcode Curl_http2_done_sending(struct connectdata *conn)
+{
+  struct h2_stream *stream;
+
+  if(!h2_active(conn))
+    return CURLE_OK;
+
+  stream = h2_stream_get(conn);
+  if(!stream || stream->upload_done || !stream->upload_left)
+    return CURLE_OK;
+
+  /* let data_source_read_callback() signal the end of the body */
+  stream->upload_done = TRUE;
+  nghttp2_session_resume_data(conn->proto.httpc.h2, stream->id);
+
+  return h2_session_send(conn);
+}
+
+void Curl_http2_done(struct connectdata *conn, bool premature)
+{
+  struct http_conn *httpc = &conn->proto.httpc;
+  struct curl_llist_element *e;
+  struct h2_stream *stream;
+
+  if(!h2_active(conn))
+    return;
+
+  e = h2_stream_find(conn, conn->data);
+  if(!e)
+    return;
+
+  stream = (struct h2_stream *)e->ptr;
+  if(stream->id > 0) {
+    if(premature && !stream->closed)
+      /* the transfer doesn't want the rest */
+      nghttp2_submit_rst_stream(httpc->h2, NGHTTP2_FLAG_NONE, stream->id,
+                                NGHTTP2_CANCEL);
+
+    /* whatever arrives for the stream now is dropped */
+    nghttp2_session_set_stream_user_data(httpc->h2, stream->id, NULL);
+
+    /* give back the window of data that was never read */
+    if(stream->bodylen > stream->bodypos)
+      nghttp2_session_consume(httpc->h2, stream->id,
+                              stream->bodylen - stream->bodypos);
+  }
+
+  Curl_llist_remove(httpc->streams, e, NULL);
+
+  (void)h2_session_send(conn);
+}
+
+void Curl_http2_cleanup(struct connectdata *conn)
+{
+  struct http_conn *httpc = &conn->proto.httpc;
+
+  if(httpc->h2) {
+    nghttp2_session_del(httpc->h2);
+    httpc->h2 = NULL;
+  }
+  if(httpc->streams) {
+    Curl_llist_destroy(httpc->streams, NULL);
+    httpc->streams = NULL;
+  }
+  Curl_safefree(httpc->inbuf);
+}
+
+#endif /* USE_NGHTTP2 */
@@ -0,0 +1,67 @@
+#ifndef HEADER_CURL_HTTP2_H
+#define HEADER_CURL_HTTP2_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#ifdef USE_NGHTTP2
+#include "http.h"
+
+/*
+ * Store nghttp2 version info in this buffer, Prefix with a space.  Return
+ * total length written.
+ */
+int Curl_http2_ver(char *p, size_t len);
+
+/* add the request headers that ask the server to upgrade to HTTP/2 */
+CURLcode Curl_http2_request_upgrade(Curl_send_buffer *req,
+                                    struct connectdata *conn);
+
+/* the server switched to HTTP/2, 'mem' holds what was read after the 101
+   response */
+CURLcode Curl_http2_switched(struct connectdata *conn,
+                             const char *mem, size_t nread);
+
+/* TRUE if there is response data received for the current transfer of the
+   connection that hasn't been read yet */
+bool Curl_http2_data_pending(const struct connectdata *conn);
+
+/* the request body of the current transfer has been passed on in full */
+CURLcode Curl_http2_done_sending(struct connectdata *conn);
+
+/* the current transfer of the connection is done with its stream */
+void Curl_http2_done(struct connectdata *conn, bool premature);
+
+/* free the HTTP/2 state of the connection */
+void Curl_http2_cleanup(struct connectdata *conn);
+
+#else /* USE_NGHTTP2 */
+#define Curl_http2_request_upgrade(x,y) CURLE_UNSUPPORTED_PROTOCOL
+#define Curl_http2_switched(x,y,z) CURLE_UNSUPPORTED_PROTOCOL
+#define Curl_http2_data_pending(x) FALSE
+#define Curl_http2_done_sending(x) CURLE_OK
+#define Curl_http2_done(x,y) Curl_nop_stmt
+#define Curl_http2_cleanup(x) Curl_nop_stmt
+#endif
+
+#endif /* HEADER_CURL_HTTP2_H */
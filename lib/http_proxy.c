@@ -35,6 +35,7 @@
 #include "progress.h"
 #include "non-ascii.h"
 #include "connect.h"
+#include "multiif.h"
 
 #define _MPRINTF_REPLACE /* use our functions only */
 #include <curl/mprintf.h>
@@ -54,7 +55,6 @@ CURLcode Curl_proxy_connect(struct connectdata *conn)
     void *prot_save;
     CURLcode result;
 
-    /* BLOCKING */
     /* We want "seamless" operations through HTTP proxy tunnel */
 
     /* Curl_proxyCONNECT is based on a pointer to a struct HTTP at the
@@ -63,8 +63,8 @@ CURLcode Curl_proxy_connect(struct connectdata *conn)
      * proxy. After Curl_proxyCONNECT we have to set back the member to the
      * original pointer
      *
-     * This function might be called several times in the multi interface case
-     * if the proxy's CONNTECT response is not instant.
+     * This function is called again and again by the multi interface until
+     * the proxy's CONNECT response has been read in full.
      */
     prot_save = conn->data->state.proto.generic;
     memset(&http_proxy, 0, sizeof(http_proxy));
@@ -83,10 +83,244 @@ CURLcode Curl_proxy_connect(struct connectdata *conn)
   return CURLE_OK;
 }
 
+/* what the response to a CONNECT is read for */
+#define CONNECT_HEADERS 1 /* the response headers */
+#define CONNECT_BODY    2 /* a response body that is skipped */
+
+/*
+ * Skip 'len' bytes of the body of a response to a CONNECT, the response is
+ * done when the whole body has been skipped.
+ */
+static void connect_skip_body(struct connectdata *conn,
+                              struct http_connect_state *s,
+                              char *ptr, ssize_t len)
+{
+  struct SessionHandle *data = conn->data;
+
+  if(s->cl) {
+    /* A Content-Length based body: simply count down the counter and make
+       sure to stop when we're done! */
+    s->cl -= len;
+    if(s->cl <= 0)
+      s->keepon = 0;
+  }
+  else if(len) {
+    /* chunked-encoded body, so we need to do the chunked dance properly to
+       know when the end of the body is reached */
+    ssize_t tookcareof = 0;
+    CHUNKcode r = Curl_httpchunk_read(conn, ptr, len, &tookcareof);
+    if(r == CHUNKE_STOP) {
+      /* we're done reading chunks! */
+      infof(data, "chunk reading DONE\n");
+      s->keepon = 0;
+    }
+    else
+      infof(data, "Read %zd bytes of chunk, continue\n", tookcareof);
+  }
+}
+
+/*
+ * A header line of the response to a CONNECT has been read. 'remaining' is
+ * the number of bytes read after it, in the buffer after the line.
+ */
+static CURLcode connect_header(struct connectdata *conn,
+                               struct http_connect_state *s,
+                               char *line_start, int perline,
+                               ssize_t remaining)
+{
+  struct SessionHandle *data = conn->data;
+  struct SingleRequest *k = &data->req;
+  CURLcode result;
+  int writetype;
+  int subversion = 0;
+  char letter;
+
+  /* convert from the network encoding */
+  result = Curl_convert_from_network(data, line_start, perline);
+  /* Curl_convert_from_network calls failf if unsuccessful */
+  if(result)
+    return result;
+
+  /* output debug if that is requested */
+  if(data->set.verbose)
+    Curl_debug(data, CURLINFO_HEADER_IN, line_start, (size_t)perline, conn);
+
+  /* send the header to the callback */
+  writetype = CLIENTWRITE_HEADER;
+  if(data->set.include_header)
+    writetype |= CLIENTWRITE_BODY;
+
+  result = Curl_client_write(conn, writetype, line_start, perline);
+  if(result)
+    return result;
+
+  /* Newlines are CRLF, so the CR is ignored as the line isn't really
+     terminated until the LF comes. Treat a following CR as end-of-headers as
+     well.*/
+
+  if(('\r' == line_start[0]) || ('\n' == line_start[0])) {
+    /* end of response-headers from the proxy */
+    s->keepon = 0;
+    if((407 == k->httpcode) && !data->state.authproblem) {
+      /* If we get a 407 response code with content length when we have no
+         auth problem, we must ignore the whole response-body */
+      char *body = line_start + perline;
+
+      if(s->cl) {
+        infof(data, "Ignore %" FORMAT_OFF_T " bytes of response-body\n",
+              s->cl);
+        s->keepon = CONNECT_BODY;
+      }
+      else if(s->chunked_encoding) {
+        /* We set ignorebody true here since the chunked decoder function
+           will acknowledge that. Pay attention so that this is cleared again
+           when the CONNECT is done! */
+        k->ignorebody = TRUE;
+        infof(data, "%zd bytes of chunk left\n", remaining);
+        s->keepon = CONNECT_BODY;
+      }
+      /* else without content-length or chunked encoding, we can't keep the
+         connection alive since the close is the end signal so we bail out
+         at once instead */
+
+      if(s->keepon)
+        /* the rest of what was read is body */
+        connect_skip_body(conn, s, body, remaining);
+    }
+    else if((200 == data->info.httpproxycode) && remaining)
+      failf(data, "Proxy CONNECT followed by %zd bytes "
+            "of opaque data. Data ignored (known bug #39)", remaining);
+    return CURLE_OK;
+  }
+
+  /* keep a backup of the position we are about to blank */
+  letter = line_start[perline];
+  line_start[perline]=0; /* zero terminate the buffer */
+  if((checkprefix("WWW-Authenticate:", line_start) &&
+      (401 == k->httpcode)) ||
+     (checkprefix("Proxy-authenticate:", line_start) &&
+      (407 == k->httpcode))) {
+    result = Curl_http_input_auth(conn, k->httpcode, line_start);
+    if(result)
+      return result;
+  }
+  else if(checkprefix("Content-Length:", line_start)) {
+    s->cl = curlx_strtoofft(line_start + strlen("Content-Length:"), NULL, 10);
+  }
+  else if(Curl_compareheader(line_start, "Connection:", "close"))
+    s->close_connection = TRUE;
+  else if(Curl_compareheader(line_start, "Transfer-Encoding:", "chunked")) {
+    infof(data, "CONNECT responded chunked\n");
+    s->chunked_encoding = TRUE;
+    /* init our chunky engine */
+    Curl_httpchunk_init(conn);
+  }
+  else if(Curl_compareheader(line_start, "Proxy-Connection:", "close"))
+    s->close_connection = TRUE;
+  else if(2 == sscanf(line_start, "HTTP/1.%d %d", &subversion,
+                      &k->httpcode)) {
+    /* store the HTTP code from the proxy */
+    data->info.httpproxycode = k->httpcode;
+  }
+  /* put back the letter we blanked out before */
+  line_start[perline]= letter;
+
+  return CURLE_OK;
+}
+
+/*
+ * Read as much of the response to the CONNECT as there is, without waiting
+ * for more. The response is done when s->keepon is 0. The line being read is
+ * kept at the start of the buffer of the handle between the calls, nothing
+ * else uses it while the tunnel is set up.
+ */
+static CURLcode connect_readresp(struct connectdata *conn, int sockindex)
+{
+  struct SessionHandle *data = conn->data;
+  struct http_connect_state *s = &conn->connect_state[sockindex];
+  curl_socket_t tunnelsocket = conn->sock[sockindex];
+  char *buf = data->state.buffer;
+  CURLcode result;
+
+  while(s->keepon) {
+    ssize_t gotbytes;
+    char *ptr;
+    char *end;
+    char *line_start;
+
+    result = Curl_read(conn, tunnelsocket, buf + s->len, BUFSIZE - s->len,
+                       &gotbytes);
+    if(result == CURLE_AGAIN)
+      return CURLE_OK; /* we get called again when there is more */
+    else if(result) {
+      s->keepon = 0;
+      return CURLE_OK;
+    }
+    else if(gotbytes <= 0) {
+      s->keepon = 0;
+      if(data->set.proxyauth && data->state.authproxy.avail) {
+        /* proxy auth was requested and there was proxy auth available,
+           then deem this as "mere" proxy disconnect */
+        conn->bits.proxy_connect_closed = TRUE;
+        return CURLE_OK;
+      }
+      failf(data, "Proxy CONNECT aborted");
+      return CURLE_RECV_ERROR;
+    }
+
+    if(s->keepon == CONNECT_BODY) {
+      /* This means we are currently ignoring a response-body */
+      connect_skip_body(conn, s, buf, gotbytes);
+      continue;
+    }
+
+    /*
+     * We got a whole chunk of data, which can be anything from one byte to a
+     * set of lines and possibly just a piece of the last line.
+     */
+    line_start = buf;
+    end = buf + s->len + gotbytes;
+    for(ptr = buf + s->len; ptr < end; ptr++) {
+      if(*ptr == 0x0a) {
+        result = connect_header(conn, s, line_start,
+                                curlx_sztosi(ptr + 1 - line_start),
+                                end - (ptr + 1));
+        if(result)
+          return result;
+        line_start = ptr + 1;
+        if(s->keepon != CONNECT_HEADERS)
+          break; /* the rest is handled already */
+      }
+    }
+
+    if(s->keepon != CONNECT_HEADERS) {
+      s->len = 0;
+      continue;
+    }
+
+    /* keep the start of the next line for the next read */
+    s->len = (size_t)(end - line_start);
+    if(s->len >= BUFSIZE) {
+      failf(data, "Proxy CONNECT response header line too long");
+      return CURLE_RECV_ERROR;
+    }
+    if(s->len && (line_start != buf))
+      memmove(buf, line_start, s->len);
+  }
+
+  /* we did the full CONNECT treatment, go COMPLETE */
+  conn->tunnel_state[sockindex] = TUNNEL_COMPLETE;
+  return CURLE_OK;
+}
+
 /*
  * Curl_proxyCONNECT() requires that we're connected to a HTTP proxy. This
  * function will issue the necessary commands to get a seamless tunnel through
  * this proxy. After that, the socket can be used just as a normal socket.
+ *
+ * It never waits for the proxy. It returns after the CONNECT is sent and is
+ * then called again whenever the socket is readable, to read what has arrived
+ * of the response. The tunnel is up when the tunnel state is TUNNEL_COMPLETE.
  */
 
 CURLcode Curl_proxyCONNECT(struct connectdata *conn,
@@ -94,23 +328,13 @@ CURLcode Curl_proxyCONNECT(struct connectdata *conn,
                            const char *hostname,
                            unsigned short remote_port)
 {
-  int subversion=0;
   struct SessionHandle *data=conn->data;
-  struct SingleRequest *k = &data->req;
+  struct http_connect_state *s = &conn->connect_state[sockindex];
   CURLcode result;
   long timeout =
     data->set.timeout?data->set.timeout:PROXY_TIMEOUT; /* in milliseconds */
-  curl_socket_t tunnelsocket = conn->sock[sockindex];
-  curl_off_t cl=0;
-  bool closeConnection = FALSE;
-  bool chunked_encoding = FALSE;
   long check;
 
-#define SELECT_OK      0
-#define SELECT_ERROR   1
-#define SELECT_TIMEOUT 2
-  int error = SELECT_OK;
-
   if(conn->tunnel_state[sockindex] == TUNNEL_COMPLETE)
     return CURLE_OK; /* CONNECT is already completed */
 
@@ -224,298 +448,64 @@ CURLcode Curl_proxyCONNECT(struct connectdata *conn,
 
       conn->tunnel_state[sockindex] = TUNNEL_CONNECT;
 
+      /* the response is read from its start */
+      memset(s, 0, sizeof(*s));
+      s->keepon = CONNECT_HEADERS;
+
+      /* make sure we get called when the time for the response is up */
+      check = timeout - Curl_tvdiff(Curl_tvnow(), conn->now);
+      if(check > 0)
+        Curl_expire(data, check);
+
       /* now we've issued the CONNECT and we're waiting to hear back, return
          and get called again polling-style */
       return CURLE_OK;
 
     } /* END CONNECT PHASE */
 
-    { /* BEGIN NEGOTIATION PHASE */
-      size_t nread;   /* total size read */
-      int perline; /* count bytes per line */
-      int keepon=TRUE;
-      ssize_t gotbytes;
-      char *ptr;
-      char *line_start;
-
-      ptr=data->state.buffer;
-      line_start = ptr;
-
-      nread=0;
-      perline=0;
-      keepon=TRUE;
-
-      while((nread<BUFSIZE) && (keepon && !error)) {
-
-        /* if timeout is requested, find out how much remaining time we have */
-        check = timeout - /* timeout time */
-          Curl_tvdiff(Curl_tvnow(), conn->now); /* spent time */
-        if(check <= 0) {
-          failf(data, "Proxy CONNECT aborted due to timeout");
-          error = SELECT_TIMEOUT; /* already too little time */
-          break;
-        }
+    /* BEGIN NEGOTIATION PHASE */
 
-        /* loop every second at least, less if the timeout is near */
-        switch (Curl_socket_ready(tunnelsocket, CURL_SOCKET_BAD,
-                                  check<1000L?check:1000)) {
-        case -1: /* select() error, stop reading */
-          error = SELECT_ERROR;
-          failf(data, "Proxy CONNECT aborted due to select/poll error");
-          break;
-        case 0: /* timeout */
-          break;
-        default:
-          DEBUGASSERT(ptr+BUFSIZE-nread <= data->state.buffer+BUFSIZE+1);
-          result = Curl_read(conn, tunnelsocket, ptr, BUFSIZE-nread,
-                             &gotbytes);
-          if(result==CURLE_AGAIN)
-            continue; /* go loop yourself */
-          else if(result)
-            keepon = FALSE;
-          else if(gotbytes <= 0) {
-            keepon = FALSE;
-            if(data->set.proxyauth && data->state.authproxy.avail) {
-              /* proxy auth was requested and there was proxy auth available,
-                 then deem this as "mere" proxy disconnect */
-              conn->bits.proxy_connect_closed = TRUE;
-            }
-            else {
-              error = SELECT_ERROR;
-              failf(data, "Proxy CONNECT aborted");
-            }
-          }
-          else {
-            /*
-             * We got a whole chunk of data, which can be anything from one
-             * byte to a set of lines and possibly just a piece of the last
-             * line.
-             */
-            int i;
-
-            nread += gotbytes;
-
-            if(keepon > TRUE) {
-              /* This means we are currently ignoring a response-body */
-
-              nread = 0; /* make next read start over in the read buffer */
-              ptr=data->state.buffer;
-              if(cl) {
-                /* A Content-Length based body: simply count down the counter
-                   and make sure to break out of the loop when we're done! */
-                cl -= gotbytes;
-                if(cl<=0) {
-                  keepon = FALSE;
-                  break;
-                }
-              }
-              else {
-                /* chunked-encoded body, so we need to do the chunked dance
-                   properly to know when the end of the body is reached */
-                CHUNKcode r;
-                ssize_t tookcareof=0;
-
-                /* now parse the chunked piece of data so that we can
-                   properly tell when the stream ends */
-                r = Curl_httpchunk_read(conn, ptr, gotbytes, &tookcareof);
-                if(r == CHUNKE_STOP) {
-                  /* we're done reading chunks! */
-                  infof(data, "chunk reading DONE\n");
-                  keepon = FALSE;
-                  /* we did the full CONNECT treatment, go COMPLETE */
-                  conn->tunnel_state[sockindex] = TUNNEL_COMPLETE;
-                }
-                else
-                  infof(data, "Read %zd bytes of chunk, continue\n",
-                        tookcareof);
-              }
-            }
-            else
-              for(i = 0; i < gotbytes; ptr++, i++) {
-                perline++; /* amount of bytes in this line so far */
-                if(*ptr == 0x0a) {
-                  char letter;
-                  int writetype;
-
-                  /* convert from the network encoding */
-                  result = Curl_convert_from_network(data, line_start,
-                                                     perline);
-                  /* Curl_convert_from_network calls failf if unsuccessful */
-                  if(result)
-                    return result;
-
-                  /* output debug if that is requested */
-                  if(data->set.verbose)
-                    Curl_debug(data, CURLINFO_HEADER_IN,
-                               line_start, (size_t)perline, conn);
-
-                  /* send the header to the callback */
-                  writetype = CLIENTWRITE_HEADER;
-                  if(data->set.include_header)
-                    writetype |= CLIENTWRITE_BODY;
-
-                  result = Curl_client_write(conn, writetype, line_start,
-                                             perline);
-                  if(result)
-                    return result;
-
-                  /* Newlines are CRLF, so the CR is ignored as the line isn't
-                     really terminated until the LF comes. Treat a following CR
-                     as end-of-headers as well.*/
-
-                  if(('\r' == line_start[0]) ||
-                     ('\n' == line_start[0])) {
-                    /* end of response-headers from the proxy */
-                    nread = 0; /* make next read start over in the read
-                                  buffer */
-                    ptr=data->state.buffer;
-                    if((407 == k->httpcode) && !data->state.authproblem) {
-                      /* If we get a 407 response code with content length
-                         when we have no auth problem, we must ignore the
-                         whole response-body */
-                      keepon = 2;
-
-                      if(cl) {
-
-                        infof(data, "Ignore %" FORMAT_OFF_T
-                              " bytes of response-body\n", cl);
-                        /* remove the remaining chunk of what we already
-                           read */
-                        cl -= (gotbytes - i);
-
-                        if(cl<=0)
-                          /* if the whole thing was already read, we are done!
-                           */
-                          keepon=FALSE;
-                      }
-                      else if(chunked_encoding) {
-                        CHUNKcode r;
-                        /* We set ignorebody true here since the chunked
-                           decoder function will acknowledge that. Pay
-                           attention so that this is cleared again when this
-                           function returns! */
-                        k->ignorebody = TRUE;
-                        infof(data, "%zd bytes of chunk left\n", gotbytes-i);
-
-                        if(line_start[1] == '\n') {
-                          /* this can only be a LF if the letter at index 0
-                             was a CR */
-                          line_start++;
-                          i++;
-                        }
-
-                        /* now parse the chunked piece of data so that we can
-                           properly tell when the stream ends */
-                        r = Curl_httpchunk_read(conn, line_start+1,
-                                                  gotbytes -i, &gotbytes);
-                        if(r == CHUNKE_STOP) {
-                          /* we're done reading chunks! */
-                          infof(data, "chunk reading DONE\n");
-                          keepon = FALSE;
-                          /* we did the full CONNECT treatment, go to
-                             COMPLETE */
-                          conn->tunnel_state[sockindex] = TUNNEL_COMPLETE;
-                        }
-                        else
-                          infof(data, "Read %zd bytes of chunk, continue\n",
-                                gotbytes);
-                      }
-                      else {
-                        /* without content-length or chunked encoding, we
-                           can't keep the connection alive since the close is
-                           the end signal so we bail out at once instead */
-                        keepon=FALSE;
-                      }
-                    }
-                    else {
-                      keepon = FALSE;
-                      if(200 == data->info.httpproxycode) {
-                        if(gotbytes - (i+1))
-                          failf(data, "Proxy CONNECT followed by %zd bytes "
-                                "of opaque data. Data ignored (known bug #39)",
-                                gotbytes - (i+1));
-                      }
-                    }
-                    /* we did the full CONNECT treatment, go to COMPLETE */
-                    conn->tunnel_state[sockindex] = TUNNEL_COMPLETE;
-                    break; /* breaks out of for-loop, not switch() */
-                  }
-
-                  /* keep a backup of the position we are about to blank */
-                  letter = line_start[perline];
-                  line_start[perline]=0; /* zero terminate the buffer */
-                  if((checkprefix("WWW-Authenticate:", line_start) &&
-                      (401 == k->httpcode)) ||
-                     (checkprefix("Proxy-authenticate:", line_start) &&
-                      (407 == k->httpcode))) {
-                    result = Curl_http_input_auth(conn, k->httpcode,
-                                                  line_start);
-                    if(result)
-                      return result;
-                  }
-                  else if(checkprefix("Content-Length:", line_start)) {
-                    cl = curlx_strtoofft(line_start +
-                                         strlen("Content-Length:"), NULL, 10);
-                  }
-                  else if(Curl_compareheader(line_start,
-                                             "Connection:", "close"))
-                    closeConnection = TRUE;
-                  else if(Curl_compareheader(line_start,
-                                             "Transfer-Encoding:",
-                                             "chunked")) {
-                    infof(data, "CONNECT responded chunked\n");
-                    chunked_encoding = TRUE;
-                    /* init our chunky engine */
-                    Curl_httpchunk_init(conn);
-                  }
-                  else if(Curl_compareheader(line_start,
-                                             "Proxy-Connection:", "close"))
-                    closeConnection = TRUE;
-                  else if(2 == sscanf(line_start, "HTTP/1.%d %d",
-                                      &subversion,
-                                      &k->httpcode)) {
-                    /* store the HTTP code from the proxy */
-                    data->info.httpproxycode = k->httpcode;
-                  }
-                  /* put back the letter we blanked out before */
-                  line_start[perline]= letter;
-
-                  perline=0; /* line starts over here */
-                  line_start = ptr+1; /* this skips the zero byte we wrote */
-                }
-              }
-          }
-          break;
-        } /* switch */
-        if(Curl_pgrsUpdate(conn))
-          return CURLE_ABORTED_BY_CALLBACK;
-      } /* while there's buffer left and loop is requested */
-
-      if(error)
-        return CURLE_RECV_ERROR;
-
-      if(data->info.httpproxycode != 200) {
-        /* Deal with the possibly already received authenticate
-           headers. 'newurl' is set to a new URL if we must loop. */
-        result = Curl_http_auth_act(conn);
-        if(result)
-          return result;
+    /* if timeout is requested, find out how much remaining time we have */
+    check = timeout - /* timeout time */
+      Curl_tvdiff(Curl_tvnow(), conn->now); /* spent time */
+    if(check <= 0) {
+      failf(data, "Proxy CONNECT aborted due to timeout");
+      return CURLE_RECV_ERROR;
+    }
 
-        if(conn->bits.close)
-          /* the connection has been marked for closure, most likely in the
-             Curl_http_auth_act() function and thus we can kill it at once
-             below
-          */
-          closeConnection = TRUE;
-      }
+    result = connect_readresp(conn, sockindex);
+    if(result)
+      return result;
 
-      if(closeConnection && data->req.newurl) {
-        /* Connection closed by server. Don't use it anymore */
-        Curl_closesocket(conn, conn->sock[sockindex]);
-        conn->sock[sockindex] = CURL_SOCKET_BAD;
-        break;
-      }
-    } /* END NEGOTIATION PHASE */
+    if(Curl_pgrsUpdate(conn))
+      return CURLE_ABORTED_BY_CALLBACK;
+
+    if(s->keepon)
+      /* there's more of the response to come, wait for it */
+      return CURLE_OK;
+
+    if(data->info.httpproxycode != 200) {
+      /* Deal with the possibly already received authenticate
+         headers. 'newurl' is set to a new URL if we must loop. */
+      result = Curl_http_auth_act(conn);
+      if(result)
+        return result;
+
+      if(conn->bits.close)
+        /* the connection has been marked for closure, most likely in the
+           Curl_http_auth_act() function and thus we can kill it at once
+           below
+        */
+        s->close_connection = TRUE;
+    }
+
+    if(s->close_connection && data->req.newurl) {
+      /* Connection closed by server. Don't use it anymore */
+      Curl_closesocket(conn, conn->sock[sockindex]);
+      conn->sock[sockindex] = CURL_SOCKET_BAD;
+      break;
+    }
+    /* END NEGOTIATION PHASE */
 
     /* If we are supposed to continue and request a new URL, which basically
      * means the HTTP authentication is still going on so if the tunnel
@@ -527,13 +517,14 @@ CURLcode Curl_proxyCONNECT(struct connectdata *conn,
             conn->tunnel_state[sockindex]);
     }
 
-  } while(data->req.newurl);
+  } while(data->req.newurl &&
+          (TUNNEL_INIT == conn->tunnel_state[sockindex]));
 
   if(200 != data->req.httpcode) {
     failf(data, "Received HTTP code %d from proxy after CONNECT",
           data->req.httpcode);
 
-    if(closeConnection && data->req.newurl)
+    if(s->close_connection && data->req.newurl)
       conn->bits.proxy_connect_closed = TRUE;
 
     if(data->req.newurl) {
@@ -549,6 +540,7 @@ CURLcode Curl_proxyCONNECT(struct connectdata *conn,
   }
 
   conn->tunnel_state[sockindex] = TUNNEL_COMPLETE;
+  data->info.numtunnels++;
 
   /* If a proxy-authorization header was used for the proxy, then we should
      make sure that it isn't accidentally used for the document request
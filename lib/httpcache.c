@@ -0,0 +1,935 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+/*
+ * An in-memory HTTP response cache as described in RFC 7234, kept in a share
+ * object (CURL_LOCK_DATA_HTTP_CACHE) so that all easy handles using the share
+ * benefit from it. It behaves like a private cache: only complete 200
+ * responses to plain GET requests are stored, fresh responses are delivered
+ * without any network traffic and stale ones with a validator are revalidated
+ * with a conditional request.
+ */
+
+#include "curl_setup.h"
+
+#if !defined(CURL_DISABLE_HTTP)
+
+#include "urldata.h"
+#include "sendf.h"
+#include "hash.h"
+#include "share.h"
+#include "http.h"
+#include "progress.h"
+#include "rawstr.h"
+#include "httpcache.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+/* The last #include file should be: */
+#include "memdebug.h"
+
+#define HTTPCACHE_HASH_SIZE 97
+
+/* the maximum number of responses kept in one cache */
+#define HTTPCACHE_MAX_ENTRIES 256
+
+/* responses with larger header and body parts than this are not stored */
+#define HTTPCACHE_MAX_ENTRY_SIZE (512*1024)
+
+/* the state of the cache for the current request */
+struct Curl_httpcache_req {
+  char *id;             /* cache id of the requested resource */
+  struct Curl_httpcache_entry *stale; /* entry being revalidated */
+  bool invalidate;      /* unsafe method, forget the stored response */
+  bool store;           /* the response may still get stored */
+
+  /* the response as it comes in */
+  Curl_send_buffer *headers;
+  Curl_send_buffer *body;
+  char *contenttype;
+  char *etag;
+  char *lastmodified;
+  char *vary;
+  time_t date;          /* Date: or -1 */
+  time_t expires;       /* Expires: or -1 */
+  long age;             /* Age: or 0 */
+  long max_age;         /* Cache-Control: max-age or -1 */
+  bool no_store;
+  bool no_cache;
+  time_t request_time;
+};
+
+static void free_buffer(Curl_send_buffer *buf)
+{
+  if(buf) {
+    Curl_safefree(buf->buffer);
+    free(buf);
+  }
+}
+
+static void freecacheentry(void *freethis)
+{
+  struct Curl_httpcache_entry *entry =
+    (struct Curl_httpcache_entry *) freethis;
+
+  Curl_safefree(entry->headers);
+  Curl_safefree(entry->body);
+  Curl_safefree(entry->contenttype);
+  Curl_safefree(entry->etag);
+  Curl_safefree(entry->lastmodified);
+  Curl_safefree(entry->vary);
+  Curl_safefree(entry->varyvalues);
+  free(entry);
+}
+
+/*
+ * Curl_mk_httpcache() creates a new response cache and returns the handle for
+ * it.
+ */
+struct curl_hash *Curl_mk_httpcache(void)
+{
+  return Curl_hash_alloc(HTTPCACHE_HASH_SIZE, Curl_hash_str,
+                         Curl_str_key_compare, freecacheentry);
+}
+
+static char *dup_or_null(const char *str, bool *oom)
+{
+  char *copy;
+
+  if(!str)
+    return NULL;
+  copy = strdup(str);
+  if(!copy)
+    *oom = TRUE;
+  return copy;
+}
+
+static char *dup_mem(const char *ptr, size_t len, bool *oom)
+{
+  /* always allocate at least one byte so that an empty part is non-NULL */
+  char *copy = malloc(len ? len : 1);
+
+  if(!copy)
+    *oom = TRUE;
+  else if(len)
+    memcpy(copy, ptr, len);
+  return copy;
+}
+
+static struct Curl_httpcache_entry *
+dup_entry(const struct Curl_httpcache_entry *entry)
+{
+  bool oom = FALSE;
+  struct Curl_httpcache_entry *copy =
+    calloc(1, sizeof(struct Curl_httpcache_entry));
+
+  if(!copy)
+    return NULL;
+
+  *copy = *entry;
+  copy->headers = dup_mem(entry->headers, entry->headerlen, &oom);
+  copy->body = dup_mem(entry->body, entry->bodylen, &oom);
+  copy->contenttype = dup_or_null(entry->contenttype, &oom);
+  copy->etag = dup_or_null(entry->etag, &oom);
+  copy->lastmodified = dup_or_null(entry->lastmodified, &oom);
+  copy->vary = dup_or_null(entry->vary, &oom);
+  copy->varyvalues = dup_or_null(entry->varyvalues, &oom);
+
+  if(oom) {
+    freecacheentry(copy);
+    return NULL;
+  }
+  return copy;
+}
+
+/*
+ * Return a cache id for the URL. The fragment is never sent and is cut off,
+ * the Accept-Encoding setting is added since it decides what body the
+ * application gets to see.
+ */
+static char *create_httpcache_id(struct SessionHandle *data)
+{
+  const char *url = data->change.url;
+  const char *encoding = data->set.str[STRING_ENCODING];
+
+  return aprintf("%.*s\n%s", (int)strcspn(url, "#"), url,
+                 encoding ? encoding : "");
+}
+
+/*
+ * Return the value of the given request header, a pointer into one of the
+ * custom headers or one of the strings libcurl generates the header from.
+ */
+static const char *request_header(struct SessionHandle *data,
+                                  const char *name, size_t namelen)
+{
+  struct curl_slist *head;
+
+  for(head = data->set.headers; head; head = head->next) {
+    if(Curl_raw_nequal(head->data, name, namelen) &&
+       (head->data[namelen] == ':')) {
+      const char *value = &head->data[namelen + 1];
+      while(*value && ISSPACE(*value))
+        value++;
+      return value;
+    }
+  }
+
+  if((namelen == 15) && Curl_raw_nequal(name, "Accept-Encoding", 15))
+    return data->set.str[STRING_ENCODING];
+  if((namelen == 10) && Curl_raw_nequal(name, "User-Agent", 10))
+    return data->set.str[STRING_USERAGENT];
+  if((namelen == 7) && Curl_raw_nequal(name, "Referer", 7))
+    return data->change.referer;
+
+  return NULL;
+}
+
+/*
+ * Return the request's values of all the headers listed in the Vary: header
+ * value 'vary' as one allocated string, so that two requests can be compared
+ * by a plain string compare.
+ */
+static char *vary_values(struct SessionHandle *data, const char *vary)
+{
+  Curl_send_buffer *buf = Curl_add_buffer_init();
+  CURLcode result = CURLE_OK;
+  char *values;
+
+  if(!buf)
+    return NULL;
+
+  while(vary && *vary && !result) {
+    size_t namelen;
+    const char *value;
+
+    while(*vary && (ISSPACE(*vary) || (*vary == ',')))
+      vary++;
+    namelen = strcspn(vary, ", \t");
+    if(!namelen)
+      break;
+
+    value = request_header(data, vary, namelen);
+    result = Curl_add_bufferf(buf, "%s\n", value ? value : "");
+    vary += namelen;
+  }
+
+  if(!result)
+    result = Curl_add_buffer(buf, "", 1);
+  if(result)
+    /* the buffer is already freed */
+    return NULL;
+
+  values = buf->buffer;
+  free(buf);
+  return values;
+}
+
+/* check a Cache-Control: or Pragma: value for a directive */
+static bool has_directive(const char *value, const char *directive,
+                          const char **arg)
+{
+  size_t len = strlen(directive);
+
+  while(value && *value) {
+    while(*value && (ISSPACE(*value) || (*value == ',')))
+      value++;
+    if(Curl_raw_nequal(value, directive, len) &&
+       (!value[len] || (value[len] == '=') || (value[len] == ',') ||
+        ISSPACE(value[len]))) {
+      if(arg)
+        *arg = (value[len] == '=') ? &value[len + 1] : NULL;
+      return TRUE;
+    }
+    value = strchr(value, ',');
+  }
+  return FALSE;
+}
+
+/* the request asks for the stored response to not be used as-is */
+static bool request_no_cache(struct SessionHandle *data)
+{
+  const char *cc = Curl_checkheaders(data, "Cache-Control:");
+  const char *pragma = Curl_checkheaders(data, "Pragma:");
+  const char *arg;
+
+  if(cc && (has_directive(cc + 14, "no-cache", NULL) ||
+            (has_directive(cc + 14, "max-age", &arg) && arg &&
+             !strtol(arg, NULL, 10))))
+    return TRUE;
+  if(!cc && pragma && has_directive(pragma + 7, "no-cache", NULL))
+    return TRUE;
+
+  return FALSE;
+}
+
+static bool request_no_store(struct SessionHandle *data)
+{
+  const char *cc = Curl_checkheaders(data, "Cache-Control:");
+
+  return (cc && has_directive(cc + 14, "no-store", NULL)) ? TRUE : FALSE;
+}
+
+/* the current age of the entry, RFC 7234 section 4.2.3 */
+static time_t current_age(const struct Curl_httpcache_entry *entry,
+                          time_t now)
+{
+  return entry->age + ((now > entry->stored) ? (now - entry->stored) : 0);
+}
+
+static int entry_is_stale(void *datap, void *hc)
+{
+  struct Curl_httpcache_entry *entry = (struct Curl_httpcache_entry *) hc;
+  time_t now = *(time_t *)datap;
+
+  return (entry->lifetime <= current_age(entry, now)) ? 1 : 0;
+}
+
+/*
+ * Store the entry in the cache. The entry is owned by the cache from now on,
+ * even when it could not be added.
+ */
+static CURLcode store_entry(struct SessionHandle *data, const char *id,
+                            struct Curl_httpcache_entry *entry)
+{
+  struct curl_hash *cache = data->share->httpcache;
+  size_t id_len = strlen(id);
+  CURLcode result = CURLE_OK;
+  time_t now;
+
+  time(&now);
+
+  Curl_share_lock(data, CURL_LOCK_DATA_HTTP_CACHE, CURL_LOCK_ACCESS_SINGLE);
+
+  if((cache->size >= HTTPCACHE_MAX_ENTRIES) &&
+     !Curl_hash_pick(cache, (void *)id, id_len+1))
+    /* full, make room by throwing out everything that is stale */
+    Curl_hash_clean_with_criterium(cache, &now, entry_is_stale);
+
+  if(cache->size >= HTTPCACHE_MAX_ENTRIES) {
+    infof(data, "HTTP cache full, response not stored\n");
+    freecacheentry(entry);
+  }
+  else if(!Curl_hash_add(cache, (void *)id, id_len+1, entry)) {
+    freecacheentry(entry);
+    result = CURLE_OUT_OF_MEMORY;
+  }
+
+  Curl_share_unlock(data, CURL_LOCK_DATA_HTTP_CACHE);
+
+  return result;
+}
+
+/*
+ * Deliver data for a response served from the cache. Without a connection
+ * the callbacks are called directly, which means no support for pausing.
+ */
+static CURLcode cache_write(struct SessionHandle *data,
+                            struct connectdata *conn, int type,
+                            char *ptr, size_t len)
+{
+  size_t wrote;
+
+  if(conn)
+    return Curl_client_write(conn, type, ptr, len);
+
+  if(!len)
+    return CURLE_OK;
+
+  if(type & CLIENTWRITE_BODY) {
+    wrote = data->set.fwrite_func(ptr, 1, len, data->set.out);
+    if(wrote != len) {
+      if(wrote == CURL_WRITEFUNC_PAUSE)
+        failf(data, "Pausing is not supported for cached responses");
+      else
+        failf(data, "Failed writing body (%zu != %zu)", wrote, len);
+      return CURLE_WRITE_ERROR;
+    }
+  }
+
+  if((type & CLIENTWRITE_HEADER) &&
+     (data->set.fwrite_header || data->set.writeheader)) {
+    curl_write_callback writeit =
+      data->set.fwrite_header?data->set.fwrite_header:data->set.fwrite_func;
+
+    wrote = writeit(ptr, 1, len, data->set.writeheader);
+    if(wrote != len) {
+      failf(data, "Failed writing header");
+      return CURLE_WRITE_ERROR;
+    }
+  }
+
+  return CURLE_OK;
+}
+
+/*
+ * Do what the header parser does with a stored header line when the response
+ * is served without a connection. Only 200 responses are stored, so there is
+ * no redirect to follow, and requests that may use cookies are never served
+ * from the cache, so there are no cookies to take in either.
+ */
+static void replay_header(struct SessionHandle *data, const char *line)
+{
+  if(checkprefix("Last-Modified:", line) &&
+     (data->set.timecondition || data->set.get_filetime)) {
+    time_t secs = time(NULL);
+    data->req.timeofdoc = curl_getdate(line + 14, &secs);
+    if(data->set.get_filetime)
+      data->info.filetime = (long)data->req.timeofdoc;
+  }
+}
+
+/* deliver a stored response to the application */
+static CURLcode serve_entry(struct SessionHandle *data,
+                            struct connectdata *conn,
+                            struct Curl_httpcache_entry *entry)
+{
+  CURLcode result = CURLE_OK;
+  int writetype = CLIENTWRITE_HEADER;
+  char *line = entry->headers;
+  char *end = entry->headers + entry->headerlen;
+
+  if(data->set.include_header)
+    writetype |= CLIENTWRITE_BODY;
+
+  /* the header callback gets one header line per invoke */
+  while((line < end) && !result) {
+    char *nl = memchr(line, '\n', end - line);
+    size_t len = nl ? (size_t)(nl - line) + 1 : (size_t)(end - line);
+
+    if(!conn) {
+      replay_header(data, line);
+      if(data->set.verbose)
+        Curl_debug(data, CURLINFO_HEADER_IN, line, len, NULL);
+    }
+    result = cache_write(data, conn, writetype, line, len);
+    line += len;
+  }
+
+  if(!result)
+    result = cache_write(data, conn, CLIENTWRITE_BODY,
+                         entry->body, entry->bodylen);
+  if(result)
+    return result;
+
+  data->info.httpcode = entry->httpcode;
+  data->info.httpversion = entry->httpversion;
+  if(!conn)
+    data->info.header_size += (long)entry->headerlen;
+
+  Curl_safefree(data->info.contenttype);
+  if(entry->contenttype) {
+    data->info.contenttype = strdup(entry->contenttype);
+    if(!data->info.contenttype)
+      return CURLE_OUT_OF_MEMORY;
+  }
+
+  Curl_pgrsSetDownloadSize(data, (curl_off_t)entry->bodylen);
+  Curl_pgrsSetDownloadCounter(data, (curl_off_t)entry->bodylen);
+
+  return CURLE_OK;
+}
+
+/*
+ * Return TRUE if the request may carry cookies or credentials. The cache id
+ * doesn't include them, so such requests are neither served from the cache
+ * nor stored, or one user's response could be handed to another.
+ */
+static bool personal_request(struct SessionHandle *data)
+{
+  const char *url = data->change.url;
+  const char *auth = strstr(url, "://");
+  size_t authlen;
+
+  if(data->cookies || data->set.str[STRING_COOKIE] ||
+     Curl_checkheaders(data, "Cookie:"))
+    return TRUE;
+
+  if(data->set.str[STRING_USERNAME] || data->set.str[STRING_PASSWORD] ||
+     (data->set.use_netrc != CURL_NETRC_IGNORED) ||
+     Curl_checkheaders(data, "Authorization:"))
+    return TRUE;
+
+  /* user name and password in the URL */
+  auth = auth ? auth + 3 : url;
+  authlen = strcspn(auth, "/?#");
+  return memchr(auth, '@', authlen) ? TRUE : FALSE;
+}
+
+/* Return TRUE if the request's method and options allow a stored response */
+static bool cacheable_request(struct SessionHandle *data)
+{
+  return (data->set.httpreq == HTTPREQ_GET) &&
+    !data->set.opt_no_body && !data->set.upload &&
+    !data->set.str[STRING_CUSTOMREQUEST] &&
+    !data->set.str[STRING_SET_RANGE] && !data->set.set_resume_from &&
+    !Curl_checkheaders(data, "Range:") &&
+    !personal_request(data);
+}
+
+/* Return TRUE if the request's method may modify the resource */
+static bool unsafe_request(struct SessionHandle *data)
+{
+  const char *custom = data->set.str[STRING_CUSTOMREQUEST];
+
+  if(custom)
+    return (!Curl_raw_equal(custom, "GET") &&
+            !Curl_raw_equal(custom, "HEAD") &&
+            !Curl_raw_equal(custom, "OPTIONS")) ? TRUE : FALSE;
+
+  return ((data->set.httpreq != HTTPREQ_GET) &&
+          (data->set.httpreq != HTTPREQ_HEAD)) || data->set.upload;
+}
+
+CURLcode Curl_httpcache_lookup(struct SessionHandle *data, bool *served)
+{
+  struct Curl_httpcache_req *hc;
+  struct Curl_httpcache_entry *entry;
+  struct Curl_httpcache_entry *fresh = NULL;
+  struct curl_hash *cache;
+  const char *url = data->change.url;
+  CURLcode result = CURLE_OK;
+  bool conditional;
+  size_t id_len;
+  time_t now;
+
+  *served = FALSE;
+
+  /* forget what a previous request in this transfer left behind */
+  Curl_httpcache_cleanup(data);
+  data->info.httpcache = CURL_HTTPCACHE_NONE;
+
+  if(!data->share || !data->share->httpcache ||
+     (!checkprefix("http://", url) && !checkprefix("https://", url)))
+    return CURLE_OK;
+
+  cache = data->share->httpcache;
+
+  if(!cacheable_request(data) && !unsafe_request(data))
+    return CURLE_OK;
+
+  hc = calloc(1, sizeof(struct Curl_httpcache_req));
+  if(!hc)
+    return CURLE_OUT_OF_MEMORY;
+  data->state.httpcache = hc;
+
+  hc->id = create_httpcache_id(data);
+  if(!hc->id)
+    return CURLE_OUT_OF_MEMORY;
+  id_len = strlen(hc->id);
+
+  if(!cacheable_request(data)) {
+    hc->invalidate = TRUE;
+    return CURLE_OK;
+  }
+
+  if(request_no_store(data)) {
+    Curl_httpcache_cleanup(data);
+    return CURLE_OK;
+  }
+
+  /* a request with conditions of its own wants to see the real response */
+  conditional = (data->set.timecondition ||
+                 Curl_checkheaders(data, "If-None-Match:") ||
+                 Curl_checkheaders(data, "If-Modified-Since:")) ?
+    TRUE : FALSE;
+
+  time(&now);
+  hc->request_time = now;
+  hc->store = TRUE;
+  hc->date = hc->expires = -1;
+  hc->max_age = -1;
+  data->info.httpcache = CURL_HTTPCACHE_MISS;
+
+  Curl_share_lock(data, CURL_LOCK_DATA_HTTP_CACHE, CURL_LOCK_ACCESS_SINGLE);
+
+  entry = Curl_hash_pick(cache, hc->id, id_len+1);
+  if(entry && entry->vary) {
+    /* only use it if the request headers the response varies on match */
+    char *values = vary_values(data, entry->vary);
+    if(!values)
+      result = CURLE_OUT_OF_MEMORY;
+    else if(strcmp(values, entry->varyvalues))
+      entry = NULL;
+    Curl_safefree(values);
+  }
+
+  if(entry && !result && !conditional) {
+    if(!entry->no_cache && !request_no_cache(data) &&
+       (entry->lifetime > current_age(entry, now))) {
+      /* copy it to serve it without holding the lock */
+      fresh = dup_entry(entry);
+      if(!fresh)
+        result = CURLE_OUT_OF_MEMORY;
+    }
+    else if(entry->etag || entry->lastmodified) {
+      hc->stale = dup_entry(entry);
+      if(!hc->stale)
+        result = CURLE_OUT_OF_MEMORY;
+    }
+    else
+      /* stale and no way to revalidate it */
+      Curl_hash_delete(cache, hc->id, id_len+1);
+  }
+
+  Curl_share_unlock(data, CURL_LOCK_DATA_HTTP_CACHE);
+
+  if(fresh) {
+    infof(data, "Serving %s from the HTTP cache\n", url);
+    hc->store = FALSE;
+    result = serve_entry(data, NULL, fresh);
+    freecacheentry(fresh);
+    if(!result) {
+      data->info.httpcache = CURL_HTTPCACHE_HIT;
+      *served = TRUE;
+    }
+  }
+  else if(hc->stale)
+    infof(data, "Revalidating stale HTTP cache entry for %s\n", url);
+
+  return result;
+}
+
+CURLcode Curl_httpcache_conditions(struct SessionHandle *data,
+                                   Curl_send_buffer *req_buffer)
+{
+  struct Curl_httpcache_req *hc = data->state.httpcache;
+  CURLcode result = CURLE_OK;
+
+  if(!hc || !hc->stale)
+    return CURLE_OK;
+
+  if(hc->stale->etag)
+    result = Curl_add_bufferf(req_buffer, "If-None-Match: %s\r\n",
+                              hc->stale->etag);
+  if(!result && hc->stale->lastmodified)
+    result = Curl_add_bufferf(req_buffer, "If-Modified-Since: %s\r\n",
+                              hc->stale->lastmodified);
+  return result;
+}
+
+/* forget all that was gathered from the response headers so far */
+static void reset_response(struct Curl_httpcache_req *hc)
+{
+  free_buffer(hc->headers);
+  hc->headers = NULL;
+  Curl_safefree(hc->contenttype);
+  Curl_safefree(hc->etag);
+  Curl_safefree(hc->lastmodified);
+  Curl_safefree(hc->vary);
+  hc->date = hc->expires = -1;
+  hc->age = 0;
+  hc->max_age = -1;
+  hc->no_store = hc->no_cache = FALSE;
+}
+
+static CURLcode parse_header(struct Curl_httpcache_req *hc, const char *line)
+{
+  char **target = NULL;
+  const char *arg;
+
+  if(checkprefix("Cache-Control:", line)) {
+    const char *value = line + 14;
+    if(has_directive(value, "no-store", NULL))
+      hc->no_store = TRUE;
+    if(has_directive(value, "no-cache", NULL))
+      hc->no_cache = TRUE;
+    if(has_directive(value, "max-age", &arg) && arg)
+      hc->max_age = strtol(arg, NULL, 10);
+  }
+  else if(checkprefix("Pragma:", line)) {
+    if(has_directive(line + 7, "no-cache", NULL))
+      hc->no_cache = TRUE;
+  }
+  else if(checkprefix("Expires:", line)) {
+    hc->expires = curl_getdate(line + 8, NULL);
+    if(hc->expires == -1)
+      /* an invalid date means already expired */
+      hc->expires = 0;
+  }
+  else if(checkprefix("Date:", line))
+    hc->date = curl_getdate(line + 5, NULL);
+  else if(checkprefix("Age:", line))
+    hc->age = strtol(line + 4, NULL, 10);
+  else if(checkprefix("ETag:", line))
+    target = &hc->etag;
+  else if(checkprefix("Last-Modified:", line))
+    target = &hc->lastmodified;
+  else if(checkprefix("Vary:", line))
+    target = &hc->vary;
+  else if(checkprefix("Content-Type:", line))
+    target = &hc->contenttype;
+
+  if(target) {
+    char *value = Curl_copy_header_value(line);
+    if(!value)
+      return CURLE_OUT_OF_MEMORY;
+    Curl_safefree(*target);
+    *target = value;
+  }
+
+  return CURLE_OK;
+}
+
+CURLcode Curl_httpcache_header(struct connectdata *conn,
+                               const char *line, size_t len, bool *hide)
+{
+  struct SessionHandle *data = conn->data;
+  struct SingleRequest *k = &data->req;
+  struct Curl_httpcache_req *hc = data->state.httpcache;
+  size_t used;
+
+  *hide = FALSE;
+
+  if(!hc || (!hc->store && !hc->stale))
+    return CURLE_OK;
+
+  if((k->httpcode >= 100) && (k->httpcode < 200)) {
+    if((*line == '\r') || (*line == '\n'))
+      /* end of an informational response, the real one comes next */
+      reset_response(hc);
+    return CURLE_OK;
+  }
+
+  if((k->httpcode == 304) && hc->stale)
+    /* the stored response is delivered instead of this */
+    *hide = TRUE;
+  else if(k->httpcode != 200)
+    hc->store = FALSE;
+
+  if(hc->store) {
+    used = hc->headers ? hc->headers->size_used : 0;
+    if(used + len > HTTPCACHE_MAX_ENTRY_SIZE)
+      hc->store = FALSE;
+    else {
+      if(!hc->headers) {
+        hc->headers = Curl_add_buffer_init();
+        if(!hc->headers)
+          return CURLE_OUT_OF_MEMORY;
+      }
+      if(Curl_add_buffer(hc->headers, line, len)) {
+        /* the buffer is gone */
+        hc->headers = NULL;
+        return CURLE_OUT_OF_MEMORY;
+      }
+    }
+  }
+
+  return parse_header(hc, line);
+}
+
+/*
+ * Calculate the freshness lifetime and the initial age of a response
+ * from the headers gathered in 'hc', RFC 7234 sections 4.2.1 and 4.2.3.
+ */
+static void set_freshness(struct Curl_httpcache_req *hc,
+                          struct Curl_httpcache_entry *entry, time_t now)
+{
+  time_t date = (hc->date != -1) ? hc->date : now;
+  time_t apparent_age = (now > date) ? now - date : 0;
+  time_t corrected_age = hc->age + (now - hc->request_time);
+
+  if(hc->max_age >= 0)
+    entry->lifetime = hc->max_age;
+  else if(hc->expires != -1)
+    entry->lifetime = (hc->expires > date) ? hc->expires - date : 0;
+  else if(entry->lastmodified) {
+    /* heuristic freshness, a tenth of the time since it was modified */
+    time_t lastmod = curl_getdate(entry->lastmodified, NULL);
+    entry->lifetime = ((lastmod != -1) && (date > lastmod)) ?
+      (date - lastmod) / 10 : 0;
+  }
+  else
+    entry->lifetime = 0;
+
+  entry->age = (apparent_age > corrected_age) ? apparent_age : corrected_age;
+  entry->stored = now;
+  entry->no_cache = hc->no_cache;
+}
+
+CURLcode Curl_httpcache_headers_done(struct connectdata *conn)
+{
+  struct SessionHandle *data = conn->data;
+  struct Curl_httpcache_req *hc = data->state.httpcache;
+  struct Curl_httpcache_entry *entry;
+  CURLcode result;
+  time_t now;
+
+  if(!hc || !hc->stale)
+    return CURLE_OK;
+
+  entry = hc->stale;
+  hc->stale = NULL;
+
+  if(data->req.httpcode != 304) {
+    /* a full response, it replaces the stored one if storable */
+    freecacheentry(entry);
+    return CURLE_OK;
+  }
+
+  infof(data, "HTTP cache entry revalidated\n");
+  hc->store = FALSE;
+
+  /* update the stored response with what the 304 response told */
+  time(&now);
+  if(hc->etag) {
+    Curl_safefree(entry->etag);
+    entry->etag = hc->etag;
+    hc->etag = NULL;
+  }
+  if((hc->max_age >= 0) || (hc->expires != -1))
+    set_freshness(hc, entry, now);
+  else {
+    /* keep the old lifetime, but age it from now */
+    time_t lifetime = entry->lifetime;
+    set_freshness(hc, entry, now);
+    entry->lifetime = lifetime;
+  }
+  entry->no_cache = entry->no_cache || hc->no_cache;
+
+  result = serve_entry(data, conn, entry);
+  if(result) {
+    freecacheentry(entry);
+    return result;
+  }
+  data->info.httpcache = CURL_HTTPCACHE_REVALIDATED;
+
+  return store_entry(data, hc->id, entry);
+}
+
+void Curl_httpcache_body(struct SessionHandle *data,
+                         const char *ptr, size_t len)
+{
+  struct Curl_httpcache_req *hc = data->state.httpcache;
+  size_t used;
+
+  if(!hc || !hc->store)
+    return;
+
+  used = (hc->headers ? hc->headers->size_used : 0) +
+    (hc->body ? hc->body->size_used : 0);
+
+  if(used + len > HTTPCACHE_MAX_ENTRY_SIZE) {
+    /* too large to be stored */
+    hc->store = FALSE;
+    return;
+  }
+
+  if(!hc->body) {
+    hc->body = Curl_add_buffer_init();
+    if(!hc->body) {
+      hc->store = FALSE;
+      return;
+    }
+  }
+
+  if(len && Curl_add_buffer(hc->body, ptr, len)) {
+    /* the buffer is gone */
+    hc->body = NULL;
+    hc->store = FALSE;
+  }
+}
+
+CURLcode Curl_httpcache_done(struct connectdata *conn)
+{
+  struct SessionHandle *data = conn->data;
+  struct Curl_httpcache_req *hc = data->state.httpcache;
+  struct Curl_httpcache_entry *entry;
+  bool oom = FALSE;
+
+  if(!hc)
+    return CURLE_OK;
+
+  if(hc->invalidate) {
+    /* a successful unsafe request makes the stored response outdated */
+    if((data->info.httpcode >= 200) && (data->info.httpcode < 400)) {
+      Curl_share_lock(data, CURL_LOCK_DATA_HTTP_CACHE,
+                      CURL_LOCK_ACCESS_SINGLE);
+      Curl_hash_delete(data->share->httpcache, hc->id, strlen(hc->id)+1);
+      Curl_share_unlock(data, CURL_LOCK_DATA_HTTP_CACHE);
+    }
+    return CURLE_OK;
+  }
+
+  if(!hc->store || !hc->headers || (data->req.httpcode != 200) ||
+     hc->no_store || (hc->vary && strchr(hc->vary, '*')))
+    return CURLE_OK;
+  hc->store = FALSE;
+
+  entry = calloc(1, sizeof(struct Curl_httpcache_entry));
+  if(!entry)
+    return CURLE_OUT_OF_MEMORY;
+
+  entry->headerlen = hc->headers->size_used;
+  entry->headers = dup_mem(hc->headers->buffer, entry->headerlen, &oom);
+  entry->bodylen = hc->body ? hc->body->size_used : 0;
+  entry->body = dup_mem(hc->body ? hc->body->buffer : NULL,
+                        entry->bodylen, &oom);
+  entry->contenttype = dup_or_null(hc->contenttype, &oom);
+  entry->etag = dup_or_null(hc->etag, &oom);
+  entry->lastmodified = dup_or_null(hc->lastmodified, &oom);
+  entry->vary = dup_or_null(hc->vary, &oom);
+  if(entry->vary && !oom) {
+    entry->varyvalues = vary_values(data, entry->vary);
+    if(!entry->varyvalues)
+      oom = TRUE;
+  }
+  entry->httpcode = data->req.httpcode;
+  entry->httpversion = conn->httpversion;
+  set_freshness(hc, entry, time(NULL));
+
+  if(oom) {
+    freecacheentry(entry);
+    return CURLE_OUT_OF_MEMORY;
+  }
+
+  if(!entry->lifetime && !entry->etag && !entry->lastmodified) {
+    /* neither fresh nor possible to revalidate, pointless to store */
+    freecacheentry(entry);
+    return CURLE_OK;
+  }
+
+  infof(data, "Response stored in the HTTP cache, fresh for %ld seconds\n",
+        (long)entry->lifetime);
+
+  return store_entry(data, hc->id, entry);
+}
+
+void Curl_httpcache_cleanup(struct SessionHandle *data)
+{
+  struct Curl_httpcache_req *hc = data->state.httpcache;
+
+  if(!hc)
+    return;
+
+  reset_response(hc);
+  free_buffer(hc->body);
+  if(hc->stale)
+    freecacheentry(hc->stale);
+  Curl_safefree(hc->id);
+  free(hc);
+  data->state.httpcache = NULL;
+}
+
+#endif /* CURL_DISABLE_HTTP */
@@ -0,0 +1,90 @@
+#ifndef HEADER_CURL_HTTPCACHE_H
+#define HEADER_CURL_HTTPCACHE_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#if !defined(CURL_DISABLE_HTTP)
+
+struct curl_hash;
+struct Curl_send_buffer;
+
+/* a stored response */
+struct Curl_httpcache_entry {
+  char *headers;        /* the full response header block as received */
+  size_t headerlen;
+  char *body;           /* the response body as passed to the application */
+  size_t bodylen;
+  char *contenttype;    /* Content-Type: value or NULL */
+  char *etag;           /* ETag: value or NULL */
+  char *lastmodified;   /* Last-Modified: value or NULL */
+  char *vary;           /* Vary: value or NULL */
+  char *varyvalues;     /* the request's values of the headers in 'vary' */
+  long httpcode;
+  long httpversion;
+  time_t stored;        /* when the response was received */
+  time_t age;           /* corrected age of the response when stored */
+  time_t lifetime;      /* freshness lifetime in seconds */
+  bool no_cache;        /* must be revalidated before each use */
+};
+
+/* make a new response cache and return the handle for it */
+struct curl_hash *Curl_mk_httpcache(void);
+
+/*
+ * Curl_httpcache_lookup() is called before a connection is setup for a
+ * request. It sets '*served' TRUE if the response was delivered from the
+ * cache, and otherwise prepares for the response to get stored or a stale
+ * entry to get revalidated.
+ */
+CURLcode Curl_httpcache_lookup(struct SessionHandle *data, bool *served);
+
+/* add conditional request headers when a stale entry is revalidated */
+CURLcode Curl_httpcache_conditions(struct SessionHandle *data,
+                                   struct Curl_send_buffer *req_buffer);
+
+/* a response header line was received, '*hide' is set TRUE if it should
+   not be passed on to the application */
+CURLcode Curl_httpcache_header(struct connectdata *conn,
+                               const char *line, size_t len, bool *hide);
+
+/* all the response headers have been received */
+CURLcode Curl_httpcache_headers_done(struct connectdata *conn);
+
+/* a piece of response body was passed on to the application */
+void Curl_httpcache_body(struct SessionHandle *data,
+                         const char *ptr, size_t len);
+
+/* the request is complete, store the response if possible */
+CURLcode Curl_httpcache_done(struct connectdata *conn);
+
+/* free the per-request cache state */
+void Curl_httpcache_cleanup(struct SessionHandle *data);
+
+#else
+#define Curl_httpcache_lookup(x,y) CURLE_OK
+#define Curl_httpcache_body(x,y,z) Curl_nop_stmt
+#define Curl_httpcache_cleanup(x) Curl_nop_stmt
+#endif
+
+#endif /* HEADER_CURL_HTTPCACHE_H */
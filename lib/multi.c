@@ -34,12 +34,15 @@
 #include "sendf.h"
 #include "timeval.h"
 #include "http.h"
+#include "httpcache.h"
 #include "select.h"
 #include "warnless.h"
 #include "speedcheck.h"
 #include "conncache.h"
 #include "bundles.h"
 #include "multihandle.h"
+#include "socks.h"
+#include "ratelimit.h"
 
 #define _MPRINTF_REPLACE /* use our functions only */
 #include <curl/mprintf.h>
@@ -72,6 +75,7 @@ static int update_timer(struct Curl_multi *multi);
 static CURLcode addHandleToSendOrPendPipeline(struct SessionHandle *handle,
                                               struct connectdata *conn);
 static int checkPendPipeline(struct connectdata *conn);
+static void process_pending_handles(struct Curl_multi *multi);
 static void moveHandleFromSendToRecvPipeline(struct SessionHandle *handle,
                                              struct connectdata *conn);
 static void moveHandleFromRecvToDonePipeline(struct SessionHandle *handle,
@@ -85,6 +89,7 @@ static CURLMcode add_next_timeout(struct timeval now,
 #ifdef DEBUGBUILD
 static const char * const statename[]={
   "INIT",
+  "CONNECT_PEND",
   "CONNECT",
   "WAITRESOLVE",
   "WAITCONNECT",
@@ -153,6 +158,8 @@ static void mstate(struct Curl_one_easy *easy, CURLMstate state
 
 struct Curl_sh_entry {
   struct SessionHandle *easy;
+  struct Curl_prefetch *prefetch; /* the prefetch lookup the socket is for */
+  struct connectdata *idle; /* the idle connection the socket is for */
   time_t timestamp;
   int action;  /* what action READ/WRITE this socket waits for */
   curl_socket_t socket; /* mainly to ease debugging */
@@ -308,19 +315,28 @@ CURLM *curl_multi_init(void)
   if(!multi->msglist)
     goto error;
 
+  multi->idle = Curl_llist_alloc(multi_freeamsg);
+  if(!multi->idle)
+    goto error;
+
   /* Let's make the doubly-linked list a circular list.  This makes
      the linked list code simpler and allows inserting at the end
      with less work (we didn't keep a tail pointer before). */
   multi->easy.next = &multi->easy;
   multi->easy.prev = &multi->easy;
 
+  multi->max_pipeline_length = MAX_PIPELINE_LENGTH;
+  multi->max_resolver_threads = DEFAULT_RESOLVER_THREADS;
+
   return (CURLM *) multi;
 
   error:
 
+  Curl_llist_destroy(multi->msglist, NULL);
+  multi->msglist = NULL;
   Curl_hash_destroy(multi->sockhash);
   multi->sockhash = NULL;
-  Curl_hash_destroy(multi->hostcache);
+  Curl_dnscache_destroy(multi->hostcache);
   multi->hostcache = NULL;
   Curl_conncache_destroy(multi->conn_cache);
   multi->conn_cache = NULL;
@@ -334,10 +350,11 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
 {
   struct curl_llist *timeoutlist;
   struct Curl_one_easy *easy;
+  struct Curl_one_easy *pos;
   struct Curl_multi *multi = (struct Curl_multi *)multi_handle;
   struct SessionHandle *data = (struct SessionHandle *)easy_handle;
   struct SessionHandle *new_closure = NULL;
-  struct curl_hash *hostcache = NULL;
+  struct Curl_dnscache *hostcache = NULL;
 
   /* First, make some basic checks that the CURLM handle is a good handle */
   if(!GOOD_MULTI_HANDLE(multi))
@@ -381,7 +398,7 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
   if(!multi->closure_handle) {
     new_closure = (struct SessionHandle *)curl_easy_init();
     if(!new_closure) {
-      Curl_hash_destroy(hostcache);
+      Curl_dnscache_destroy(hostcache);
       free(easy);
       Curl_llist_destroy(timeoutlist, NULL);
       return CURLM_OUT_OF_MEMORY;
@@ -420,31 +437,43 @@ CURLMcode curl_multi_add_handle(CURLM *multi_handle,
   easy->easy_handle->multi_pos =  easy;
 
   /* for multi interface connections, we share DNS cache automatically if the
-     easy handle's one is currently not set. */
+     easy handle's one is currently not set. The global one is used instead
+     if the handle asks for it. */
   if(!easy->easy_handle->dns.hostcache ||
      (easy->easy_handle->dns.hostcachetype == HCACHE_NONE)) {
-    easy->easy_handle->dns.hostcache = multi->hostcache;
-    easy->easy_handle->dns.hostcachetype = HCACHE_MULTI;
+    struct Curl_dnscache *global = NULL;
+    if(data->set.global_dns_cache)
+      global = Curl_global_host_cache_init();
+    if(global) {
+      easy->easy_handle->dns.hostcache = global;
+      easy->easy_handle->dns.hostcachetype = HCACHE_GLOBAL;
+    }
+    else {
+      easy->easy_handle->dns.hostcache = multi->hostcache;
+      easy->easy_handle->dns.hostcachetype = HCACHE_MULTI;
+    }
   }
 
   /* Point to the multi's connection cache */
   easy->easy_handle->state.conn_cache = multi->conn_cache;
 
-  /* This adds the new entry at the 'end' of the doubly-linked circular
-     list of Curl_one_easy structs to try and maintain a FIFO queue so
-     the pipelined requests are in order. */
+  /* This adds the new entry after the last one of the same or a higher
+     priority in the doubly-linked circular list of Curl_one_easy structs.
+     The more urgent transfers are thus served first, and the list is a FIFO
+     queue within each priority so the pipelined requests are in order. */
+  pos = multi->easy.prev;
+  while((pos != &multi->easy) &&
+        (pos->easy_handle->set.priority < data->set.priority))
+    pos = pos->prev;
 
-  /* We add this new entry last in the list. We make our 'next' point to the
-     'first' struct and our 'prev' point to the previous 'prev' */
-  easy->next = &multi->easy;
-  easy->prev = multi->easy.prev;
+  /* We make our 'next' point to the struct after 'pos' and our 'prev' point
+     to 'pos' */
+  easy->next = pos->next;
+  easy->prev = pos;
 
-  /* make 'easy' the last node in the chain */
-  multi->easy.prev = easy;
-
-  /* if there was a prev node, make sure its 'next' pointer links to
-     the new node */
-  easy->prev->next = easy;
+  /* and link them to the new node */
+  pos->next->prev = easy;
+  pos->next = easy;
 
   /* make the SessionHandle refer back to this multi handle */
   Curl_easy_addmulti(easy_handle, multi_handle);
@@ -554,8 +583,9 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
       data->state.timeoutlist = NULL;
     }
 
-    if(easy->easy_handle->dns.hostcachetype == HCACHE_MULTI) {
-      /* stop using the multi handle's DNS cache */
+    if((easy->easy_handle->dns.hostcachetype == HCACHE_MULTI) ||
+       (easy->easy_handle->dns.hostcachetype == HCACHE_GLOBAL)) {
+      /* stop using the multi handle's or the global DNS cache */
       easy->easy_handle->dns.hostcache = NULL;
       easy->easy_handle->dns.hostcachetype = HCACHE_NONE;
     }
@@ -631,6 +661,9 @@ CURLMcode curl_multi_remove_handle(CURLM *multi_handle,
 
     multi->num_easy--; /* one less to care about now */
 
+    /* a connection may have been made available for a waiting handle */
+    process_pending_handles(multi);
+
     update_timer(multi);
     return CURLM_OK;
   }
@@ -643,6 +676,28 @@ bool Curl_multi_canPipeline(const struct Curl_multi* multi)
   return multi->pipelining_enabled;
 }
 
+size_t Curl_multi_max_host_connections(const struct Curl_multi *multi)
+{
+  return (multi && (multi->max_host_connections > 0)) ?
+    (size_t)multi->max_host_connections : 0;
+}
+
+size_t Curl_multi_max_pipeline_length(const struct Curl_multi *multi)
+{
+  return (multi && (multi->max_pipeline_length > 0)) ?
+    (size_t)multi->max_pipeline_length : MAX_PIPELINE_LENGTH;
+}
+
+curl_off_t Curl_multi_content_length_penalty_size(const struct Curl_multi *m)
+{
+  return m ? m->content_length_penalty_size : 0;
+}
+
+curl_off_t Curl_multi_chunk_length_penalty_size(const struct Curl_multi *m)
+{
+  return m ? m->chunk_length_penalty_size : 0;
+}
+
 void Curl_multi_handlePipeBreak(struct SessionHandle *data)
 {
   struct Curl_one_easy *one_easy = data->set.one_easy;
@@ -658,6 +713,10 @@ static int waitconnect_getsock(struct connectdata *conn,
   if(!numsocks)
     return GETSOCK_BLANK;
 
+  /* the handshake with a SOCKS proxy waits for either direction */
+  if(Curl_SOCKS_busy(conn, FIRSTSOCKET))
+    return Curl_SOCKS_getsock(conn, sock, numsocks, FIRSTSOCKET);
+
   sock[0] = conn->sock[FIRSTSOCKET];
 
   /* when we've sent a CONNECT to a proxy, we should rather wait for the
@@ -677,6 +736,14 @@ static int domore_getsock(struct connectdata *conn,
   return GETSOCK_BLANK;
 }
 
+/* returns bitmapped flags for the sockets of the prefetch lookup */
+static int prefetch_getsock(struct Curl_prefetch *p, curl_socket_t *socks,
+                            int numsocks)
+{
+  long ms;
+  return Curl_resolver_refresh_getsock(p->lookup, socks, numsocks, &ms);
+}
+
 /* returns bitmapped flags for this handle and its sockets */
 static int multi_getsock(struct Curl_one_easy *easy,
                          curl_socket_t *socks, /* points to numsocks number
@@ -705,6 +772,7 @@ static int multi_getsock(struct Curl_one_easy *easy,
   case CURLM_STATE_COMPLETED:
   case CURLM_STATE_MSGSENT:
   case CURLM_STATE_INIT:
+  case CURLM_STATE_CONNECT_PEND:
   case CURLM_STATE_CONNECT:
   case CURLM_STATE_WAITDO:
   case CURLM_STATE_DONE:
@@ -750,6 +818,7 @@ CURLMcode curl_multi_fdset(CURLM *multi_handle,
      and then we must make sure that is done. */
   struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
   struct Curl_one_easy *easy;
+  struct Curl_prefetch *p = multi->prefetch;
   int this_max_fd=-1;
   curl_socket_t sockbunch[MAX_SOCKSPEREASYHANDLE];
   int bitmap;
@@ -759,9 +828,13 @@ CURLMcode curl_multi_fdset(CURLM *multi_handle,
   if(!GOOD_MULTI_HANDLE(multi))
     return CURLM_BAD_HANDLE;
 
+  /* the easy handles first, then the prefetch lookups */
   easy=multi->easy.next;
-  while(easy != &multi->easy) {
-    bitmap = multi_getsock(easy, sockbunch, MAX_SOCKSPEREASYHANDLE);
+  while((easy != &multi->easy) || p) {
+    if(easy != &multi->easy)
+      bitmap = multi_getsock(easy, sockbunch, MAX_SOCKSPEREASYHANDLE);
+    else
+      bitmap = prefetch_getsock(p, sockbunch, MAX_SOCKSPEREASYHANDLE);
 
     for(i=0; i< MAX_SOCKSPEREASYHANDLE; i++) {
       curl_socket_t s = CURL_SOCKET_BAD;
@@ -783,7 +856,10 @@ CURLMcode curl_multi_fdset(CURLM *multi_handle,
       }
     }
 
-    easy = easy->next; /* check next handle */
+    if(easy != &multi->easy)
+      easy = easy->next; /* check next handle */
+    else
+      p = p->next;
   }
 
   *max_fd = this_max_fd;
@@ -791,6 +867,85 @@ CURLMcode curl_multi_fdset(CURLM *multi_handle,
   return CURLM_OK;
 }
 
+/*
+ * Curl_multi_idle_add() starts watching the socket of a connection that was
+ * just left idle in the connection cache, so that the server closing it is
+ * noticed right away: curl_multi_wait() polls the sockets in the 'idle' list
+ * and the socket callback is told to wait for it to get readable, with the
+ * closure handle as its easy handle. The sockhash entry of the transfer that
+ * left the connection is taken over.
+ */
+void Curl_multi_idle_add(struct Curl_multi *multi, struct connectdata *conn)
+{
+  curl_socket_t s = conn->sock[FIRSTSOCKET];
+  struct Curl_sh_entry *entry;
+
+  if(conn->idle_multi || !multi->closure_handle)
+    return;
+
+  if(!Curl_llist_insert_next(multi->idle, multi->idle->tail, conn))
+    return; /* it is then only checked when it is about to be reused */
+  conn->idle_multi = multi;
+  conn->idle_node = multi->idle->tail;
+
+  entry = sh_addentry(multi->sockhash, s, multi->closure_handle);
+  if(!entry)
+    return;
+  entry->easy = multi->closure_handle;
+  entry->idle = conn;
+  entry->action = CURL_POLL_IN;
+  if(multi->socket_cb)
+    multi->socket_cb(multi->closure_handle, s, CURL_POLL_IN,
+                     multi->socket_userp, entry->socketp);
+}
+
+/*
+ * Curl_multi_idle_remove() stops watching the socket of an idle connection,
+ * as it is about to be reused or closed.
+ */
+void Curl_multi_idle_remove(struct connectdata *conn)
+{
+  struct Curl_multi *multi = conn->idle_multi;
+  curl_socket_t s = conn->sock[FIRSTSOCKET];
+  struct Curl_sh_entry *entry;
+
+  if(!multi)
+    return;
+
+  Curl_llist_remove(multi->idle, conn->idle_node, NULL);
+  conn->idle_multi = NULL;
+  conn->idle_node = NULL;
+
+  entry = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+  if(entry && (entry->idle == conn)) {
+    if(multi->socket_cb)
+      multi->socket_cb(multi->closure_handle, s, CURL_POLL_REMOVE,
+                       multi->socket_userp, entry->socketp);
+    sh_delentry(multi->sockhash, s);
+  }
+}
+
+/*
+ * Curl_multi_idle_evented() tells if the socket of the idle connection is
+ * watched by the event loop of the application. A closed connection is then
+ * reaped as soon as the application passes on the event, so the ones left
+ * are alive.
+ */
+bool Curl_multi_idle_evented(const struct connectdata *conn)
+{
+  return (conn->idle_multi && conn->idle_multi->socket_cb) ? TRUE : FALSE;
+}
+
+/* The socket of the idle connection got readable: the server closed it or
+   sent data nobody asked for, either way it can't be reused */
+static void idle_reap(struct Curl_multi *multi, struct connectdata *conn)
+{
+  conn->data = multi->closure_handle;
+  infof(conn->data, "Connection %ld seems to be dead!\n",
+        conn->connection_id);
+  Curl_disconnect(conn, /* dead_connection */ TRUE);
+}
+
 CURLMcode curl_multi_wait(CURLM *multi_handle,
                           struct curl_waitfd extra_fds[],
                           unsigned int extra_nfds,
@@ -799,19 +954,33 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
 {
   struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
   struct Curl_one_easy *easy;
+  struct Curl_prefetch *p;
   curl_socket_t sockbunch[MAX_SOCKSPEREASYHANDLE];
   int bitmap;
   unsigned int i;
   unsigned int nfds = extra_nfds;
+  unsigned int idle_start;
+  int rc = 0;
   struct pollfd *ufds = NULL;
+  struct curl_llist_element *e;
 
   if(!GOOD_MULTI_HANDLE(multi))
     return CURLM_BAD_HANDLE;
 
-  /* Count up how many fds we have from the multi handle */
+  /* The idle connections in the cache are watched as well, so that the ones
+     the server closes are reaped right away and the others are known to be
+     alive when they are reused */
+  nfds += (unsigned int)multi->idle->size;
+
+  /* Count up how many fds we have from the multi handle, the easy handles
+     first and then the prefetch lookups */
   easy=multi->easy.next;
-  while(easy != &multi->easy) {
-    bitmap = multi_getsock(easy, sockbunch, MAX_SOCKSPEREASYHANDLE);
+  p = multi->prefetch;
+  while((easy != &multi->easy) || p) {
+    if(easy != &multi->easy)
+      bitmap = multi_getsock(easy, sockbunch, MAX_SOCKSPEREASYHANDLE);
+    else
+      bitmap = prefetch_getsock(p, sockbunch, MAX_SOCKSPEREASYHANDLE);
 
     for(i=0; i< MAX_SOCKSPEREASYHANDLE; i++) {
       curl_socket_t s = CURL_SOCKET_BAD;
@@ -829,7 +998,10 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
       }
     }
 
-    easy = easy->next; /* check next handle */
+    if(easy != &multi->easy)
+      easy = easy->next; /* check next handle */
+    else
+      p = p->next;
   }
 
   if(nfds) {
@@ -841,8 +1013,12 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
 
   /* Add the curl handles to our pollfds first */
   easy=multi->easy.next;
-  while(easy != &multi->easy) {
-    bitmap = multi_getsock(easy, sockbunch, MAX_SOCKSPEREASYHANDLE);
+  p = multi->prefetch;
+  while((easy != &multi->easy) || p) {
+    if(easy != &multi->easy)
+      bitmap = multi_getsock(easy, sockbunch, MAX_SOCKSPEREASYHANDLE);
+    else
+      bitmap = prefetch_getsock(p, sockbunch, MAX_SOCKSPEREASYHANDLE);
 
     for(i=0; i< MAX_SOCKSPEREASYHANDLE; i++) {
       curl_socket_t s = CURL_SOCKET_BAD;
@@ -864,7 +1040,10 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
       }
     }
 
-    easy = easy->next; /* check next handle */
+    if(easy != &multi->easy)
+      easy = easy->next; /* check next handle */
+    else
+      p = p->next;
   }
 
   /* Add external file descriptions from poll-like struct curl_waitfd */
@@ -880,15 +1059,42 @@ CURLMcode curl_multi_wait(CURLM *multi_handle,
     ++nfds;
   }
 
-  if(nfds)
+  /* Add the idle connections last */
+  idle_start = nfds;
+  for(e = multi->idle->head; e; e = e->next) {
+    struct connectdata *conn = e->ptr;
+    ufds[nfds].fd = conn->sock[FIRSTSOCKET];
+    ufds[nfds].events = POLLIN;
+    ++nfds;
+  }
+
+  if(nfds) {
     /* wait... */
-    i = Curl_poll(ufds, nfds, timeout_ms);
-  else
-    i = 0;
+    rc = Curl_poll(ufds, nfds, timeout_ms);
+    if(rc >= 0) {
+      struct timeval now = Curl_tvnow();
+
+      /* a reaped connection leaves the list, the ones after it stay in the
+         order they were added to the pollfds in */
+      i = idle_start;
+      e = multi->idle->head;
+      while(e) {
+        struct connectdata *conn = e->ptr;
+        e = e->next;
+
+        if(ufds[i++].revents) {
+          rc--;
+          idle_reap(multi, conn);
+        }
+        else
+          conn->alive = now;
+      }
+    }
+  }
 
   Curl_safefree(ufds);
   if(ret)
-    *ret = i;
+    *ret = rc;
   return CURLM_OK;
 }
 
@@ -900,6 +1106,7 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
   bool connected;
   bool async;
   bool protocol_connect = FALSE;
+  bool cached = FALSE;
   bool dophase_done = FALSE;
   bool done = FALSE;
   CURLMcode result = CURLM_OK;
@@ -998,11 +1205,39 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       }
       break;
 
+    case CURLM_STATE_CONNECT_PEND:
+      /* We will stay here until there is a connection available. Then
+         we try again in the CURLM_STATE_CONNECT state. */
+      break;
+
     case CURLM_STATE_CONNECT:
-      /* Connect. We get a connection identifier filled in. */
       Curl_pgrsTime(data, TIMER_STARTSINGLE);
+
+      /* A fresh enough response in the HTTP cache makes the connection
+         unnecessary */
+      easy->result = Curl_httpcache_lookup(data, &cached);
+      if(CURLE_OK != easy->result)
+        break;
+      if(cached) {
+        /* the response is delivered, finish off the transfer in DONE */
+        Curl_posttransfer(data);
+        multistate(easy, CURLM_STATE_DONE);
+        result = CURLM_CALL_MULTI_PERFORM;
+        break;
+      }
+
+      /* Connect. We get a connection identifier filled in. */
       easy->result = Curl_connect(data, &easy->easy_conn,
                                   &async, &protocol_connect);
+      if(CURLE_NO_CONNECTION_AVAILABLE == easy->result) {
+        /* There was no connection available. We will go to the pending
+           state and wait for an available connection. */
+        if(!easy->waiting.tv_sec)
+          easy->waiting = now;
+        multistate(easy, CURLM_STATE_CONNECT_PEND);
+        easy->result = CURLE_OK;
+        break;
+      }
 
       if(CURLE_OK == easy->result) {
         /* Add this handle to the send or pend pipeline */
@@ -1385,14 +1620,33 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       if(( (data->set.max_send_speed == 0) ||
            (data->progress.ulspeed < data->set.max_send_speed ))  &&
          ( (data->set.max_recv_speed == 0) ||
-           (data->progress.dlspeed < data->set.max_recv_speed)))
-        multistate(easy, CURLM_STATE_PERFORM);
+           (data->progress.dlspeed < data->set.max_recv_speed))) {
+        /* and the shared limits must have tokens again */
+        timeout_ms = Curl_ratelimit_wait(multi, data, now);
+        if(timeout_ms)
+          Curl_expire(data, Curl_ratelimit_held(multi, data, timeout_ms));
+        else
+          multistate(easy, CURLM_STATE_PERFORM);
+      }
+      else
+        /* its own limits hold it back, the others don't wait for it */
+        easy->rate_held = FALSE;
       break;
 
     case CURLM_STATE_PERFORM:
       {
       char *newurl = NULL;
       bool retry = FALSE;
+      curl_off_t sent;
+      curl_off_t received;
+
+      /* check the limits of the multi handle and of the handle's group */
+      timeout_ms = Curl_ratelimit_wait(multi, data, now);
+      if(timeout_ms) {
+        multistate(easy, CURLM_STATE_TOOFAST);
+        Curl_expire(data, Curl_ratelimit_held(multi, data, timeout_ms));
+        break;
+      }
 
       /* check if over send speed */
       if((data->set.max_send_speed > 0) &&
@@ -1427,9 +1681,14 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
       }
 
       /* read/write data if it is ready to do so */
+      k = &data->req;
+      sent = k->writebytecount;
+      received = k->bytecount;
+
       easy->result = Curl_readwrite(easy->easy_conn, &done);
 
-      k = &data->req;
+      Curl_ratelimit_charge(multi, data, k->writebytecount - sent,
+                            k->bytecount - received);
 
       if(!(k->keepon & KEEP_RECV)) {
         /* We're done receiving */
@@ -1559,6 +1818,9 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
           result = CURLM_CALL_MULTI_PERFORM;
         }
 
+        /* the pipeline may have grown after this request was queued */
+        data->info.conn_max_pipeline = easy->easy_conn->max_pipeline_depth;
+
         /* post-transfer command */
         easy->result = Curl_done(&easy->easy_conn, CURLE_OK, FALSE);
         /*
@@ -1569,6 +1831,15 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
          */
         if(easy->easy_conn)
           easy->easy_conn = NULL;
+
+        /* the connection may now be free for a handle that waits for one */
+        process_pending_handles(multi);
+      }
+      else if(data->info.httpcache == CURL_HTTPCACHE_HIT) {
+        /* served from the HTTP cache, what Curl_done() does for the
+           transfer without the connection part */
+        if(Curl_pgrsFinish(data))
+          easy->result = CURLE_ABORTED_BY_CALLBACK;
       }
 
       if(data->set.wildcardmatch) {
@@ -1640,6 +1911,9 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
                We don't have to do this in every case block above where a
                failure is detected */
             easy->easy_conn = NULL;
+
+            /* a waiting handle may now get a connection of its own */
+            process_pending_handles(multi);
           }
         }
         else if(easy->state == CURLM_STATE_CONNECT) {
@@ -1680,6 +1954,309 @@ static CURLMcode multi_runsingle(struct Curl_multi *multi,
 }
 
 
+/*
+ * prefetch_free() lets go of a prefetch, done or not.
+ */
+static void prefetch_free(struct Curl_prefetch *p)
+{
+  if(p->lookup)
+    Curl_resolver_refresh_free(p->lookup);
+  Curl_safefree(p->name);
+  free(p);
+}
+
+/*
+ * prefetch_done() posts the message of a finished prefetch. The prefetch is
+ * freed when the application has read the message.
+ */
+static void prefetch_done(struct Curl_multi *multi, struct Curl_prefetch *p,
+                          CURLcode result)
+{
+  p->info.name = p->name;
+  p->info.result = result;
+  p->msg.extmsg.msg = CURLMSG_PREFETCH;
+  p->msg.extmsg.easy_handle = NULL;
+  p->msg.extmsg.data.whatever = &p->info;
+
+  if(multi_addmsg(multi, &p->msg))
+    /* nobody will ever know */
+    prefetch_free(p);
+}
+
+/*
+ * prefetch_store() stores a prefetched name in the DNS cache of the multi
+ * handle and in the other caches its easy handles use, the global one or the
+ * ones of shares. Returns FALSE if out of memory.
+ */
+static bool prefetch_store(struct Curl_multi *multi, struct Curl_prefetch *p,
+                           const Curl_addrinfo *addr, time_t expires)
+{
+  struct Curl_one_easy *easy;
+
+  if(!Curl_cache_copy(NULL, multi->hostcache, addr, p->hostname, p->port,
+                      expires))
+    return FALSE;
+
+  for(easy = multi->easy.next; easy != &multi->easy; easy = easy->next) {
+    struct SessionHandle *data = easy->easy_handle;
+    struct Curl_dnscache *cache = data->dns.hostcache;
+    struct Curl_one_easy *prev;
+
+    if(!cache || (cache == multi->hostcache))
+      continue;
+
+    /* only once for each cache */
+    for(prev = multi->easy.next; prev != easy; prev = prev->next)
+      if(prev->easy_handle->dns.hostcache == cache)
+        break;
+    if(prev != easy)
+      continue;
+
+    if(!Curl_cache_copy(data, cache, addr, p->hostname, p->port, expires))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * prefetch_sockets() tells the application about the sockets the lookup of
+ * the prefetch waits for now, like singlesocket() does for an easy handle,
+ * and sets when the lookup is to be checked again without socket action.
+ * The closure handle is passed as the easy handle of these sockets. Without
+ * a lookup, all the sockets are removed.
+ */
+static void prefetch_sockets(struct Curl_multi *multi,
+                             struct Curl_prefetch *p, struct timeval now)
+{
+  curl_socket_t socks[MAX_SOCKSPEREASYHANDLE];
+  struct Curl_sh_entry *entry;
+  int curraction = 0;
+  long ms = 0;
+  int num;
+  int i;
+
+  if(p->lookup)
+    curraction = Curl_resolver_refresh_getsock(p->lookup, socks,
+                                               MAX_SOCKSPEREASYHANDLE, &ms);
+
+  for(i = 0; (i < MAX_SOCKSPEREASYHANDLE) &&
+        (curraction & (GETSOCK_READSOCK(i) | GETSOCK_WRITESOCK(i))); i++) {
+    int action = CURL_POLL_NONE;
+    curl_socket_t s = socks[i];
+
+    if(curraction & GETSOCK_READSOCK(i))
+      action |= CURL_POLL_IN;
+    if(curraction & GETSOCK_WRITESOCK(i))
+      action |= CURL_POLL_OUT;
+
+    entry = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+    if(entry) {
+      if(entry->action == action)
+        continue;
+    }
+    else {
+      entry = sh_addentry(multi->sockhash, s, multi->closure_handle);
+      if(!entry)
+        /* fatal */
+        break;
+      entry->prefetch = p;
+    }
+
+    if(multi->socket_cb)
+      multi->socket_cb(multi->closure_handle, s, action,
+                       multi->socket_userp, entry->socketp);
+    entry->action = action;
+  }
+  num = i;
+
+  /* remove the sockets that are no longer waited for */
+  for(i = 0; i < p->numsocks; i++) {
+    curl_socket_t s = p->sockets[i];
+    int j;
+    for(j = 0; j < num; j++)
+      if(s == socks[j])
+        break;
+    if(j < num)
+      continue;
+
+    entry = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
+    if(entry && (entry->prefetch == p)) {
+      if(multi->socket_cb)
+        multi->socket_cb(multi->closure_handle, s, CURL_POLL_REMOVE,
+                         multi->socket_userp, entry->socketp);
+      sh_delentry(multi->sockhash, s);
+    }
+  }
+
+  memcpy(p->sockets, socks, num*sizeof(curl_socket_t));
+  p->numsocks = num;
+
+  p->expire = now;
+  p->expire.tv_sec += ms/1000;
+  p->expire.tv_usec += (ms%1000)*1000;
+  if(p->expire.tv_usec >= 1000000) {
+    p->expire.tv_sec++;
+    p->expire.tv_usec -= 1000000;
+  }
+}
+
+/*
+ * check_prefetch() goes on with the prefetch lookups, stores the results of
+ * the ones that are done in the DNS cache and posts their messages. Unless
+ * 'all' is set, for when there may have been action on their sockets, this
+ * is only done once one of them is to be checked without socket action.
+ */
+static void check_prefetch(struct Curl_multi *multi, struct timeval now,
+                           bool all)
+{
+  struct Curl_prefetch **pp = &multi->prefetch;
+  bool first = TRUE;
+
+  if(!multi->prefetch ||
+     (!all && (curlx_tvdiff(multi->prefetch_check, now) > 0)))
+    return;
+
+  while(*pp) {
+    struct Curl_prefetch *p = *pp;
+    void *lookup = p->lookup;
+    Curl_addrinfo *addr;
+    time_t expires;
+    CURLcode result;
+
+    if(!Curl_resolver_refresh_done(lookup, &addr, &expires)) {
+      prefetch_sockets(multi, p, now);
+      if(first || (curlx_tvdiff(p->expire, multi->prefetch_check) < 0))
+        multi->prefetch_check = p->expire;
+      first = FALSE;
+      pp = &p->next;
+      continue;
+    }
+
+    /* it is done, unlink it */
+    *pp = p->next;
+    p->lookup = NULL;
+    prefetch_sockets(multi, p, now);
+    Curl_resolver_refresh_free(lookup);
+
+    if(!addr) {
+      prefetch_done(multi, p, CURLE_COULDNT_RESOLVE_HOST);
+      continue;
+    }
+
+    result = prefetch_store(multi, p, addr, expires) ?
+      CURLE_OK : CURLE_OUT_OF_MEMORY;
+    Curl_freeaddrinfo(addr);
+    prefetch_done(multi, p, result);
+  }
+}
+
+/*
+ * closure_init() makes sure the multi handle has a closure handle, which is
+ * otherwise only created when the first easy handle is added.
+ */
+static bool closure_init(struct Curl_multi *multi)
+{
+  if(!multi->closure_handle) {
+    multi->closure_handle = (struct SessionHandle *)curl_easy_init();
+    if(!multi->closure_handle)
+      return FALSE;
+    Curl_easy_addmulti(multi->closure_handle, multi);
+    multi->closure_handle->state.conn_cache = multi->conn_cache;
+  }
+  return TRUE;
+}
+
+CURLMcode curl_multi_prefetch(CURLM *multi_handle, struct curl_slist *names)
+{
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+  /* the lookups use the resolver setup of the closure handle, and its
+     sockets are passed to the socket callback */
+  if(!closure_init(multi))
+    return CURLM_OUT_OF_MEMORY;
+
+  for(; names; names = names->next) {
+    struct Curl_prefetch *p = calloc(1, sizeof(struct Curl_prefetch));
+    if(!p)
+      return CURLM_OUT_OF_MEMORY;
+
+    p->name = strdup(names->data);
+    if(!p->name) {
+      free(p);
+      return CURLM_OUT_OF_MEMORY;
+    }
+
+    if(2 != sscanf(names->data, "%255[^:]:%d", p->hostname, &p->port)) {
+      prefetch_done(multi, p, CURLE_URL_MALFORMAT);
+      continue;
+    }
+
+    p->lookup = Curl_resolver_prefetch(multi->closure_handle, p->hostname,
+                                       p->port);
+    if(!p->lookup) {
+#ifdef CURLRES_ASYNCH
+      prefetch_done(multi, p, CURLE_OUT_OF_MEMORY);
+#else
+      /* the synchronous resolver runs no lookups nobody waits for */
+      prefetch_done(multi, p, CURLE_NOT_BUILT_IN);
+#endif
+      continue;
+    }
+
+    p->next = multi->prefetch;
+    multi->prefetch = p;
+  }
+
+  /* get the sockets and times of the new lookups right away, and the results
+     of those that are already done */
+  check_prefetch(multi, Curl_tvnow(), TRUE);
+
+  update_timer(multi);
+
+  return CURLM_OK;
+}
+
+CURLMcode curl_multi_rategroup(CURLM *multi_handle, long group,
+                               curl_off_t max_send_speed,
+                               curl_off_t max_recv_speed)
+{
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+  if(Curl_ratelimit_set(multi, group, max_send_speed, max_recv_speed))
+    return CURLM_OUT_OF_MEMORY;
+
+  return CURLM_OK;
+}
+
+CURLMcode curl_multi_rategroup_stats(CURLM *multi_handle, long group,
+                                     struct curl_rategroup_stats *stats)
+{
+  struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
+  struct Curl_rategroup *g;
+
+  if(!GOOD_MULTI_HANDLE(multi))
+    return CURLM_BAD_HANDLE;
+
+  memset(stats, 0, sizeof(*stats));
+
+  /* a group that never got limits set has no counters */
+  g = Curl_ratelimit_group(multi, group);
+  if(g) {
+    stats->sent = g->sent;
+    stats->received = g->received;
+    stats->waits = g->waits;
+  }
+
+  return CURLM_OK;
+}
+
 CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
 {
   struct Curl_multi *multi=(struct Curl_multi *)multi_handle;
@@ -1691,6 +2268,8 @@ CURLMcode curl_multi_perform(CURLM *multi_handle, int *running_handles)
   if(!GOOD_MULTI_HANDLE(multi))
     return CURLM_BAD_HANDLE;
 
+  check_prefetch(multi, now, TRUE);
+
   easy=multi->easy.next;
   while(easy != &multi->easy) {
     CURLMcode result;
@@ -1781,6 +2360,28 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
     }
     multi->closure_handle = NULL;
 
+    /* drop the prefetches, and the messages of the done ones */
+    while(multi->prefetch) {
+      struct Curl_prefetch *p = multi->prefetch;
+      multi->prefetch = p->next;
+      prefetch_free(p);
+    }
+    while(multi->msglist->head) {
+      struct Curl_message *msg = multi->msglist->head->ptr;
+      Curl_llist_remove(multi->msglist, multi->msglist->head, NULL);
+      if(msg->extmsg.msg == CURLMSG_PREFETCH)
+        prefetch_free((struct Curl_prefetch *)msg);
+    }
+    if(multi->prefetch_read)
+      prefetch_free(multi->prefetch_read);
+    multi->prefetch_read = NULL;
+
+    Curl_ratelimit_cleanup(multi);
+
+    /* stop the name resolver threads */
+    Curl_resolver_pool_destroy(multi->resolver_pool);
+    multi->resolver_pool = NULL;
+
     Curl_hash_destroy(multi->sockhash);
     multi->sockhash = NULL;
 
@@ -1791,6 +2392,10 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
     Curl_llist_destroy(multi->msglist, NULL);
     multi->msglist = NULL;
 
+    /* closing the connections emptied the list of idle ones */
+    Curl_llist_destroy(multi->idle, NULL);
+    multi->idle = NULL;
+
     /* remove all easy handles */
     easy = multi->easy.next;
     while(easy != &multi->easy) {
@@ -1801,6 +2406,10 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
         easy->easy_handle->dns.hostcache = NULL;
         easy->easy_handle->dns.hostcachetype = HCACHE_NONE;
       }
+      else if(easy->easy_handle->dns.hostcachetype == HCACHE_GLOBAL) {
+        easy->easy_handle->dns.hostcache = NULL;
+        easy->easy_handle->dns.hostcachetype = HCACHE_NONE;
+      }
 
       /* Clear the pointer to the connection cache */
       easy->easy_handle->state.conn_cache = NULL;
@@ -1811,7 +2420,7 @@ CURLMcode curl_multi_cleanup(CURLM *multi_handle)
       easy = nexteasy;
     }
 
-    Curl_hash_destroy(multi->hostcache);
+    Curl_dnscache_destroy(multi->hostcache);
     multi->hostcache = NULL;
 
     free(multi);
@@ -1839,7 +2448,16 @@ CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue)
 
   *msgs_in_queue = 0; /* default to none */
 
-  if(GOOD_MULTI_HANDLE(multi) && Curl_llist_count(multi->msglist)) {
+  if(!GOOD_MULTI_HANDLE(multi))
+    return NULL;
+
+  if(multi->prefetch_read) {
+    /* the application is done with the previous prefetch message */
+    prefetch_free(multi->prefetch_read);
+    multi->prefetch_read = NULL;
+  }
+
+  if(Curl_llist_count(multi->msglist)) {
     /* there is one or more messages in the list */
     struct curl_llist_element *e;
 
@@ -1853,6 +2471,9 @@ CURLMsg *curl_multi_info_read(CURLM *multi_handle, int *msgs_in_queue)
 
     *msgs_in_queue = curlx_uztosi(Curl_llist_count(multi->msglist));
 
+    if(msg->extmsg.msg == CURLMSG_PREFETCH)
+      multi->prefetch_read = (struct Curl_prefetch *)msg;
+
     return &msg->extmsg;
   }
   else
@@ -1948,7 +2569,11 @@ static void singlesocket(struct Curl_multi *multi,
       remove_sock_from_hash = TRUE;
 
       entry = Curl_hash_pick(multi->sockhash, (char *)&s, sizeof(s));
-      if(entry) {
+      if(entry && entry->idle)
+        /* the connection was left idle and its socket is watched for that
+           now, see Curl_multi_idle_add() */
+        remove_sock_from_hash = FALSE;
+      else if(entry) {
         /* check if the socket to be removed serves a connection which has
            other easy-s in a pipeline. In this case the socket should not be
            removed. */
@@ -2082,6 +2707,8 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
   struct Curl_tree *t;
   struct timeval now = Curl_tvnow();
 
+  check_prefetch(multi, now, FALSE);
+
   if(checkall) {
     struct Curl_one_easy *easyp;
     /* *perform() deals with running_handles on its own */
@@ -2110,6 +2737,12 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
          asked to get removed, so thus we better survive stray socket actions
          and just move on. */
       ;
+    else if(entry->prefetch)
+      /* a socket of a prefetch lookup */
+      check_prefetch(multi, now, TRUE);
+    else if(entry->idle)
+      /* a socket of an idle connection */
+      idle_reap(multi, entry->idle);
     else {
       data = entry->easy;
 
@@ -2153,9 +2786,6 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
       /* Now we fall-through and do the timer-based stuff, since we don't want
          to force the user to have to deal with timeouts as long as at least
          one connection in fact has traffic. */
-
-      data = NULL; /* set data to NULL again to avoid calling
-                      multi_runsingle() in case there's no need to */
     }
   }
 
@@ -2168,32 +2798,58 @@ static CURLMcode multi_socket(struct Curl_multi *multi,
 
   /*
    * The loop following here will go on as long as there are expire-times left
-   * to process in the splay and 'data' will be re-assigned for every expired
-   * handle we deal with.
+   * to process in the splay. The handles whose timers have expired are
+   * collected first and then dealt with in the order of the list of handles,
+   * so that of the transfers that may go at the same time, those of a higher
+   * priority, or that have waited too long, get a free connection first.
    */
-  do {
-    /* the first loop lap 'data' can be NULL */
-    if(data) {
+  for(;;) {
+    struct Curl_one_easy *expired = NULL;
+    struct Curl_one_easy *easy;
+    int num = 0;
+
+    /* Check if there's one (more) expired timer to deal with! This function
+       extracts a matching node if there is one */
+    for(;;) {
+      multi->timetree = Curl_splaygetbest(now, multi->timetree, &t);
+      if(!t)
+        break;
+      data = t->payload;
+      (void)add_next_timeout(now, multi, data);
+      expired = data->set.one_easy;
+      expired->expired = TRUE;
+      expired->next_expired = NULL;
+      num++;
+    }
+
+    if(!num)
+      break;
+
+    if(num > 1) {
+      struct Curl_one_easy **tail = &expired;
+      for(easy = multi->easy.next; easy != &multi->easy; easy = easy->next)
+        if(easy->expired) {
+          *tail = easy;
+          tail = &easy->next_expired;
+        }
+      *tail = NULL;
+    }
+
+    while(expired) {
+      easy = expired;
+      expired = easy->next_expired;
+      easy->expired = FALSE;
+
       do
-        result = multi_runsingle(multi, now, data->set.one_easy);
+        result = multi_runsingle(multi, now, easy);
       while(CURLM_CALL_MULTI_PERFORM == result);
 
       if(CURLM_OK >= result)
         /* get the socket(s) and check if the state has been changed since
            last */
-        singlesocket(multi, data->set.one_easy);
+        singlesocket(multi, easy);
     }
-
-    /* Check if there's one (more) expired timer to deal with! This function
-       extracts a matching node if there is one */
-
-    multi->timetree = Curl_splaygetbest(now, multi->timetree, &t);
-    if(t) {
-      data = t->payload; /* assign this for next loop */
-      (void)add_next_timeout(now, multi, t->payload);
-    }
-
-  } while(t);
+  }
 
   *running_handles = multi->num_alive;
   return result;
@@ -2231,6 +2887,35 @@ CURLMcode curl_multi_setopt(CURLM *multi_handle,
   case CURLMOPT_MAXCONNECTS:
     multi->maxconnects = va_arg(param, long);
     break;
+  case CURLMOPT_MAX_HOST_CONNECTIONS:
+    multi->max_host_connections = va_arg(param, long);
+    break;
+  case CURLMOPT_MAX_PIPELINE_LENGTH:
+    multi->max_pipeline_length = va_arg(param, long);
+    break;
+  case CURLMOPT_CONTENT_LENGTH_PENALTY_SIZE:
+    multi->content_length_penalty_size = va_arg(param, curl_off_t);
+    break;
+  case CURLMOPT_CHUNK_LENGTH_PENALTY_SIZE:
+    multi->chunk_length_penalty_size = va_arg(param, curl_off_t);
+    break;
+  case CURLMOPT_MAX_RESOLVER_THREADS:
+    multi->max_resolver_threads = va_arg(param, long);
+    if(multi->max_resolver_threads < 1)
+      multi->max_resolver_threads = DEFAULT_RESOLVER_THREADS;
+    break;
+  case CURLMOPT_PREFETCH_DNS_SERVERS:
+    if(!closure_init(multi))
+      res = CURLM_OUT_OF_MEMORY;
+    else {
+      CURLcode result = Curl_set_dns_servers(multi->closure_handle,
+                                             va_arg(param, char *));
+      if(result == CURLE_OUT_OF_MEMORY)
+        res = CURLM_OUT_OF_MEMORY;
+      else if(result)
+        res = CURLM_UNKNOWN_OPTION;
+    }
+    break;
   default:
     res = CURLM_UNKNOWN_OPTION;
     break;
@@ -2304,6 +2989,16 @@ static CURLMcode multi_timeout(struct Curl_multi *multi,
   else
     *timeout_ms = -1;
 
+  if(multi->prefetch) {
+    /* names are being prefetched, the lookups are checked when their
+       attempts time out */
+    long prefetch_ms = curlx_tvdiff(multi->prefetch_check, Curl_tvnow());
+    if(prefetch_ms < 0)
+      prefetch_ms = 0;
+    if((*timeout_ms < 0) || (prefetch_ms < *timeout_ms))
+      *timeout_ms = prefetch_ms;
+  }
+
   return CURLM_OK;
 }
 
@@ -2326,6 +3021,7 @@ CURLMcode curl_multi_timeout(CURLM *multi_handle,
 static int update_timer(struct Curl_multi *multi)
 {
   long timeout_ms;
+  struct timeval key;
 
   if(!multi->timer_cb)
     return 0;
@@ -2344,23 +3040,92 @@ static int update_timer(struct Curl_multi *multi)
   }
 
   /* When multi_timeout() is done, multi->timetree points to the node with the
-   * timeout we got the (relative) time-out time for. We can thus easily check
-   * if this is the same (fixed) time as we got in a previous call and then
-   * avoid calling the callback again. */
-  if(Curl_splaycomparekeys(multi->timetree->key, multi->timer_lastcall) == 0)
+   * timeout we got the (relative) time-out time for, unless the next check of
+   * the prefetches comes earlier. We can thus easily check if this is the
+   * same (fixed) time as we got in a previous call and then avoid calling the
+   * callback again. */
+  if(multi->prefetch &&
+     (!multi->timetree ||
+      (Curl_splaycomparekeys(multi->prefetch_check,
+                             multi->timetree->key) < 0)))
+    key = multi->prefetch_check;
+  else
+    key = multi->timetree->key;
+
+  if(Curl_splaycomparekeys(key, multi->timer_lastcall) == 0)
     return 0;
 
-  multi->timer_lastcall = multi->timetree->key;
+  multi->timer_lastcall = key;
 
   return multi->timer_cb((CURLM*)multi, timeout_ms, multi->timer_userp);
 }
 
+/* return the number of requests allowed to be outstanding on the
+   connection at once */
+static size_t max_pipeline_length(struct connectdata *conn)
+{
+  if(!conn->server_supports_pipelining)
+    return 1;
+
+  return Curl_multi_max_pipeline_length(conn->data?conn->data->multi:NULL);
+}
+
+/* TRUE if the transfer has waited too long to be overtaken */
+static bool waited_too_long(struct Curl_one_easy *easy, struct timeval now)
+{
+  return (easy->waiting.tv_sec &&
+          (Curl_tvdiff(now, easy->waiting) >= PRIORITY_AGING)) ?
+    TRUE : FALSE;
+}
+
+/*
+ * pend_position() returns the element of the pend pipeline of the connection
+ * that a transfer of the given priority is to be queued after, NULL to queue
+ * it first. The transfers of the same or a higher priority stay ahead of it,
+ * and so do those that have waited too long. 'ahead' is set to how many they
+ * are.
+ */
+static struct curl_llist_element *pend_position(struct connectdata *conn,
+                                                long priority,
+                                                struct timeval now,
+                                                size_t *ahead)
+{
+  struct curl_llist_element *e = conn->pend_pipe->tail;
+  size_t behind = 0;
+
+  while(e) {
+    struct SessionHandle *queued = e->ptr;
+    if((queued->set.priority >= priority) ||
+       waited_too_long(queued->set.one_easy, now))
+      break;
+    behind++;
+    e = e->prev;
+  }
+
+  *ahead = conn->pend_pipe->size - behind;
+  return e;
+}
+
+size_t Curl_multi_pipeline_ahead(struct connectdata *conn,
+                                 struct SessionHandle *data)
+{
+  size_t ahead;
+
+  (void)pend_position(conn, data->set.priority, Curl_tvnow(), &ahead);
+
+  return conn->send_pipe->size + conn->recv_pipe->size + ahead;
+}
+
 static CURLcode addHandleToSendOrPendPipeline(struct SessionHandle *handle,
                                               struct connectdata *conn)
 {
   size_t pipeLen = conn->send_pipe->size + conn->recv_pipe->size;
   struct curl_llist_element *sendhead = conn->send_pipe->head;
+  struct curl_llist_element *after;
   struct curl_llist *pipeline;
+  struct Curl_one_easy *easy = handle->set.one_easy;
+  struct timeval now = Curl_tvnow();
+  size_t ahead;
   CURLcode rc;
 
   if(!Curl_isPipeliningEnabled(handle) ||
@@ -2368,13 +3133,39 @@ static CURLcode addHandleToSendOrPendPipeline(struct SessionHandle *handle,
     pipeline = conn->send_pipe;
   else {
     if(conn->server_supports_pipelining &&
-       pipeLen < MAX_PIPELINE_LENGTH)
+       pipeLen < max_pipeline_length(conn))
       pipeline = conn->send_pipe;
     else
       pipeline = conn->pend_pipe;
   }
 
-  rc = Curl_addHandleToPipeline(handle, pipeline);
+  if(pipeline == conn->pend_pipe) {
+    /* wait in line behind the transfers that are as urgent or have waited
+       too long to be overtaken, counting from when a connection was first
+       waited for */
+    if(!easy->waiting.tv_sec)
+      easy->waiting = now;
+    after = pend_position(conn, handle->set.priority, now, &ahead);
+    rc = Curl_llist_insert_next(pipeline, after, handle) ?
+      CURLE_OK : CURLE_OUT_OF_MEMORY;
+  }
+  else {
+    easy->waiting.tv_sec = 0;
+    easy->waiting.tv_usec = 0;
+    ahead = conn->pend_pipe->size;
+    rc = Curl_addHandleToPipeline(handle, pipeline);
+  }
+
+  /* the number of requests queued ahead of this one on the connection */
+  handle->info.pipeline_position = (long)(pipeLen + ahead);
+
+  if(CURLE_OK == rc) {
+    conn->num_requests++;
+    if(handle->info.pipeline_position + 1 > conn->max_pipeline_depth)
+      conn->max_pipeline_depth = handle->info.pipeline_position + 1;
+    handle->info.conn_requests = conn->num_requests;
+    handle->info.conn_max_pipeline = conn->max_pipeline_depth;
+  }
 
   if(pipeline == conn->send_pipe && sendhead != conn->send_pipe->head) {
     /* this is a new one as head, expire it */
@@ -2397,8 +3188,7 @@ static int checkPendPipeline(struct connectdata *conn)
   size_t pipeLen = conn->send_pipe->size + conn->recv_pipe->size;
   if(conn->server_supports_pipelining || pipeLen == 0) {
     struct curl_llist_element *curr = conn->pend_pipe->head;
-    const size_t maxPipeLen =
-      conn->server_supports_pipelining ? MAX_PIPELINE_LENGTH : 1;
+    const size_t maxPipeLen = max_pipeline_length(conn);
 
     while(pipeLen < maxPipeLen && curr) {
       Curl_llist_move(conn->pend_pipe, curr,
@@ -2427,6 +3217,45 @@ static int checkPendPipeline(struct connectdata *conn)
   return result;
 }
 
+/*
+ * process_pending_handles() moves all handles that wait for a connection to
+ * become available back to the CONNECT state so that they get another
+ * chance to get one. They get it in list order, so the ones that have waited
+ * too long are moved first in the list, ahead of the ones of a higher
+ * priority.
+ */
+static void process_pending_handles(struct Curl_multi *multi)
+{
+  struct Curl_one_easy *easy;
+  struct Curl_one_easy *next;
+  struct Curl_one_easy *front = &multi->easy;
+  struct timeval now = Curl_tvnow();
+
+  easy=multi->easy.next;
+  while(easy != &multi->easy) {
+    next = easy->next;
+    if(easy->state == CURLM_STATE_CONNECT_PEND) {
+      multistate(easy, CURLM_STATE_CONNECT);
+      /* Make sure that the handle will be processed soonish. */
+      Curl_expire(easy->easy_handle, 1);
+
+      if(waited_too_long(easy, now)) {
+        if(easy != front->next) {
+          /* unlink and put it after the ones moved before it */
+          easy->prev->next = easy->next;
+          easy->next->prev = easy->prev;
+          easy->next = front->next;
+          easy->prev = front;
+          front->next->prev = easy;
+          front->next = easy;
+        }
+        front = easy;
+      }
+    }
+    easy = next; /* operate on next handle */
+  }
+}
+
 /* Move this transfer from the sending list to the receiving list.
 
    Pay special attention to the new sending list "leader" as it needs to get
@@ -32,24 +32,26 @@ struct Curl_message {
 */
 typedef enum {
   CURLM_STATE_INIT,        /* 0 - start in this state */
-  CURLM_STATE_CONNECT,     /* 1 - resolve/connect has been sent off */
-  CURLM_STATE_WAITRESOLVE, /* 2 - awaiting the resolve to finalize */
-  CURLM_STATE_WAITCONNECT, /* 3 - awaiting the connect to finalize */
-  CURLM_STATE_WAITPROXYCONNECT, /* 4 - awaiting proxy CONNECT to finalize */
-  CURLM_STATE_PROTOCONNECT, /* 5 - completing the protocol-specific connect
+  CURLM_STATE_CONNECT_PEND, /* 1 - no connection slot available, wait for
+                               one to become free */
+  CURLM_STATE_CONNECT,     /* 2 - resolve/connect has been sent off */
+  CURLM_STATE_WAITRESOLVE, /* 3 - awaiting the resolve to finalize */
+  CURLM_STATE_WAITCONNECT, /* 4 - awaiting the connect to finalize */
+  CURLM_STATE_WAITPROXYCONNECT, /* 5 - awaiting proxy CONNECT to finalize */
+  CURLM_STATE_PROTOCONNECT, /* 6 - completing the protocol-specific connect
                                phase */
-  CURLM_STATE_WAITDO,      /* 6 - wait for our turn to send the request */
-  CURLM_STATE_DO,          /* 7 - start send off the request (part 1) */
-  CURLM_STATE_DOING,       /* 8 - sending off the request (part 1) */
-  CURLM_STATE_DO_MORE,     /* 9 - send off the request (part 2) */
-  CURLM_STATE_DO_DONE,     /* 10 - done sending off request */
-  CURLM_STATE_WAITPERFORM, /* 11 - wait for our turn to read the response */
-  CURLM_STATE_PERFORM,     /* 12 - transfer data */
-  CURLM_STATE_TOOFAST,     /* 13 - wait because limit-rate exceeded */
-  CURLM_STATE_DONE,        /* 14 - post data transfer operation */
-  CURLM_STATE_COMPLETED,   /* 15 - operation complete */
-  CURLM_STATE_MSGSENT,     /* 16 - the operation complete message is sent */
-  CURLM_STATE_LAST         /* 17 - not a true state, never use this */
+  CURLM_STATE_WAITDO,      /* 7 - wait for our turn to send the request */
+  CURLM_STATE_DO,          /* 8 - start send off the request (part 1) */
+  CURLM_STATE_DOING,       /* 9 - sending off the request (part 1) */
+  CURLM_STATE_DO_MORE,     /* 10 - send off the request (part 2) */
+  CURLM_STATE_DO_DONE,     /* 11 - done sending off request */
+  CURLM_STATE_WAITPERFORM, /* 12 - wait for our turn to read the response */
+  CURLM_STATE_PERFORM,     /* 13 - transfer data */
+  CURLM_STATE_TOOFAST,     /* 14 - wait because limit-rate exceeded */
+  CURLM_STATE_DONE,        /* 15 - post data transfer operation */
+  CURLM_STATE_COMPLETED,   /* 16 - operation complete */
+  CURLM_STATE_MSGSENT,     /* 17 - the operation complete message is sent */
+  CURLM_STATE_LAST         /* 18 - not a true state, never use this */
 } CURLMstate;
 
 /* we support N sockets per easy handle. Set the corresponding bit to what
@@ -77,6 +79,38 @@ struct Curl_one_easy {
      socket is to be removed from the hash. See singlesocket(). */
   curl_socket_t sockets[MAX_SOCKSPEREASYHANDLE];
   int numsocks;
+
+  struct timeval waiting; /* when it started to wait for a connection, or for
+                             a place in a pipeline */
+  curl_off_t rate_used; /* the bytes charged to the rate limits, divided by
+                           the weight, see Curl_ratelimit_wait() */
+  bool rate_held;       /* the rate limits hold back the transfer */
+
+  bool expired; /* its timer expired and it is yet to be dealt with, see
+                   multi_socket() */
+  struct Curl_one_easy *next_expired; /* the next one of those */
+};
+
+/* nothing gets served before a transfer of a lower priority that has waited
+   this many milliseconds for a connection or a place in a pipeline */
+#define PRIORITY_AGING 2000
+
+/* default maximum number of name resolver threads of a multi handle */
+#define DEFAULT_RESOLVER_THREADS 16
+
+/* a name to resolve given to curl_multi_prefetch() */
+struct Curl_prefetch {
+  struct Curl_message msg;   /* first, posted when the lookup is done */
+  struct curl_prefetch info; /* what the message points to */
+  struct Curl_prefetch *next; /* the next one still being resolved */
+  char *name;                 /* the "host:port" string */
+  char hostname[256];
+  int port;
+  void *lookup; /* the lookup in progress */
+  curl_socket_t sockets[MAX_SOCKSPEREASYHANDLE]; /* the sockets of the lookup
+                                                    the application knows */
+  int numsocks;
+  struct timeval expire; /* when to check the lookup without socket action */
 };
 
 /* This is the struct known as CURLM on the outside */
@@ -99,7 +133,7 @@ struct Curl_multi {
   void *socket_userp;
 
   /* Hostname cache */
-  struct curl_hash *hostcache;
+  struct Curl_dnscache *hostcache;
 
   /* timetree points to the splay-tree of time nodes to figure out expire
      times of all currently set timers */
@@ -116,6 +150,10 @@ struct Curl_multi {
   /* Shared connection cache (bundles)*/
   struct conncache *conn_cache;
 
+  /* the idle connections of the cache whose sockets are watched for the
+     server closing them */
+  struct curl_llist *idle;
+
   /* This handle will be used for closing the cached connections in
      curl_multi_cleanup() */
   struct SessionHandle *closure_handle;
@@ -123,6 +161,34 @@ struct Curl_multi {
   long maxconnects; /* if >0, a fixed limit of the maximum number of entries
                        we're allowed to grow the connection cache to */
 
+  long max_host_connections; /* if >0, a fixed limit of the maximum number
+                                of connections per host */
+
+  long max_pipeline_length; /* if >0, maximum number of requests in a
+                               pipeline */
+
+  curl_off_t content_length_penalty_size; /* a connection with a
+                                             content-length bigger than
+                                             this is not considered
+                                             for pipelining */
+
+  curl_off_t chunk_length_penalty_size; /* a connection with a chunk length
+                                           bigger than this is not
+                                           considered for pipelining */
+
+  /* the threaded resolver's pool of worker threads, created on first use */
+  struct Curl_resolver_pool *resolver_pool;
+  long max_resolver_threads; /* maximum number of threads in the pool */
+
+  /* names given to curl_multi_prefetch() that are still being resolved */
+  struct Curl_prefetch *prefetch;
+  struct timeval prefetch_check; /* the earliest of their 'expire' times */
+  /* the prefetch whose message was read last, freed on the next read */
+  struct Curl_prefetch *prefetch_read;
+
+  /* the speed limits set with curl_multi_rategroup() */
+  struct Curl_rategroup *rategroups;
+
   /* timer callback and user data pointer for the *socket() API */
   curl_multi_timer_callback timer_cb;
   void *timer_userp;
@@ -28,8 +28,25 @@
 void Curl_expire(struct SessionHandle *data, long milli);
 
 bool Curl_multi_canPipeline(const struct Curl_multi* multi);
+
+/* the limits and penalties set for the connections of a multi handle */
+size_t Curl_multi_max_host_connections(const struct Curl_multi *multi);
+size_t Curl_multi_max_pipeline_length(const struct Curl_multi *multi);
+curl_off_t Curl_multi_content_length_penalty_size(const struct Curl_multi *m);
+curl_off_t Curl_multi_chunk_length_penalty_size(const struct Curl_multi *m);
 void Curl_multi_handlePipeBreak(struct SessionHandle *data);
 
+/* start and stop watching the socket of an idle connection, and if the
+   application's event loop watches it */
+void Curl_multi_idle_add(struct Curl_multi *multi, struct connectdata *conn);
+void Curl_multi_idle_remove(struct connectdata *conn);
+bool Curl_multi_idle_evented(const struct connectdata *conn);
+
+/* the number of requests the transfer would have ahead of it if it was
+   queued on the connection */
+size_t Curl_multi_pipeline_ahead(struct connectdata *conn,
+                                 struct SessionHandle *data);
+
 /* the write bits start at bit 16 for the *getsock() bitmap */
 #define GETSOCK_WRITEBITSTART 16
 
@@ -464,6 +464,8 @@ polarssl_connect_step3(struct connectdata *conn,
 
       retcode = Curl_ssl_addsessionid(conn, new_session,
                                    sizeof(ssl_session));
+      if(retcode)
+        free(new_session);
     }
     else {
       retcode = CURLE_OUT_OF_MEMORY;
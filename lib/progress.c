@@ -131,12 +131,22 @@ static char *max5data(curl_off_t bytes, char *max5)
 
 */
 
+static int pgrs_update(struct SessionHandle *data);
+
 int Curl_pgrsDone(struct connectdata *conn)
+{
+  return Curl_pgrsFinish(conn->data);
+}
+
+/*
+ * Curl_pgrsFinish() is Curl_pgrsDone() for a transfer that may not have a
+ * connection, like one served from the HTTP cache.
+ */
+int Curl_pgrsFinish(struct SessionHandle *data)
 {
   int rc;
-  struct SessionHandle *data = conn->data;
   data->progress.lastshow=0;
-  rc = Curl_pgrsUpdate(conn); /* the final (forced) update */
+  rc = pgrs_update(data); /* the final (forced) update */
   if(rc)
     return rc;
 
@@ -250,6 +260,11 @@ void Curl_pgrsSetUploadSize(struct SessionHandle *data, curl_off_t size)
  * progress callback!
  */
 int Curl_pgrsUpdate(struct connectdata *conn)
+{
+  return pgrs_update(conn->data);
+}
+
+static int pgrs_update(struct SessionHandle *data)
 {
   struct timeval now;
   int result;
@@ -260,7 +275,6 @@ int Curl_pgrsUpdate(struct connectdata *conn)
   curl_off_t total_transfer;
   curl_off_t total_expected_transfer;
   curl_off_t timespent;
-  struct SessionHandle *data = conn->data;
   int nowindex = data->progress.speeder_c% CURR_TIME;
   int checkindex;
   int countindex; /* amount of seconds stored in the speeder array */
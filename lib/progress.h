@@ -40,6 +40,7 @@ typedef enum {
 } timerid;
 
 int Curl_pgrsDone(struct connectdata *);
+int Curl_pgrsFinish(struct SessionHandle *data);
 void Curl_pgrsStartNow(struct SessionHandle *data);
 void Curl_pgrsSetDownloadSize(struct SessionHandle *data, curl_off_t size);
 void Curl_pgrsSetUploadSize(struct SessionHandle *data, curl_off_t size);
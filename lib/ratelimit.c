@@ -0,0 +1,298 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#include <curl/curl.h>
+
+#include "urldata.h"
+#include "multihandle.h"
+#include "ratelimit.h"
+
+#include "curl_memory.h"
+/* The last #include file should be: */
+#include "memdebug.h"
+
+/* a bucket holds at most this many milliseconds worth of tokens, which is
+   the largest burst an idle group can do */
+#define RATELIMIT_BURST_MS 100
+
+/* a transfer that may not go yet because it isn't its turn checks again
+   after this many milliseconds */
+#define RATELIMIT_TURN_MS 1
+
+static void bucket_init(struct Curl_ratebucket *bucket, curl_off_t rate,
+                        struct timeval now)
+{
+  bucket->rate = rate;
+  bucket->tokens = rate * RATELIMIT_BURST_MS / 1000;
+  bucket->filled = now;
+}
+
+/*
+ * bucket_wait() tops up the tokens for the time passed since the last time
+ * and returns the number of milliseconds until the bucket is out of debt.
+ */
+static long bucket_wait(struct Curl_ratebucket *bucket, struct timeval now)
+{
+  curl_off_t add;
+  curl_off_t burst;
+  long ms;
+
+  if(!bucket->rate)
+    return 0;
+
+  ms = Curl_tvdiff(now, bucket->filled);
+  add = bucket->rate * ms / 1000;
+  if(add > 0) {
+    /* only move the fill time when tokens were added, or slow rates would
+       never get any */
+    burst = bucket->rate * RATELIMIT_BURST_MS / 1000;
+    bucket->tokens += add;
+    if(bucket->tokens > burst)
+      bucket->tokens = burst;
+    bucket->filled = now;
+  }
+
+  if(bucket->tokens >= 0)
+    return 0;
+
+  return (long)(-bucket->tokens * 1000 / bucket->rate) + 1;
+}
+
+/* only the buckets of the directions the transfer still uses can hold it
+   back, a download doesn't wait for the debt of the uploads */
+static long group_wait(struct Curl_rategroup *group, struct timeval now,
+                       int keepon)
+{
+  long send_ms = (keepon & KEEP_SEND) ? bucket_wait(&group->send, now) : 0;
+  long recv_ms = (keepon & KEEP_RECV) ? bucket_wait(&group->recv, now) : 0;
+
+  return (send_ms > recv_ms) ? send_ms : recv_ms;
+}
+
+struct Curl_rategroup *Curl_ratelimit_group(struct Curl_multi *multi,
+                                            long group)
+{
+  struct Curl_rategroup *g;
+
+  for(g = multi->rategroups; g; g = g->next)
+    if(g->id == group)
+      return g;
+
+  return NULL;
+}
+
+CURLcode Curl_ratelimit_set(struct Curl_multi *multi, long group,
+                            curl_off_t max_send_speed,
+                            curl_off_t max_recv_speed)
+{
+  struct Curl_rategroup *g = Curl_ratelimit_group(multi, group);
+  struct timeval now = Curl_tvnow();
+
+  if(!g) {
+    g = calloc(1, sizeof(struct Curl_rategroup));
+    if(!g)
+      return CURLE_OUT_OF_MEMORY;
+    g->id = group;
+    g->next = multi->rategroups;
+    multi->rategroups = g;
+  }
+
+  /* negative limits are no limits, like zero */
+  bucket_init(&g->send, (max_send_speed > 0) ? max_send_speed : 0, now);
+  bucket_init(&g->recv, (max_recv_speed > 0) ? max_recv_speed : 0, now);
+
+  return CURLE_OK;
+}
+
+/* how long the limits of the multi handle and of the easy handle's group
+   keep it from transferring */
+static long limits_wait(struct Curl_multi *multi, struct SessionHandle *data,
+                        struct timeval now)
+{
+  struct Curl_rategroup *g;
+  int keepon = data->req.keepon;
+  long ms = 0;
+
+  /* the handle has to stay within the limits of both the multi handle and
+     its own group, the tokens a group doesn't use are left to the others */
+  g = Curl_ratelimit_group(multi, 0);
+  if(g)
+    ms = group_wait(g, now, keepon);
+
+  if(data->set.rate_group) {
+    g = Curl_ratelimit_group(multi, data->set.rate_group);
+    if(g) {
+      long group_ms = group_wait(g, now, keepon);
+      if(group_ms > ms)
+        ms = group_ms;
+    }
+  }
+
+  return ms;
+}
+
+/* the group whose limits the easy handle shares by weight with the others
+   in it: its own group, or the whole multi handle if that has no limits */
+static struct Curl_rategroup *share_group(struct Curl_multi *multi,
+                                          struct SessionHandle *data)
+{
+  struct Curl_rategroup *g = NULL;
+
+  if(data->set.rate_group)
+    g = Curl_ratelimit_group(multi, data->set.rate_group);
+  if(!g)
+    g = Curl_ratelimit_group(multi, 0);
+
+  return g;
+}
+
+/*
+ * Is it the turn of the easy handle to go? It is not if another transfer of
+ * its share group, held back before, may go now as well and got fewer bytes
+ * for its weight.
+ */
+static bool my_turn(struct Curl_multi *multi, struct Curl_one_easy *easy,
+                    struct Curl_rategroup *share, struct timeval now)
+{
+  struct Curl_one_easy *other;
+
+  for(other = multi->easy.next; other != &multi->easy; other = other->next) {
+    if((other == easy) || !other->rate_held ||
+       (other->state != CURLM_STATE_TOOFAST) ||
+       (other->rate_used >= easy->rate_used))
+      continue;
+
+    if((share_group(multi, other->easy_handle) == share) &&
+       !limits_wait(multi, other->easy_handle, now))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Every transfer counts the bytes charged to it, divided by its weight. When
+ * the limits hold back transfers of a group, the one with the fewest of them
+ * goes first once there are tokens again. The bytes of the group are thus
+ * split in proportion to the weights of its busy transfers. The count of a
+ * transfer that starts, or was idle, is moved up to a burst behind that of
+ * the transfer the group last let go, so it doesn't get to use up the
+ * tokens alone for long.
+ */
+long Curl_ratelimit_wait(struct Curl_multi *multi,
+                         struct SessionHandle *data, struct timeval now)
+{
+  struct Curl_one_easy *easy = data->set.one_easy;
+  struct Curl_rategroup *share;
+  curl_off_t credit;
+  long ms;
+
+  if(!multi->rategroups)
+    return 0;
+
+  ms = limits_wait(multi, data, now);
+
+  share = share_group(multi, data);
+  if(!share)
+    return ms;
+
+  /* a transfer that was idle gets no more than a burst ahead for it */
+  credit = (share->send.rate + share->recv.rate) * RATELIMIT_BURST_MS / 1000 *
+    CURL_MAX_RATE_WEIGHT / data->set.rate_weight;
+  if(easy->rate_used < share->turn - credit)
+    easy->rate_used = share->turn - credit;
+
+  if(ms)
+    return ms;
+
+  if(!my_turn(multi, easy, share, now))
+    return RATELIMIT_TURN_MS;
+
+  share->turn = easy->rate_used;
+  easy->rate_held = FALSE;
+
+  return 0;
+}
+
+long Curl_ratelimit_held(struct Curl_multi *multi,
+                         struct SessionHandle *data, long ms)
+{
+  struct Curl_rategroup *g = Curl_ratelimit_group(multi, 0);
+
+  if(g)
+    g->waits++;
+
+  if(data->set.rate_group) {
+    g = Curl_ratelimit_group(multi, data->set.rate_group);
+    if(g)
+      g->waits++;
+  }
+
+  data->set.one_easy->rate_held = TRUE;
+
+  return ms;
+}
+
+static void group_charge(struct Curl_rategroup *group,
+                         curl_off_t sent, curl_off_t received)
+{
+  if(group->send.rate)
+    group->send.tokens -= sent;
+  if(group->recv.rate)
+    group->recv.tokens -= received;
+  group->sent += sent;
+  group->received += received;
+}
+
+void Curl_ratelimit_charge(struct Curl_multi *multi,
+                           struct SessionHandle *data,
+                           curl_off_t sent, curl_off_t received)
+{
+  struct Curl_rategroup *g;
+
+  if(!multi->rategroups || (!sent && !received))
+    return;
+
+  g = Curl_ratelimit_group(multi, 0);
+  if(g)
+    group_charge(g, sent, received);
+
+  if(data->set.rate_group) {
+    g = Curl_ratelimit_group(multi, data->set.rate_group);
+    if(g)
+      group_charge(g, sent, received);
+  }
+
+  data->set.one_easy->rate_used +=
+    (sent + received) * CURL_MAX_RATE_WEIGHT / data->set.rate_weight;
+}
+
+void Curl_ratelimit_cleanup(struct Curl_multi *multi)
+{
+  while(multi->rategroups) {
+    struct Curl_rategroup *g = multi->rategroups;
+    multi->rategroups = g->next;
+    free(g);
+  }
+}
@@ -0,0 +1,95 @@
+#ifndef HEADER_CURL_RATELIMIT_H
+#define HEADER_CURL_RATELIMIT_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+/* A token bucket. The tokens are bytes that may be transferred right away.
+   Transfers are charged after the fact, so the count goes negative when a
+   transfer did more than there were tokens for, and has to be paid back
+   before the next one may go. */
+struct Curl_ratebucket {
+  curl_off_t rate;       /* bytes per second, 0 means unlimited */
+  curl_off_t tokens;     /* bytes that may be transferred now */
+  struct timeval filled; /* when the tokens were last topped up */
+};
+
+/* the limits and counters of a group of easy handles */
+struct Curl_rategroup {
+  struct Curl_rategroup *next;
+  long id;                      /* CURLOPT_RATE_GROUP, 0 is the multi */
+  struct Curl_ratebucket send;
+  struct Curl_ratebucket recv;
+  curl_off_t sent;              /* bytes sent by the group */
+  curl_off_t received;          /* bytes received by the group */
+  long waits;                   /* times a transfer was held back */
+  curl_off_t turn;              /* the weighted bytes of the transfer that
+                                   the group last let go, see
+                                   Curl_ratelimit_wait() */
+};
+
+struct Curl_multi;
+
+/*
+ * Curl_ratelimit_set() sets the limits of a group, group 0 being the whole
+ * multi handle.
+ */
+CURLcode Curl_ratelimit_set(struct Curl_multi *multi, long group,
+                            curl_off_t max_send_speed,
+                            curl_off_t max_recv_speed);
+
+/* the group with this id, or NULL if no limits were ever set for it */
+struct Curl_rategroup *Curl_ratelimit_group(struct Curl_multi *multi,
+                                            long group);
+
+/*
+ * Curl_ratelimit_wait() returns for how many milliseconds the multi and
+ * group limits keep the easy handle from transferring, 0 if it may go now.
+ * Only the limits of the directions the transfer still sends or receives in
+ * count. Of the transfers that may go, those that got fewer bytes for their
+ * weight go first.
+ */
+long Curl_ratelimit_wait(struct Curl_multi *multi,
+                         struct SessionHandle *data, struct timeval now);
+
+/*
+ * Curl_ratelimit_held() counts that the limits hold back a transfer of the
+ * easy handle for 'ms' milliseconds, and returns how long it is to wait.
+ * The transfer then waits for its turn until Curl_ratelimit_wait() lets it
+ * go.
+ */
+long Curl_ratelimit_held(struct Curl_multi *multi,
+                         struct SessionHandle *data, long ms);
+
+/*
+ * Curl_ratelimit_charge() takes what the easy handle just transferred from
+ * the buckets of its group and of the multi handle.
+ */
+void Curl_ratelimit_charge(struct Curl_multi *multi,
+                           struct SessionHandle *data,
+                           curl_off_t sent, curl_off_t received);
+
+/* free the groups of the multi handle */
+void Curl_ratelimit_cleanup(struct Curl_multi *multi);
+
+#endif /* HEADER_CURL_RATELIMIT_H */
@@ -0,0 +1,334 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#if !defined(CURL_DISABLE_HTTP)
+
+#include "urldata.h"
+#include "sendf.h"
+#include "hash.h"
+#include "share.h"
+#include "redircache.h"
+
+#include "curl_memory.h"
+/* The last #include file should be: */
+#include "memdebug.h"
+
+#define REDIRCACHE_HASH_SIZE 97
+
+/* the most redirects kept in a cache, the ones closest to going stale make
+   room for new ones beyond this */
+#define REDIRCACHE_MAX_ENTRIES 500
+
+/* never walk more cached redirects than this in one go, a cached redirect
+   loop would otherwise keep us spinning forever when maxredirs is -1 */
+#define REDIRCACHE_MAX_HOPS 50
+
+static void freeredirentry(void *freethis)
+{
+  struct Curl_redir_entry *entry = (struct Curl_redir_entry *) freethis;
+
+  Curl_safefree(entry->target);
+  free(entry);
+}
+
+/*
+ * Curl_mk_redircache() creates a new redirect cache and returns the handle
+ * for it.
+ */
+struct curl_hash *Curl_mk_redircache(void)
+{
+  return Curl_hash_alloc(REDIRCACHE_HASH_SIZE, Curl_hash_str,
+                         Curl_str_key_compare, freeredirentry);
+}
+
+/*
+ * Return a redirect cache id string for the provided URL. The scheme and the
+ * host name are lower cased, the fragment is cut off and an empty path is
+ * made "/" so that trivially different spellings of the same URL end up in
+ * the same cache entry.
+ */
+static char *create_redircache_id(const char *url)
+{
+  const char *scheme_end = strstr(url, "://");
+  const char *auth = url;
+  const char *host;
+  const char *end;
+  const char *p;
+  size_t len = strcspn(url, "#");
+  size_t prefix;
+  char *id;
+  char *ptr;
+
+  if(scheme_end && ((size_t)(scheme_end - url) < len))
+    auth = scheme_end + 3;
+  else
+    scheme_end = NULL;
+
+  end = auth + strcspn(auth, "/?#");
+
+  /* user name and password are case sensitive, skip past them */
+  host = auth;
+  for(p = auth; p < end; p++)
+    if(*p == '@')
+      host = p + 1;
+
+  prefix = end - url;
+  id = malloc(len + 2); /* room for an added slash and the zero */
+  if(!id)
+    return NULL;
+
+  memcpy(id, url, prefix);
+  ptr = id + prefix;
+  if(*end != '/')
+    *ptr++ = '/';
+  memcpy(ptr, end, len - prefix);
+  ptr[len - prefix] = 0;
+
+  if(scheme_end)
+    for(ptr = id; ptr < id + (scheme_end - url); ptr++)
+      *ptr = (char)TOLOWER(*ptr);
+  for(ptr = id + (host - url); ptr < id + prefix; ptr++)
+    *ptr = (char)TOLOWER(*ptr);
+
+  return id;
+}
+
+/*
+ * This function is set as a callback to Curl_hash_clean_with_criterium() to
+ * remove the stale entries.
+ */
+static int redircache_timestamp_remove(void *datap, void *hc)
+{
+  time_t now = *(time_t *)datap;
+  struct Curl_redir_entry *entry = (struct Curl_redir_entry *)hc;
+
+  return entry->expires && (entry->expires <= now);
+}
+
+/*
+ * Remove the stale entries from the cache, and when it's still full the one
+ * that goes stale first, so that there's room for one more. Entries kept
+ * forever go last. Called with the share lock held.
+ */
+static void redircache_prune(struct curl_hash *cache, time_t now)
+{
+  struct curl_hash_iterator iter;
+  struct curl_hash_element *he;
+  struct curl_hash_element *oldest = NULL;
+
+  Curl_hash_clean_with_criterium(cache, &now, redircache_timestamp_remove);
+
+  if(cache->size < REDIRCACHE_MAX_ENTRIES)
+    return;
+
+  Curl_hash_start_iterate(cache, &iter);
+  while((he = Curl_hash_next_element(&iter)) != NULL) {
+    struct Curl_redir_entry *entry = (struct Curl_redir_entry *)he->ptr;
+    if(!oldest)
+      oldest = he;
+    else {
+      time_t oldest_expires =
+        ((struct Curl_redir_entry *)oldest->ptr)->expires;
+      if(entry->expires &&
+         (!oldest_expires || (entry->expires < oldest_expires)))
+        oldest = he;
+    }
+  }
+
+  if(oldest)
+    Curl_hash_delete(cache, oldest->key, oldest->key_len);
+}
+
+CURLcode Curl_redircache_add(struct SessionHandle *data,
+                             const char *url, const char *target)
+{
+  struct curl_hash *cache;
+  struct Curl_redir_entry *entry;
+  CURLcode result = CURLE_OK;
+  char *id;
+  size_t id_len;
+  time_t now;
+
+  if(!data->share || !data->share->redircache ||
+     !data->set.redir_cache_timeout)
+    /* not enabled */
+    return CURLE_OK;
+
+  cache = data->share->redircache;
+
+  id = create_redircache_id(url);
+  if(!id)
+    return CURLE_OUT_OF_MEMORY;
+  id_len = strlen(id);
+
+  entry = malloc(sizeof(struct Curl_redir_entry));
+  if(!entry) {
+    free(id);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  entry->target = strdup(target);
+  if(!entry->target) {
+    free(entry);
+    free(id);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  time(&now);
+  if(data->set.redir_cache_timeout == -1)
+    entry->expires = 0;
+  else
+    entry->expires = now + data->set.redir_cache_timeout;
+
+  Curl_share_lock(data, CURL_LOCK_DATA_REDIRECT, CURL_LOCK_ACCESS_SINGLE);
+
+  if(!Curl_hash_pick(cache, id, id_len+1))
+    redircache_prune(cache, now);
+
+  /* an already present entry for this URL gets replaced */
+  if(!Curl_hash_add(cache, id, id_len+1, entry)) {
+    freeredirentry(entry);
+    result = CURLE_OUT_OF_MEMORY;
+  }
+
+  Curl_share_unlock(data, CURL_LOCK_DATA_REDIRECT);
+
+  if(!result)
+    infof(data, "Permanent redirect to '%s' stored in redirect cache\n",
+          target);
+
+  free(id);
+  return result;
+}
+
+/*
+ * Return an allocated copy of the target the given URL is known to redirect
+ * to, or NULL when there's no (fresh) entry for it. Stale entries found are
+ * removed from the cache. '*oom' is set TRUE on allocation failure.
+ */
+static char *redircache_lookup(struct SessionHandle *data,
+                               const char *url, bool *oom)
+{
+  struct curl_hash *cache = data->share->redircache;
+  struct Curl_redir_entry *entry;
+  char *target = NULL;
+  char *id;
+  size_t id_len;
+  time_t now;
+
+  *oom = FALSE;
+
+  id = create_redircache_id(url);
+  if(!id) {
+    *oom = TRUE;
+    return NULL;
+  }
+  id_len = strlen(id);
+
+  time(&now);
+
+  Curl_share_lock(data, CURL_LOCK_DATA_REDIRECT, CURL_LOCK_ACCESS_SINGLE);
+
+  entry = Curl_hash_pick(cache, id, id_len+1);
+  if(entry && entry->expires && (entry->expires <= now)) {
+    /* too old, forget about it */
+    Curl_hash_delete(cache, id, id_len+1);
+    entry = NULL;
+  }
+  if(entry) {
+    target = strdup(entry->target);
+    if(!target)
+      *oom = TRUE;
+  }
+
+  Curl_share_unlock(data, CURL_LOCK_DATA_REDIRECT);
+
+  free(id);
+  return target;
+}
+
+CURLcode Curl_redircache_follow(struct SessionHandle *data)
+{
+  int hops = 0;
+
+  if(!data->share || !data->share->redircache ||
+     !data->set.http_follow_location || (data->set.httpreq != HTTPREQ_GET))
+    /* only GET requests that would follow anyway are shortcut, other
+       methods may change on the way. HEAD requests are GET requests with
+       opt_no_body set here, and they are shortcut too. */
+    return CURLE_OK;
+
+  while(hops < REDIRCACHE_MAX_HOPS) {
+    bool oom;
+    char *target;
+
+    if((data->set.maxredirs != -1) &&
+       (data->set.followlocation >= data->set.maxredirs))
+      /* leave it to the network round-trip to trigger the error */
+      break;
+
+    target = redircache_lookup(data, data->change.url, &oom);
+    if(oom)
+      return CURLE_OUT_OF_MEMORY;
+    if(!target)
+      break;
+
+    infof(data, "Redirect cache: '%s' has moved to '%s'\n",
+          data->change.url, target);
+
+    if(data->set.http_auto_referer) {
+      if(data->change.referer_alloc) {
+        Curl_safefree(data->change.referer);
+        data->change.referer_alloc = FALSE;
+      }
+
+      data->change.referer = strdup(data->change.url);
+      if(!data->change.referer) {
+        free(target);
+        return CURLE_OUT_OF_MEMORY;
+      }
+      data->change.referer_alloc = TRUE;
+    }
+
+    if(data->change.url_alloc) {
+      Curl_safefree(data->change.url);
+      data->change.url_alloc = FALSE;
+    }
+
+    /* stored targets are always absolute URLs */
+    data->change.url = target;
+    data->change.url_alloc = TRUE;
+    data->state.allow_port = FALSE;
+    data->state.this_is_a_follow = TRUE;
+    data->set.followlocation++;
+    hops++;
+  }
+
+  if(hops)
+    data->info.redircache_hits++;
+  else
+    data->info.redircache_misses++;
+
+  return CURLE_OK;
+}
+
+#endif /* CURL_DISABLE_HTTP */
@@ -0,0 +1,58 @@
+#ifndef HEADER_CURL_REDIRCACHE_H
+#define HEADER_CURL_REDIRCACHE_H
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+
+#include "curl_setup.h"
+
+#if !defined(CURL_DISABLE_HTTP)
+
+struct curl_hash;
+
+struct Curl_redir_entry {
+  char *target;   /* the absolute URL the source has permanently moved to */
+  time_t expires; /* when this entry goes stale, 0 means never */
+};
+
+/* make a new redirect cache and return the handle for it */
+struct curl_hash *Curl_mk_redircache(void);
+
+/*
+ * Curl_redircache_add() stores a permanent (301 or 308) redirect from 'url'
+ * to 'target' in the redirect cache of the share the handle uses.
+ */
+CURLcode Curl_redircache_add(struct SessionHandle *data,
+                             const char *url, const char *target);
+
+/*
+ * Curl_redircache_follow() replaces data->change.url with the final target
+ * of all cached permanent redirects it leads to, as if they had been
+ * followed over the network.
+ */
+CURLcode Curl_redircache_follow(struct SessionHandle *data);
+
+#else
+#define Curl_redircache_add(x,y,z) CURLE_OK
+#define Curl_redircache_follow(x) CURLE_OK
+#endif
+
+#endif /* HEADER_CURL_REDIRCACHE_H */
@@ -31,6 +31,7 @@
 #include "ssh.h"
 #include "multiif.h"
 #include "non-ascii.h"
+#include "httpcache.h"
 
 #define _MPRINTF_REPLACE /* use the internal *printf() functions */
 #include <curl/mprintf.h>
@@ -459,6 +460,10 @@ CURLcode Curl_client_write(struct connectdata *conn,
       failf(data, "Failed writing body (%zu != %zu)", wrote, len);
       return CURLE_WRITE_ERROR;
     }
+
+    if(type == CLIENTWRITE_BODY)
+      /* the HTTP cache may want a copy of the response body */
+      Curl_httpcache_body(data, ptr, len);
   }
 
   if((type & CLIENTWRITE_HEADER) &&
@@ -569,6 +574,9 @@ CURLcode Curl_read(struct connectdata *conn, /* connection data */
   if(nread < 0)
     return curlcode;
 
+  if(conn->data->set.tcp_quickack)
+    Curl_quickack(conn, sockfd);
+
   if(pipelining) {
     memcpy(buf, conn->master_buffer, nread);
     conn->buf_len = nread;
@@ -26,6 +26,8 @@
 #include "urldata.h"
 #include "share.h"
 #include "sslgen.h"
+#include "redircache.h"
+#include "httpcache.h"
 #include "curl_memory.h"
 
 /* The last #include file should be: */
@@ -89,10 +91,7 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     case CURL_LOCK_DATA_SSL_SESSION:
 #ifdef USE_SSL
       if(!share->sslsession) {
-        share->max_ssl_sessions = 8;
-        share->sslsession = calloc(share->max_ssl_sessions,
-                                   sizeof(struct curl_ssl_session));
-        share->sessionage = 0;
+        share->sslsession = Curl_ssl_mk_sessioncache(8);
         if(!share->sslsession)
           res = CURLSHE_NOMEM;
       }
@@ -104,6 +103,30 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     case CURL_LOCK_DATA_CONNECT:     /* not supported (yet) */
       break;
 
+    case CURL_LOCK_DATA_REDIRECT:
+#ifndef CURL_DISABLE_HTTP
+      if(!share->redircache) {
+        share->redircache = Curl_mk_redircache();
+        if(!share->redircache)
+          res = CURLSHE_NOMEM;
+      }
+#else
+      res = CURLSHE_NOT_BUILT_IN;
+#endif
+      break;
+
+    case CURL_LOCK_DATA_HTTP_CACHE:
+#ifndef CURL_DISABLE_HTTP
+      if(!share->httpcache) {
+        share->httpcache = Curl_mk_httpcache();
+        if(!share->httpcache)
+          res = CURLSHE_NOMEM;
+      }
+#else
+      res = CURLSHE_NOT_BUILT_IN;
+#endif
+      break;
+
     default:
       res = CURLSHE_BAD_OPTION;
     }
@@ -116,7 +139,7 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     switch( type ) {
     case CURL_LOCK_DATA_DNS:
       if(share->hostcache) {
-        Curl_hash_destroy(share->hostcache);
+        Curl_dnscache_destroy(share->hostcache);
         share->hostcache = NULL;
       }
       break;
@@ -134,7 +157,8 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
 
     case CURL_LOCK_DATA_SSL_SESSION:
 #ifdef USE_SSL
-      Curl_safefree(share->sslsession);
+      Curl_ssl_sessioncache_destroy(share->sslsession);
+      share->sslsession = NULL;
 #else
       res = CURLSHE_NOT_BUILT_IN;
 #endif
@@ -143,6 +167,28 @@ curl_share_setopt(CURLSH *sh, CURLSHoption option, ...)
     case CURL_LOCK_DATA_CONNECT:
       break;
 
+    case CURL_LOCK_DATA_REDIRECT:
+#ifndef CURL_DISABLE_HTTP
+      if(share->redircache) {
+        Curl_hash_destroy(share->redircache);
+        share->redircache = NULL;
+      }
+#else
+      res = CURLSHE_NOT_BUILT_IN;
+#endif
+      break;
+
+    case CURL_LOCK_DATA_HTTP_CACHE:
+#ifndef CURL_DISABLE_HTTP
+      if(share->httpcache) {
+        Curl_hash_destroy(share->httpcache);
+        share->httpcache = NULL;
+      }
+#else
+      res = CURLSHE_NOT_BUILT_IN;
+#endif
+      break;
+
     default:
       res = CURLSHE_BAD_OPTION;
       break;
@@ -193,7 +239,7 @@ curl_share_cleanup(CURLSH *sh)
   }
 
   if(share->hostcache) {
-    Curl_hash_destroy(share->hostcache);
+    Curl_dnscache_destroy(share->hostcache);
     share->hostcache = NULL;
   }
 
@@ -202,13 +248,18 @@ curl_share_cleanup(CURLSH *sh)
     Curl_cookie_cleanup(share->cookies);
 #endif
 
-#ifdef USE_SSL
-  if(share->sslsession) {
-    size_t i;
-    for(i = 0; i < share->max_ssl_sessions; i++)
-      Curl_ssl_kill_session(&(share->sslsession[i]));
-    free(share->sslsession);
+  if(share->redircache) {
+    Curl_hash_destroy(share->redircache);
+    share->redircache = NULL;
   }
+
+  if(share->httpcache) {
+    Curl_hash_destroy(share->httpcache);
+    share->httpcache = NULL;
+  }
+
+#ifdef USE_SSL
+  Curl_ssl_sessioncache_destroy(share->sslsession);
 #endif
 
   if(share->unlockfunc)
@@ -44,14 +44,15 @@ struct Curl_share {
   curl_unlock_function unlockfunc;
   void *clientdata;
 
-  struct curl_hash *hostcache;
+  struct Curl_dnscache *hostcache;
 #if !defined(CURL_DISABLE_HTTP) && !defined(CURL_DISABLE_COOKIES)
   struct CookieInfo *cookies;
 #endif
 
-  struct curl_ssl_session *sslsession;
-  size_t max_ssl_sessions;
-  long sessionage;
+  struct Curl_sslcache *sslsession;
+
+  struct curl_hash *redircache; /* permanent redirects */
+  struct curl_hash *httpcache;  /* stored HTTP responses */
 };
 
 CURLSHcode Curl_share_lock (struct SessionHandle *, curl_lock_data,
@@ -37,6 +37,8 @@
 #include "select.h"
 #include "connect.h"
 #include "timeval.h"
+#include "hostip.h"
+#include "multiif.h"
 #include "socks.h"
 
 /* The last #include file should be: */
@@ -95,77 +97,98 @@ int Curl_blockread_all(struct connectdata *conn, /* connection data */
   return result;
 }
 
+/* the steps of the handshakes, kept in socks_state.state */
+enum socks_step {
+  SOCKS_INIT,          /* no handshake going on */
+  SOCKS4_RESOLVING,    /* resolving the name of the remote host */
+  SOCKS4_SEND_CONNECT, /* sending the connect request */
+  SOCKS4_RECV_CONNECT, /* reading the reply to it */
+  SOCKS5_SEND_METHODS, /* sending the authentication methods we offer */
+  SOCKS5_RECV_METHOD,  /* reading the method the proxy picked */
+  SOCKS5_SEND_AUTH,    /* sending the user name and password */
+  SOCKS5_RECV_AUTH,    /* reading the verdict on them */
+  SOCKS5_REQUEST,      /* authenticated, composing the connect request */
+  SOCKS5_RESOLVING,    /* resolving the name of the remote host */
+  SOCKS5_SEND_CONNECT, /* sending the connect request */
+  SOCKS5_RECV_CONNECT, /* reading the first 10 bytes of the reply to it */
+  SOCKS5_RECV_ADDRESS  /* reading the rest of the address in the reply */
+};
+
 /*
-* This function logs in to a SOCKS4 proxy and sends the specifics to the final
-* destination server.
-*
-* Reference :
-*   http://socks.permeo.com/protocol/socks4.protocol
-*
-* Note :
-*   Set protocol4a=true for  "SOCKS 4A (Simple Extension to SOCKS 4 Protocol)"
-*   Nonsupport "Identification Protocol (RFC1413)"
-*/
-CURLcode Curl_SOCKS4(const char *proxy_name,
-                     const char *hostname,
-                     int remote_port,
-                     int sockindex,
-                     struct connectdata *conn,
-                     bool protocol4a)
+ * Send what is left of the message in the buffer, as much of it as the
+ * socket takes right now. *sent is set TRUE once all of it is sent.
+ */
+static CURLcode socks_send(struct connectdata *conn, int sockindex,
+                           bool *sent)
 {
-#define SOCKS4REQLEN 262
-  unsigned char socksreq[SOCKS4REQLEN]; /* room for SOCKS4 request incl. user
-                                           id */
-  int result;
+  struct socks_state *s = &conn->socks_state[sockindex];
+  ssize_t written;
   CURLcode code;
-  curl_socket_t sock = conn->sock[sockindex];
-  struct SessionHandle *data = conn->data;
-
-  if(Curl_timeleft(data, NULL, TRUE) < 0) {
-    /* time-out, bail out, go home */
-    failf(data, "Connection time-out");
-    return CURLE_OPERATION_TIMEDOUT;
-  }
-
-  curlx_nonblock(sock, FALSE);
-
-  /*
-   * Compose socks4 request
-   *
-   * Request format
-   *
-   *     +----+----+----+----+----+----+----+----+----+----+....+----+
-   *     | VN | CD | DSTPORT |      DSTIP        | USERID       |NULL|
-   *     +----+----+----+----+----+----+----+----+----+----+....+----+
-   * # of bytes:  1    1      2              4           variable       1
-   */
 
-  socksreq[0] = 4; /* version (SOCKS4) */
-  socksreq[1] = 1; /* connect */
-  socksreq[2] = (unsigned char)((remote_port >> 8) & 0xff); /* PORT MSB */
-  socksreq[3] = (unsigned char)(remote_port & 0xff);        /* PORT LSB */
+  *sent = FALSE;
+  code = Curl_write_plain(conn, conn->sock[sockindex], s->buf + s->done,
+                          s->len - s->done, &written);
+  if(code == CURLE_AGAIN)
+    return CURLE_OK;
+  else if(code)
+    return code;
+
+  s->done += written;
+  *sent = (s->done == s->len);
+  return CURLE_OK;
+}
 
-  /* DNS resolve only for SOCKS4, not SOCKS4a */
-  if(!protocol4a) {
-    struct Curl_dns_entry *dns;
-    Curl_addrinfo *hp=NULL;
-    int rc;
+/*
+ * Read what is left to read of the message of s->len bytes into the buffer,
+ * as much of it as there is right now. *got is set TRUE once all of it is
+ * read.
+ */
+static CURLcode socks_recv(struct connectdata *conn, int sockindex,
+                           bool *got)
+{
+  struct socks_state *s = &conn->socks_state[sockindex];
+  ssize_t nread;
+  CURLcode code;
 
-    rc = Curl_resolv(conn, hostname, remote_port, &dns);
+  *got = FALSE;
+  code = Curl_read_plain(conn->sock[sockindex], (char *)s->buf + s->done,
+                         s->len - s->done, &nread);
+  if(code == CURLE_AGAIN)
+    return CURLE_OK;
+  else if(code)
+    return code;
+  else if(!nread)
+    return CURLE_RECV_ERROR; /* the proxy closed the connection */
+
+  s->done += nread;
+  *got = (s->done == s->len);
+  return CURLE_OK;
+}
 
-    if(rc == CURLRESOLV_ERROR)
-      return CURLE_COULDNT_RESOLVE_PROXY;
+/* the next message to send or read is 'len' bytes */
+#define socks_next(s,l) ((s)->len = (l), (s)->done = 0)
 
-    if(rc == CURLRESOLV_PENDING)
-      /* ignores the return code, but 'dns' remains NULL on failure */
-      (void)Curl_resolver_wait_resolv(conn, &dns);
+/*
+ * Compose the SOCKS4 request in the buffer, after the version, command and
+ * port number already in it. 'dns' is the resolved remote host, NULL for
+ * SOCKS4a.
+ */
+static CURLcode socks4_request(struct connectdata *conn,
+                               struct socks_state *s,
+                               const char *proxy_name,
+                               const char *hostname,
+                               struct Curl_dns_entry *dns)
+{
+  struct SessionHandle *data = conn->data;
+  unsigned char *socksreq = s->buf;
+  size_t packetsize;
 
+  if(dns) {
     /*
      * We cannot use 'hostent' as a struct that Curl_resolv() returns.  It
      * returns a Curl_addrinfo pointer that may not always look the same.
      */
-    if(dns)
-      hp=dns->addr;
+    Curl_addrinfo *hp = dns->addr;
     if(hp) {
       char buf[64];
       unsigned short ip[4];
@@ -181,16 +204,23 @@ CURLcode Curl_SOCKS4(const char *proxy_name,
       }
       else
         hp = NULL; /* fail! */
+    }
 
-      Curl_resolv_unlock(data, dns); /* not used anymore from now on */
+    Curl_resolv_unlock(data, dns); /* not used anymore from now on */
 
-    }
     if(!hp) {
       failf(data, "Failed to resolve \"%s\" for SOCKS4 connect.",
             hostname);
       return CURLE_COULDNT_RESOLVE_HOST;
     }
   }
+  else {
+    /* SOCKS4a, set special invalid IP address 0.0.0.x */
+    socksreq[4] = 0;
+    socksreq[5] = 0;
+    socksreq[6] = 0;
+    socksreq[7] = 1;
+  }
 
   /*
    * This is currently not supporting "Identification Protocol (RFC1413)".
@@ -198,265 +228,274 @@ CURLcode Curl_SOCKS4(const char *proxy_name,
   socksreq[8] = 0; /* ensure empty userid is NUL-terminated */
   if(proxy_name) {
     size_t plen = strlen(proxy_name);
-    if(plen >= sizeof(socksreq) - 8) {
+    if(plen >= sizeof(s->buf) - 8) {
       failf(data, "Too long SOCKS proxy name, can't use!\n");
       return CURLE_COULDNT_CONNECT;
     }
     /* copy the proxy name WITH trailing zero */
     memcpy(socksreq + 8, proxy_name, plen+1);
   }
+  packetsize = 9 + strlen((char *)socksreq + 8); /* size including NUL */
 
-  /*
-   * Make connection
-   */
-  {
-    ssize_t actualread;
-    ssize_t written;
-    ssize_t hostnamelen = 0;
-    int packetsize = 9 +
-      (int)strlen((char*)socksreq + 8); /* size including NUL */
-
-    /* If SOCKS4a, set special invalid IP address 0.0.0.x */
-    if(protocol4a) {
-      socksreq[4] = 0;
-      socksreq[5] = 0;
-      socksreq[6] = 0;
-      socksreq[7] = 1;
-      /* If still enough room in buffer, also append hostname */
-      hostnamelen = (ssize_t)strlen(hostname) + 1; /* length including NUL */
-      if(packetsize + hostnamelen <= SOCKS4REQLEN)
-        strcpy((char*)socksreq + packetsize, hostname);
-      else
-        hostnamelen = 0; /* Flag: hostname did not fit in buffer */
-    }
-
-    /* Send request */
-    code = Curl_write_plain(conn, sock, (char *)socksreq,
-                            packetsize + hostnamelen,
-                            &written);
-    if((code != CURLE_OK) || (written != packetsize + hostnamelen)) {
-      failf(data, "Failed to send SOCKS4 connect request.");
-      return CURLE_COULDNT_CONNECT;
-    }
-    if(protocol4a && hostnamelen == 0) {
-      /* SOCKS4a with very long hostname - send that name separately */
-      hostnamelen = (ssize_t)strlen(hostname) + 1;
-      code = Curl_write_plain(conn, sock, (char *)hostname, hostnamelen,
-                              &written);
-      if((code != CURLE_OK) || (written != hostnamelen)) {
-        failf(data, "Failed to send SOCKS4 connect request.");
-        return CURLE_COULDNT_CONNECT;
-      }
-    }
-
-    packetsize = 8; /* receive data size */
-
-    /* Receive response */
-    result = Curl_blockread_all(conn, sock, (char *)socksreq, packetsize,
-                                &actualread);
-    if((result != CURLE_OK) || (actualread != packetsize)) {
-      failf(data, "Failed to receive SOCKS4 connect request ack.");
-      return CURLE_COULDNT_CONNECT;
-    }
-
-    /*
-     * Response format
-     *
-     *     +----+----+----+----+----+----+----+----+
-     *     | VN | CD | DSTPORT |      DSTIP        |
-     *     +----+----+----+----+----+----+----+----+
-     * # of bytes:  1    1      2              4
-     *
-     * VN is the version of the reply code and should be 0. CD is the result
-     * code with one of the following values:
-     *
-     * 90: request granted
-     * 91: request rejected or failed
-     * 92: request rejected because SOCKS server cannot connect to
-     *     identd on the client
-     * 93: request rejected because the client program and identd
-     *     report different user-ids
-     */
-
-    /* wrong version ? */
-    if(socksreq[0] != 0) {
-      failf(data,
-            "SOCKS4 reply has wrong version, version should be 4.");
-      return CURLE_COULDNT_CONNECT;
-    }
-
-    /* Result */
-    switch(socksreq[1]) {
-    case 90:
-      infof(data, "SOCKS4%s request granted.\n", protocol4a?"a":"");
-      break;
-    case 91:
-      failf(data,
-            "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
-            ", request rejected or failed.",
-            (unsigned char)socksreq[4], (unsigned char)socksreq[5],
-            (unsigned char)socksreq[6], (unsigned char)socksreq[7],
-            ((socksreq[8] << 8) | socksreq[9]),
-            socksreq[1]);
-      return CURLE_COULDNT_CONNECT;
-    case 92:
-      failf(data,
-            "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
-            ", request rejected because SOCKS server cannot connect to "
-            "identd on the client.",
-            (unsigned char)socksreq[4], (unsigned char)socksreq[5],
-            (unsigned char)socksreq[6], (unsigned char)socksreq[7],
-            ((socksreq[8] << 8) | socksreq[9]),
-            socksreq[1]);
-      return CURLE_COULDNT_CONNECT;
-    case 93:
-      failf(data,
-            "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
-            ", request rejected because the client program and identd "
-            "report different user-ids.",
-            (unsigned char)socksreq[4], (unsigned char)socksreq[5],
-            (unsigned char)socksreq[6], (unsigned char)socksreq[7],
-            ((socksreq[8] << 8) | socksreq[9]),
-            socksreq[1]);
-      return CURLE_COULDNT_CONNECT;
-    default:
-      failf(data,
-            "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
-            ", Unknown.",
-            (unsigned char)socksreq[4], (unsigned char)socksreq[5],
-            (unsigned char)socksreq[6], (unsigned char)socksreq[7],
-            ((socksreq[8] << 8) | socksreq[9]),
-            socksreq[1]);
+  if(!dns) {
+    /* SOCKS4a, the host name follows */
+    size_t hostnamelen = strlen(hostname) + 1; /* length including NUL */
+    if(packetsize + hostnamelen > sizeof(s->buf)) {
+      failf(data, "Too long host name for SOCKS4a connect.");
       return CURLE_COULDNT_CONNECT;
     }
+    memcpy(socksreq + packetsize, hostname, hostnamelen);
+    packetsize += hostnamelen;
   }
 
-  curlx_nonblock(sock, TRUE);
-
-  return CURLE_OK; /* Proxy was successful! */
+  socks_next(s, packetsize);
+  return CURLE_OK;
 }
 
 /*
- * This function logs in to a SOCKS5 proxy and sends the specifics to the final
- * destination server.
+ * The reply to a SOCKS4 request has been read.
  */
-CURLcode Curl_SOCKS5(const char *proxy_name,
-                     const char *proxy_password,
-                     const char *hostname,
-                     int remote_port,
-                     int sockindex,
-                     struct connectdata *conn)
+static CURLcode socks4_reply(struct connectdata *conn,
+                             struct socks_state *s,
+                             bool protocol4a)
 {
+  struct SessionHandle *data = conn->data;
+  unsigned char *socksreq = s->buf;
+
   /*
-    According to the RFC1928, section "6.  Replies". This is what a SOCK5
-    replies:
+   * Response format
+   *
+   *     +----+----+----+----+----+----+----+----+
+   *     | VN | CD | DSTPORT |      DSTIP        |
+   *     +----+----+----+----+----+----+----+----+
+   * # of bytes:  1    1      2              4
+   *
+   * VN is the version of the reply code and should be 0. CD is the result
+   * code with one of the following values:
+   *
+   * 90: request granted
+   * 91: request rejected or failed
+   * 92: request rejected because SOCKS server cannot connect to
+   *     identd on the client
+   * 93: request rejected because the client program and identd
+   *     report different user-ids
+   */
 
-        +----+-----+-------+------+----------+----------+
-        |VER | REP |  RSV  | ATYP | BND.ADDR | BND.PORT |
-        +----+-----+-------+------+----------+----------+
-        | 1  |  1  | X'00' |  1   | Variable |    2     |
-        +----+-----+-------+------+----------+----------+
+  /* wrong version ? */
+  if(socksreq[0] != 0) {
+    failf(data,
+          "SOCKS4 reply has wrong version, version should be 4.");
+    return CURLE_COULDNT_CONNECT;
+  }
 
-    Where:
+  /* Result */
+  switch(socksreq[1]) {
+  case 90:
+    infof(data, "SOCKS4%s request granted.\n", protocol4a?"a":"");
+    break;
+  case 91:
+    failf(data,
+          "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
+          ", request rejected or failed.",
+          (unsigned char)socksreq[4], (unsigned char)socksreq[5],
+          (unsigned char)socksreq[6], (unsigned char)socksreq[7],
+          ((socksreq[2] << 8) | socksreq[3]),
+          socksreq[1]);
+    return CURLE_COULDNT_CONNECT;
+  case 92:
+    failf(data,
+          "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
+          ", request rejected because SOCKS server cannot connect to "
+          "identd on the client.",
+          (unsigned char)socksreq[4], (unsigned char)socksreq[5],
+          (unsigned char)socksreq[6], (unsigned char)socksreq[7],
+          ((socksreq[2] << 8) | socksreq[3]),
+          socksreq[1]);
+    return CURLE_COULDNT_CONNECT;
+  case 93:
+    failf(data,
+          "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
+          ", request rejected because the client program and identd "
+          "report different user-ids.",
+          (unsigned char)socksreq[4], (unsigned char)socksreq[5],
+          (unsigned char)socksreq[6], (unsigned char)socksreq[7],
+          ((socksreq[2] << 8) | socksreq[3]),
+          socksreq[1]);
+    return CURLE_COULDNT_CONNECT;
+  default:
+    failf(data,
+          "Can't complete SOCKS4 connection to %d.%d.%d.%d:%d. (%d)"
+          ", Unknown.",
+          (unsigned char)socksreq[4], (unsigned char)socksreq[5],
+          (unsigned char)socksreq[6], (unsigned char)socksreq[7],
+          ((socksreq[2] << 8) | socksreq[3]),
+          socksreq[1]);
+    return CURLE_COULDNT_CONNECT;
+  }
 
-    o  VER    protocol version: X'05'
-    o  REP    Reply field:
-    o  X'00' succeeded
-  */
+  return CURLE_OK;
+}
 
-  unsigned char socksreq[600]; /* room for large user/pw (255 max each) */
-  ssize_t actualread;
-  ssize_t written;
-  int result;
+static CURLcode socks4(const char *proxy_name,
+                       const char *hostname,
+                       int remote_port,
+                       int sockindex,
+                       struct connectdata *conn,
+                       bool protocol4a,
+                       bool *done)
+{
+  struct socks_state *s = &conn->socks_state[sockindex];
+  unsigned char *socksreq = s->buf;
+  struct Curl_dns_entry *dns = NULL;
   CURLcode code;
-  curl_socket_t sock = conn->sock[sockindex];
-  struct SessionHandle *data = conn->data;
-  long timeout;
-  bool socks5_resolve_local = (conn->proxytype == CURLPROXY_SOCKS5)?TRUE:FALSE;
-  const size_t hostname_len = strlen(hostname);
-  ssize_t len = 0;
+  bool ready;
 
-  /* RFC1928 chapter 5 specifies max 255 chars for domain name in packet */
-  if(!socks5_resolve_local && hostname_len > 255) {
-    infof(conn->data,"SOCKS5: server resolving disabled for hostnames of "
-          "length > 255 [actual len=%zu]\n", hostname_len);
-    socks5_resolve_local = TRUE;
-  }
-
-  /* get timeout */
-  timeout = Curl_timeleft(data, NULL, TRUE);
+  for(;;) {
+    switch(s->state) {
+    case SOCKS_INIT:
+      /*
+       * Compose socks4 request
+       *
+       * Request format
+       *
+       *     +----+----+----+----+----+----+----+----+----+----+....+----+
+       *     | VN | CD | DSTPORT |      DSTIP        | USERID       |NULL|
+       *     +----+----+----+----+----+----+----+----+----+----+....+----+
+       * # of bytes:  1    1      2              4           variable       1
+       */
+
+      socksreq[0] = 4; /* version (SOCKS4) */
+      socksreq[1] = 1; /* connect */
+      socksreq[2] = (unsigned char)((remote_port >> 8) & 0xff); /* PORT MSB */
+      socksreq[3] = (unsigned char)(remote_port & 0xff);        /* PORT LSB */
+
+      /* DNS resolve only for SOCKS4, not SOCKS4a */
+      if(!protocol4a) {
+        int rc = Curl_resolv(conn, hostname, remote_port, &dns);
+
+        if(rc == CURLRESOLV_ERROR)
+          return CURLE_COULDNT_RESOLVE_PROXY;
+
+        if(rc == CURLRESOLV_PENDING) {
+          s->state = SOCKS4_RESOLVING;
+          return CURLE_OK;
+        }
+        if(!dns) {
+          failf(conn->data, "Failed to resolve \"%s\" for SOCKS4 connect.",
+                hostname);
+          return CURLE_COULDNT_RESOLVE_HOST;
+        }
+      }
 
-  if(timeout < 0) {
-    /* time-out, bail out, go home */
-    failf(data, "Connection time-out");
-    return CURLE_OPERATION_TIMEDOUT;
-  }
+      code = socks4_request(conn, s, proxy_name, hostname, dns);
+      if(code)
+        return code;
+      s->state = SOCKS4_SEND_CONNECT;
+      break;
 
-  curlx_nonblock(sock, TRUE);
+    case SOCKS4_RESOLVING:
+      code = Curl_resolver_is_resolved(conn, &dns);
+      if(code)
+        return code;
+      if(!dns)
+        return CURLE_OK; /* not yet */
 
-  /* wait until socket gets connected */
-  result = Curl_socket_ready(CURL_SOCKET_BAD, sock, timeout);
+      code = socks4_request(conn, s, proxy_name, hostname, dns);
+      if(code)
+        return code;
+      s->state = SOCKS4_SEND_CONNECT;
+      break;
 
-  if(-1 == result) {
-    failf(conn->data, "SOCKS5: no connection here");
-    return CURLE_COULDNT_CONNECT;
-  }
-  else if(0 == result) {
-    failf(conn->data, "SOCKS5: connection timeout");
-    return CURLE_OPERATION_TIMEDOUT;
-  }
+    case SOCKS4_SEND_CONNECT:
+      code = socks_send(conn, sockindex, &ready);
+      if(code) {
+        failf(conn->data, "Failed to send SOCKS4 connect request.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
 
-  if(result & CURL_CSELECT_ERR) {
-    failf(conn->data, "SOCKS5: error occurred during connection");
-    return CURLE_COULDNT_CONNECT;
-  }
+      socks_next(s, 8); /* receive data size */
+      s->state = SOCKS4_RECV_CONNECT;
+      break;
 
-  socksreq[0] = 5; /* version */
-#if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
-  socksreq[1] = (char)(proxy_name ? 3 : 2); /* number of methods (below) */
-  socksreq[2] = 0; /* no authentication */
-  socksreq[3] = 1; /* gssapi */
-  socksreq[4] = 2; /* username/password */
-#else
-  socksreq[1] = (char)(proxy_name ? 2 : 1); /* number of methods (below) */
-  socksreq[2] = 0; /* no authentication */
-  socksreq[3] = 2; /* username/password */
-#endif
+    case SOCKS4_RECV_CONNECT:
+      code = socks_recv(conn, sockindex, &ready);
+      if(code) {
+        failf(conn->data, "Failed to receive SOCKS4 connect request ack.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
 
-  curlx_nonblock(sock, FALSE);
+      code = socks4_reply(conn, s, protocol4a);
+      if(!code)
+        *done = TRUE; /* Proxy was successful! */
+      return code;
 
-  code = Curl_write_plain(conn, sock, (char *)socksreq, (2 + (int)socksreq[1]),
-                          &written);
-  if((code != CURLE_OK) || (written != (2 + (int)socksreq[1]))) {
-    failf(data, "Unable to send initial SOCKS5 request.");
-    return CURLE_COULDNT_CONNECT;
+    default:
+      return CURLE_COULDNT_CONNECT;
+    }
   }
+}
 
-  curlx_nonblock(sock, TRUE);
+/*
+* This function logs in to a SOCKS4 proxy and sends the specifics to the final
+* destination server.
+*
+* Reference :
+*   http://socks.permeo.com/protocol/socks4.protocol
+*
+* Note :
+*   Set protocol4a=true for  "SOCKS 4A (Simple Extension to SOCKS 4 Protocol)"
+*   Nonsupport "Identification Protocol (RFC1413)"
+*/
+CURLcode Curl_SOCKS4(const char *proxy_name,
+                     const char *hostname,
+                     int remote_port,
+                     int sockindex,
+                     struct connectdata *conn,
+                     bool protocol4a,
+                     bool *done)
+{
+  struct SessionHandle *data = conn->data;
+  CURLcode code;
 
-  result = Curl_socket_ready(sock, CURL_SOCKET_BAD, timeout);
+  *done = FALSE;
 
-  if(-1 == result) {
-    failf(conn->data, "SOCKS5 nothing to read");
-    return CURLE_COULDNT_CONNECT;
-  }
-  else if(0 == result) {
-    failf(conn->data, "SOCKS5 read timeout");
-    return CURLE_OPERATION_TIMEDOUT;
+  if(Curl_timeleft(data, NULL, TRUE) < 0) {
+    /* time-out, bail out, go home */
+    failf(data, "Connection time-out");
+    code = CURLE_OPERATION_TIMEDOUT;
   }
+  else
+    code = socks4(proxy_name, hostname, remote_port, sockindex, conn,
+                  protocol4a, done);
 
-  if(result & CURL_CSELECT_ERR) {
-    failf(conn->data, "SOCKS5 read error occurred");
-    return CURLE_RECV_ERROR;
-  }
+  if(code || *done)
+    /* the next handshake over this socket starts over */
+    conn->socks_state[sockindex].state = SOCKS_INIT;
 
-  curlx_nonblock(sock, FALSE);
+  return code;
+}
 
-  result=Curl_blockread_all(conn, sock, (char *)socksreq, 2, &actualread);
-  if((result != CURLE_OK) || (actualread != 2)) {
-    failf(data, "Unable to receive initial SOCKS5 response.");
-    return CURLE_COULDNT_CONNECT;
-  }
+/*
+ * The method the SOCKS5 proxy picked has been read, authenticate with it.
+ * *next is set to the state to go on with.
+ */
+static CURLcode socks5_method(struct connectdata *conn,
+                              struct socks_state *s,
+                              const char *proxy_name,
+                              const char *proxy_password,
+                              int sockindex,
+                              int *next)
+{
+  struct SessionHandle *data = conn->data;
+  unsigned char *socksreq = s->buf;
+
+#if !defined(HAVE_GSSAPI) && !defined(USE_WINDOWS_SSPI)
+  (void)sockindex;
+#endif
 
   if(socksreq[0] != 5) {
     failf(data, "Received invalid version in initial SOCKS5 response.");
@@ -464,20 +503,32 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
   }
   if(socksreq[1] == 0) {
     /* Nothing to do, no authentication needed */
-    ;
+    *next = SOCKS5_REQUEST;
+    return CURLE_OK;
   }
 #if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
   else if(socksreq[1] == 1) {
+    /* the GSSAPI negotiation is done blocking */
+    CURLcode code;
+    curlx_nonblock(conn->sock[sockindex], FALSE);
     code = Curl_SOCKS5_gssapi_negotiate(sockindex, conn);
+    curlx_nonblock(conn->sock[sockindex], TRUE);
     if(code != CURLE_OK) {
       failf(data, "Unable to negotiate SOCKS5 gssapi context.");
       return CURLE_COULDNT_CONNECT;
     }
+    if(conn->socks5_gssapi_enctype) {
+      failf(data, "SOCKS5 gssapi protection not yet implemented.");
+      return CURLE_COULDNT_CONNECT;
+    }
+    *next = SOCKS5_REQUEST;
+    return CURLE_OK;
   }
 #endif
   else if(socksreq[1] == 2) {
     /* Needs user name and password */
     size_t proxy_name_len, proxy_password_len;
+    size_t len = 0;
     if(proxy_name && proxy_password) {
       proxy_name_len = strlen(proxy_name);
       proxy_password_len = strlen(proxy_password);
@@ -494,7 +545,6 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
      * | 1  |  1   | 1 to 255 |  1   | 1 to 255 |
      * +----+------+----------+------+----------+
      */
-    len = 0;
     socksreq[len++] = 1;    /* username/pw subnegotiation version */
     socksreq[len++] = (unsigned char) proxy_name_len;
     if(proxy_name && proxy_name_len)
@@ -505,90 +555,70 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
       memcpy(socksreq + len, proxy_password, proxy_password_len);
     len += proxy_password_len;
 
-    code = Curl_write_plain(conn, sock, (char *)socksreq, len, &written);
-    if((code != CURLE_OK) || (len != written)) {
-      failf(data, "Failed to send SOCKS5 sub-negotiation request.");
-      return CURLE_COULDNT_CONNECT;
-    }
-
-    result=Curl_blockread_all(conn, sock, (char *)socksreq, 2, &actualread);
-    if((result != CURLE_OK) || (actualread != 2)) {
-      failf(data, "Unable to receive SOCKS5 sub-negotiation response.");
-      return CURLE_COULDNT_CONNECT;
-    }
-
-    /* ignore the first (VER) byte */
-    if(socksreq[1] != 0) { /* status */
-      failf(data, "User was rejected by the SOCKS5 server (%d %d).",
-            socksreq[0], socksreq[1]);
-      return CURLE_COULDNT_CONNECT;
-    }
-
-    /* Everything is good so far, user was authenticated! */
+    socks_next(s, len);
+    *next = SOCKS5_SEND_AUTH;
+    return CURLE_OK;
   }
-  else {
-    /* error */
+
+  /* error */
 #if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
-    if(socksreq[1] == 255) {
+  if(socksreq[1] == 255) {
 #else
-    if(socksreq[1] == 1) {
-      failf(data,
-            "SOCKS5 GSSAPI per-message authentication is not supported.");
-      return CURLE_COULDNT_CONNECT;
-    }
-    else if(socksreq[1] == 255) {
+  if(socksreq[1] == 1) {
+    failf(data,
+          "SOCKS5 GSSAPI per-message authentication is not supported.");
+    return CURLE_COULDNT_CONNECT;
+  }
+  else if(socksreq[1] == 255) {
 #endif
-      if(!proxy_name || !*proxy_name) {
-        failf(data,
-              "No authentication method was acceptable. (It is quite likely"
-              " that the SOCKS5 server wanted a username/password, since none"
-              " was supplied to the server on this connection.)");
-      }
-      else {
-        failf(data, "No authentication method was acceptable.");
-      }
-      return CURLE_COULDNT_CONNECT;
+    if(!proxy_name || !*proxy_name) {
+      failf(data,
+            "No authentication method was acceptable. (It is quite likely"
+            " that the SOCKS5 server wanted a username/password, since none"
+            " was supplied to the server on this connection.)");
     }
     else {
-      failf(data,
-            "Undocumented SOCKS5 mode attempted to be used by server.");
-      return CURLE_COULDNT_CONNECT;
+      failf(data, "No authentication method was acceptable.");
     }
+    return CURLE_COULDNT_CONNECT;
   }
 
+  failf(data, "Undocumented SOCKS5 mode attempted to be used by server.");
+  return CURLE_COULDNT_CONNECT;
+}
+
+/*
+ * Compose the SOCKS5 connect request in the buffer. 'dns' is the resolved
+ * remote host, NULL to let the proxy resolve the name.
+ */
+static CURLcode socks5_request(struct connectdata *conn,
+                               struct socks_state *s,
+                               const char *hostname,
+                               int remote_port,
+                               struct Curl_dns_entry *dns)
+{
+  struct SessionHandle *data = conn->data;
+  unsigned char *socksreq = s->buf;
+  size_t len = 0;
+
   /* Authentication is complete, now specify destination to the proxy */
-  len = 0;
   socksreq[len++] = 5; /* version (SOCKS5) */
   socksreq[len++] = 1; /* connect */
   socksreq[len++] = 0; /* must be zero */
 
-  if(!socks5_resolve_local) {
+  if(!dns) {
+    const size_t hostname_len = strlen(hostname);
     socksreq[len++] = 3; /* ATYP: domain name = 3 */
     socksreq[len++] = (char) hostname_len; /* address length */
     memcpy(&socksreq[len], hostname, hostname_len); /* address str w/o NULL */
     len += hostname_len;
   }
   else {
-    struct Curl_dns_entry *dns;
-    Curl_addrinfo *hp = NULL;
-    int rc = Curl_resolv(conn, hostname, remote_port, &dns);
-
-    if(rc == CURLRESOLV_ERROR)
-      return CURLE_COULDNT_RESOLVE_HOST;
-
-    if(rc == CURLRESOLV_PENDING) {
-      /* this requires that we're in "wait for resolve" state */
-      code = Curl_resolver_wait_resolv(conn, &dns);
-      if(code != CURLE_OK)
-        return code;
-    }
-
     /*
      * We cannot use 'hostent' as a struct that Curl_resolv() returns.  It
      * returns a Curl_addrinfo pointer that may not always look the same.
      */
-    if(dns)
-      hp=dns->addr;
+    Curl_addrinfo *hp = dns->addr;
     if(hp) {
       struct sockaddr_in *saddr_in;
 #ifdef ENABLE_IPV6
@@ -600,10 +630,8 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
         socksreq[len++] = 1; /* ATYP: IPv4 = 1 */
 
         saddr_in = (struct sockaddr_in*)hp->ai_addr;
-        for(i = 0; i < 4; i++) {
+        for(i = 0; i < 4; i++)
           socksreq[len++] = ((unsigned char*)&saddr_in->sin_addr.s_addr)[i];
-          infof(data, "%d\n", socksreq[len-1]);
-        }
       }
 #ifdef ENABLE_IPV6
       else if(hp->ai_family == AF_INET6) {
@@ -617,9 +645,10 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
 #endif
       else
         hp = NULL; /* fail! */
-
-      Curl_resolv_unlock(data, dns); /* not used anymore from now on */
     }
+
+    Curl_resolv_unlock(data, dns); /* not used anymore from now on */
+
     if(!hp) {
       failf(data, "Failed to resolve \"%s\" for SOCKS5 connect.",
             hostname);
@@ -630,34 +659,39 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
   socksreq[len++] = (unsigned char)((remote_port >> 8) & 0xff); /* PORT MSB */
   socksreq[len++] = (unsigned char)(remote_port & 0xff);        /* PORT LSB */
 
-#if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
-  if(conn->socks5_gssapi_enctype) {
-    failf(data, "SOCKS5 gssapi protection not yet implemented.");
-  }
-  else
-#endif
-    code = Curl_write_plain(conn, sock, (char *)socksreq, len, &written);
+  socks_next(s, len);
+  return CURLE_OK;
+}
 
-  if((code != CURLE_OK) || (len != written)) {
-    failf(data, "Failed to send SOCKS5 connect request.");
-    return CURLE_COULDNT_CONNECT;
-  }
+/*
+ * The first 10 bytes of the reply to the SOCKS5 connect request have been
+ * read. *more is set to the size of the rest of the reply.
+ */
+static CURLcode socks5_reply(struct connectdata *conn,
+                             struct socks_state *s,
+                             const char *hostname,
+                             size_t *more)
+{
+  struct SessionHandle *data = conn->data;
+  unsigned char *socksreq = s->buf;
+  size_t len = 10;
+
+  /*
+    According to the RFC1928, section "6.  Replies". This is what a SOCK5
+    replies:
 
-  len = 10; /* minimum packet size is 10 */
+        +----+-----+-------+------+----------+----------+
+        |VER | REP |  RSV  | ATYP | BND.ADDR | BND.PORT |
+        +----+-----+-------+------+----------+----------+
+        | 1  |  1  | X'00' |  1   | Variable |    2     |
+        +----+-----+-------+------+----------+----------+
 
-#if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
-  if(conn->socks5_gssapi_enctype) {
-    failf(data, "SOCKS5 gssapi protection not yet implemented.");
-  }
-  else
-#endif
-    result = Curl_blockread_all(conn, sock, (char *)socksreq,
-                                len, &actualread);
+    Where:
 
-  if((result != CURLE_OK) || (len != actualread)) {
-    failf(data, "Failed to receive SOCKS5 connect request ack.");
-    return CURLE_COULDNT_CONNECT;
-  }
+    o  VER    protocol version: X'05'
+    o  REP    Reply field:
+    o  X'00' succeeded
+  */
 
   if(socksreq[0] != 5) { /* version */
     failf(data,
@@ -726,25 +760,260 @@ CURLcode Curl_SOCKS5(const char *proxy_name,
   }
 
   /* At this point we already read first 10 bytes */
+  *more = (len > 10) ? len - 10 : 0;
+  return CURLE_OK;
+}
+
+static CURLcode socks5(const char *proxy_name,
+                       const char *proxy_password,
+                       const char *hostname,
+                       int remote_port,
+                       int sockindex,
+                       struct connectdata *conn,
+                       bool *done)
+{
+  struct socks_state *s = &conn->socks_state[sockindex];
+  struct SessionHandle *data = conn->data;
+  unsigned char *socksreq = s->buf;
+  struct Curl_dns_entry *dns = NULL;
+  bool socks5_resolve_local = (conn->proxytype == CURLPROXY_SOCKS5)?TRUE:FALSE;
+  const size_t hostname_len = strlen(hostname);
+  CURLcode code;
+  size_t more;
+  int next;
+  bool ready;
+
+  /* RFC1928 chapter 5 specifies max 255 chars for domain name in packet */
+  if(!socks5_resolve_local && hostname_len > 255) {
+    if(s->state == SOCKS_INIT)
+      infof(conn->data,"SOCKS5: server resolving disabled for hostnames of "
+            "length > 255 [actual len=%zu]\n", hostname_len);
+    socks5_resolve_local = TRUE;
+  }
+
+  for(;;) {
+    switch(s->state) {
+    case SOCKS_INIT:
+      socksreq[0] = 5; /* version */
 #if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
-  if(!conn->socks5_gssapi_enctype) {
-    /* decrypt_gssapi_blockread already read the whole packet */
+      socksreq[1] = (char)(proxy_name ? 3 : 2); /* number of methods (below) */
+      socksreq[2] = 0; /* no authentication */
+      socksreq[3] = 1; /* gssapi */
+      socksreq[4] = 2; /* username/password */
+#else
+      socksreq[1] = (char)(proxy_name ? 2 : 1); /* number of methods (below) */
+      socksreq[2] = 0; /* no authentication */
+      socksreq[3] = 2; /* username/password */
 #endif
-    if(len > 10) {
-      len -= 10;
-      result = Curl_blockread_all(conn, sock, (char *)&socksreq[10],
-                                  len, &actualread);
-      if((result != CURLE_OK) || (len != actualread)) {
+      socks_next(s, 2 + (size_t)socksreq[1]);
+      s->state = SOCKS5_SEND_METHODS;
+      break;
+
+    case SOCKS5_SEND_METHODS:
+      code = socks_send(conn, sockindex, &ready);
+      if(code) {
+        failf(data, "Unable to send initial SOCKS5 request.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
+
+      socks_next(s, 2);
+      s->state = SOCKS5_RECV_METHOD;
+      break;
+
+    case SOCKS5_RECV_METHOD:
+      code = socks_recv(conn, sockindex, &ready);
+      if(code) {
+        failf(data, "Unable to receive initial SOCKS5 response.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
+
+      code = socks5_method(conn, s, proxy_name, proxy_password, sockindex,
+                           &next);
+      if(code)
+        return code;
+      s->state = next;
+      break;
+
+    case SOCKS5_SEND_AUTH:
+      code = socks_send(conn, sockindex, &ready);
+      if(code) {
+        failf(data, "Failed to send SOCKS5 sub-negotiation request.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
+
+      socks_next(s, 2);
+      s->state = SOCKS5_RECV_AUTH;
+      break;
+
+    case SOCKS5_RECV_AUTH:
+      code = socks_recv(conn, sockindex, &ready);
+      if(code) {
+        failf(data, "Unable to receive SOCKS5 sub-negotiation response.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
+
+      /* ignore the first (VER) byte */
+      if(socksreq[1] != 0) { /* status */
+        failf(data, "User was rejected by the SOCKS5 server (%d %d).",
+              socksreq[0], socksreq[1]);
+        return CURLE_COULDNT_CONNECT;
+      }
+
+      /* Everything is good so far, user was authenticated! */
+      s->state = SOCKS5_REQUEST;
+      break;
+
+    case SOCKS5_REQUEST:
+      s->state = SOCKS5_SEND_CONNECT;
+      if(socks5_resolve_local) {
+        int rc = Curl_resolv(conn, hostname, remote_port, &dns);
+
+        if(rc == CURLRESOLV_ERROR)
+          return CURLE_COULDNT_RESOLVE_HOST;
+
+        if(rc == CURLRESOLV_PENDING) {
+          s->state = SOCKS5_RESOLVING;
+          return CURLE_OK;
+        }
+        if(!dns) {
+          failf(data, "Failed to resolve \"%s\" for SOCKS5 connect.",
+                hostname);
+          return CURLE_COULDNT_RESOLVE_HOST;
+        }
+      }
+      code = socks5_request(conn, s, hostname, remote_port, dns);
+      if(code)
+        return code;
+      break;
+
+    case SOCKS5_RESOLVING:
+      code = Curl_resolver_is_resolved(conn, &dns);
+      if(code)
+        return code;
+      if(!dns)
+        return CURLE_OK; /* not yet */
+
+      code = socks5_request(conn, s, hostname, remote_port, dns);
+      if(code)
+        return code;
+      s->state = SOCKS5_SEND_CONNECT;
+      break;
+
+    case SOCKS5_SEND_CONNECT:
+      code = socks_send(conn, sockindex, &ready);
+      if(code) {
+        failf(data, "Failed to send SOCKS5 connect request.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
+
+      socks_next(s, 10); /* minimum packet size is 10 */
+      s->state = SOCKS5_RECV_CONNECT;
+      break;
+
+    case SOCKS5_RECV_CONNECT:
+      code = socks_recv(conn, sockindex, &ready);
+      if(code) {
+        failf(data, "Failed to receive SOCKS5 connect request ack.");
+        return CURLE_COULDNT_CONNECT;
+      }
+      if(!ready)
+        return CURLE_OK;
+
+      code = socks5_reply(conn, s, hostname, &more);
+      if(code)
+        return code;
+      if(!more) {
+        *done = TRUE; /* Proxy was successful! */
+        return CURLE_OK;
+      }
+      s->len += more;
+      s->state = SOCKS5_RECV_ADDRESS;
+      break;
+
+    case SOCKS5_RECV_ADDRESS:
+      code = socks_recv(conn, sockindex, &ready);
+      if(code) {
         failf(data, "Failed to receive SOCKS5 connect request ack.");
         return CURLE_COULDNT_CONNECT;
       }
+      if(ready)
+        *done = TRUE; /* Proxy was successful! */
+      return CURLE_OK;
+
+    default:
+      return CURLE_COULDNT_CONNECT;
     }
-#if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
   }
-#endif
+}
 
-  curlx_nonblock(sock, TRUE);
-  return CURLE_OK; /* Proxy was successful! */
+/*
+ * This function logs in to a SOCKS5 proxy and sends the specifics to the final
+ * destination server.
+ */
+CURLcode Curl_SOCKS5(const char *proxy_name,
+                     const char *proxy_password,
+                     const char *hostname,
+                     int remote_port,
+                     int sockindex,
+                     struct connectdata *conn,
+                     bool *done)
+{
+  struct SessionHandle *data = conn->data;
+  CURLcode code;
+
+  *done = FALSE;
+
+  if(Curl_timeleft(data, NULL, TRUE) < 0) {
+    /* time-out, bail out, go home */
+    failf(data, "Connection time-out");
+    code = CURLE_OPERATION_TIMEDOUT;
+  }
+  else
+    code = socks5(proxy_name, proxy_password, hostname, remote_port,
+                  sockindex, conn, done);
+
+  if(code || *done)
+    /* the next handshake over this socket starts over */
+    conn->socks_state[sockindex].state = SOCKS_INIT;
+
+  return code;
+}
+
+/*
+ * The sockets to wait for while the handshake with a SOCKS proxy goes on.
+ */
+int Curl_SOCKS_getsock(struct connectdata *conn, curl_socket_t *sock,
+                       int numsocks, int sockindex)
+{
+  if(!numsocks)
+    return GETSOCK_BLANK;
+
+  switch(conn->socks_state[sockindex].state) {
+  case SOCKS4_RESOLVING:
+  case SOCKS5_RESOLVING:
+    return Curl_resolver_getsock(conn, sock, numsocks);
+
+  case SOCKS4_SEND_CONNECT:
+  case SOCKS5_SEND_METHODS:
+  case SOCKS5_SEND_AUTH:
+  case SOCKS5_SEND_CONNECT:
+    sock[0] = conn->sock[sockindex];
+    return GETSOCK_WRITESOCK(0);
+
+  default:
+    sock[0] = conn->sock[sockindex];
+    return GETSOCK_READSOCK(0);
+  }
 }
 
 #endif /* CURL_DISABLE_PROXY */
@@ -24,9 +24,14 @@
 
 #include "curl_setup.h"
 
+/* TRUE while the handshake with the SOCKS proxy over the socket is going on,
+   that is, after it started and before it completed or failed */
+#define Curl_SOCKS_busy(conn,i) ((conn)->socks_state[i].state != 0)
+
 #ifdef CURL_DISABLE_PROXY
-#define Curl_SOCKS4(a,b,c,d,e,f) CURLE_NOT_BUILT_IN
-#define Curl_SOCKS5(a,b,c,d,e,f) CURLE_NOT_BUILT_IN
+#define Curl_SOCKS4(a,b,c,d,e,f,g) CURLE_NOT_BUILT_IN
+#define Curl_SOCKS5(a,b,c,d,e,f,g) CURLE_NOT_BUILT_IN
+#define Curl_SOCKS_getsock(a,b,c,d) 0
 #else
 /*
  * Helper read-from-socket functions. Does the same as Curl_read() but it
@@ -43,25 +48,36 @@ int Curl_blockread_all(struct connectdata *conn,
 
 /*
  * This function logs in to a SOCKS4(a) proxy and sends the specifics to the
- * final destination server.
+ * final destination server. It does as much of the handshake as it can
+ * without blocking and is called again when the socket is ready, until it
+ * sets *done TRUE.
  */
 CURLcode Curl_SOCKS4(const char *proxy_name,
                      const char *hostname,
                      int remote_port,
                      int sockindex,
                      struct connectdata *conn,
-                     bool protocol4a);
+                     bool protocol4a,
+                     bool *done);
 
 /*
  * This function logs in to a SOCKS5 proxy and sends the specifics to the
- * final destination server.
+ * final destination server. Like Curl_SOCKS4(), it is called again until it
+ * sets *done TRUE.
  */
 CURLcode Curl_SOCKS5(const char *proxy_name,
                      const char *proxy_password,
                      const char *hostname,
                      int remote_port,
                      int sockindex,
-                     struct connectdata *conn);
+                     struct connectdata *conn,
+                     bool *done);
+
+/*
+ * The sockets to wait for while the handshake over the socket is going on.
+ */
+int Curl_SOCKS_getsock(struct connectdata *conn, curl_socket_t *sock,
+                       int numsocks, int sockindex);
 
 #if defined(HAVE_GSSAPI) || defined(USE_WINDOWS_SSPI)
 /*
@@ -45,6 +45,13 @@
 
 #include "curl_setup.h"
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_IO_H
+#include <io.h>
+#endif
+
 #include "urldata.h"
 #define SSLGEN_C
 #include "sslgen.h" /* generic SSL protos etc */
@@ -63,6 +70,10 @@
 #include "curl_memory.h"
 #include "progress.h"
 #include "share.h"
+#include "hash.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
 /* The last #include file should be: */
 #include "memdebug.h"
 
@@ -225,6 +236,157 @@ Curl_ssl_connect_nonblocking(struct connectdata *conn, int sockindex,
   return res;
 }
 
+/*
+ * The session ID cache
+ * ====================
+ *
+ * Sessions are found by a hash of the host name, the port and the SSL config
+ * they were made with, in a table that grows with the number of sessions so
+ * that the lists of its slots stay short. They are also linked in the order
+ * they were last used in, so that the least recently used one is evicted
+ * when a new one does not fit.
+ */
+
+static unsigned long hash_string(unsigned long h, const char *str)
+{
+  if(!str)
+    return CURL_HASH_STR_NEXT(h, 1); /* not the same as an empty string */
+  while(*str) {
+    h = CURL_HASH_STR_NEXT(h, Curl_raw_toupper(*str));
+    str++;
+  }
+  return CURL_HASH_STR_NEXT(h, 0);
+}
+
+/* the hash of what Curl_ssl_config_matches() compares, plus name and port */
+static unsigned long session_hash(const char *name, unsigned short port,
+                                  const struct ssl_config_data *config)
+{
+  unsigned long h = hash_string(CURL_HASH_STR_INIT, name);
+
+  h = CURL_HASH_STR_NEXT(h, port & 0xff);
+  h = CURL_HASH_STR_NEXT(h, port >> 8);
+  h = CURL_HASH_STR_NEXT(h, config->version);
+  h = CURL_HASH_STR_NEXT(h, config->verifypeer);
+  h = CURL_HASH_STR_NEXT(h, config->verifyhost);
+  h = hash_string(h, config->CApath);
+  h = hash_string(h, config->CAfile);
+  h = hash_string(h, config->random_file);
+  h = hash_string(h, config->egdsocket);
+  return hash_string(h, config->cipher_list);
+}
+
+/*
+ * Find the session for the name, port and config in the cache, 'hv' being
+ * their session_hash(). The cache is locked.
+ */
+static struct curl_ssl_session *find_session(struct Curl_sslcache *cache,
+                                             const char *name,
+                                             unsigned short port,
+                                             struct ssl_config_data *config,
+                                             unsigned long hv)
+{
+  struct curl_ssl_session *check;
+
+  for(check = cache->table[hv % cache->slots]; check; check = check->next) {
+    if((check->hv == hv) &&
+       (port == check->remote_port) &&
+       Curl_raw_equal(name, check->name) &&
+       Curl_ssl_config_matches(config, &check->ssl_config))
+      return check;
+  }
+  return NULL;
+}
+
+/* link the session in as the most recently used one */
+static void session_link_newest(struct Curl_sslcache *cache,
+                                struct curl_ssl_session *session)
+{
+  session->older = cache->lru.older;
+  session->newer = &cache->lru;
+  session->older->newer = session;
+  session->newer->older = session;
+}
+
+/* link the session in as the least recently used one */
+static void session_link_oldest(struct Curl_sslcache *cache,
+                                struct curl_ssl_session *session)
+{
+  session->older = &cache->lru;
+  session->newer = cache->lru.newer;
+  session->older->newer = session;
+  session->newer->older = session;
+}
+
+static void session_unlink(struct curl_ssl_session *session)
+{
+  session->older->newer = session->newer;
+  session->newer->older = session->older;
+  session->older = session->newer = NULL;
+}
+
+/*
+ * Remove a session from the cache and free it. The cache is locked.
+ */
+static void remove_session(struct Curl_sslcache *cache,
+                           struct curl_ssl_session *session)
+{
+  struct curl_ssl_session **pp = &cache->table[session->hv % cache->slots];
+
+  while(*pp != session)
+    pp = &(*pp)->next;
+  *pp = session->next;
+
+  session_unlink(session);
+  cache->count--;
+
+  Curl_ssl_kill_session(session);
+  free(session);
+}
+
+/*
+ * Double the number of slots of the cache once it holds more sessions than
+ * it has slots. Without memory for that it keeps the slots it has.
+ */
+static void grow_table(struct Curl_sslcache *cache)
+{
+  struct curl_ssl_session **table;
+  struct curl_ssl_session *session;
+  size_t slots = cache->slots * 2;
+  size_t i;
+
+  table = calloc(slots, sizeof(struct curl_ssl_session *));
+  if(!table)
+    return;
+
+  for(i = 0; i < cache->slots; i++) {
+    while((session = cache->table[i]) != NULL) {
+      cache->table[i] = session->next;
+      session->next = table[session->hv % slots];
+      table[session->hv % slots] = session;
+    }
+  }
+
+  free(cache->table);
+  cache->table = table;
+  cache->slots = slots;
+}
+
+/*
+ * Add a session to the table of the cache, the caller links it in. The cache
+ * is locked.
+ */
+static void insert_session(struct Curl_sslcache *cache,
+                           struct curl_ssl_session *session)
+{
+  session->next = cache->table[session->hv % cache->slots];
+  cache->table[session->hv % cache->slots] = session;
+  cache->count++;
+
+  if(cache->count > cache->slots)
+    grow_table(cache);
+}
+
 /*
  * Check if there's a session ID for the given connection in the cache, and if
  * there's one suitable, it is provided. Returns TRUE when no entry matched.
@@ -235,41 +397,39 @@ int Curl_ssl_getsessionid(struct connectdata *conn,
 {
   struct curl_ssl_session *check;
   struct SessionHandle *data = conn->data;
-  size_t i;
-  long *general_age;
+  struct Curl_sslcache *cache = data->state.session;
+  unsigned long hv;
   bool no_match = TRUE;
 
   *ssl_sessionid = NULL;
 
-  if(!conn->ssl_config.sessionid)
+  if(!conn->ssl_config.sessionid || !cache)
     /* session ID re-use is disabled */
     return TRUE;
 
+  hv = session_hash(conn->host.name, (unsigned short)conn->remote_port,
+                    &conn->ssl_config);
+
   /* Lock if shared */
-  if(SSLSESSION_SHARED(data)) {
+  if(SSLSESSION_SHARED(data))
     Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
-    general_age = &data->share->sessionage;
-  }
-  else
-    general_age = &data->state.sessionage;
 
-  for(i = 0; i < data->set.ssl.max_ssl_sessions; i++) {
-    check = &data->state.session[i];
-    if(!check->sessionid)
-      /* not session ID means blank entry */
-      continue;
-    if(Curl_raw_equal(conn->host.name, check->name) &&
-       (conn->remote_port == check->remote_port) &&
-       Curl_ssl_config_matches(&conn->ssl_config, &check->ssl_config)) {
-      /* yes, we have a session ID! */
-      (*general_age)++;          /* increase general age */
-      check->age = *general_age; /* set this as used in this age */
-      *ssl_sessionid = check->sessionid;
-      if(idsize)
-        *idsize = check->idsize;
-      no_match = FALSE;
-      break;
-    }
+  check = find_session(cache, conn->host.name,
+                       (unsigned short)conn->remote_port, &conn->ssl_config,
+                       hv);
+  if(check && check->expires && (check->expires <= time(NULL))) {
+    /* loaded from the session file and too old to be used now */
+    remove_session(cache, check);
+    check = NULL;
+  }
+  if(check) {
+    /* yes, we have a session ID! It is the most recently used one now */
+    session_unlink(check);
+    session_link_newest(cache, check);
+    *ssl_sessionid = check->sessionid;
+    if(idsize)
+      *idsize = check->idsize;
+    no_match = FALSE;
   }
 
   /* Unlock */
@@ -291,7 +451,6 @@ void Curl_ssl_kill_session(struct curl_ssl_session *session)
     curlssl_session_free(session->sessionid);
 
     session->sessionid = NULL;
-    session->age = 0; /* fresh */
 
     Curl_free_ssl_config(&session->ssl_config);
 
@@ -304,20 +463,31 @@ void Curl_ssl_kill_session(struct curl_ssl_session *session)
  */
 void Curl_ssl_delsessionid(struct connectdata *conn, void *ssl_sessionid)
 {
-  size_t i;
   struct SessionHandle *data=conn->data;
+  struct Curl_sslcache *cache = data->state.session;
+  struct curl_ssl_session *check;
+  unsigned long hv;
+
+  if(!cache)
+    return;
+
+  hv = session_hash(conn->host.name, (unsigned short)conn->remote_port,
+                    &conn->ssl_config);
 
   if(SSLSESSION_SHARED(data))
     Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
 
-  for(i = 0; i < data->set.ssl.max_ssl_sessions; i++) {
-    struct curl_ssl_session *check = &data->state.session[i];
-
-    if(check->sessionid == ssl_sessionid) {
-      Curl_ssl_kill_session(check);
-      break;
-    }
+  /* it is normally the one of this connection, else look through them all */
+  check = find_session(cache, conn->host.name,
+                       (unsigned short)conn->remote_port, &conn->ssl_config,
+                       hv);
+  if(!check || (check->sessionid != ssl_sessionid)) {
+    for(check = cache->lru.newer; check != &cache->lru; check = check->newer)
+      if(check->sessionid == ssl_sessionid)
+        break;
   }
+  if(check != &cache->lru)
+    remove_session(cache, check);
 
   if(SSLSESSION_SHARED(data))
     Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
@@ -327,89 +497,587 @@ void Curl_ssl_delsessionid(struct connectdata *conn, void *ssl_sessionid)
  * Store session id in the session cache. The ID passed on to this function
  * must already have been extracted and allocated the proper way for the SSL
  * layer. Curl_XXXX_session_free() will be called to free/kill the session ID
- * later on.
+ * later on. If this returns an error, the session was not stored and the
+ * caller must free it.
  */
 CURLcode Curl_ssl_addsessionid(struct connectdata *conn,
                                void *ssl_sessionid,
                                size_t idsize)
 {
-  size_t i;
   struct SessionHandle *data=conn->data; /* the mother of all structs */
-  struct curl_ssl_session *store = &data->state.session[0];
-  long oldest_age=data->state.session[0].age; /* zero if unused */
-  char *clone_host;
-  long *general_age;
+  struct Curl_sslcache *cache = data->state.session;
+  struct curl_ssl_session *store;
+  struct curl_ssl_session *old;
 
   /* Even though session ID re-use might be disabled, that only disables USING
      IT. We still store it here in case the re-using is again enabled for an
      upcoming transfer */
 
-  clone_host = strdup(conn->host.name);
-  if(!clone_host)
+  if(!cache)
+    /* nothing to hand it to, like after CURLOPT_SHARE was unset during the
+       transfer, the caller keeps and frees the session */
+    return CURLE_OUT_OF_MEMORY;
+
+  store = calloc(1, sizeof(struct curl_ssl_session));
+  if(!store)
     return CURLE_OUT_OF_MEMORY; /* bail out */
 
+  store->name = strdup(conn->host.name); /* clone host name */
+  if(!store->name ||
+     !Curl_clone_ssl_config(&conn->ssl_config, &store->ssl_config)) {
+    /* let caller free sessionid */
+    Curl_free_ssl_config(&store->ssl_config);
+    Curl_safefree(store->name);
+    free(store);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  store->sessionid = ssl_sessionid;
+  store->idsize = idsize;
+  store->remote_port = (unsigned short)conn->remote_port; /* port number */
+  store->hv = session_hash(store->name, store->remote_port,
+                           &store->ssl_config);
+
   /* Now we should add the session ID and the host name to the cache, (remove
-     the oldest if necessary) */
+     the least recently used one if necessary) */
 
   /* If using shared SSL session, lock! */
-  if(SSLSESSION_SHARED(data)) {
+  if(SSLSESSION_SHARED(data))
     Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
-    general_age = &data->share->sessionage;
+
+  /* a shared cache holds as many sessions as the most any of its users
+     want */
+  if(!SSLSESSION_SHARED(data) ||
+     (cache->max < data->set.ssl.max_ssl_sessions))
+    cache->max = data->set.ssl.max_ssl_sessions;
+
+  /* a session for the same connection setup is replaced */
+  old = find_session(cache, store->name, store->remote_port,
+                     &store->ssl_config, store->hv);
+  if(old)
+    remove_session(cache, old);
+
+  /* cache is full, we must "kill" the least recently used entry! */
+  while(cache->count && (cache->count >= cache->max))
+    remove_session(cache, cache->lru.newer);
+
+  insert_session(cache, store);
+  session_link_newest(cache, store);
+
+  /* Unlock */
+  if(SSLSESSION_SHARED(data))
+    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+
+  return CURLE_OK;
+}
+
+#ifdef curlssl_session_export
+/*
+ * The session file
+ * ================
+ *
+ * With CURLOPT_SSL_SESSIONID_FILE, the sessions of a cache are loaded from a
+ * file when a handle starts to use the cache and written back to it when the
+ * cache is destroyed, so that they outlive the process. There is one line
+ * per session:
+ *
+ * <expires> <port> <version> <verifypeer> <verifyhost> <name> <CApath>
+ * <CAfile> <random_file> <egdsocket> <cipher_list> <session>
+ *
+ * The strings and the session, as serialized by the SSL backend, are hex
+ * encoded after an 'x', a NULL string is a '-'. The sessions of the file
+ * that the writer has no newer ones for are kept. The file is replaced as a
+ * whole, readers and writers take a lock on "<file>.lock" meanwhile.
+ */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#define SESSIONFILE_HEADER "# libcurl SSL sessions\n"
+/* how long a session the backend doesn't know the lifetime of is kept */
+#define SESSIONFILE_LIFETIME (24*3600)
+/* the largest file read */
+#define SESSIONFILE_MAXSIZE (64*1024*1024)
+#define SESSIONFILE_FIELDS 12
+
+/* a line of the file */
+struct sessionline {
+  time_t expires;
+  unsigned short port;
+  struct ssl_config_data config;
+  char *name;
+  unsigned char *blob;
+  size_t bloblen;
+};
+
+/* open and lock the lock file of the session file, -1 on failure */
+static int sessionfile_lock(const char *file, bool exclusive)
+{
+  char *lockname = aprintf("%s.lock", file);
+  int fd;
+
+  if(!lockname)
+    return -1;
+  fd = open(lockname, O_RDWR|O_CREAT, 0600);
+  free(lockname);
+  if(fd == -1)
+    return -1;
+
+#if defined(HAVE_FCNTL) && defined(F_SETLKW)
+  {
+    struct flock lk;
+    memset(&lk, 0, sizeof(lk));
+    lk.l_type = (short)(exclusive?F_WRLCK:F_RDLCK);
+    lk.l_whence = SEEK_SET;
+    while(fcntl(fd, F_SETLKW, &lk) == -1) {
+      if(errno != EINTR) {
+        close(fd);
+        return -1;
+      }
+    }
   }
-  else {
-    general_age = &data->state.sessionage;
+#elif defined(WIN32)
+  {
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    if(!LockFileEx((HANDLE)_get_osfhandle(fd),
+                   exclusive?LOCKFILE_EXCLUSIVE_LOCK:0, 0, 1, 0, &ov)) {
+      close(fd);
+      return -1;
+    }
   }
+#else
+  (void)exclusive; /* no locking */
+#endif
+  return fd;
+}
 
-  /* find an empty slot for us, or find the oldest */
-  for(i = 1; (i < data->set.ssl.max_ssl_sessions) &&
-        data->state.session[i].sessionid; i++) {
-    if(data->state.session[i].age < oldest_age) {
-      oldest_age = data->state.session[i].age;
-      store = &data->state.session[i];
+/* closing the lock file releases the lock */
+static void sessionfile_unlock(int fd)
+{
+#if defined(WIN32) && !(defined(HAVE_FCNTL) && defined(F_SETLKW))
+  OVERLAPPED ov;
+  memset(&ov, 0, sizeof(ov));
+  UnlockFileEx((HANDLE)_get_osfhandle(fd), 0, 1, 0, &ov);
+#endif
+  close(fd);
+}
+
+/* read the whole session file into a zero terminated buffer */
+static char *sessionfile_read(const char *file)
+{
+  FILE *fp = fopen(file, "rb");
+  char *buf = NULL;
+  long size;
+
+  if(!fp)
+    return NULL;
+
+  if(!fseek(fp, 0, SEEK_END) && ((size = ftell(fp)) >= 0) &&
+     (size <= SESSIONFILE_MAXSIZE) && !fseek(fp, 0, SEEK_SET)) {
+    buf = malloc((size_t)size + 1);
+    if(buf) {
+      if(fread(buf, 1, (size_t)size, fp) == (size_t)size)
+        buf[size] = '\0';
+      else
+        Curl_safefree(buf);
     }
   }
-  if(i == data->set.ssl.max_ssl_sessions)
-    /* cache is full, we must "kill" the oldest entry! */
-    Curl_ssl_kill_session(store);
+  fclose(fp);
+  return buf;
+}
+
+static void write_hex(FILE *out, const unsigned char *ptr, size_t len)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  fputc('x', out);
+  while(len--) {
+    fputc(hex[*ptr >> 4], out);
+    fputc(hex[*ptr & 0x0f], out);
+    ptr++;
+  }
+}
+
+static void write_string(FILE *out, const char *str)
+{
+  if(str)
+    write_hex(out, (const unsigned char *)str, strlen(str));
   else
-    store = &data->state.session[i]; /* use this slot */
+    fputc('-', out);
+  fputc(' ', out);
+}
 
-  /* now init the session struct wisely */
-  store->sessionid = ssl_sessionid;
-  store->idsize = idsize;
-  store->age = *general_age;    /* set current age */
-  if(store->name)
-    /* free it if there's one already present */
-    free(store->name);
-  store->name = clone_host;               /* clone host name */
-  store->remote_port = conn->remote_port; /* port number */
+static int hexval(char c)
+{
+  if((c >= '0') && (c <= '9'))
+    return c - '0';
+  if((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  return -1;
+}
+
+/*
+ * Decode a field of 'len' bytes into a new, zero terminated buffer. A '-' is
+ * NULL. Returns FALSE if the field is bad or there is no memory.
+ */
+static bool read_hex(const char *field, size_t len, unsigned char **out,
+                     size_t *outlen)
+{
+  unsigned char *buf;
+  size_t i;
 
+  *out = NULL;
+  if((len == 1) && (*field == '-'))
+    return TRUE;
+  if((*field != 'x') || !(len & 1))
+    return FALSE;
+
+  buf = malloc(len / 2 + 1);
+  if(!buf)
+    return FALSE;
+  for(i = 1; i < len; i += 2) {
+    int hi = hexval(field[i]);
+    int lo = hexval(field[i + 1]);
+    if((hi < 0) || (lo < 0)) {
+      free(buf);
+      return FALSE;
+    }
+    buf[i / 2] = (unsigned char)((hi << 4) | lo);
+  }
+  buf[len / 2] = '\0';
+  if(outlen)
+    *outlen = len / 2;
+  *out = buf;
+  return TRUE;
+}
 
-  /* Unlock */
-  if(SSLSESSION_SHARED(data))
-    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+static void free_sessionline(struct sessionline *sl)
+{
+  Curl_safefree(sl->name);
+  Curl_safefree(sl->blob);
+  Curl_free_ssl_config(&sl->config);
+}
 
-  if(!Curl_clone_ssl_config(&conn->ssl_config, &store->ssl_config)) {
-    store->sessionid = NULL; /* let caller free sessionid */
-    free(clone_host);
-    return CURLE_OUT_OF_MEMORY;
+/*
+ * Parse a line of the session file, the session itself only if 'blob' is
+ * TRUE. Returns FALSE for lines that aren't sessions.
+ */
+static bool parse_sessionline(const char *line, size_t linelen,
+                              struct sessionline *sl, bool blob)
+{
+  const char *field[SESSIONFILE_FIELDS];
+  size_t flen[SESSIONFILE_FIELDS];
+  const char *end = line + linelen;
+  const char *ptr = line;
+  char *str[6];
+  int i;
+
+  memset(sl, 0, sizeof(struct sessionline));
+
+  for(i = 0; i < SESSIONFILE_FIELDS; i++) {
+    const char *sp = memchr(ptr, ' ', end - ptr);
+    if(!sp)
+      sp = end;
+    field[i] = ptr;
+    flen[i] = sp - ptr;
+    if(!flen[i] || ((sp == end) && (i < SESSIONFILE_FIELDS - 1)))
+      return FALSE;
+    ptr = sp + 1;
+  }
+  if(ptr <= end)
+    return FALSE; /* more fields than known */
+
+  sl->expires = (time_t)strtol(field[0], NULL, 10);
+  sl->port = (unsigned short)strtol(field[1], NULL, 10);
+  sl->config.version = strtol(field[2], NULL, 10);
+  sl->config.verifypeer = (field[3][0] == '1')?TRUE:FALSE;
+  sl->config.verifyhost = (field[4][0] == '1')?TRUE:FALSE;
+
+  for(i = 0; i < 6; i++) {
+    if(!read_hex(field[5 + i], flen[5 + i], (unsigned char **)&str[i],
+                 NULL)) {
+      while(i--)
+        free(str[i]);
+      return FALSE;
+    }
   }
+  sl->name = str[0];
+  sl->config.CApath = str[1];
+  sl->config.CAfile = str[2];
+  sl->config.random_file = str[3];
+  sl->config.egdsocket = str[4];
+  sl->config.cipher_list = str[5];
+
+  if(!sl->name ||
+     (blob && (!read_hex(field[11], flen[11], &sl->blob, &sl->bloblen) ||
+               !sl->blob))) {
+    free_sessionline(sl);
+    return FALSE;
+  }
+  return TRUE;
+}
 
-  return CURLE_OK;
+/* the next line of the file, FALSE at the end */
+static bool next_line(char **ptr, char **line, size_t *len)
+{
+  char *nl;
+
+  if(!**ptr)
+    return FALSE;
+  *line = *ptr;
+  nl = strchr(*ptr, '\n');
+  if(nl) {
+    *len = nl - *ptr;
+    *ptr = nl + 1;
+  }
+  else {
+    *len = strlen(*ptr);
+    *ptr += *len;
+  }
+  return TRUE;
 }
 
+/*
+ * Load the sessions of the file into the cache, after the ones it has. The
+ * cache is locked.
+ */
+static void sessionfile_load(struct Curl_sslcache *cache, const char *file)
+{
+  struct sessionline sl;
+  char *buf;
+  char *ptr;
+  char *line;
+  size_t len;
+  time_t now = time(NULL);
+  int fd = sessionfile_lock(file, FALSE);
+
+  if(fd == -1)
+    return;
+  buf = sessionfile_read(file);
+  sessionfile_unlock(fd);
+  if(!buf)
+    return;
+
+  ptr = buf;
+  while((cache->count < cache->max) && next_line(&ptr, &line, &len)) {
+    struct curl_ssl_session *store;
+    unsigned long hv;
+
+    if(!parse_sessionline(line, len, &sl, TRUE))
+      continue;
+    hv = session_hash(sl.name, sl.port, &sl.config);
+    if((sl.expires <= now) ||
+       find_session(cache, sl.name, sl.port, &sl.config, hv)) {
+      free_sessionline(&sl);
+      continue;
+    }
+
+    store = calloc(1, sizeof(struct curl_ssl_session));
+    if(store)
+      store->sessionid = curlssl_session_import(sl.blob, sl.bloblen,
+                                                &store->idsize);
+    if(!store || !store->sessionid) {
+      Curl_safefree(store);
+      free_sessionline(&sl);
+      continue;
+    }
+    store->name = sl.name;
+    store->remote_port = sl.port;
+    store->ssl_config = sl.config;
+    store->expires = sl.expires;
+    store->hv = hv;
+    sl.name = NULL;
+    memset(&sl.config, 0, sizeof(sl.config));
+    free_sessionline(&sl);
+
+    /* the file has the most recently used ones first */
+    insert_session(cache, store);
+    session_link_oldest(cache, store);
+  }
+
+  free(buf);
+}
+
+/* write a session of the cache to the file */
+static bool write_session(FILE *out, struct curl_ssl_session *session,
+                          time_t now)
+{
+  unsigned char *blob;
+  size_t bloblen;
+  time_t expires = session->expires; /* backends may know better */
+
+  if(curlssl_session_export(session->sessionid, session->idsize, &blob,
+                            &bloblen, &expires))
+    return FALSE;
+  if(!expires)
+    expires = now + SESSIONFILE_LIFETIME;
+  if(expires <= now) {
+    free(blob);
+    return FALSE;
+  }
+
+  fprintf(out, "%ld %u %ld %d %d ", (long)expires,
+          (unsigned int)session->remote_port, session->ssl_config.version,
+          session->ssl_config.verifypeer?1:0,
+          session->ssl_config.verifyhost?1:0);
+  write_string(out, session->name);
+  write_string(out, session->ssl_config.CApath);
+  write_string(out, session->ssl_config.CAfile);
+  write_string(out, session->ssl_config.random_file);
+  write_string(out, session->ssl_config.egdsocket);
+  write_string(out, session->ssl_config.cipher_list);
+  write_hex(out, blob, bloblen);
+  fputc('\n', out);
+
+  free(blob);
+  return TRUE;
+}
+
+/*
+ * Write the sessions of the cache to its file, the most recently used first,
+ * followed by the ones of the file the cache has nothing for. No more than
+ * the cache holds are kept.
+ */
+static void sessionfile_save(struct Curl_sslcache *cache)
+{
+  struct curl_ssl_session *session;
+  struct sessionline sl;
+  char *tmpname;
+  char *buf;
+  char *ptr;
+  char *line;
+  size_t len;
+  size_t written = 0;
+  time_t now = time(NULL);
+  FILE *out;
+  int tmpfd;
+  int fd;
+
+  tmpname = aprintf("%s.tmp", cache->file);
+  if(!tmpname)
+    return;
+
+  fd = sessionfile_lock(cache->file, TRUE);
+  if(fd == -1) {
+    free(tmpname);
+    return;
+  }
+
+  /* the sessions may be used to resume connections, only the user gets to
+     read them */
+  tmpfd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 0600);
+#ifdef HAVE_FDOPEN
+  out = (tmpfd != -1)?fdopen(tmpfd, "wb"):NULL;
+#else
+  /* the file is made with its mode, write it through a stream of its own */
+  if(tmpfd != -1) {
+    close(tmpfd);
+    tmpfd = -1;
+    out = fopen(tmpname, "wb");
+  }
+  else
+    out = NULL;
+#endif
+  if(!out) {
+    if(tmpfd != -1)
+      close(tmpfd);
+    sessionfile_unlock(fd);
+    free(tmpname);
+    return;
+  }
+
+  fputs(SESSIONFILE_HEADER, out);
+  for(session = cache->lru.older;
+      (session != &cache->lru) && (written < cache->max);
+      session = session->older) {
+    if(write_session(out, session, now))
+      written++;
+  }
+
+  buf = sessionfile_read(cache->file);
+  ptr = buf;
+  while(buf && (written < cache->max) && next_line(&ptr, &line, &len)) {
+    if(!parse_sessionline(line, len, &sl, FALSE))
+      continue;
+    if((sl.expires > now) &&
+       !find_session(cache, sl.name, sl.port, &sl.config,
+                     session_hash(sl.name, sl.port, &sl.config))) {
+      fwrite(line, 1, len, out);
+      fputc('\n', out);
+      written++;
+    }
+    free_sessionline(&sl);
+  }
+  Curl_safefree(buf);
+
+  if(ferror(out) | fclose(out))
+    remove(tmpname);
+  else {
+#ifdef WIN32
+    /* rename() doesn't replace files there */
+    remove(cache->file);
+#endif
+    if(rename(tmpname, cache->file))
+      remove(tmpname);
+  }
+
+  sessionfile_unlock(fd);
+  free(tmpname);
+}
+#endif /* curlssl_session_export */
+
+/*
+ * Curl_ssl_mk_sessioncache() creates an empty session ID cache for at most
+ * 'amount' sessions.
+ */
+struct Curl_sslcache *Curl_ssl_mk_sessioncache(size_t amount)
+{
+  struct Curl_sslcache *cache = calloc(1, sizeof(struct Curl_sslcache));
+  if(!cache)
+    return NULL;
+
+  /* start small, the table grows with the number of sessions */
+  cache->slots = (amount && (amount < 8))?amount:8;
+  cache->table = calloc(cache->slots, sizeof(struct curl_ssl_session *));
+  if(!cache->table) {
+    free(cache);
+    return NULL;
+  }
+  cache->max = amount;
+  cache->lru.older = cache->lru.newer = &cache->lru;
+  return cache;
+}
+
+/*
+ * Curl_ssl_sessioncache_destroy() frees a session ID cache and all the
+ * sessions in it.
+ */
+void Curl_ssl_sessioncache_destroy(struct Curl_sslcache *cache)
+{
+  if(cache) {
+#ifdef curlssl_session_export
+    if(cache->file) {
+      sessionfile_save(cache);
+      free(cache->file);
+    }
+#endif
+#ifdef curlssl_contexts_free
+    curlssl_contexts_free(cache->contexts);
+#endif
+    while(cache->count)
+      remove_session(cache, cache->lru.newer);
+    free(cache->table);
+    free(cache);
+  }
+}
 
 void Curl_ssl_close_all(struct SessionHandle *data)
 {
-  size_t i;
   /* kill the session ID cache if not shared */
   if(data->state.session && !SSLSESSION_SHARED(data)) {
-    for(i = 0; i < data->set.ssl.max_ssl_sessions; i++)
-      /* the single-killer function handles empty table slots */
-      Curl_ssl_kill_session(&data->state.session[i]);
-
-    /* free the cache data */
-    Curl_safefree(data->state.session);
+    Curl_ssl_sessioncache_destroy(data->state.session);
+    data->state.session = NULL;
   }
 
   curlssl_close_all(data);
@@ -456,25 +1124,51 @@ struct curl_slist *Curl_ssl_engines_list(struct SessionHandle *data)
 }
 
 /*
- * This sets up a session ID cache to the specified size. Make sure this code
- * is agnostic to what underlying SSL technology we use.
+ * This sets up a session ID cache to the specified size, and loads the
+ * session file into it the first time it is used with one. Make sure this
+ * code is agnostic to what underlying SSL technology we use.
  */
 CURLcode Curl_ssl_initsessions(struct SessionHandle *data, size_t amount)
 {
-  struct curl_ssl_session *session;
+  struct Curl_sslcache *cache = data->state.session;
 
-  if(data->state.session)
-    /* this is just a precaution to prevent multiple inits */
-    return CURLE_OK;
+  if(!cache) {
+    cache = Curl_ssl_mk_sessioncache(amount);
+    if(!cache)
+      return CURLE_OUT_OF_MEMORY;
 
-  session = calloc(amount, sizeof(struct curl_ssl_session));
-  if(!session)
-    return CURLE_OUT_OF_MEMORY;
+    /* store the info in the SSL section */
+    data->set.ssl.max_ssl_sessions = amount;
+    data->state.session = cache;
+  }
+
+#ifdef curlssl_session_export
+  if(data->set.str[STRING_SSL_SESSIONID_FILE]) {
+    CURLcode result = CURLE_OK;
+
+    if(SSLSESSION_SHARED(data))
+      Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION,
+                      CURL_LOCK_ACCESS_SINGLE);
+
+    /* a cache uses the file it was first used with */
+    if(!cache->file) {
+      cache->file = strdup(data->set.str[STRING_SSL_SESSIONID_FILE]);
+      if(cache->file) {
+        if(cache->max < data->set.ssl.max_ssl_sessions)
+          cache->max = data->set.ssl.max_ssl_sessions;
+        sessionfile_load(cache, cache->file);
+      }
+      else
+        result = CURLE_OUT_OF_MEMORY;
+    }
+
+    if(SSLSESSION_SHARED(data))
+      Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+
+    return result;
+  }
+#endif
 
-  /* store the info in the SSL section */
-  data->set.ssl.max_ssl_sessions = amount;
-  data->state.session = session;
-  data->state.sessionage = 1; /* this is brand new */
   return CURLE_OK;
 }
 
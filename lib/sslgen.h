@@ -52,6 +52,9 @@ struct curl_slist *Curl_ssl_engines_list(struct SessionHandle *data);
 
 /* init the SSL session ID cache */
 CURLcode Curl_ssl_initsessions(struct SessionHandle *, size_t);
+/* create and destroy a session ID cache, as used by a share */
+struct Curl_sslcache *Curl_ssl_mk_sessioncache(size_t amount);
+void Curl_ssl_sessioncache_destroy(struct Curl_sslcache *cache);
 size_t Curl_ssl_version(char *buffer, size_t size);
 bool Curl_ssl_data_pending(const struct connectdata *conn,
                            int connindex);
@@ -103,6 +106,8 @@ void Curl_ssl_md5sum(unsigned char *tmp, /* input */
 #define Curl_ssl_free_certinfo(x) Curl_nop_stmt
 #define Curl_ssl_connect_nonblocking(x,y,z) CURLE_NOT_BUILT_IN
 #define Curl_ssl_kill_session(x) Curl_nop_stmt
+#define Curl_ssl_mk_sessioncache(x) NULL
+#define Curl_ssl_sessioncache_destroy(x) Curl_nop_stmt
 #endif
 
 #endif /* HEADER_CURL_SSLGEN_H */
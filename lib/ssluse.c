@@ -48,6 +48,7 @@
 #include "sslgen.h"
 #include "rawstr.h"
 #include "hostcheck.h"
+#include "share.h"
 
 #define _MPRINTF_REPLACE /* use the internal *printf() functions */
 #include <curl/mprintf.h>
@@ -959,6 +960,37 @@ void Curl_ossl_session_free(void *ptr)
   SSL_SESSION_free(ptr);
 }
 
+CURLcode Curl_ossl_session_export(void *ptr, size_t idsize,
+                                  unsigned char **blob, size_t *bloblen,
+                                  time_t *expires)
+{
+  SSL_SESSION *session = ptr;
+  unsigned char *p;
+  int len = i2d_SSL_SESSION(session, NULL);
+
+  (void)idsize;
+  if(len <= 0)
+    return CURLE_SSL_CONNECT_ERROR;
+  *blob = p = malloc(len);
+  if(!p)
+    return CURLE_OUT_OF_MEMORY;
+  i2d_SSL_SESSION(session, &p);
+  *bloblen = (size_t)len;
+  *expires = (time_t)(SSL_SESSION_get_time(session) +
+                      SSL_SESSION_get_timeout(session));
+  return CURLE_OK;
+}
+
+void *Curl_ossl_session_import(const unsigned char *blob, size_t bloblen,
+                               size_t *idsize)
+{
+  /* older OpenSSL versions take a non-const pointer */
+  unsigned char *p = (unsigned char *)blob;
+
+  *idsize = 0; /* not known, just like for the sessions of connections */
+  return d2i_SSL_SESSION(NULL, (void *)&p, (long)bloblen);
+}
+
 /*
  * This function is called when the 'data' struct is going away. Close
  * down everything and free all resources!
@@ -1342,105 +1374,284 @@ static void ssl_tls_trace(int direction, int ssl_ver, int content_type,
 #  define use_sni(x)  Curl_nop_stmt
 #endif
 
-static CURLcode
-ossl_connect_step1(struct connectdata *conn,
-                   int sockindex)
-{
-  CURLcode retcode = CURLE_OK;
+/*
+ * The context cache
+ * =================
+ *
+ * Setting up an SSL_CTX means parsing the CA certificates, which costs more
+ * CPU time than the handshake. The contexts made for connections that don't
+ * use a client certificate, TLS-SRP or a CURLOPT_SSL_CTX_FUNCTION are kept
+ * with the session ID cache of the handle, or of the share object it uses,
+ * and are used again for the connections with the same setup. The contexts
+ * made for the same CA certificates share one X509_STORE. A context is
+ * dropped when a file it was made from has been changed since.
+ */
 
-  struct SessionHandle *data = conn->data;
-  SSL_METHOD_QUAL SSL_METHOD *req_method=NULL;
-  void *ssl_sessionid=NULL;
-  X509_LOOKUP *lookup=NULL;
-  curl_socket_t sockfd = conn->sock[sockindex];
-  struct ssl_connect_data *connssl = &conn->ssl[sockindex];
-  long ctx_options;
-#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
-  bool sni;
-#ifdef ENABLE_IPV6
-  struct in6_addr addr;
+#define CTXCACHE_MAX 8 /* most contexts kept */
+
+/* tells if a file has been changed */
+struct filestamp {
+  time_t mtime;
+  curl_off_t size;
+};
+
+struct ossl_ctxentry {
+  struct ossl_ctxentry *next; /* the list is in most recently used order */
+  SSL_CTX *ctx;
+  long version;
+  bool verifypeer;
+  bool enable_beast;
+  char *cafile;
+  char *capath;
+  char *crlfile;
+  char *cipher_list;
+  struct filestamp stamp[3]; /* of cafile, capath and crlfile */
+};
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+#define ctx_up_ref(x) SSL_CTX_up_ref(x)
+#define store_up_ref(x) X509_STORE_up_ref(x)
 #else
-  struct in_addr addr;
-#endif
+#define ctx_up_ref(x) CRYPTO_add(&(x)->references, 1, CRYPTO_LOCK_SSL_CTX)
+#define store_up_ref(x) CRYPTO_add(&(x)->references, 1, CRYPTO_LOCK_X509_STORE)
 #endif
 
-  DEBUGASSERT(ssl_connect_1 == connssl->connecting_state);
+#define CTXCACHE_SHARED(data) (data->share &&                         \
+                               (data->share->specifier &              \
+                                (1<<CURL_LOCK_DATA_SSL_SESSION)))
 
-  /* Make funny stuff to get random input */
-  Curl_ossl_seed(data);
+static void file_stamp(const char *file, struct filestamp *stamp)
+{
+  struct_stat st;
 
-  /* check to see if we've been told to use an explicit SSL/TLS version */
+  if(file && !stat(file, &st)) {
+    stamp->mtime = st.st_mtime;
+    stamp->size = (curl_off_t)st.st_size;
+  }
+  else {
+    stamp->mtime = 0;
+    stamp->size = -1;
+  }
+}
 
-  switch(data->set.ssl.version) {
-  default:
-  case CURL_SSLVERSION_DEFAULT:
+static bool strequal_null(const char *a, const char *b)
+{
+  if(a && b)
+    return strcmp(a, b)?FALSE:TRUE;
+  return (a == b)?TRUE:FALSE;
+}
+
+/* TRUE if the context of the entry has the CA certificates of the handle */
+static bool ctxentry_cas(struct ossl_ctxentry *entry,
+                         struct SessionHandle *data)
+{
+  return (strequal_null(entry->cafile, data->set.str[STRING_SSL_CAFILE]) &&
+          strequal_null(entry->capath, data->set.str[STRING_SSL_CAPATH]) &&
+          strequal_null(entry->crlfile, data->set.str[STRING_SSL_CRLFILE]));
+}
+
+/* TRUE if the files the entry was made from haven't changed */
+static bool ctxentry_current(struct ossl_ctxentry *entry)
+{
+  struct filestamp now;
+  const char *files[3];
+  int i;
+
+  files[0] = entry->cafile;
+  files[1] = entry->capath;
+  files[2] = entry->crlfile;
+  for(i = 0; i < 3; i++) {
+    file_stamp(files[i], &now);
+    if((now.mtime != entry->stamp[i].mtime) ||
+       (now.size != entry->stamp[i].size))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static void ctxentry_free(struct ossl_ctxentry *entry)
+{
+  SSL_CTX_free(entry->ctx);
+  Curl_safefree(entry->cafile);
+  Curl_safefree(entry->capath);
+  Curl_safefree(entry->crlfile);
+  Curl_safefree(entry->cipher_list);
+  free(entry);
+}
+
+/* the contexts made for connections like this one can be kept */
+static bool ctx_cacheable(struct SessionHandle *data)
+{
+  return (data->state.session &&
+          !data->set.ssl.fsslctx &&
+          !data->set.str[STRING_CERT] &&
+          !data->set.str[STRING_CERT_TYPE]
 #ifdef USE_TLS_SRP
-    if(data->set.ssl.authtype == CURL_TLSAUTH_SRP) {
-      infof(data, "Set version TLSv1 for SRP authorisation\n");
-      req_method = TLSv1_client_method() ;
+          && (data->set.ssl.authtype != CURL_TLSAUTH_SRP)
+#endif
+    )?TRUE:FALSE;
+}
+
+/*
+ * Get a reference to the context kept for the setup of the handle, or NULL.
+ * Outdated contexts are dropped on the way. If there's none, '*store' is set
+ * to a reference to the X509_STORE of a context made for the same CA
+ * certificates, if there is one.
+ */
+static SSL_CTX *ctxcache_get(struct SessionHandle *data, X509_STORE **store)
+{
+  struct Curl_sslcache *cache = data->state.session;
+  struct ossl_ctxentry **prevp;
+  struct ossl_ctxentry *entry;
+  SSL_CTX *ctx = NULL;
+
+  *store = NULL;
+
+  if(CTXCACHE_SHARED(data))
+    Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
+
+  prevp = &cache->contexts;
+  while((entry = *prevp) != NULL) {
+    if(!ctxentry_cas(entry, data)) {
+      prevp = &entry->next;
+      continue;
+    }
+    if(!ctxentry_current(entry)) {
+      *prevp = entry->next;
+      ctxentry_free(entry);
+      continue;
+    }
+    if((entry->version == data->set.ssl.version) &&
+       (entry->verifypeer == data->set.ssl.verifypeer) &&
+       (entry->enable_beast == data->set.ssl_enable_beast) &&
+       strequal_null(entry->cipher_list,
+                     data->set.str[STRING_SSL_CIPHER_LIST])) {
+      /* it is the most recently used one now */
+      *prevp = entry->next;
+      entry->next = cache->contexts;
+      cache->contexts = entry;
+      ctx = entry->ctx;
+      ctx_up_ref(ctx);
+      break;
+    }
+    if(!*store) {
+      *store = SSL_CTX_get_cert_store(entry->ctx);
+      store_up_ref(*store);
+    }
+    prevp = &entry->next;
+  }
+
+  if(ctx && *store) {
+    X509_STORE_free(*store);
+    *store = NULL;
+  }
+
+  if(CTXCACHE_SHARED(data))
+    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+
+  return ctx;
+}
+
+/* keep the context made for the setup of the handle */
+static void ctxcache_add(struct SessionHandle *data, SSL_CTX *ctx)
+{
+  struct Curl_sslcache *cache = data->state.session;
+  struct ossl_ctxentry *entry = calloc(1, sizeof(struct ossl_ctxentry));
+  struct ossl_ctxentry **prevp;
+  int count;
+
+  if(!entry)
+    return; /* not kept, no harm done */
+
+  entry->ctx = ctx;
+  entry->version = data->set.ssl.version;
+  entry->verifypeer = data->set.ssl.verifypeer;
+  entry->enable_beast = data->set.ssl_enable_beast;
+  if((data->set.str[STRING_SSL_CAFILE] &&
+      !(entry->cafile = strdup(data->set.str[STRING_SSL_CAFILE]))) ||
+     (data->set.str[STRING_SSL_CAPATH] &&
+      !(entry->capath = strdup(data->set.str[STRING_SSL_CAPATH]))) ||
+     (data->set.str[STRING_SSL_CRLFILE] &&
+      !(entry->crlfile = strdup(data->set.str[STRING_SSL_CRLFILE]))) ||
+     (data->set.str[STRING_SSL_CIPHER_LIST] &&
+      !(entry->cipher_list =
+        strdup(data->set.str[STRING_SSL_CIPHER_LIST])))) {
+    entry->ctx = NULL;
+    ctxentry_free(entry);
+    return;
+  }
+  file_stamp(entry->cafile, &entry->stamp[0]);
+  file_stamp(entry->capath, &entry->stamp[1]);
+  file_stamp(entry->crlfile, &entry->stamp[2]);
+  ctx_up_ref(ctx);
+
+  if(CTXCACHE_SHARED(data))
+    Curl_share_lock(data, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_ACCESS_SINGLE);
+
+  entry->next = cache->contexts;
+  cache->contexts = entry;
+
+  /* drop the least recently used ones that don't fit */
+  for(count = 0, prevp = &entry->next; *prevp; count++) {
+    if(count >= CTXCACHE_MAX - 1) {
+      struct ossl_ctxentry *old = *prevp;
+      *prevp = old->next;
+      ctxentry_free(old);
     }
     else
-#endif
-    /* we try to figure out version */
-    req_method = SSLv23_client_method();
-    use_sni(TRUE);
-    break;
-  case CURL_SSLVERSION_TLSv1:
-    req_method = TLSv1_client_method();
-    use_sni(TRUE);
-    break;
-  case CURL_SSLVERSION_SSLv2:
-#ifdef OPENSSL_NO_SSL2
-    failf(data, "OpenSSL was built without SSLv2 support");
-    return CURLE_NOT_BUILT_IN;
-#else
-#ifdef USE_TLS_SRP
-    if(data->set.ssl.authtype == CURL_TLSAUTH_SRP)
-      return CURLE_SSL_CONNECT_ERROR;
-#endif
-    req_method = SSLv2_client_method();
-    use_sni(FALSE);
-    break;
-#endif
-  case CURL_SSLVERSION_SSLv3:
-#ifdef USE_TLS_SRP
-    if(data->set.ssl.authtype == CURL_TLSAUTH_SRP)
-      return CURLE_SSL_CONNECT_ERROR;
-#endif
-    req_method = SSLv3_client_method();
-    use_sni(FALSE);
-    break;
+      prevp = &(*prevp)->next;
   }
 
-  if(connssl->ctx)
-    SSL_CTX_free(connssl->ctx);
+  if(CTXCACHE_SHARED(data))
+    Curl_share_unlock(data, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+/*
+ * Curl_ossl_contexts_free() frees the contexts kept with a session ID cache
+ * that goes away.
+ */
+void Curl_ossl_contexts_free(struct ossl_ctxentry *entry)
+{
+  while(entry) {
+    struct ossl_ctxentry *next = entry->next;
+    ctxentry_free(entry);
+    entry = next;
+  }
+}
+
+/*
+ * Make the SSL_CTX for the connection, with the CA certificates of 'store'
+ * if that isn't NULL. The reference to the store is passed on. '*keep' is
+ * set FALSE if the context must not be used for other connections.
+ */
+static CURLcode
+ossl_new_ctx(struct connectdata *conn, int sockindex,
+             SSL_METHOD_QUAL SSL_METHOD *req_method, X509_STORE *store,
+             bool *keep)
+{
+  struct SessionHandle *data = conn->data;
+  struct ssl_connect_data *connssl = &conn->ssl[sockindex];
+  X509_LOOKUP *lookup=NULL;
+  long ctx_options;
+
   connssl->ctx = SSL_CTX_new(req_method);
 
   if(!connssl->ctx) {
     failf(data, "SSL: couldn't create a context: %s",
           ERR_error_string(ERR_peek_error(), NULL));
+    if(store)
+      X509_STORE_free(store);
     return CURLE_OUT_OF_MEMORY;
   }
 
+  if(store)
+    /* the CA certificates and CRLs loaded for another context */
+    SSL_CTX_set_cert_store(connssl->ctx, store);
+
 #ifdef SSL_MODE_RELEASE_BUFFERS
   SSL_CTX_set_mode(connssl->ctx, SSL_MODE_RELEASE_BUFFERS);
 #endif
 
-#ifdef SSL_CTRL_SET_MSG_CALLBACK
-  if(data->set.fdebug && data->set.verbose) {
-    /* the SSL trace callback is only used for verbose logging so we only
-       inform about failures of setting it */
-    if(!SSL_CTX_callback_ctrl(connssl->ctx, SSL_CTRL_SET_MSG_CALLBACK,
-                               (void (*)(void))ssl_tls_trace)) {
-      infof(data, "SSL: couldn't set callback!\n");
-    }
-    else if(!SSL_CTX_ctrl(connssl->ctx, SSL_CTRL_SET_MSG_CALLBACK_ARG, 0,
-                          conn)) {
-      infof(data, "SSL: couldn't set callback argument!\n");
-    }
-  }
-#endif
-
   /* OpenSSL contains code to work-around lots of bugs and flaws in various
      SSL-implementations. SSL_CTX_set_options() is used to enabled those
      work-arounds. The man page for this option states that SSL_OP_ALL enables
@@ -1547,7 +1758,8 @@ ossl_connect_step1(struct connectdata *conn,
     }
   }
 #endif
-  if(data->set.str[STRING_SSL_CAFILE] || data->set.str[STRING_SSL_CAPATH]) {
+  if(!store &&
+     (data->set.str[STRING_SSL_CAFILE] || data->set.str[STRING_SSL_CAPATH])) {
     /* tell SSL where to find CA certificates that are used to verify
        the servers certificate. */
     if(!SSL_CTX_load_verify_locations(connssl->ctx,
@@ -1568,6 +1780,8 @@ ossl_connect_step1(struct connectdata *conn,
            is required. */
         infof(data, "error setting certificate verify locations,"
               " continuing anyway:\n");
+        /* try them again for the next connection */
+        *keep = FALSE;
       }
     }
     else {
@@ -1583,7 +1797,7 @@ ossl_connect_step1(struct connectdata *conn,
           "none");
   }
 
-  if(data->set.str[STRING_SSL_CRLFILE]) {
+  if(!store && data->set.str[STRING_SSL_CRLFILE]) {
     /* tell SSL where to find CRL file that is used to check certificate
      * revocation */
     lookup=X509_STORE_add_lookup(SSL_CTX_get_cert_store(connssl->ctx),
@@ -1616,14 +1830,107 @@ ossl_connect_step1(struct connectdata *conn,
 
   /* give application a chance to interfere with SSL set up. */
   if(data->set.ssl.fsslctx) {
-    retcode = (*data->set.ssl.fsslctx)(data, connssl->ctx,
-                                       data->set.ssl.fsslctxp);
+    CURLcode retcode = (*data->set.ssl.fsslctx)(data, connssl->ctx,
+                                                data->set.ssl.fsslctxp);
     if(retcode) {
       failf(data,"error signaled by ssl ctx callback");
       return retcode;
     }
   }
 
+  return CURLE_OK;
+}
+
+static CURLcode
+ossl_connect_step1(struct connectdata *conn,
+                   int sockindex)
+{
+  CURLcode retcode = CURLE_OK;
+
+  struct SessionHandle *data = conn->data;
+  SSL_METHOD_QUAL SSL_METHOD *req_method=NULL;
+  void *ssl_sessionid=NULL;
+  X509_STORE *store=NULL;
+  bool cacheable;
+  curl_socket_t sockfd = conn->sock[sockindex];
+  struct ssl_connect_data *connssl = &conn->ssl[sockindex];
+#ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
+  bool sni;
+#ifdef ENABLE_IPV6
+  struct in6_addr addr;
+#else
+  struct in_addr addr;
+#endif
+#endif
+
+  DEBUGASSERT(ssl_connect_1 == connssl->connecting_state);
+
+  /* Make funny stuff to get random input */
+  Curl_ossl_seed(data);
+
+  /* check to see if we've been told to use an explicit SSL/TLS version */
+
+  switch(data->set.ssl.version) {
+  default:
+  case CURL_SSLVERSION_DEFAULT:
+#ifdef USE_TLS_SRP
+    if(data->set.ssl.authtype == CURL_TLSAUTH_SRP) {
+      infof(data, "Set version TLSv1 for SRP authorisation\n");
+      req_method = TLSv1_client_method() ;
+    }
+    else
+#endif
+    /* we try to figure out version */
+    req_method = SSLv23_client_method();
+    use_sni(TRUE);
+    break;
+  case CURL_SSLVERSION_TLSv1:
+    req_method = TLSv1_client_method();
+    use_sni(TRUE);
+    break;
+  case CURL_SSLVERSION_SSLv2:
+#ifdef OPENSSL_NO_SSL2
+    failf(data, "OpenSSL was built without SSLv2 support");
+    return CURLE_NOT_BUILT_IN;
+#else
+#ifdef USE_TLS_SRP
+    if(data->set.ssl.authtype == CURL_TLSAUTH_SRP)
+      return CURLE_SSL_CONNECT_ERROR;
+#endif
+    req_method = SSLv2_client_method();
+    use_sni(FALSE);
+    break;
+#endif
+  case CURL_SSLVERSION_SSLv3:
+#ifdef USE_TLS_SRP
+    if(data->set.ssl.authtype == CURL_TLSAUTH_SRP)
+      return CURLE_SSL_CONNECT_ERROR;
+#endif
+    req_method = SSLv3_client_method();
+    use_sni(FALSE);
+    break;
+  }
+
+  if(connssl->ctx)
+    SSL_CTX_free(connssl->ctx);
+  connssl->ctx = NULL;
+
+  /* use the context made for an earlier connection with the same setup if
+     there is one, that saves loading the CA certificates again */
+  cacheable = ctx_cacheable(data);
+  if(cacheable)
+    connssl->ctx = ctxcache_get(data, &store);
+
+  if(connssl->ctx)
+    infof(data, "SSL re-using context\n");
+  else {
+    retcode = ossl_new_ctx(conn, sockindex, req_method, store, &cacheable);
+    if(retcode)
+      return retcode;
+    if(cacheable)
+      ctxcache_add(data, connssl->ctx);
+  }
+
   /* Lets make an SSL structure */
   if(connssl->handle)
     SSL_free(connssl->handle);
@@ -1634,6 +1941,28 @@ ossl_connect_step1(struct connectdata *conn,
   }
   SSL_set_connect_state(connssl->handle);
 
+#ifdef SSL_CTRL_SET_MSG_CALLBACK
+  /* the trace callback is set on the SSL handle, never on the context, as a
+     kept context is also used by connections that are not verbose. A handle
+     gets the callback of its context, so it is cleared for those. */
+  if(data->set.fdebug && data->set.verbose) {
+    /* the SSL trace callback is only used for verbose logging so we only
+       inform about failures of setting it */
+    if(!SSL_callback_ctrl(connssl->handle, SSL_CTRL_SET_MSG_CALLBACK,
+                          (void (*)(void))ssl_tls_trace)) {
+      infof(data, "SSL: couldn't set callback!\n");
+    }
+    else if(!SSL_ctrl(connssl->handle, SSL_CTRL_SET_MSG_CALLBACK_ARG, 0,
+                      conn)) {
+      infof(data, "SSL: couldn't set callback argument!\n");
+    }
+  }
+  else {
+    SSL_callback_ctrl(connssl->handle, SSL_CTRL_SET_MSG_CALLBACK, NULL);
+    SSL_ctrl(connssl->handle, SSL_CTRL_SET_MSG_CALLBACK_ARG, 0, NULL);
+  }
+#endif
+
   connssl->server_cert = 0x0;
 
 #ifdef SSL_CTRL_SET_TLSEXT_HOSTNAME
@@ -2353,6 +2682,10 @@ ossl_connect_step3(struct connectdata *conn,
     retcode = Curl_ssl_addsessionid(conn, our_ssl_sessionid,
                                     0 /* unknown size */);
     if(retcode) {
+#ifdef HAVE_SSL_GET1_SESSION
+      /* the cache didn't take our reference */
+      SSL_SESSION_free(our_ssl_sessionid);
+#endif
       failf(data, "failed to store ssl session");
       return retcode;
     }
@@ -50,6 +50,17 @@ CURLcode Curl_ossl_set_engine(struct SessionHandle *data, const char *engine);
    should be freed */
 void Curl_ossl_session_free(void *ptr);
 
+/* function provided for the generic SSL-layer, called when the session ID
+   cache the contexts are kept with goes away */
+void Curl_ossl_contexts_free(struct ossl_ctxentry *contexts);
+
+/* serialize a session id for the session file, and make one from that */
+CURLcode Curl_ossl_session_export(void *ptr, size_t idsize,
+                                  unsigned char **blob, size_t *bloblen,
+                                  time_t *expires);
+void *Curl_ossl_session_import(const unsigned char *blob, size_t bloblen,
+                               size_t *idsize);
+
 /* Sets engine as default for all SSL operations */
 CURLcode Curl_ossl_set_engine_default(struct SessionHandle *data);
 
@@ -79,6 +90,9 @@ void Curl_ossl_md5sum(unsigned char *tmp, /* input */
 #define curlssl_connect Curl_ossl_connect
 #define curlssl_connect_nonblocking Curl_ossl_connect_nonblocking
 #define curlssl_session_free(x) Curl_ossl_session_free(x)
+#define curlssl_session_export(a,b,c,d,e) Curl_ossl_session_export(a,b,c,d,e)
+#define curlssl_session_import(x,y,z) Curl_ossl_session_import(x,y,z)
+#define curlssl_contexts_free(x) Curl_ossl_contexts_free(x)
 #define curlssl_close_all Curl_ossl_close_all
 #define curlssl_close Curl_ossl_close
 #define curlssl_shutdown(x,y) Curl_ossl_shutdown(x,y)
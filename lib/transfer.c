@@ -74,7 +74,9 @@
 #include "http_digest.h"
 #include "curl_ntlm.h"
 #include "http_negotiate.h"
+#include "http2.h"
 #include "share.h"
+#include "redircache.h"
 #include "curl_memory.h"
 #include "select.h"
 #include "multiif.h"
@@ -89,6 +91,10 @@
 
 #define CURL_TIMEOUT_EXPECT_100 1000 /* counting ms here */
 
+/* don't ask the read callback for more upload data when there's less room
+   than this left in the buffer */
+#define UPLOAD_COALESCE_MIN 256
+
 /*
  * This function will call the read callback to fill our buffer with data
  * to upload.
@@ -300,7 +306,10 @@ static int data_pending(const struct connectdata *conn)
   /* in the case of libssh2, we can never be really sure that we have emptied
      its internal buffers so we MUST always try until we get EAGAIN back */
   return conn->handler->protocol&(CURLPROTO_SCP|CURLPROTO_SFTP) ||
-    Curl_ssl_data_pending(conn, FIRSTSOCKET);
+    Curl_ssl_data_pending(conn, FIRSTSOCKET) ||
+    /* the HTTP/2 stream may have been received while reading for another
+       transfer on the connection */
+    Curl_http2_data_pending(conn);
 }
 
 static void read_rewind(struct connectdata *conn,
@@ -773,6 +782,58 @@ static CURLcode readwrite_data(struct SessionHandle *data,
   return CURLE_OK;
 }
 
+/*
+ * Every send on a TLS connection becomes a TLS record of its own. When the
+ * read callback hands over small pieces, such as chunks of a chunked upload,
+ * we keep on reading into the upload buffer until it is full or the callback
+ * has no more to give right now, so that the pieces go in one send.
+ *
+ * '*nreadp' bytes were read to upload_fromhere, and on return it is the
+ * number of bytes there with the new ones added.
+ */
+CURLcode Curl_coalesce_upload(struct connectdata *conn, ssize_t *nreadp)
+{
+  struct SessionHandle *data = conn->data;
+  struct SingleRequest *k = &data->req;
+  char *start = k->upload_fromhere;
+  ssize_t nread = *nreadp;
+  int num = (conn->writesockfd == conn->sock[SECONDARYSOCKET]);
+  CURLcode result = CURLE_OK;
+
+  if(!conn->ssl[num].use)
+    return CURLE_OK;
+
+  while(!k->upload_done && !(k->keepon & KEEP_SEND_PAUSE) &&
+        ((data->set.infilesize < 0) ||
+         (k->writebytecount + nread < data->set.infilesize)) &&
+        (k->uploadbuf + BUFSIZE - (start + nread) >= UPLOAD_COALESCE_MIN)) {
+    int fillcount;
+
+    k->upload_fromhere = start + nread;
+    result = Curl_fillreadbuffer(conn, (int)(k->uploadbuf + BUFSIZE -
+                                             k->upload_fromhere),
+                                 &fillcount);
+    if(result)
+      break;
+    if(fillcount <= 0) {
+      if(!(k->keepon & KEEP_SEND_PAUSE))
+        /* the end of the upload, the next round finishes it */
+        k->upload_eof = TRUE;
+      break;
+    }
+
+    /* a chunk header may start a few bytes further on, close the gap */
+    if(k->upload_fromhere != start + nread)
+      memmove(start + nread, k->upload_fromhere, fillcount);
+    nread += fillcount;
+  }
+
+  k->upload_fromhere = start;
+  *nreadp = nread;
+
+  return result;
+}
+
 /*
  * Send data to upload to the server, when the socket is writable.
  */
@@ -807,7 +868,7 @@ static CURLcode readwrite_upload(struct SessionHandle *data,
       /* init the "upload from here" pointer */
       data->req.upload_fromhere = k->uploadbuf;
 
-      if(!k->upload_done) {
+      if(!k->upload_done && !k->upload_eof) {
         /* HTTP pollution, this should be written nicer to become more
            protocol agnostic. */
         int fillcount;
@@ -841,6 +902,12 @@ static CURLcode readwrite_upload(struct SessionHandle *data,
           return result;
 
         nread = (ssize_t)fillcount;
+
+        if((nread > 0) && !sending_http_headers) {
+          result = Curl_coalesce_upload(conn, &nread);
+          if(result)
+            return result;
+        }
       }
       else
         nread = 0; /* we're done uploading/reading */
@@ -853,6 +920,10 @@ static CURLcode readwrite_upload(struct SessionHandle *data,
         /* done */
         k->keepon &= ~KEEP_SEND; /* we're done writing */
 
+        result = Curl_http2_done_sending(conn);
+        if(result)
+          return result;
+
         if(conn->bits.rewindaftersend) {
           result = Curl_readrewind(conn);
           if(result)
@@ -1018,7 +1089,8 @@ CURLcode Curl_readwrite(struct connectdata *conn,
      the stream was rewound (in which case we have data in a
      buffer) */
   if((k->keepon & KEEP_RECV) &&
-     ((select_res & CURL_CSELECT_IN) || conn->bits.stream_was_rewound)) {
+     ((select_res & CURL_CSELECT_IN) || conn->bits.stream_was_rewound ||
+      Curl_http2_data_pending(conn))) {
 
     result = readwrite_data(data, conn, k, &didwhat, done);
     if(result || *done)
@@ -1313,6 +1385,9 @@ CURLcode Curl_pretransfer(struct SessionHandle *data)
        consider to be fine */
     data->state.authhost.picked &= data->state.authhost.want;
     data->state.authproxy.picked &= data->state.authproxy.want;
+
+    /* skip the round-trips of already known permanent redirects */
+    res = Curl_redircache_follow(data);
   }
 
   return res;
@@ -1649,6 +1724,16 @@ CURLcode Curl_follow(struct SessionHandle *data,
 
   }
 
+  if((type == FOLLOW_REDIR) && (data->set.httpreq == HTTPREQ_GET) &&
+     ((data->info.httpcode == 301) || (data->info.httpcode == 308))) {
+    /* remember permanent redirects so that they can be skipped next time */
+    CURLcode res = Curl_redircache_add(data, data->change.url, newurl);
+    if(res) {
+      free(newurl);
+      return res;
+    }
+  }
+
   if(type == FOLLOW_FAKE) {
     /* we're only figuring out the new url if we would've followed locations
        but now we're done so we can get out! */
@@ -1771,6 +1856,10 @@ CURLcode Curl_follow(struct SessionHandle *data,
   Curl_pgrsTime(data, TIMER_REDIRECT);
   Curl_pgrsResetTimesSizes(data);
 
+  if(type == FOLLOW_REDIR)
+    /* the new URL may itself be known to have moved */
+    return Curl_redircache_follow(data);
+
   return CURLE_OK;
 #endif /* CURL_DISABLE_HTTP */
 }
@@ -25,6 +25,9 @@
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h> /* for TCP_FASTOPEN_CONNECT */
+#endif
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -107,6 +110,7 @@ int curl_win32_idn_to_ascii(const char *in, char **out);
 #include "telnet.h"
 #include "tftp.h"
 #include "http.h"
+#include "httpcache.h"
 #include "file.h"
 #include "curl_ldap.h"
 #include "ssh.h"
@@ -429,6 +433,9 @@ CURLcode Curl_close(struct SessionHandle *data)
 
   Curl_digest_cleanup(data);
 
+  Curl_httpcache_cleanup(data);
+  Curl_safefree(data->state.customheaders);
+
   Curl_safefree(data->info.contenttype);
   Curl_safefree(data->info.wouldredirect);
 
@@ -489,6 +496,8 @@ CURLcode Curl_init_userdefined(struct UserDefined *set)
   set->ftp_filemethod = FTPFILE_MULTICWD;
 
   set->dns_cache_timeout = 60; /* Timeout every 60 seconds by default */
+  set->redir_cache_timeout = 3600; /* cache permanent redirects an hour */
+  set->rate_weight = CURL_DEFAULT_RATE_WEIGHT;
 
   /* Set the default size of the SSL session ID cache */
   set->ssl.max_ssl_sessions = 5;
@@ -647,6 +656,26 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
   case CURLOPT_DNS_CACHE_TIMEOUT:
     data->set.dns_cache_timeout = va_arg(param, long);
     break;
+  case CURLOPT_DNS_CACHE_STALE:
+    /*
+     * The number of seconds a DNS cache entry may be used after it timed out,
+     * while it is resolved again in the background.
+     */
+    data->set.dns_cache_stale = va_arg(param, long);
+    break;
+  case CURLOPT_DNS_NEGATIVE_TIMEOUT:
+    /*
+     * The number of seconds a failed name lookup is kept in the DNS cache.
+     */
+    data->set.dns_negative_timeout = va_arg(param, long);
+    break;
+  case CURLOPT_REDIR_CACHE_TIMEOUT:
+    /*
+     * The number of seconds a permanent redirect is kept in the redirect
+     * cache of the share used. -1 keeps them forever, 0 disables storing.
+     */
+    data->set.redir_cache_timeout = va_arg(param, long);
+    break;
   case CURLOPT_DNS_USE_GLOBAL_CACHE:
     /* remember we want this enabled */
     arg = va_arg(param, long);
@@ -1057,6 +1086,8 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
      * Set a list with HTTP headers to use (or replace internals with)
      */
     data->set.headers = va_arg(param, struct curl_slist *);
+    /* the lines are rendered again for the next request */
+    Curl_safefree(data->state.customheaders);
     break;
 
   case CURLOPT_HTTP200ALIASES:
@@ -1188,9 +1219,15 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
      * This sets a requested HTTP version to be used. The value is one of
      * the listed enums in curl/curl.h.
      */
-    data->set.httpversion = va_arg(param, long);
+    arg = va_arg(param, long);
+#ifndef USE_NGHTTP2
+    if(arg == CURL_HTTP_VERSION_2_0)
+      return CURLE_UNSUPPORTED_PROTOCOL;
+#endif
+    data->set.httpversion = arg;
     break;
 
+
   case CURLOPT_HTTPAUTH:
     /*
      * Set HTTP Authentication type BITMASK.
@@ -1475,6 +1512,30 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
      */
     data->set.max_recv_speed=va_arg(param, curl_off_t);
     break;
+  case CURLOPT_RATE_GROUP:
+    /*
+     * The transfer shares the speed limits set with curl_multi_rategroup()
+     * for this group.
+     */
+    data->set.rate_group=va_arg(param, long);
+    break;
+  case CURLOPT_RATE_WEIGHT:
+    /*
+     * The share of the rate group limits the transfer gets, relative to the
+     * other busy transfers of the group.
+     */
+    arg = va_arg(param, long);
+    if((arg < 1) || (arg > CURL_MAX_RATE_WEIGHT))
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.rate_weight = arg;
+    break;
+  case CURLOPT_PRIORITY:
+    /*
+     * Transfers with a higher priority are served first by the multi handle.
+     * It is used when the handle is added to one.
+     */
+    data->set.priority=va_arg(param, long);
+    break;
   case CURLOPT_LOW_SPEED_TIME:
     /*
      * The low speed time that if transfers are below the set
@@ -2000,7 +2061,9 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
       }
 #endif   /* CURL_DISABLE_HTTP */
       if(data->share->sslsession) {
-        data->set.ssl.max_ssl_sessions = data->share->max_ssl_sessions;
+        /* use the shared session cache, first free own one if any */
+        if(data->state.session)
+          Curl_ssl_sessioncache_destroy(data->state.session);
         data->state.session = data->share->sslsession;
       }
       Curl_share_unlock(data, CURL_LOCK_DATA_SHARE);
@@ -2134,6 +2197,28 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
     data->set.ssl.sessionid = (0 != va_arg(param, long))?TRUE:FALSE;
     break;
 
+  case CURLOPT_SSL_SESSIONID_CACHE_SIZE:
+    /*
+     * The number of SSL sessions kept in the session ID cache.
+     */
+    arg = va_arg(param, long);
+    if(arg < 1)
+      return CURLE_BAD_FUNCTION_ARGUMENT;
+    data->set.ssl.max_ssl_sessions = (size_t)arg;
+    break;
+
+  case CURLOPT_SSL_SESSIONID_FILE:
+    /*
+     * The file the SSL sessions are loaded from and saved to.
+     */
+#if defined(USE_SSLEAY) || defined(USE_GNUTLS)
+    result = setstropt(&data->set.str[STRING_SSL_SESSIONID_FILE],
+                       va_arg(param, char *));
+#else
+    result = CURLE_NOT_BUILT_IN;
+#endif
+    break;
+
 #ifdef USE_LIBSSH2
     /* we only include SSH options if explicitly built to support SSH */
   case CURLOPT_SSH_AUTH_TYPES:
@@ -2416,6 +2501,32 @@ CURLcode Curl_setopt(struct SessionHandle *data, CURLoption option,
   case CURLOPT_TCP_KEEPINTVL:
     data->set.tcp_keepintvl = va_arg(param, long);
     break;
+  case CURLOPT_SOCK_RCVBUF:
+    data->set.sock_rcvbuf = va_arg(param, long);
+    break;
+  case CURLOPT_SOCK_SNDBUF:
+    data->set.sock_sndbuf = va_arg(param, long);
+    break;
+  case CURLOPT_TCP_NOTSENT_LOWAT:
+    data->set.tcp_notsent_lowat = va_arg(param, long);
+    break;
+  case CURLOPT_TCP_CONGESTION:
+    result = setstropt(&data->set.str[STRING_TCP_CONGESTION],
+                       va_arg(param, char *));
+    break;
+  case CURLOPT_TCP_QUICKACK:
+    data->set.tcp_quickack = (0 != va_arg(param, long))?TRUE:FALSE;
+    break;
+  case CURLOPT_SOCK_BUSY_POLL:
+    data->set.sock_busy_poll = va_arg(param, long);
+    break;
+  case CURLOPT_TCP_FASTOPEN:
+#ifdef TCP_FASTOPEN_CONNECT
+    data->set.tcp_fastopen = (0 != va_arg(param, long))?TRUE:FALSE;
+#else
+    result = CURLE_NOT_BUILT_IN;
+#endif
+    break;
 
   default:
     /* unknown tag and its companion, just ignore: */
@@ -2542,6 +2653,7 @@ CURLcode Curl_disconnect(struct connectdata *conn, bool dead_connection)
 
     /* unlink ourselves! */
   infof(data, "Closing connection %d\n", conn->connection_id);
+  Curl_multi_idle_remove(conn);
   Curl_conncache_remove_conn(data->state.conn_cache, conn);
 
 #if defined(USE_LIBIDN)
@@ -2580,22 +2692,98 @@ CURLcode Curl_disconnect(struct connectdata *conn, bool dead_connection)
   return CURLE_OK;
 }
 
+/* An idle connection that curl_multi_wait() saw alive no longer than this
+   many milliseconds ago is reused without another look at its socket. Should
+   it still have died in between, the request is retried on a new one if it
+   can be sent again. An upload that can't be rewound fails instead. */
+#define CONN_ALIVE_TIMEOUT 1000
+
+bool Curl_conn_idle(const struct connectdata *conn)
+{
+  return (!conn->inuse && !conn->send_pipe->size && !conn->recv_pipe->size &&
+          (conn->sock[FIRSTSOCKET] != CURL_SOCKET_BAD) &&
+          /* RTSP is a special case due to RTP interleaving */
+          !(conn->handler->protocol & CURLPROTO_RTSP)) ? TRUE : FALSE;
+}
+
+/* TRUE if the idle connection needs a look at its socket before reuse. One
+   watched by the event loop of the application is reaped when it closes. */
+static bool conn_alive_unknown(const struct connectdata *conn,
+                               struct timeval now)
+{
+  return (Curl_conn_idle(conn) && !Curl_multi_idle_evented(conn) &&
+          (!conn->alive.tv_sec ||
+           (Curl_tvdiff(now, conn->alive) >= CONN_ALIVE_TIMEOUT))) ?
+    TRUE : FALSE;
+}
+
 /*
- * This function should return TRUE if the socket is to be assumed to
- * be dead. Most commonly this happens when the server has closed the
- * connection due to inactivity.
+ * Close the idle connections in the bundle that are dead. Most commonly this
+ * happens when the server has closed the connection due to inactivity. The
+ * connections not recently seen alive by the event loop are checked with a
+ * single poll, instead of one per connection.
+ *
+ * The bundle itself is freed if it loses all its connections.
  */
-static bool SocketIsDead(curl_socket_t sock)
+static void prune_dead_connections(struct SessionHandle *data,
+                                   struct connectbundle *bundle)
 {
-  int sval;
-  bool ret_val = TRUE;
+  struct curl_llist_element *curr;
+  struct connectdata *check;
+  struct pollfd *pfd;
+  struct timeval now = Curl_tvnow();
+  unsigned int npfd = 0;
+
+  pfd = malloc(bundle->num_connections * sizeof(struct pollfd));
+  if(!pfd)
+    return; /* a dead one gets retried on a new connection anyway */
+
+  for(curr = bundle->conn_list->head; curr; curr = curr->next) {
+    check = curr->ptr;
+    if(conn_alive_unknown(check, now)) {
+      pfd[npfd].fd = check->sock[FIRSTSOCKET];
+      pfd[npfd].events = POLLIN;
+      pfd[npfd].revents = 0;
+      npfd++;
+    }
+  }
+
+  if(npfd && (Curl_poll(pfd, npfd, 0) < 0)) {
+    free(pfd);
+    return;
+  }
+
+  npfd = 0;
+  curr = bundle->conn_list->head;
+  while(curr) {
+    bool dead;
+
+    check = curr->ptr;
+    curr = curr->next;
+
+    if(conn_alive_unknown(check, now)) {
+      dead = pfd[npfd++].revents ? TRUE : FALSE;
+      if(!dead)
+        check->alive = now;
+    }
+    else if(!check->inuse && !check->send_pipe->size &&
+            !check->recv_pipe->size &&
+            (check->handler->protocol & CURLPROTO_RTSP))
+      dead = Curl_rtsp_connisdead(check);
+    else
+      continue;
+
+    if(dead) {
+      check->data = data;
+      infof(data, "Connection %ld seems to be dead!\n",
+            check->connection_id);
 
-  sval = Curl_socket_ready(sock, CURL_SOCKET_BAD, 0);
-  if(sval == 0)
-    /* timeout */
-    ret_val = FALSE;
+      /* disconnect resources */
+      Curl_disconnect(check, /* dead_connection */ TRUE);
+    }
+  }
 
-  return ret_val;
+  free(pfd);
 }
 
 static bool IsPipeliningPossible(const struct SessionHandle *handle,
@@ -2766,6 +2954,78 @@ find_oldest_idle_connection(struct SessionHandle *data)
   return conn_candidate;
 }
 
+/*
+ * This function finds the connection in the given bundle that has been unused
+ * for the longest time.
+ *
+ * Returns the pointer to the oldest idle connection, or NULL if none was
+ * found.
+ */
+static struct connectdata *
+find_oldest_idle_connection_in_bundle(struct connectbundle *bundle)
+{
+  struct curl_llist_element *curr;
+  long highscore=-1;
+  long score;
+  struct timeval now;
+  struct connectdata *conn_candidate = NULL;
+  struct connectdata *conn;
+
+  now = Curl_tvnow();
+
+  curr = bundle->conn_list->head;
+  while(curr) {
+    conn = curr->ptr;
+
+    if(!conn->inuse) {
+      /* Set higher score for the age passed since the connection was used */
+      score = Curl_tvdiff(now, conn->now);
+
+      if(score > highscore) {
+        highscore = score;
+        conn_candidate = conn;
+      }
+    }
+    curr = curr->next;
+  }
+
+  return conn_candidate;
+}
+
+/*
+ * Return TRUE if the request at the head of the connection's receive pipe is
+ * known to be so big that new requests are better off not queuing up behind
+ * it.
+ */
+static bool pipeline_penalized(struct SessionHandle *data,
+                               struct connectdata *conn)
+{
+  struct SessionHandle *recv_handle = gethandleathead(conn->recv_pipe);
+  curl_off_t penalty_size =
+    Curl_multi_content_length_penalty_size(data->multi);
+  curl_off_t chunk_penalty_size =
+    Curl_multi_chunk_length_penalty_size(data->multi);
+  curl_off_t recv_size = -2; /* Make it easy to spot in the log */
+  bool penalized = FALSE;
+
+  if(recv_handle)
+    recv_size = recv_handle->req.size;
+
+  if(penalty_size > 0 && recv_size > penalty_size)
+    penalized = TRUE;
+
+  if(chunk_penalty_size > 0 &&
+     (curl_off_t)conn->chunk.datasize > chunk_penalty_size)
+    penalized = TRUE;
+
+  if(penalized)
+    infof(data, "Connection #%ld is penalized, content-length: %"
+          FORMAT_OFF_T ", chunk size: %zu\n", conn->connection_id,
+          recv_size, conn->chunk.datasize);
+
+  return penalized;
+}
+
 /*
  * Given one filled in connection struct (named needle), this function should
  * detect if there already is one that has all the significant details
@@ -2782,15 +3042,24 @@ ConnectionExists(struct SessionHandle *data,
 {
   struct connectdata *check;
   struct connectdata *chosen = 0;
+  struct connectdata *fallback = NULL; /* least loaded full or penalized
+                                          pipe */
+  size_t chosen_load = 0;
+  size_t fallback_load = 0;
   bool canPipeline = IsPipeliningPossible(data, needle);
   bool wantNTLM = (data->state.authhost.want==CURLAUTH_NTLM) ||
                   (data->state.authhost.want==CURLAUTH_NTLM_WB) ? TRUE : FALSE;
+  size_t max_pipe_len = Curl_multi_max_pipeline_length(data->multi);
+  size_t max_host_connections = Curl_multi_max_host_connections(data->multi);
   struct connectbundle *bundle;
 
   /* Look up the bundle with all the connections to this
-     particular host */
-  bundle = Curl_conncache_find_bundle(data->state.conn_cache,
-                                      needle->host.name);
+     particular host, after having rid it of the dead ones */
+  bundle = Curl_conncache_find_bundle(data->state.conn_cache, needle);
+  if(bundle) {
+    prune_dead_connections(data, bundle);
+    bundle = Curl_conncache_find_bundle(data->state.conn_cache, needle);
+  }
   if(bundle) {
     struct curl_llist_element *curr;
 
@@ -2811,28 +3080,6 @@ ConnectionExists(struct SessionHandle *data,
 
       pipeLen = check->send_pipe->size + check->recv_pipe->size;
 
-      if(!pipeLen && !check->inuse) {
-        /* The check for a dead socket makes sense only if there are no
-           handles in pipeline and the connection isn't already marked in
-           use */
-        bool dead;
-        if(check->handler->protocol & CURLPROTO_RTSP)
-          /* RTSP is a special case due to RTP interleaving */
-          dead = Curl_rtsp_connisdead(check);
-        else
-          dead = SocketIsDead(check->sock[FIRSTSOCKET]);
-
-        if(dead) {
-          check->data = data;
-          infof(data, "Connection %d seems to be dead!\n",
-                check->connection_id);
-
-          /* disconnect resources */
-          Curl_disconnect(check, /* dead_connection */ TRUE);
-          continue;
-        }
-      }
-
       if(canPipeline) {
         /* Make sure the pipe has only GET requests */
         struct SessionHandle* sh = gethandleathead(check->send_pipe);
@@ -2846,7 +3093,7 @@ ConnectionExists(struct SessionHandle *data,
             continue;
         }
 #ifdef DEBUGBUILD
-      if(pipeLen > MAX_PIPELINE_LENGTH) {
+      if(pipeLen > max_pipe_len) {
         infof(data, "BAD! Connection #%ld has too big pipeline!\n",
               check->connection_id);
       }
@@ -2929,6 +3176,25 @@ ConnectionExists(struct SessionHandle *data,
           continue;
       }
 
+      if(needle->bits.proxy &&
+         (needle->bits.tunnel_proxy || !needle->bits.httpproxy)) {
+        /* The connection goes through a tunnel or a SOCKS proxy to the
+           remote host, so it is only the same one if it is the same proxy,
+           asked with the same credentials */
+        if((needle->proxytype != check->proxytype) ||
+           (needle->bits.tunnel_proxy != check->bits.tunnel_proxy) ||
+           !Curl_raw_equal(needle->proxy.name, check->proxy.name) ||
+           (needle->port != check->port))
+          continue;
+
+        if((needle->bits.proxy_user_passwd !=
+            check->bits.proxy_user_passwd) ||
+           (needle->bits.proxy_user_passwd &&
+            (!strequal(needle->proxyuser, check->proxyuser) ||
+             !strequal(needle->proxypasswd, check->proxypasswd))))
+          continue;
+      }
+
       if(!needle->bits.httpproxy || needle->handler->flags&PROTOPT_SSL ||
          (needle->bits.httpproxy && check->bits.httpproxy &&
           needle->bits.tunnel_proxy && check->bits.tunnel_proxy &&
@@ -2988,6 +3254,28 @@ ConnectionExists(struct SessionHandle *data,
         }
       }
 
+      if(match && canPipeline && pipeLen) {
+        /* The connection is busy. Queue up on the pipe with the lowest
+           expected wait, counted in requests ahead of us, but stay away
+           from pipes that are full or stuck behind a big transfer as long
+           as there is another way. Waiting transfers of a lower priority
+           are not ahead of us. */
+        size_t load = Curl_multi_pipeline_ahead(check, data);
+
+        if((check->server_supports_pipelining && (pipeLen >= max_pipe_len)) ||
+           pipeline_penalized(data, check)) {
+          if(!fallback || (load < fallback_load)) {
+            fallback = check;
+            fallback_load = load;
+          }
+        }
+        else if(!chosen || (load < chosen_load)) {
+          chosen = check;
+          chosen_load = load;
+        }
+        continue;
+      }
+
       if(match) {
         chosen = check;
 
@@ -3004,11 +3292,23 @@ ConnectionExists(struct SessionHandle *data,
           break;
       }
     }
+
+    if(!chosen && fallback && max_host_connections &&
+       (bundle->num_connections >= max_host_connections)) {
+      /* no new connection may be made to this host, so wait in line on
+         the least loaded of the pipes we would rather have avoided */
+      infof(data, "Connection #%ld is the best pipe available\n",
+            fallback->connection_id);
+      chosen = fallback;
+    }
   }
 
   if(chosen) {
     chosen->inuse = TRUE; /* mark this as being in use so that no other
                             handle in a multi stack may nick it */
+    chosen->alive.tv_sec = 0; /* the idle check is stale from now on */
+    chosen->alive.tv_usec = 0;
+    Curl_multi_idle_remove(chosen);
     *usethis = chosen;
     return TRUE; /* yes, we found one to use! */
   }
@@ -3078,9 +3378,13 @@ static CURLcode ConnectionStore(struct SessionHandle *data,
 
    Note: this function's sub-functions call failf()
 
+   *done is set TRUE once the step is complete, until then this is to be
+   called again when the socket is ready.
 */
-CURLcode Curl_connected_proxy(struct connectdata *conn)
+CURLcode Curl_connected_proxy(struct connectdata *conn, bool *done)
 {
+  *done = TRUE;
+
   if(!conn->bits.proxy)
     return CURLE_OK;
 
@@ -3090,15 +3394,15 @@ CURLcode Curl_connected_proxy(struct connectdata *conn)
   case CURLPROXY_SOCKS5_HOSTNAME:
     return Curl_SOCKS5(conn->proxyuser, conn->proxypasswd,
                        conn->host.name, conn->remote_port,
-                       FIRSTSOCKET, conn);
+                       FIRSTSOCKET, conn, done);
 
   case CURLPROXY_SOCKS4:
     return Curl_SOCKS4(conn->proxyuser, conn->host.name,
-                       conn->remote_port, FIRSTSOCKET, conn, FALSE);
+                       conn->remote_port, FIRSTSOCKET, conn, FALSE, done);
 
   case CURLPROXY_SOCKS4A:
     return Curl_SOCKS4(conn->proxyuser, conn->host.name,
-                       conn->remote_port, FIRSTSOCKET, conn, TRUE);
+                       conn->remote_port, FIRSTSOCKET, conn, TRUE, done);
 
 #endif /* CURL_DISABLE_PROXY */
   case CURLPROXY_HTTP:
@@ -3141,10 +3445,16 @@ static CURLcode ConnectPlease(struct SessionHandle *data,
     conn->ip_addr = addr;
 
     if(*connected) {
-      result = Curl_connected_proxy(conn);
+      bool done;
+      result = Curl_connected_proxy(conn, &done);
       if(!result) {
-        conn->bits.tcpconnect[FIRSTSOCKET] = TRUE;
-        Curl_pgrsTime(data, TIMER_CONNECT); /* connect done */
+        if(done) {
+          conn->bits.tcpconnect[FIRSTSOCKET] = TRUE;
+          Curl_pgrsTime(data, TIMER_CONNECT); /* connect done */
+        }
+        else
+          /* the proxy handshake goes on in Curl_is_connected() */
+          *connected = FALSE;
       }
     }
   }
@@ -4965,6 +5275,36 @@ static CURLcode create_conn(struct SessionHandle *data,
   else
     reuse = ConnectionExists(data, conn, &conn_temp);
 
+  if(!reuse) {
+    /* If there's a limit on the number of connections to this host and it
+       has been reached, close an idle one to make room or wait for one of
+       the busy ones to get done */
+    size_t max_host_connections =
+      Curl_multi_max_host_connections(data->multi);
+    struct connectbundle *bundle =
+      Curl_conncache_find_bundle(data->state.conn_cache, conn);
+
+    if(max_host_connections && bundle &&
+       (bundle->num_connections >= max_host_connections)) {
+      struct connectdata *conn_candidate =
+        find_oldest_idle_connection_in_bundle(bundle);
+
+      if(conn_candidate) {
+        /* Set the connection's owner correctly, then kill it */
+        conn_candidate->data = data;
+        (void)Curl_disconnect(conn_candidate, /* dead_connection */ FALSE);
+      }
+      else {
+        infof(data, "No connections available.\n");
+
+        conn_free(conn);
+        *in_connect = NULL;
+
+        return CURLE_NO_CONNECTION_AVAILABLE;
+      }
+    }
+  }
+
   if(reuse) {
     /*
      * We already have a connection for this, we got the former connection
@@ -4983,6 +5323,11 @@ static CURLcode create_conn(struct SessionHandle *data,
     infof(data, "Re-using existing connection! (#%ld) with host %s\n",
           conn->connection_id,
           conn->proxy.name?conn->proxy.dispname:conn->host.dispname);
+
+    if(conn->bits.httpproxy && conn->bits.tunnel_proxy &&
+       (conn->tunnel_state[FIRSTSOCKET] == TUNNEL_COMPLETE))
+      /* the CONNECT done before is good for this transfer too */
+      data->info.numtunnels_reused++;
   }
   else {
     /*
@@ -5277,6 +5622,9 @@ CURLcode Curl_done(struct connectdata **connp,
       /* remember the most recently used connection */
       data->state.lastconnect = conn;
 
+      if(Curl_conn_idle(conn))
+        Curl_multi_idle_add(data->multi, conn);
+
       infof(data, "Connection #%ld to host %s left intact\n",
             conn->connection_id,
             conn->bits.httpproxy?conn->proxy.dispname:conn->host.dispname);
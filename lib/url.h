@@ -65,6 +65,10 @@ void Curl_getoff_all_pipelines(struct SessionHandle *data,
 
 void Curl_close_connections(struct SessionHandle *data);
 
+/* TRUE if the connection is idle in the connection cache and a readable or
+   hung up socket thus means that it is dead */
+bool Curl_conn_idle(const struct connectdata *conn);
+
 /* Called on connect, and if there's already a protocol-specific struct
    allocated for a different connection, this frees it that it can be setup
    properly later on. */
@@ -74,7 +78,7 @@ void Curl_reset_reqproto(struct connectdata *conn);
 #define CURL_DEFAULT_SOCKS5_GSSAPI_SERVICE "rcmd" /* default socks5 gssapi
                                                      service */
 
-CURLcode Curl_connected_proxy(struct connectdata *conn);
+CURLcode Curl_connected_proxy(struct connectdata *conn, bool *done);
 
 #ifdef CURL_DISABLE_VERBOSE_STRINGS
 #define Curl_verboseconnect(x)  Curl_nop_stmt
@@ -66,6 +66,11 @@
 */
 #define RESP_TIMEOUT (1800*1000)
 
+/* the weight a transfer has in its rate group when CURLOPT_RATE_WEIGHT isn't
+   set, and the largest it may set */
+#define CURL_DEFAULT_RATE_WEIGHT 16
+#define CURL_MAX_RATE_WEIGHT 256
+
 #include "cookie.h"
 #include "formdata.h"
 
@@ -373,9 +378,28 @@ struct curl_ssl_session {
   char *name;       /* host name for which this ID was used */
   void *sessionid;  /* as returned from the SSL layer */
   size_t idsize;    /* if known, otherwise 0 */
-  long age;         /* just a number, the higher the more recent */
+  unsigned long hv; /* hash of the name, the port and the setup */
+  struct curl_ssl_session *next;  /* next in the same slot of the cache */
+  struct curl_ssl_session *older; /* used less recently than this */
+  struct curl_ssl_session *newer; /* used more recently than this */
   unsigned short remote_port; /* remote port to connect to */
   struct ssl_config_data ssl_config; /* setup for this session */
+  time_t expires;   /* when it can no longer be used, 0 if unknown */
+};
+
+/* a cache of SSL sessions, of a handle or shared by the handles of a share
+   object */
+struct Curl_sslcache {
+  struct curl_ssl_session **table; /* 'slots' lists of sessions */
+  size_t slots;
+  size_t count;  /* number of sessions in the cache */
+  size_t max;    /* most sessions it holds */
+  struct curl_ssl_session lru; /* list head, lru.newer is the least
+                                  recently used session */
+  char *file;    /* session file to save the sessions in, or NULL */
+#ifdef USE_SSLEAY
+  struct ossl_ctxentry *contexts; /* SSL_CTXs kept for reuse, see ssluse.c */
+#endif
 };
 
 /* Struct used for Digest challenge-response authentication */
@@ -509,6 +533,20 @@ struct ConnectBits {
   bool bound; /* set true if bind() has already been done on this socket/
                  connection */
   bool type_set;  /* type= was used in the URL */
+  bool tcp_fastopen; /* TCP Fast Open was asked for on the latest socket, it
+                        may not be connected until the first data is sent */
+};
+
+/*
+ * The socket tuning in effect on a connection, read back from the socket
+ * after CURLOPT_SOCK_RCVBUF and friends were applied. All zero when none of
+ * them were set.
+ */
+struct socktune {
+  long rcvbuf;
+  long sndbuf;
+  long notsent_lowat;
+  char congestion[16]; /* TCP_CA_NAME_MAX in Linux */
 };
 
 struct hostname {
@@ -553,6 +591,7 @@ struct Curl_async {
   struct Curl_dns_entry *dns;
   bool done;  /* set TRUE when the lookup is complete */
   int status; /* if done is TRUE, this is the status from the callback */
+  time_t expires; /* when the answer's time to live runs out, 0 if unknown */
   void *os_specific;  /* 'struct thread_data' for Windows */
 };
 #endif
@@ -575,6 +614,13 @@ enum expect100 {
   EXP100_FAILED               /* used on 417 Expectation Failed */
 };
 
+enum upgrade101 {
+  UPGR101_INIT,               /* default state */
+  UPGR101_REQUESTED,          /* upgrade requested */
+  UPGR101_RECEIVED,           /* response received */
+  UPGR101_WORKING             /* talking upgraded protocol */
+};
+
 /*
  * Request specific data in the easy handle (SessionHandle).  Previously,
  * these members were on the connectdata struct but since a conn struct may
@@ -625,6 +671,7 @@ struct SingleRequest {
                                    'RTSP/1.? XXX' line */
   struct timeval start100;      /* time stamp to wait for the 100 code from */
   enum expect100 exp100;        /* expect 100 continue state */
+  enum upgrade101 upgr101;      /* 101 upgrade state */
 
   int auto_decoding;            /* What content encoding. sec 3.5, RFC2616. */
 
@@ -650,6 +697,8 @@ struct SingleRequest {
 
   bool upload_done; /* set to TRUE when doing chunked transfer-encoding upload
                        and we're uploading the last chunk */
+  bool upload_eof;  /* the read callback returned 0 while more was asked for
+                       to fill up the upload buffer, don't call it again */
 
   bool ignorebody;  /* we read a response-body but we ignore it! */
   bool ignorecl;    /* This HTTP response has no body so we ignore the Content-
@@ -784,6 +833,30 @@ typedef ssize_t (Curl_recv)(struct connectdata *conn, /* connection data */
                             size_t len,               /* max amount to read */
                             CURLcode *err);           /* error to return */
 
+/*
+ * How far reading the response to a CONNECT request sent to a HTTP proxy has
+ * come, see http_proxy.c. The response is read as it arrives, the line being
+ * read is kept in the buffer of the handle meanwhile.
+ */
+struct http_connect_state {
+  size_t len;            /* bytes of a response line in the buffer */
+  int keepon;            /* what is read, 0 when the response is done */
+  curl_off_t cl;         /* size of the response body left to skip */
+  bool chunked_encoding; /* the response body is chunked */
+  bool close_connection; /* the proxy closes the connection after it */
+};
+
+/*
+ * How far the handshake with a SOCKS proxy has come, see socks.c. The
+ * messages are sent and read as the socket lets us.
+ */
+struct socks_state {
+  int state;               /* step of the handshake, 0 when none is going on */
+  size_t len;              /* size of the message being sent or read */
+  size_t done;             /* bytes of it sent or read so far */
+  unsigned char buf[600];  /* the message */
+};
+
 /*
  * The connectdata struct contains all fields and variables that should be
  * unique for an entire connection.
@@ -806,6 +879,12 @@ struct connectdata {
                  TRUE this handle is being used by an easy handle and cannot
                  be used by any other easy handle without careful
                  consideration (== only for pipelining). */
+  struct timeval alive; /* when the connection was last seen alive while
+                           idle, zero when not since it was last used */
+  struct Curl_multi *idle_multi; /* the multi handle watching the socket of
+                                    the idle connection, or NULL */
+  struct curl_llist_element *idle_node; /* in the 'idle' list of that multi
+                                           handle */
 
   /**** Fields set when inited and not modified again */
   long connection_id; /* Contains a unique number to make it easier to
@@ -855,6 +934,8 @@ struct connectdata {
   char local_ip[MAX_IPADR_LEN];
   long local_port;
 
+  struct socktune socktune; /* the tuning of the latest socket */
+
   char *user;    /* user name string, allocated */
   char *passwd;  /* password string, allocated */
 
@@ -943,6 +1024,10 @@ struct connectdata {
                                    their responses on this pipeline */
   struct curl_llist *pend_pipe; /* List of pending handles on
                                    this pipeline */
+  long num_requests;       /* number of requests queued on this connection
+                              during its lifetime */
+  long max_pipeline_depth; /* largest number of requests that have been
+                              queued on this connection at once */
   struct curl_llist *done_pipe; /* Handles that are finished, but
                                    still reference this connectdata */
 #define MAX_PIPELINE_LENGTH 5
@@ -994,6 +1079,7 @@ struct connectdata {
     struct pop3_conn pop3c;
     struct smtp_conn smtpc;
     struct rtsp_conn rtspc;
+    struct http_conn httpc;
     void *generic;
   } proto;
 
@@ -1022,6 +1108,8 @@ struct connectdata {
     TUNNEL_CONNECT, /* CONNECT has been sent off */
     TUNNEL_COMPLETE /* CONNECT response received completely */
   } tunnel_state[2]; /* two separate ones to allow FTP */
+  struct http_connect_state connect_state[2]; /* reading the responses */
+  struct socks_state socks_state[2]; /* handshakes with a SOCKS proxy */
 
    struct connectbundle *bundle; /* The bundle we are member of */
 };
@@ -1048,14 +1136,27 @@ struct PureInfo {
   long numconnects; /* how many new connection did libcurl created */
   char *contenttype; /* the content type of the object */
   char *wouldredirect; /* URL this would've been redirected to if asked to */
-
-  /* PureInfo members 'conn_primary_ip', 'conn_primary_port', 'conn_local_ip'
-     and, 'conn_local_port' are copied over from the connectdata struct in
-     order to allow curl_easy_getinfo() to return this information even when
-     the session handle is no longer associated with a connection, and also
-     allow curl_easy_reset() to clear this information from the session handle
-     without disturbing information which is still alive, and that might be
-     reused, in the connection cache. */
+  long redircache_hits;   /* times the redirect cache skipped redirects */
+  long redircache_misses; /* times the redirect cache had nothing to offer */
+  long httpcache; /* CURL_HTTPCACHE_* outcome of the most recent request */
+  long pipeline_position; /* requests queued ahead of this one on the
+                             connection it was added to */
+  long conn_requests; /* requests the connection has carried, this one
+                         included */
+  long conn_max_pipeline; /* deepest pipeline seen on the connection */
+  long dns_cache_hits;   /* names found in the DNS cache */
+  long dns_cache_stale;  /* outdated names used while being refreshed */
+  long dns_cache_misses; /* names that had to be resolved */
+  long numtunnels;       /* proxy CONNECT tunnels set up */
+  long numtunnels_reused; /* proxy CONNECT tunnels taken from the cache */
+
+  /* PureInfo members 'conn_primary_ip', 'conn_primary_port', 'conn_local_ip',
+     'conn_local_port' and 'conn_socktune' are copied over from the
+     connectdata struct in order to allow curl_easy_getinfo() to return this
+     information even when the session handle is no longer associated with a
+     connection, and also allow curl_easy_reset() to clear this information
+     from the session handle without disturbing information which is still
+     alive, and that might be reused, in the connection cache. */
 
   char conn_primary_ip[MAX_IPADR_LEN];
   long conn_primary_port;
@@ -1063,6 +1164,8 @@ struct PureInfo {
   char conn_local_ip[MAX_IPADR_LEN];
   long conn_local_port;
 
+  struct socktune conn_socktune;
+
   struct curl_certinfo certs; /* info about the certs, only populated in
                                  OpenSSL builds. Asked for with
                                  CURLOPT_CERTINFO / CURLINFO_CERTINFO */
@@ -1195,8 +1298,7 @@ struct UrlState {
                        following not keep sending user+password... This is
                        strdup() data.
                     */
-  struct curl_ssl_session *session; /* array of 'max_ssl_sessions' size */
-  long sessionage;                  /* number of the most recent session */
+  struct Curl_sslcache *session;    /* the SSL session ID cache */
   char *tempwrite;      /* allocated buffer to keep data in when a write
                            callback returns to make the connection paused */
   size_t tempwritesize; /* size of the 'tempwrite' allocated buffer */
@@ -1275,6 +1377,20 @@ struct UrlState {
   long rtsp_next_server_CSeq; /* the session's next server CSeq */
   long rtsp_CSeq_recv; /* most recent CSeq received */
 
+  /* HTTP cache state of the current request, or NULL */
+  struct Curl_httpcache_req *httpcache;
+
+  /* The CURLOPT_HTTPHEADER lines as rendered for the most recent request,
+     the conditions they were filtered with and the list they were rendered
+     from, see Curl_add_custom_headers() */
+  char *customheaders;
+  size_t customheaderslen;
+  int customheadersmask;
+  struct curl_slist *customheaderslist;
+  size_t customheaderscount;
+  size_t customheaderssig;
+  size_t reqsize_hint; /* size of the most recent HTTP request header */
+
   /* Protocol specific data.
    *
    *************************************************************************
@@ -1363,6 +1479,7 @@ enum dupstring {
   STRING_USERAGENT,       /* User-Agent string */
   STRING_SSL_CRLFILE,     /* crl file to check certificate */
   STRING_SSL_ISSUERCERT,  /* issuer cert file to check certificate */
+  STRING_SSL_SESSIONID_FILE, /* file to keep SSL sessions in */
   STRING_USERNAME,        /* <username>, if used */
   STRING_PASSWORD,        /* <password>, if used */
   STRING_PROXYUSERNAME,   /* Proxy <username>, if used */
@@ -1383,6 +1500,7 @@ enum dupstring {
 #endif
   STRING_MAIL_FROM,
   STRING_MAIL_AUTH,
+  STRING_TCP_CONGESTION,  /* TCP congestion control algorithm */
 
 #ifdef USE_TLS_SRP
   STRING_TLSAUTH_USERNAME,     /* TLS auth <username> */
@@ -1464,6 +1582,10 @@ struct UserDefined {
   curl_off_t max_send_speed; /* high speed limit in bytes/second for upload */
   curl_off_t max_recv_speed; /* high speed limit in bytes/second for
                                 download */
+  long rate_group; /* the group of the multi handle whose speed limits
+                      the transfer shares, 0 for none */
+  long rate_weight; /* share of the group limits, 1 - 256 */
+  long priority;    /* the higher, the sooner the multi handle serves it */
   curl_off_t set_resume_from;  /* continue [ftp] transfer from here */
   struct curl_slist *headers; /* linked list of extra headers */
   struct curl_httppost *httppost;  /* linked list of POST data */
@@ -1488,6 +1610,9 @@ struct UserDefined {
   struct ssl_config_data ssl;  /* user defined SSL stuff */
   curl_proxytype proxytype; /* what kind of proxy that is in use */
   long dns_cache_timeout; /* DNS cache timeout */
+  long dns_cache_stale; /* seconds outdated DNS entries may still be used */
+  long dns_negative_timeout; /* seconds failed lookups are cached */
+  long redir_cache_timeout; /* seconds permanent redirects are cached */
   long buffer_size;      /* size of receive buffer to use */
   void *private_data; /* application-private data */
 
@@ -1593,12 +1718,18 @@ struct UserDefined {
   bool tcp_keepalive;    /* use TCP keepalives */
   long tcp_keepidle;     /* seconds in idle before sending keepalive probe */
   long tcp_keepintvl;    /* seconds between TCP keepalive probes */
+  bool tcp_fastopen;     /* send the first data with the SYN */
+  long sock_rcvbuf;      /* SO_RCVBUF to set, 0 for the system default */
+  long sock_sndbuf;      /* SO_SNDBUF to set, 0 for the system default */
+  long tcp_notsent_lowat; /* TCP_NOTSENT_LOWAT to set, 0 for none */
+  bool tcp_quickack;     /* set TCP_QUICKACK */
+  long sock_busy_poll;   /* SO_BUSY_POLL microseconds, 0 for none */
 
   size_t maxconnects;  /* Max idle connections in the connection cache */
 };
 
 struct Names {
-  struct curl_hash *hostcache;
+  struct Curl_dnscache *hostcache;
   enum {
     HCACHE_NONE,    /* not pointing to anything */
     HCACHE_GLOBAL,  /* points to the (shrug) global one */
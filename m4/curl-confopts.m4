@@ -49,6 +49,32 @@ AC_HELP_STRING([--disable-threaded-resolver],[Disable threaded resolver]),
   AC_MSG_RESULT([$want_thres])
 ])
 
+dnl CURL_CHECK_OPTION_STUB_RESOLVER
+dnl -------------------------------------------------
+dnl Verify if configure has been invoked with option
+dnl --enable-stub-resolver or --disable-stub-resolver, and
+dnl set shell variable want_stubres as appropriate.
+
+AC_DEFUN([CURL_CHECK_OPTION_STUB_RESOLVER], [
+  AC_MSG_CHECKING([whether to enable the built-in stub resolver])
+  OPT_STUBRES="default"
+  AC_ARG_ENABLE(stub_resolver,
+AC_HELP_STRING([--enable-stub-resolver],[Enable built-in stub resolver])
+AC_HELP_STRING([--disable-stub-resolver],[Disable built-in stub resolver]),
+  OPT_STUBRES=$enableval)
+  case "$OPT_STUBRES" in
+    yes)
+      dnl --enable-stub-resolver option used
+      want_stubres="yes"
+      ;;
+    *)
+      dnl configure option not specified
+      want_stubres="no"
+      ;;
+  esac
+  AC_MSG_RESULT([$want_stubres])
+])
+
 dnl CURL_CHECK_OPTION_ARES
 dnl -------------------------------------------------
 dnl Verify if configure has been invoked with option
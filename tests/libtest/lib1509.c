@@ -0,0 +1,80 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+/*
+ * Two handles using the same share get the same URL. The first one follows
+ * a 301 over the network, the second one should go straight to the target
+ * thanks to the shared redirect cache.
+ */
+int test(char *URL)
+{
+  int res = 0;
+  CURL *curl = NULL;
+  CURLSH *share = NULL;
+  long hits;
+  long misses;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  share = curl_share_init();
+  if(!share) {
+    fprintf(stderr, "curl_share_init() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  if(curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_REDIRECT)) {
+    fprintf(stderr, "curl_share_setopt() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  for(i = 0; i < 2; i++) {
+    easy_init(curl);
+    easy_setopt(curl, CURLOPT_URL, URL);
+    easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    easy_setopt(curl, CURLOPT_SHARE, share);
+
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+
+    curl_easy_getinfo(curl, CURLINFO_REDIRECT_CACHE_HITS, &hits);
+    curl_easy_getinfo(curl, CURLINFO_REDIRECT_CACHE_MISSES, &misses);
+    printf("transfer %d: %ld hits %ld misses\n", i + 1, hits, misses);
+
+    curl_easy_cleanup(curl);
+    curl = NULL;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_share_cleanup(share);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,81 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+/*
+ * Four transfers sharing a HTTP cache. The first response is fresh for an
+ * hour so the second transfer of the same URL is served from the cache. The
+ * third response must be revalidated before use, so the fourth transfer
+ * sends a conditional request and gets the stored body after a 304.
+ */
+int test(char *URL)
+{
+  int res = 0;
+  CURL *curl = NULL;
+  CURLSH *share = NULL;
+  char url2[256];
+  long outcome;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  share = curl_share_init();
+  if(!share) {
+    fprintf(stderr, "curl_share_init() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  if(curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HTTP_CACHE)) {
+    fprintf(stderr, "curl_share_setopt() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  snprintf(url2, sizeof(url2), "%s0002", URL);
+
+  for(i = 0; i < 4; i++) {
+    easy_init(curl);
+    easy_setopt(curl, CURLOPT_URL, (i < 2) ? URL : url2);
+    easy_setopt(curl, CURLOPT_SHARE, share);
+
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+
+    curl_easy_getinfo(curl, CURLINFO_HTTP_CACHE, &outcome);
+    printf("transfer %d: cache outcome %ld\n", i + 1, outcome);
+
+    curl_easy_cleanup(curl);
+    curl = NULL;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_share_cleanup(share);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,84 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+/*
+ * Requests with a changing path and the same custom headers on one handle,
+ * then with a header appended to the list in place, then with a new header
+ * list set. The rendered headers are re-used only while the list is the
+ * same.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  struct curl_slist *first = NULL;
+  struct curl_slist *second = NULL;
+  char target[256];
+  int res = 0;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  first = curl_slist_append(first, "X-Custom: first");
+  if(first)
+    first = curl_slist_append(first, "Accept:");
+  second = curl_slist_append(second, "X-Custom: second");
+  if(!first || !second) {
+    fprintf(stderr, "curl_slist_append() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_HTTPHEADER, first);
+
+  for(i = 1; i <= 4; i++) {
+    if(i == 3) {
+      /* the head of the list stays the same */
+      if(curl_slist_append(first, "X-Appended: yes") != first) {
+        fprintf(stderr, "curl_slist_append() failed\n");
+        res = TEST_ERR_MAJOR_BAD;
+        goto test_cleanup;
+      }
+    }
+    else if(i == 4)
+      easy_setopt(curl, CURLOPT_HTTPHEADER, second);
+
+    snprintf(target, sizeof(target), "%s%04d", URL, i);
+    easy_setopt(curl, CURLOPT_URL, target);
+
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_slist_free_all(first);
+  curl_slist_free_all(second);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,62 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+/*
+ * Get the URL with its host name resolved by the name servers given in the
+ * second argument. Run with the URL "check" it tells if this libcurl can be
+ * made to use specific name servers at all.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  int res = 0;
+
+  if(!strcmp(URL, "check")) {
+    curl = curl_easy_init();
+    if(curl) {
+      if(curl_easy_setopt(curl, CURLOPT_DNS_SERVERS, "127.0.0.1") ==
+         CURLE_NOT_BUILT_IN)
+        printf("libcurl lacks CURLOPT_DNS_SERVERS support\n");
+      curl_easy_cleanup(curl);
+    }
+    return 0;
+  }
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_DNS_SERVERS, libtest_arg2);
+
+  res = curl_easy_perform(curl);
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
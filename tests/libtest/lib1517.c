@@ -0,0 +1,64 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+/*
+ * Get the URL twice over separate connections with failed name resolves
+ * remembered, and show how the DNS cache was used each time. The name servers
+ * to use can be given in the second argument.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  int res = 0;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+  easy_setopt(curl, CURLOPT_DNS_NEGATIVE_TIMEOUT, 60L);
+  if(libtest_arg2)
+    easy_setopt(curl, CURLOPT_DNS_SERVERS, libtest_arg2);
+
+  for(i = 0; i < 2; i++) {
+    long hits = -1;
+    long misses = -1;
+
+    res = curl_easy_perform(curl);
+
+    curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_HITS, &hits);
+    curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_MISSES, &misses);
+    printf("res %d hits %ld misses %ld\n", res, hits, misses);
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
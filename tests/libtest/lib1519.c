@@ -0,0 +1,140 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+/*
+ * Prefetch the "host:port" name given in the second argument, then get the
+ * URL with the name found in the DNS cache of the multi handle. Run with the
+ * URL "check" it tells if this libcurl can prefetch names at all.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  struct curl_slist *names = NULL;
+  CURLMsg *msg;
+  int still_running;
+  int msgs;
+  int prefetched = 0;
+  long hits = -1;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  if(!strcmp(URL, "check")) {
+    names = curl_slist_append(names, "127.0.0.1:1");
+    if(names && !curl_multi_prefetch(multi, names)) {
+      msg = curl_multi_info_read(multi, &msgs);
+      if(msg &&
+         (((struct curl_prefetch *)msg->data.whatever)->result ==
+          CURLE_NOT_BUILT_IN))
+        printf("libcurl lacks prefetch support\n");
+    }
+    goto test_cleanup;
+  }
+
+  names = curl_slist_append(names, "no-port-number");
+  if(names)
+    names = curl_slist_append(names, libtest_arg2);
+  if(!names) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  res = (int)curl_multi_prefetch(multi, names);
+  if(res)
+    goto test_cleanup;
+
+  /* wait for both names to be done */
+  while(prefetched < 2) {
+    int num;
+
+    multi_perform(multi, &still_running);
+
+    while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      struct curl_prefetch *p = msg->data.whatever;
+      if(msg->msg != CURLMSG_PREFETCH) {
+        res = TEST_ERR_MAJOR_BAD;
+        goto test_cleanup;
+      }
+      printf("prefetched %s: %d\n", p->name, (int)p->result);
+      prefetched++;
+    }
+
+    abort_on_test_timeout();
+
+    if(prefetched < 2) {
+      res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+      if(res)
+        goto test_cleanup;
+    }
+  }
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+
+  multi_add_handle(multi, curl);
+
+  do {
+    int num;
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+
+    if(still_running) {
+      res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+      if(res)
+        goto test_cleanup;
+    }
+  } while(still_running);
+
+  msg = curl_multi_info_read(multi, &msgs);
+  if(msg)
+    res = (int)msg->data.result;
+
+  curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_HITS, &hits);
+  printf("DNS cache hits: %ld\n", hits);
+
+test_cleanup:
+
+  if(curl) {
+    curl_multi_remove_handle(multi, curl);
+    curl_easy_cleanup(curl);
+  }
+  curl_multi_cleanup(multi);
+  curl_slist_free_all(names);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "memdebug.h"
+
+/*
+ * Get the URL twice with the SSL session file given in the second argument,
+ * each time with a new handle as a new process would, and tell how many of
+ * the handshakes resumed a session. Then count and time the handshakes of
+ * NUM_HANDLES such handles, without and with the file. Run with the URL
+ * "check" it tells if this libcurl can keep sessions in a file at all.
+ */
+
+#define NUM_HANDLES 10
+
+static int resumed;
+
+static int count_resumed(CURL *handle, curl_infotype type, char *data,
+                         size_t size, void *userp)
+{
+  (void)handle;
+  (void)userp;
+  if((type == CURLINFO_TEXT) && (size >= 23) &&
+     !memcmp(data, "SSL re-using session ID", 23))
+    resumed++;
+  return 0;
+}
+
+static size_t discard(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* get the URL with a handle of its own, the sessions are saved when the
+   handle is cleaned up */
+static int get(char *URL, const char *file)
+{
+  CURL *curl = NULL;
+  int res = 0;
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  if(file)
+    easy_setopt(curl, CURLOPT_SSL_SESSIONID_FILE, file);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, count_resumed);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+
+  res = (int)curl_easy_perform(curl);
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+
+  return res;
+}
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  struct timeval start;
+  int res = 0;
+  int i;
+  int n;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  if(!strcmp(URL, "check")) {
+    easy_init(curl);
+    if(curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_FILE, "x") ==
+       CURLE_NOT_BUILT_IN)
+      printf("libcurl lacks SSL session file support\n");
+    goto test_cleanup;
+  }
+
+  /* remove what an earlier run left */
+  remove(libtest_arg2);
+
+  for(i = 0; i < 2; i++) {
+    resumed = 0;
+    res = get(URL, libtest_arg2);
+    if(res)
+      goto test_cleanup;
+    printf("handshake %d resumed: %d\n", i + 1, resumed);
+  }
+
+  for(n = 0; n < 2; n++) {
+    const char *file = n ? libtest_arg2 : NULL;
+
+    remove(libtest_arg2);
+    resumed = 0;
+    start = tutil_tvnow();
+    for(i = 0; i < NUM_HANDLES; i++) {
+      res = get(URL, file);
+      if(res)
+        goto test_cleanup;
+    }
+    printf("%d handles %s the file: %d full handshakes, %d resumed\n",
+           NUM_HANDLES, file ? "with" : "without", NUM_HANDLES - resumed,
+           resumed);
+    fprintf(stderr, "%d handles %s the file in %ld ms\n", NUM_HANDLES,
+            file ? "with" : "without", tutil_tvdiff(tutil_tvnow(), start));
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,149 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "memdebug.h"
+
+/*
+ * Get the URL over three new connections with one handle and the CA
+ * certificates of the second argument, and tell how many of them used the
+ * SSL context made for the first one instead of loading the certificates
+ * again. A fourth connection, not verbose, must not trace the SSL messages
+ * like the connections that made the context did. Then count and time
+ * NUM_CONNECTIONS connections with a new context each and with the kept
+ * ones. Run with the URL "check" it tells if this libcurl keeps SSL
+ * contexts at all.
+ */
+
+#define NUM_CONNECTIONS 20
+
+static int reused;
+static int traced;
+
+static int count_reused(CURL *handle, curl_infotype type, char *data,
+                        size_t size, void *userp)
+{
+  (void)handle;
+  (void)userp;
+  if((type == CURLINFO_TEXT) && (size >= 20) &&
+     !memcmp(data, "SSL re-using context", 20))
+    reused++;
+  else if((type == CURLINFO_SSL_DATA_IN) || (type == CURLINFO_SSL_DATA_OUT))
+    traced++;
+  return 0;
+}
+
+static size_t discard(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/* a context function makes libcurl make a new context for every
+   connection, as it may change it */
+static CURLcode own_ctx(CURL *curl, void *sslctx, void *userp)
+{
+  (void)curl;
+  (void)sslctx;
+  (void)userp;
+  return CURLE_OK;
+}
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  struct timeval start;
+  long ms;
+  int res = 0;
+  int i;
+  int n;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  if(!strcmp(URL, "check")) {
+    /* the contexts are kept by OpenSSL builds only */
+    curl_version_info_data *ver = curl_version_info(CURLVERSION_NOW);
+    if(!ver->ssl_version || strncmp(ver->ssl_version, "OpenSSL", 7))
+      printf("libcurl does not keep SSL contexts\n");
+    goto test_cleanup;
+  }
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_CAINFO, libtest_arg2);
+  easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, count_reused);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+
+  for(i = 0; i < 3; i++) {
+    res = (int)curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+  }
+
+  printf("contexts reused: %d\n", reused);
+
+  easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+  traced = 0;
+  res = (int)curl_easy_perform(curl);
+  if(res)
+    goto test_cleanup;
+
+  printf("SSL messages traced when not verbose: %d\n", traced);
+
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  for(n = 0; n < 2; n++) {
+    if(n)
+      easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, NULL);
+    else
+      easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION, own_ctx);
+
+    reused = 0;
+    start = tutil_tvnow();
+    for(i = 0; i < NUM_CONNECTIONS; i++) {
+      res = (int)curl_easy_perform(curl);
+      if(res)
+        goto test_cleanup;
+    }
+    ms = tutil_tvdiff(tutil_tvnow(), start);
+
+    printf("%d connections %s: %d contexts reused\n", NUM_CONNECTIONS,
+           n ? "with kept contexts" : "with a new context each", reused);
+    fprintf(stderr, "%d connections %s in %ld ms, %ld connections/s\n",
+            NUM_CONNECTIONS,
+            n ? "with kept contexts" : "with a new context each", ms,
+            ms ? NUM_CONNECTIONS * 1000L / ms : 0L);
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,118 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+/*
+ * Get the URL through a tunnel in the HTTP proxy given in the second
+ * argument, a proxy that is slow to respond to the CONNECT. Get the FTP URL
+ * in the third argument at the same time, that must not have to wait for the
+ * proxy.
+ */
+int test(char *URL)
+{
+  CURL *tunnel = NULL;
+  CURL *ftp = NULL;
+  CURLM *multi = NULL;
+  CURLMsg *msg;
+  int still_running;
+  int msgs;
+  long longest = 0;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(tunnel);
+  easy_setopt(tunnel, CURLOPT_URL, URL);
+  easy_setopt(tunnel, CURLOPT_PROXY, libtest_arg2);
+  easy_setopt(tunnel, CURLOPT_HTTPPROXYTUNNEL, 1L);
+  easy_setopt(tunnel, CURLOPT_WRITEFUNCTION, discard);
+
+  easy_init(ftp);
+  easy_setopt(ftp, CURLOPT_URL, libtest_arg3);
+  easy_setopt(ftp, CURLOPT_WRITEFUNCTION, discard);
+
+  multi_init(multi);
+
+  multi_add_handle(multi, tunnel);
+  multi_add_handle(multi, ftp);
+
+  do {
+    struct timeval before;
+    long spent;
+    int num;
+
+    before = tutil_tvnow();
+    multi_perform(multi, &still_running);
+    spent = tutil_tvdiff(tutil_tvnow(), before);
+    if(spent > longest)
+      longest = spent;
+
+    while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      if(msg->msg == CURLMSG_DONE)
+        printf("%s done: %d\n", (msg->easy_handle == ftp)?"FTP":"tunnel",
+               (int)msg->data.result);
+    }
+
+    abort_on_test_timeout();
+
+    if(still_running) {
+      res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+      if(res)
+        goto test_cleanup;
+    }
+  } while(still_running);
+
+  if(longest < 1000)
+    printf("longest curl_multi_perform() under a second\n");
+  else
+    printf("curl_multi_perform() took %ld ms\n", longest);
+
+test_cleanup:
+
+  if(tunnel) {
+    curl_multi_remove_handle(multi, tunnel);
+    curl_easy_cleanup(tunnel);
+  }
+  if(ftp) {
+    curl_multi_remove_handle(multi, ftp);
+    curl_easy_cleanup(ftp);
+  }
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
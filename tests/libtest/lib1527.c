@@ -0,0 +1,82 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+static void show_tunnels(CURL *curl, int num)
+{
+  long tunnels = -1;
+  long reused = -1;
+
+  curl_easy_getinfo(curl, CURLINFO_NUM_TUNNELS, &tunnels);
+  curl_easy_getinfo(curl, CURLINFO_NUM_TUNNELS_REUSED, &reused);
+  printf("transfer %d: %ld tunnels, %ld reused\n", num, tunnels, reused);
+}
+
+/*
+ * Set up a tunnel to the URL in the HTTP proxy given in the second argument
+ * with CURLOPT_CONNECT_ONLY, then get the URL three times. The first two
+ * transfers go through the tunnel set up in advance, the third one uses
+ * proxy credentials and needs a tunnel of its own.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLcode res = CURLE_OK;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_PROXY, libtest_arg2);
+  easy_setopt(curl, CURLOPT_HTTPPROXYTUNNEL, 1L);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+
+  for(i = 0; i <= 3; i++) {
+    /* the first round only sets up the tunnel */
+    easy_setopt(curl, CURLOPT_CONNECT_ONLY, (i == 0)?1L:0L);
+    if(i == 3)
+      easy_setopt(curl, CURLOPT_PROXYUSERPWD, "user:secret");
+
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+
+    show_tunnels(curl, i);
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return (int)res;
+}
@@ -0,0 +1,112 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+
+#include "memdebug.h"
+
+/* TRUE when the data in the SYN of the latest connection was acked */
+static int syn_data;
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+static int closesocket_cb(void *clientp, curl_socket_t item)
+{
+#if defined(TCP_INFO) && defined(TCPI_OPT_SYN_DATA)
+  struct tcp_info info;
+  socklen_t len = sizeof(info);
+
+  if(!getsockopt(item, IPPROTO_TCP, TCP_INFO, (void *)&info, &len))
+    syn_data = (info.tcpi_options & TCPI_OPT_SYN_DATA)?1:0;
+#endif
+  (void)clientp;
+  return sclose(item);
+}
+
+/*
+ * Get the URL twice with TCP Fast Open on new connections. The first one
+ * gets a cookie from the server, if the system didn't have one already, the
+ * second one must then have its request sent in the SYN. Run with the URL
+ * "check" it tells if this system can do TCP Fast Open on the loopback
+ * interface.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLcode res = CURLE_OK;
+  int i;
+
+  if(!strcmp(URL, "check")) {
+    FILE *f = fopen("/proc/sys/net/ipv4/tcp_fastopen", "r");
+    int mode = 0;
+    if(!f || (fscanf(f, "%d", &mode) != 1) || ((mode & 3) != 3))
+      printf("the system doesn't do TCP Fast Open for clients and servers\n");
+    else {
+      curl = curl_easy_init();
+      if(curl) {
+        if(curl_easy_setopt(curl, CURLOPT_TCP_FASTOPEN, 1L) ==
+           CURLE_NOT_BUILT_IN)
+          printf("libcurl lacks CURLOPT_TCP_FASTOPEN support\n");
+        curl_easy_cleanup(curl);
+      }
+    }
+    if(f)
+      fclose(f);
+    return 0;
+  }
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_TCP_FASTOPEN, 1L);
+  easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_CLOSESOCKETFUNCTION, closesocket_cb);
+
+  for(i = 0; i < 2; i++) {
+    syn_data = 0;
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+  }
+
+  printf("data sent in the SYN: %s\n", syn_data?"yes":"no");
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return (int)res;
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "memdebug.h"
+
+/* connections timed after the ordering check */
+#define NUM_CONNECTIONS 100
+
+/* the local port range starts this far above the test servers' HTTP port,
+   so that runs with different base ports (runtests.pl -b) use different
+   ranges */
+#define PORT_OFFSET 1000
+
+/* the number of times a local port was found busy */
+static int failed_binds;
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+static int debug_cb(CURL *handle, curl_infotype type, char *data,
+                    size_t size, void *userp)
+{
+  static const char busy[] = "Bind to local port";
+  (void)handle;
+  (void)userp;
+  if((type == CURLINFO_TEXT) && (size >= sizeof(busy) - 1) &&
+     !memcmp(data, busy, sizeof(busy) - 1))
+    failed_binds++;
+  return 0;
+}
+
+/*
+ * Get the URL three times on new connections bound to a local port in a
+ * range above the HTTP server port given in the second argument. The ports
+ * of the closed connections are still busy, but the later connections must
+ * not have to try them: the search starts after the port used last.
+ *
+ * Then time NUM_CONNECTIONS more connections in the range, and as many with
+ * the port left to the kernel, and write the connect rates to stderr.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLcode res = CURLE_OK;
+  long port[3];
+  struct timeval start;
+  long ms;
+  int i;
+  int n;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_LOCALPORT, atol(libtest_arg2) + PORT_OFFSET);
+  easy_setopt(curl, CURLOPT_LOCALPORTRANGE, 5000L);
+  easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_cb);
+
+  for(i = 0; i < 3; i++) {
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+    curl_easy_getinfo(curl, CURLINFO_LOCAL_PORT, &port[i]);
+    if(!i)
+      /* ports still busy from an earlier run may be tried first */
+      failed_binds = 0;
+  }
+
+  printf("ports %s, %d failed binds after the first connection\n",
+         ((port[1] == port[0] + 1) && (port[2] == port[1] + 1))?
+         "in order":"out of order", failed_binds);
+
+  for(n = 0; n < 2; n++) {
+    if(n)
+      easy_setopt(curl, CURLOPT_LOCALPORT, 0L);
+
+    failed_binds = 0;
+    start = tutil_tvnow();
+    for(i = 0; i < NUM_CONNECTIONS; i++) {
+      res = curl_easy_perform(curl);
+      if(res)
+        goto test_cleanup;
+    }
+    ms = tutil_tvdiff(tutil_tvnow(), start);
+
+    printf("%d connections %s: %d failed binds\n", NUM_CONNECTIONS,
+           n ? "on any port" : "in the range", failed_binds);
+    fprintf(stderr, "%d connections %s in %ld ms, %ld connections/s\n",
+            NUM_CONNECTIONS, n ? "on any port" : "in the range", ms,
+            ms ? NUM_CONNECTIONS * 1000L / ms : 0L);
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return (int)res;
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+
+#include "memdebug.h"
+
+/* the socket of the transfer, and if TCP_QUICKACK was on when the last
+   piece of the response came */
+static curl_socket_t sock = CURL_SOCKET_BAD;
+static int quickack = -1;
+
+static int sockopt_cb(void *clientp, curl_socket_t curlfd,
+                      curlsocktype purpose)
+{
+  (void)clientp;
+  (void)purpose;
+  sock = curlfd;
+  return CURL_SOCKOPT_OK;
+}
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+#ifdef TCP_QUICKACK
+  int val = 0;
+  curl_socklen_t len = sizeof(val);
+
+  if(!getsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, (void *)&val, &len))
+    quickack = val;
+  val = 0;
+  setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, (void *)&val, sizeof(val));
+#endif
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+static void show_tuning(CURL *curl, const char *what)
+{
+  long rcvbuf = -1;
+  long sndbuf = -1;
+  long lowat = -1;
+  char *congestion = NULL;
+
+  curl_easy_getinfo(curl, CURLINFO_SOCK_RCVBUF, &rcvbuf);
+  curl_easy_getinfo(curl, CURLINFO_SOCK_SNDBUF, &sndbuf);
+  curl_easy_getinfo(curl, CURLINFO_TCP_NOTSENT_LOWAT, &lowat);
+  curl_easy_getinfo(curl, CURLINFO_TCP_CONGESTION, &congestion);
+
+  /* the system may make the buffers bigger than asked for */
+  printf("%s: rcvbuf %s, sndbuf %s, notsent_lowat %ld, congestion %s, "
+         "quickack %s\n", what,
+         (rcvbuf >= 65536)?"big":(rcvbuf?"small":"unknown"),
+         (sndbuf >= 65536)?"big":(sndbuf?"small":"unknown"),
+         lowat, congestion?congestion:"unknown",
+         (quickack > 0)?"on":(quickack?"unknown":"off"));
+}
+
+/*
+ * Get the URL on a socket with tuned buffers and TCP options, then on one
+ * that isn't tuned, and show what curl_easy_getinfo() says about them. Run
+ * with the URL "check" it tells if the system has the socket options.
+ *
+ * The response is read in small pieces and the write callback turns
+ * TCP_QUICKACK off after each of them, the way the system does on its own,
+ * so it is only on again for the next piece if libcurl set it after reading.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLcode res = CURLE_OK;
+
+  if(!strcmp(URL, "check")) {
+#if !defined(TCP_NOTSENT_LOWAT) || !defined(TCP_CONGESTION) || \
+  !defined(TCP_QUICKACK)
+    printf("the system lacks TCP_NOTSENT_LOWAT, TCP_CONGESTION or "
+           "TCP_QUICKACK\n");
+#endif
+    return 0;
+  }
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  easy_setopt(curl, CURLOPT_BUFFERSIZE, 16L);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_cb);
+  easy_setopt(curl, CURLOPT_SOCK_RCVBUF, 65536L);
+  easy_setopt(curl, CURLOPT_SOCK_SNDBUF, 65536L);
+  easy_setopt(curl, CURLOPT_TCP_NOTSENT_LOWAT, 16384L);
+  easy_setopt(curl, CURLOPT_TCP_CONGESTION, "reno");
+  easy_setopt(curl, CURLOPT_TCP_QUICKACK, 1L);
+
+  quickack = -1;
+  res = curl_easy_perform(curl);
+  if(res)
+    goto test_cleanup;
+  show_tuning(curl, "tuned");
+
+  easy_setopt(curl, CURLOPT_SOCK_RCVBUF, 0L);
+  easy_setopt(curl, CURLOPT_SOCK_SNDBUF, 0L);
+  easy_setopt(curl, CURLOPT_TCP_NOTSENT_LOWAT, 0L);
+  easy_setopt(curl, CURLOPT_TCP_CONGESTION, NULL);
+  easy_setopt(curl, CURLOPT_TCP_QUICKACK, 0L);
+
+  quickack = -1;
+  res = curl_easy_perform(curl);
+  if(res)
+    goto test_cleanup;
+  show_tuning(curl, "untuned");
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return (int)res;
+}
@@ -0,0 +1,324 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define MAX_SOCKETS 8
+
+static int closed;
+
+/* the sockets the socket callback was told to watch, and for what */
+struct watched {
+  curl_socket_t sockets[MAX_SOCKETS];
+  int actions[MAX_SOCKETS];
+  int count;
+};
+
+static int closesocket_cb(void *clientp, curl_socket_t item)
+{
+  (void)clientp;
+  closed++;
+  return sclose(item);
+}
+
+/* run the transfer of the easy handle to completion */
+static int transfer(CURLM *multi, CURL *curl)
+{
+  int still_running;
+  int res = 0;
+
+  multi_add_handle(multi, curl);
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = -1;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+test_cleanup:
+
+  curl_multi_remove_handle(multi, curl);
+
+  return res;
+}
+
+static int socket_cb(CURL *easy, curl_socket_t s, int action, void *userp,
+                     void *socketp)
+{
+  struct watched *w = userp;
+  int i;
+
+  (void)easy;
+  (void)socketp;
+
+  for(i = 0; i < w->count; i++)
+    if(w->sockets[i] == s)
+      break;
+
+  if(action == CURL_POLL_REMOVE) {
+    if(i < w->count) {
+      w->count--;
+      w->sockets[i] = w->sockets[w->count];
+      w->actions[i] = w->actions[w->count];
+    }
+  }
+  else if(i < w->count)
+    w->actions[i] = action;
+  else if(w->count < MAX_SOCKETS) {
+    w->sockets[w->count] = s;
+    w->actions[w->count++] = action;
+  }
+  return 0;
+}
+
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+  long *timeout = userp;
+  (void)multi;
+  *timeout = timeout_ms;
+  return 0;
+}
+
+/*
+ * Wait for activity on the sockets handed to the socket callback, or for
+ * the timeout given to the timer callback, and tell libcurl about it.
+ */
+static int drive(CURLM *multi, struct watched *w, long *timeout,
+                 int *running)
+{
+  struct timeval tv;
+  fd_set rd, wr;
+  int maxfd = -1;
+  int rc;
+  int i;
+
+  FD_ZERO(&rd);
+  FD_ZERO(&wr);
+  for(i = 0; i < w->count; i++) {
+    if(w->actions[i] & CURL_POLL_IN)
+      FD_SET(w->sockets[i], &rd);
+    if(w->actions[i] & CURL_POLL_OUT)
+      FD_SET(w->sockets[i], &wr);
+    if((int)w->sockets[i] > maxfd)
+      maxfd = (int)w->sockets[i];
+  }
+
+  if((*timeout < 0) || (*timeout > 1000))
+    *timeout = 1000;
+  tv.tv_sec = *timeout / 1000;
+  tv.tv_usec = (*timeout % 1000) * 1000;
+
+  rc = select_wrapper(maxfd + 1, &rd, &wr, NULL, &tv);
+  if(rc < 0)
+    return TEST_ERR_MAJOR_BAD;
+
+  if(!rc) {
+    *timeout = -1;
+    return (int)curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0,
+                                         running);
+  }
+
+  for(i = 0; i < w->count; i++) {
+    curl_socket_t s = w->sockets[i];
+    int ev = (FD_ISSET(s, &rd) ? CURL_CSELECT_IN : 0) |
+      (FD_ISSET(s, &wr) ? CURL_CSELECT_OUT : 0);
+    if(ev)
+      /* the callback may change the array, one socket per round */
+      return (int)curl_multi_socket_action(multi, s, ev, running);
+  }
+  return 0;
+}
+
+/* run the transfer of the easy handle to completion with the socket API */
+static int socket_transfer(CURLM *multi, CURL *curl, struct watched *w,
+                           long *timeout)
+{
+  int running = 0;
+  int res = 0;
+
+  multi_add_handle(multi, curl);
+
+  res = (int)curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0,
+                                      &running);
+  while(!res && running) {
+    abort_on_test_timeout();
+    res = drive(multi, w, timeout, &running);
+  }
+
+test_cleanup:
+
+  curl_multi_remove_handle(multi, curl);
+
+  return res;
+}
+
+/* the number of sockets the socket callback was told to wait on for
+   reading only, like those of idle connections */
+static int idle_sockets(struct watched *w)
+{
+  int num = 0;
+  int i;
+  for(i = 0; i < w->count; i++)
+    if(w->actions[i] == CURL_POLL_IN)
+      num++;
+  return num;
+}
+
+/* wait with only the idle connection left in the cache */
+static int idle_wait(CURLM *multi, int timeout_ms)
+{
+  int num = -1;
+  int res = (int)curl_multi_wait(multi, NULL, 0, timeout_ms, &num);
+  if(res != CURLM_OK) {
+    printf("curl_multi_wait() returned %d\n", res);
+    return -1;
+  }
+  printf("idle wait: %d fds, %d connection(s) closed\n", num, closed);
+  return 0;
+}
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  CURLM *sockmulti = NULL;
+  struct watched w;
+  long timeout = -1;
+  int running = 0;
+  char target_url[256];
+  long connects = -1;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_CLOSESOCKETFUNCTION, closesocket_cb);
+
+  /* the server closes this connection behind our back */
+  sprintf(target_url, "%s0001", URL);
+  easy_setopt(curl, CURLOPT_URL, target_url);
+  res = transfer(multi, curl);
+  if(res)
+    goto test_cleanup;
+
+  /* the hang up is noticed while waiting and the connection is closed */
+  res = idle_wait(multi, TEST_HANG_TIMEOUT);
+  if(res)
+    goto test_cleanup;
+
+  /* this connection is kept alive by the server */
+  sprintf(target_url, "%s0002", URL);
+  easy_setopt(curl, CURLOPT_URL, target_url);
+  res = transfer(multi, curl);
+  if(res)
+    goto test_cleanup;
+
+  res = idle_wait(multi, 100);
+  if(res)
+    goto test_cleanup;
+
+  /* and reused */
+  sprintf(target_url, "%s0003", URL);
+  easy_setopt(curl, CURLOPT_URL, target_url);
+  res = transfer(multi, curl);
+  if(res)
+    goto test_cleanup;
+
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  printf("new connections for the last transfer: %ld\n", connects);
+
+  /* the same again with the socket API: the sockets of idle connections are
+     passed to the socket callback, and the hang up is noticed on them */
+  memset(&w, 0, sizeof(w));
+  multi_init(sockmulti);
+  multi_setopt(sockmulti, CURLMOPT_SOCKETFUNCTION, socket_cb);
+  multi_setopt(sockmulti, CURLMOPT_SOCKETDATA, &w);
+  multi_setopt(sockmulti, CURLMOPT_TIMERFUNCTION, timer_cb);
+  multi_setopt(sockmulti, CURLMOPT_TIMERDATA, &timeout);
+
+  sprintf(target_url, "%s0004", URL);
+  easy_setopt(curl, CURLOPT_URL, target_url);
+  res = socket_transfer(sockmulti, curl, &w, &timeout);
+  if(res)
+    goto test_cleanup;
+  printf("idle sockets watched: %d\n", idle_sockets(&w));
+
+  while(w.count) {
+    abort_on_test_timeout();
+    res = drive(sockmulti, &w, &timeout, &running);
+    if(res)
+      goto test_cleanup;
+  }
+  printf("idle sockets watched after the hang up: %d, "
+         "%d connection(s) closed\n", w.count, closed);
+
+  sprintf(target_url, "%s0005", URL);
+  easy_setopt(curl, CURLOPT_URL, target_url);
+  res = socket_transfer(sockmulti, curl, &w, &timeout);
+  if(res)
+    goto test_cleanup;
+  printf("idle sockets watched: %d\n", idle_sockets(&w));
+
+  sprintf(target_url, "%s0006", URL);
+  easy_setopt(curl, CURLOPT_URL, target_url);
+  res = socket_transfer(sockmulti, curl, &w, &timeout);
+  if(res)
+    goto test_cleanup;
+
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  printf("new connections for the last transfer: %ld\n", connects);
+
+test_cleanup:
+
+  /* proper cleanup sequence - type PA */
+
+  curl_easy_cleanup(curl);
+  curl_multi_cleanup(sockmulti);
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
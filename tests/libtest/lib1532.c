@@ -0,0 +1,200 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 4
+
+static const char upload_data[] =
+  "fifty bytes to upload, five times the send limit!\n";
+
+struct uploadthis {
+  const char *readptr;
+  size_t left;
+};
+
+static size_t read_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  struct uploadthis *up = (struct uploadthis *)userp;
+  size_t len = size * nmemb;
+
+  if(len > up->left)
+    len = up->left;
+  memcpy(ptr, up->readptr, len);
+  up->readptr += len;
+  up->left -= len;
+  return len;
+}
+
+static size_t discard(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+static void show_group(CURLM *multi, long group, const char *what)
+{
+  struct curl_rategroup_stats stats;
+
+  curl_multi_rategroup_stats(multi, group, &stats);
+  printf("%s: sent %" CURL_FORMAT_CURL_OFF_T ", received %"
+         CURL_FORMAT_CURL_OFF_T ", held back: %s\n", what, stats.sent,
+         stats.received, stats.waits ? "yes" : "no");
+}
+
+/* run the transfers added to the multi handle to completion */
+static int run(CURLM *multi)
+{
+  int still_running;
+  int res = 0;
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    /* held back transfers have no sockets to wait for, only a timeout */
+    res = (int)curl_multi_wait(multi, NULL, 0, 100, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = -1;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+test_cleanup:
+
+  return res;
+}
+
+/*
+ * Two transfers in group 1, which may receive 100 bytes per second, and one
+ * in group 2, which has no limits, all at once. The first group 1 transfer to
+ * get its response uses up the limit, so the other one is held back.
+ *
+ * Then an upload in group 3, which may send 10 bytes per second, of 50
+ * bytes. The upload leaves the group in debt for seconds, but that must not
+ * hold back the download of the response.
+ */
+int test(char *URL)
+{
+  CURL *curl[NUM_HANDLES];
+  CURLM *multi = NULL;
+  char target_url[256];
+  struct uploadthis up;
+  struct timeval start;
+  long ms;
+  int res = 0;
+  int i;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curl[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  /* no limits for all of them and group 2, just the counters */
+  res = (int)curl_multi_rategroup(multi, 0, 0, 0);
+  if(!res)
+    res = (int)curl_multi_rategroup(multi, 1, 0, 100);
+  if(!res)
+    res = (int)curl_multi_rategroup(multi, 2, 0, 0);
+  if(res)
+    goto test_cleanup;
+
+  for(i = 0; i < NUM_HANDLES - 1; i++) {
+    easy_init(curl[i]);
+    sprintf(target_url, "%s%04i", URL, i + 1);
+    easy_setopt(curl[i], CURLOPT_URL, target_url);
+    easy_setopt(curl[i], CURLOPT_WRITEFUNCTION, discard);
+    easy_setopt(curl[i], CURLOPT_RATE_GROUP, (i < 2) ? 1L : 2L);
+    multi_add_handle(multi, curl[i]);
+  }
+
+  res = run(multi);
+  if(res)
+    goto test_cleanup;
+
+  show_group(multi, 1, "group 1");
+  show_group(multi, 2, "group 2");
+  show_group(multi, 0, "all");
+  show_group(multi, 3, "group 3");
+
+  res = (int)curl_multi_rategroup(multi, 3, 10, 0);
+  if(res)
+    goto test_cleanup;
+
+  up.readptr = upload_data;
+  up.left = strlen(upload_data);
+
+  easy_init(curl[i]);
+  sprintf(target_url, "%s%04i", URL, i + 1);
+  easy_setopt(curl[i], CURLOPT_URL, target_url);
+  easy_setopt(curl[i], CURLOPT_UPLOAD, 1L);
+  easy_setopt(curl[i], CURLOPT_INFILESIZE, (long)up.left);
+  easy_setopt(curl[i], CURLOPT_READFUNCTION, read_cb);
+  easy_setopt(curl[i], CURLOPT_READDATA, &up);
+  easy_setopt(curl[i], CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl[i], CURLOPT_RATE_GROUP, 3L);
+  multi_add_handle(multi, curl[i]);
+
+  start = tutil_tvnow();
+  res = run(multi);
+  if(res)
+    goto test_cleanup;
+  ms = tutil_tvdiff(tutil_tvnow(), start);
+
+  show_group(multi, 3, "group 3");
+  /* the debt is paid back after some five seconds */
+  printf("response held back by the send limit: %s\n",
+         (ms >= 2000) ? "yes" : "no");
+
+test_cleanup:
+
+  /* proper cleanup sequence - type PB */
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curl[i]);
+    curl_easy_cleanup(curl[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,246 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 3
+
+#define MAX_SOCKETS 8
+
+/* the sockets the socket callback was told to watch, and for what */
+struct watched {
+  curl_socket_t sockets[MAX_SOCKETS];
+  int actions[MAX_SOCKETS];
+  int count;
+};
+
+static int socket_cb(CURL *easy, curl_socket_t s, int action, void *userp,
+                     void *socketp)
+{
+  struct watched *w = userp;
+  int i;
+
+  (void)easy;
+  (void)socketp;
+
+  for(i = 0; i < w->count; i++)
+    if(w->sockets[i] == s)
+      break;
+
+  if(action == CURL_POLL_REMOVE) {
+    if(i < w->count) {
+      w->count--;
+      w->sockets[i] = w->sockets[w->count];
+      w->actions[i] = w->actions[w->count];
+    }
+  }
+  else if(i < w->count)
+    w->actions[i] = action;
+  else if(w->count < MAX_SOCKETS) {
+    w->sockets[w->count] = s;
+    w->actions[w->count++] = action;
+  }
+  return 0;
+}
+
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+  long *timeout = userp;
+  (void)multi;
+  *timeout = timeout_ms;
+  return 0;
+}
+
+/*
+ * Wait for activity on the sockets handed to the socket callback, or for
+ * the timeout given to the timer callback, and tell libcurl about it.
+ */
+static int drive(CURLM *multi, struct watched *w, long *timeout,
+                 int *running)
+{
+  struct timeval tv;
+  fd_set rd, wr;
+  int maxfd = -1;
+  int rc;
+  int i;
+
+  FD_ZERO(&rd);
+  FD_ZERO(&wr);
+  for(i = 0; i < w->count; i++) {
+    if(w->actions[i] & CURL_POLL_IN)
+      FD_SET(w->sockets[i], &rd);
+    if(w->actions[i] & CURL_POLL_OUT)
+      FD_SET(w->sockets[i], &wr);
+    if((int)w->sockets[i] > maxfd)
+      maxfd = (int)w->sockets[i];
+  }
+
+  if((*timeout < 0) || (*timeout > 1000))
+    *timeout = 1000;
+  tv.tv_sec = *timeout / 1000;
+  tv.tv_usec = (*timeout % 1000) * 1000;
+
+  rc = select_wrapper(maxfd + 1, &rd, &wr, NULL, &tv);
+  if(rc < 0)
+    return TEST_ERR_MAJOR_BAD;
+
+  if(!rc) {
+    *timeout = -1;
+    return (int)curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0,
+                                         running);
+  }
+
+  for(i = 0; i < w->count; i++) {
+    curl_socket_t s = w->sockets[i];
+    int ev = (FD_ISSET(s, &rd) ? CURL_CSELECT_IN : 0) |
+      (FD_ISSET(s, &wr) ? CURL_CSELECT_OUT : 0);
+    if(ev)
+      /* the callback may change the array, one socket per round */
+      return (int)curl_multi_socket_action(multi, s, ev, running);
+  }
+  return 0;
+}
+
+/* add the transfers, the last one of a higher priority */
+static int add_transfers(CURLM *multi, CURL **curl, const char *URL,
+                         int first)
+{
+  char target_url[256];
+  int res = 0;
+  int i;
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    easy_init(curl[i]);
+    sprintf(target_url, "%s%04i", URL, first + i);
+    easy_setopt(curl[i], CURLOPT_URL, target_url);
+    if(i == NUM_HANDLES - 1)
+      easy_setopt(curl[i], CURLOPT_PRIORITY, 10L);
+    multi_add_handle(multi, curl[i]);
+  }
+
+test_cleanup:
+
+  return res;
+}
+
+/*
+ * Two transfers of the default priority and then one of a higher priority
+ * are added to a multi handle that may only have one connection to the
+ * host. The one of the higher priority is done first, then the others in
+ * the order they were added.
+ *
+ * Then the same with the socket API, where the timers of all three expire
+ * at once.
+ */
+int test(char *URL)
+{
+  CURL *curl[NUM_HANDLES];
+  CURLM *multi = NULL;
+  CURLM *sockmulti = NULL;
+  struct watched w;
+  long timeout = -1;
+  int still_running;
+  int res = 0;
+  int i;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curl[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+
+  res = add_transfers(multi, curl, URL, 1);
+  if(res)
+    goto test_cleanup;
+
+  multi_perform(multi, &still_running);
+
+  abort_on_test_timeout();
+
+  while(still_running) {
+    int num;
+    res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+    if(res != CURLM_OK) {
+      printf("curl_multi_wait() returned %d\n", res);
+      res = -1;
+      goto test_cleanup;
+    }
+
+    abort_on_test_timeout();
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+  }
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curl[i]);
+    curl_easy_cleanup(curl[i]);
+    curl[i] = NULL;
+  }
+
+  memset(&w, 0, sizeof(w));
+
+  multi_init(sockmulti);
+
+  multi_setopt(sockmulti, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+  multi_setopt(sockmulti, CURLMOPT_SOCKETFUNCTION, socket_cb);
+  multi_setopt(sockmulti, CURLMOPT_SOCKETDATA, &w);
+  multi_setopt(sockmulti, CURLMOPT_TIMERFUNCTION, timer_cb);
+  multi_setopt(sockmulti, CURLMOPT_TIMERDATA, &timeout);
+
+  res = add_transfers(sockmulti, curl, URL, NUM_HANDLES + 1);
+  if(res)
+    goto test_cleanup;
+
+  res = (int)curl_multi_socket_action(sockmulti, CURL_SOCKET_TIMEOUT, 0,
+                                      &still_running);
+  while(!res && still_running) {
+    abort_on_test_timeout();
+    res = drive(sockmulti, &w, &timeout, &still_running);
+  }
+
+test_cleanup:
+
+  /* proper cleanup sequence - type PB */
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(sockmulti ? sockmulti : multi, curl[i]);
+    curl_easy_cleanup(curl[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  curl_multi_cleanup(sockmulti);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,198 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef __linux__
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0)
+/* the count of the TCP segments with data sent came with Linux 4.6 */
+#include <linux/tcp.h>
+#define HAVE_TCPI_DATA_SEGS_OUT 1
+#endif
+#endif
+
+#include "testutil.h"
+#include "memdebug.h"
+
+static const char *post[]={
+  "one",
+  "two",
+  "three",
+  "and a final longer crap: four",
+  NULL
+};
+
+struct WriteThis {
+  int counter;
+};
+
+static int sends = 0;
+
+/* the socket of the transfer, when the request headers were sent and how
+   long it took until the response came */
+static curl_socket_t sock = CURL_SOCKET_BAD;
+static struct timeval headers_sent;
+static long response_ms = -1;
+
+static int sockopt_cb(void *clientp, curl_socket_t curlfd,
+                      curlsocktype purpose)
+{
+  (void)clientp;
+  (void)purpose;
+  sock = curlfd;
+  return CURL_SOCKOPT_OK;
+}
+
+/* the number of TCP segments with data sent on the socket so far, the TLS
+   handshake included, -1 if unknown */
+static long segments_sent(void)
+{
+#ifdef HAVE_TCPI_DATA_SEGS_OUT
+  struct tcp_info info;
+  curl_socklen_t len = sizeof(info);
+
+  if(!getsockopt(sock, IPPROTO_TCP, TCP_INFO, (void *)&info, &len))
+    return (long)info.tcpi_data_segs_out;
+#endif
+  return -1;
+}
+
+static size_t read_callback(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+  struct WriteThis *pooh = (struct WriteThis *)userp;
+  const char *data;
+
+  if(size*nmemb < 1)
+    return 0;
+
+  data = post[pooh->counter];
+
+  if(data) {
+    size_t len = strlen(data);
+    memcpy(ptr, data, len);
+    pooh->counter++; /* advance pointer */
+    return len;
+  }
+  return 0;                         /* no more data left to deliver */
+}
+
+/* every send of upload data is passed to the debug callback once, and
+   each is one TLS record */
+static int debug_callback(CURL *handle, curl_infotype type, char *data,
+                          size_t size, void *userp)
+{
+  (void)handle;
+  (void)data;
+  (void)size;
+  (void)userp;
+
+  if(type == CURLINFO_HEADER_OUT)
+    headers_sent = tutil_tvnow();
+  else if(type == CURLINFO_DATA_OUT)
+    sends++;
+  else if((type == CURLINFO_HEADER_IN) && (response_ms < 0))
+    response_ms = tutil_tvdiff(tutil_tvnow(), headers_sent);
+
+  return 0;
+}
+
+/*
+ * The pieces handed over by the read callback, and the chunks made of them,
+ * are sent in one go on a TLS connection.
+ *
+ * The TLS records the body took, the TCP segments with data sent on the
+ * connection, and the time from the request headers to the response go to
+ * stderr.
+ */
+int test(char *URL)
+{
+  CURL *curl;
+  CURLcode res=CURLE_OK;
+  struct curl_slist *slist = NULL;
+  struct WriteThis pooh;
+  pooh.counter = 0;
+
+  if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) {
+    fprintf(stderr, "curl_global_init() failed\n");
+    return TEST_ERR_MAJOR_BAD;
+  }
+
+  if ((curl = curl_easy_init()) == NULL) {
+    fprintf(stderr, "curl_easy_init() failed\n");
+    curl_global_cleanup();
+    return TEST_ERR_MAJOR_BAD;
+  }
+
+  slist = curl_slist_append(slist, "Transfer-Encoding: chunked");
+  if(slist)
+    slist = curl_slist_append(slist, "Expect:");
+  if (slist == NULL) {
+    fprintf(stderr, "curl_slist_append() failed\n");
+    curl_easy_cleanup(curl);
+    curl_global_cleanup();
+    return TEST_ERR_MAJOR_BAD;
+  }
+
+  test_setopt(curl, CURLOPT_URL, URL);
+  test_setopt(curl, CURLOPT_POST, 1L);
+  test_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  test_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+
+#ifdef CURL_DOES_CONVERSIONS
+  /* Convert the POST data to ASCII */
+  test_setopt(curl, CURLOPT_TRANSFERTEXT, 1L);
+#endif
+
+  test_setopt(curl, CURLOPT_READFUNCTION, read_callback);
+  test_setopt(curl, CURLOPT_INFILE, &pooh);
+  test_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_callback);
+  test_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_cb);
+  /* every record is a segment of its own then, Nagle's algorithm would
+     rather hold the records back until the previous segment is acked */
+  test_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+  test_setopt(curl, CURLOPT_VERBOSE, 1L);
+  test_setopt(curl, CURLOPT_HTTPHEADER, slist);
+
+  res = curl_easy_perform(curl);
+
+  printf("upload data sent in %d send(s)\n", sends);
+  fprintf(stderr, "upload body: %d TLS record(s)\n", sends);
+  fprintf(stderr, "connection: %ld TCP segment(s) with data\n",
+          segments_sent());
+  fprintf(stderr, "response: %ld ms after the request headers\n",
+          response_ms);
+
+test_cleanup:
+
+  /* clean up the headers list */
+  if(slist)
+    curl_slist_free_all(slist);
+
+  /* always cleanup */
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
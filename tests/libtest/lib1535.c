@@ -0,0 +1,102 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+static int progress_calls = 0;
+
+static int progress_callback(void *clientp, double dltotal, double dlnow,
+                             double ultotal, double ulnow)
+{
+  (void)clientp;
+  (void)dltotal;
+  (void)dlnow;
+  (void)ultotal;
+  (void)ulnow;
+  progress_calls++;
+  return 0;
+}
+
+/*
+ * Three transfers of the same URL sharing a HTTP cache. The second one is
+ * served from the cache and is finished like one that went to the server:
+ * the file time is taken from the stored Last-Modified: header and the
+ * progress callback gets its final call. The third one sends a cookie and
+ * must not be served a response stored for a request without one.
+ */
+int test(char *URL)
+{
+  int res = 0;
+  CURL *curl = NULL;
+  CURLSH *share = NULL;
+  long outcome;
+  long filetime;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  share = curl_share_init();
+  if(!share) {
+    fprintf(stderr, "curl_share_init() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  if(curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_HTTP_CACHE)) {
+    fprintf(stderr, "curl_share_setopt() failed\n");
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  for(i = 0; i < 3; i++) {
+    easy_init(curl);
+    easy_setopt(curl, CURLOPT_URL, URL);
+    easy_setopt(curl, CURLOPT_SHARE, share);
+    easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    easy_setopt(curl, CURLOPT_PROGRESSFUNCTION, progress_callback);
+    if(i == 2)
+      easy_setopt(curl, CURLOPT_COOKIE, "tasty=yes");
+
+    progress_calls = 0;
+    res = curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+
+    curl_easy_getinfo(curl, CURLINFO_HTTP_CACHE, &outcome);
+    curl_easy_getinfo(curl, CURLINFO_FILETIME, &filetime);
+    printf("transfer %d: cache outcome %ld, filetime %ld, progress %s\n",
+           i + 1, outcome, filetime, progress_calls ? "called" : "silent");
+
+    curl_easy_cleanup(curl);
+    curl = NULL;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_share_cleanup(share);
+  curl_global_cleanup();
+
+  return res;
+}
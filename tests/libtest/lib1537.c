@@ -0,0 +1,146 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+/*
+ * Prefetch the "host:port" name given in the second argument while a handle
+ * using a shared DNS cache is in the multi handle, then get the URL with
+ * another handle of the same share. The name is to be found in the shared
+ * cache.
+ */
+int test(char *URL)
+{
+  CURL *idle = NULL;
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  CURLSH *share = NULL;
+  struct curl_slist *names = NULL;
+  CURLMsg *msg;
+  int still_running;
+  int msgs;
+  int prefetched = 0;
+  long hits = -1;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  share = curl_share_init();
+  if(!share) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+
+  multi_init(multi);
+
+  /* this one only makes the shared cache one of the multi handle, it has
+     no URL and is done at once */
+  easy_init(idle);
+  easy_setopt(idle, CURLOPT_SHARE, share);
+  multi_add_handle(multi, idle);
+
+  names = curl_slist_append(names, libtest_arg2);
+  if(!names) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  res = (int)curl_multi_prefetch(multi, names);
+  if(res)
+    goto test_cleanup;
+
+  while(!prefetched) {
+    int num;
+
+    multi_perform(multi, &still_running);
+
+    while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      struct curl_prefetch *p = msg->data.whatever;
+      if(msg->msg != CURLMSG_PREFETCH)
+        /* the idle handle */
+        continue;
+      printf("prefetched %s: %d\n", p->name, (int)p->result);
+      prefetched++;
+    }
+
+    abort_on_test_timeout();
+
+    if(!prefetched) {
+      res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+      if(res)
+        goto test_cleanup;
+    }
+  }
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_SHARE, share);
+
+  multi_add_handle(multi, curl);
+
+  do {
+    int num;
+
+    multi_perform(multi, &still_running);
+
+    abort_on_test_timeout();
+
+    if(still_running) {
+      res = (int)curl_multi_wait(multi, NULL, 0, TEST_HANG_TIMEOUT, &num);
+      if(res)
+        goto test_cleanup;
+    }
+  } while(still_running);
+
+  while((msg = curl_multi_info_read(multi, &msgs)) != NULL)
+    if(msg->easy_handle == curl)
+      res = (int)msg->data.result;
+
+  curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_HITS, &hits);
+  printf("DNS cache hits: %ld\n", hits);
+
+test_cleanup:
+
+  if(curl) {
+    curl_multi_remove_handle(multi, curl);
+    curl_easy_cleanup(curl);
+  }
+  if(idle) {
+    curl_multi_remove_handle(multi, idle);
+    curl_easy_cleanup(idle);
+  }
+  curl_multi_cleanup(multi);
+  curl_share_cleanup(share);
+  curl_slist_free_all(names);
+  curl_global_cleanup();
+
+  return res;
+}
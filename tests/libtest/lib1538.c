@@ -0,0 +1,100 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+/*
+ * Get the URL twice with the SSL sessions in a share, then twice more after
+ * the share is unset again, and tell which of the handshakes resumed a
+ * session. Every transfer uses a new connection.
+ */
+
+static int resumed;
+
+static int count_resumed(CURL *handle, curl_infotype type, char *data,
+                         size_t size, void *userp)
+{
+  (void)handle;
+  (void)userp;
+  if((type == CURLINFO_TEXT) && (size >= 23) &&
+     !memcmp(data, "SSL re-using session ID", 23))
+    resumed++;
+  return 0;
+}
+
+static size_t discard(void *ptr, size_t size, size_t nmemb, void *userp)
+{
+  (void)ptr;
+  (void)userp;
+  return size * nmemb;
+}
+
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLSH *share = NULL;
+  int res = 0;
+  int i;
+
+  global_init(CURL_GLOBAL_ALL);
+
+  share = curl_share_init();
+  if(!share) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+  easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+  easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, count_resumed);
+  easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+  easy_setopt(curl, CURLOPT_SHARE, share);
+
+  for(i = 0; i < 4; i++) {
+    if(i == 2)
+      /* the handle gets a session cache of its own again */
+      easy_setopt(curl, CURLOPT_SHARE, NULL);
+
+    resumed = 0;
+    res = (int)curl_easy_perform(curl);
+    if(res)
+      goto test_cleanup;
+
+    printf("handshake %d %s resumed: %d\n", i + 1,
+           (i < 2) ? "shared" : "unshared", resumed);
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_share_cleanup(share);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,107 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "memdebug.h"
+
+static int asked; /* lookups started with the name servers */
+
+static int debug_cb(CURL *handle, curl_infotype type, char *data,
+                    size_t size, void *userp)
+{
+  (void)handle;
+  (void)userp;
+  if((type == CURLINFO_TEXT) && (size > 15) &&
+     !memcmp(data, "Asking DNS for ", 15))
+    asked++;
+  return 0;
+}
+
+static void sleep_ms(int ms)
+{
+  struct timeval tv;
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  select_wrapper(0, NULL, NULL, NULL, &tv);
+}
+
+/*
+ * Get the URL with its host name resolved by the name servers given in the
+ * second argument, which answer with records that live for a second. The
+ * outdated entry is used while it is refreshed in the background, and the
+ * refreshed entry expires with its records again. Run with the URL "check"
+ * it tells if this libcurl can be made to use specific name servers at all.
+ */
+int test(char *URL)
+{
+  /* milliseconds to wait before each transfer */
+  static const int pause[] = { 0, 1500, 500, 1500 };
+  CURL *curl = NULL;
+  int res = 0;
+  int i;
+
+  if(!strcmp(URL, "check")) {
+    curl = curl_easy_init();
+    if(curl) {
+      if(curl_easy_setopt(curl, CURLOPT_DNS_SERVERS, "127.0.0.1") ==
+         CURLE_NOT_BUILT_IN)
+        printf("libcurl lacks CURLOPT_DNS_SERVERS support\n");
+      curl_easy_cleanup(curl);
+    }
+    return 0;
+  }
+
+  global_init(CURL_GLOBAL_ALL);
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+  easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+  easy_setopt(curl, CURLOPT_DNS_SERVERS, libtest_arg2);
+  easy_setopt(curl, CURLOPT_DNS_CACHE_STALE, 60L);
+  easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debug_cb);
+  easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+
+  for(i = 0; i < (int)(sizeof(pause)/sizeof(pause[0])); i++) {
+    long hits = -1;
+    long stale = -1;
+    long misses = -1;
+
+    sleep_ms(pause[i]);
+    res = curl_easy_perform(curl);
+
+    curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_HITS, &hits);
+    curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_STALE, &stale);
+    curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_MISSES, &misses);
+    printf("res %d hits %ld stale %ld misses %ld asked %d\n", res, hits,
+           stale, misses, asked);
+    if(res)
+      break;
+  }
+
+test_cleanup:
+
+  curl_easy_cleanup(curl);
+  curl_global_cleanup();
+
+  return res;
+}
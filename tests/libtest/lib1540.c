@@ -0,0 +1,233 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define MAX_SOCKETS 8
+
+struct watched {
+  curl_socket_t sockets[MAX_SOCKETS];
+  int count;
+  int added; /* number of sockets ever added */
+};
+
+static int socket_cb(CURL *easy, curl_socket_t s, int action, void *userp,
+                     void *socketp)
+{
+  struct watched *w = userp;
+  int i;
+
+  (void)easy;
+  (void)socketp;
+
+  for(i = 0; i < w->count; i++)
+    if(w->sockets[i] == s)
+      break;
+
+  if(action == CURL_POLL_REMOVE) {
+    if(i < w->count)
+      w->sockets[i] = w->sockets[--w->count];
+  }
+  else if((i == w->count) && (w->count < MAX_SOCKETS)) {
+    w->sockets[w->count++] = s;
+    w->added++;
+  }
+  return 0;
+}
+
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+  long *timeout = userp;
+  (void)multi;
+  *timeout = timeout_ms;
+  return 0;
+}
+
+/*
+ * Wait for activity on the sockets handed to the socket callback, or for
+ * the timeout given to the timer callback, and tell libcurl about it.
+ */
+static int drive(CURLM *multi, struct watched *w, long *timeout,
+                 int *running)
+{
+  struct timeval tv;
+  fd_set fds;
+  int maxfd = -1;
+  int rc;
+  int i;
+
+  FD_ZERO(&fds);
+  for(i = 0; i < w->count; i++) {
+    FD_SET(w->sockets[i], &fds);
+    if((int)w->sockets[i] > maxfd)
+      maxfd = (int)w->sockets[i];
+  }
+
+  if((*timeout < 0) || (*timeout > 1000))
+    *timeout = 1000;
+  tv.tv_sec = *timeout / 1000;
+  tv.tv_usec = (*timeout % 1000) * 1000;
+
+  rc = select_wrapper(maxfd + 1, &fds, NULL, NULL, &tv);
+  if(rc < 0)
+    return TEST_ERR_MAJOR_BAD;
+
+  if(!rc) {
+    *timeout = -1;
+    return (int)curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0,
+                                         running);
+  }
+
+  for(i = 0; i < w->count; i++) {
+    curl_socket_t s = w->sockets[i];
+    if(FD_ISSET(s, &fds)) {
+      rc = (int)curl_multi_socket_action(multi, s, CURL_CSELECT_IN,
+                                         running);
+      if(rc)
+        return rc;
+      /* the callback may have changed the array */
+      break;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Prefetch the "host:port" name given in the third argument with the name
+ * servers given in the second argument, driven by the socket callback API.
+ * The servers drop the first query, so the lookup has to be waited for on
+ * its socket and retried on the timer. Then get the URL with the name found in the DNS cache of the multi handle.
+ * Run with the URL "check" it tells if this libcurl can prefetch names with
+ * specific name servers at all.
+ */
+int test(char *URL)
+{
+  CURL *curl = NULL;
+  CURLM *multi = NULL;
+  struct curl_slist *names = NULL;
+  struct watched w;
+  CURLMsg *msg;
+  long timeout = -1;
+  int running = 0;
+  int msgs;
+  int prefetched = 0;
+  int done = 0;
+  long hits = -1;
+  int res = 0;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  if(!strcmp(URL, "check")) {
+    if(curl_multi_setopt(multi, CURLMOPT_PREFETCH_DNS_SERVERS, "127.0.0.1")
+       == CURLM_UNKNOWN_OPTION)
+      printf("libcurl lacks CURLMOPT_PREFETCH_DNS_SERVERS support\n");
+    goto test_cleanup;
+  }
+
+  memset(&w, 0, sizeof(w));
+
+  multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+  multi_setopt(multi, CURLMOPT_SOCKETDATA, &w);
+  multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+  multi_setopt(multi, CURLMOPT_TIMERDATA, &timeout);
+  multi_setopt(multi, CURLMOPT_PREFETCH_DNS_SERVERS, libtest_arg2);
+
+  names = curl_slist_append(names, libtest_arg3);
+  if(!names) {
+    res = TEST_ERR_MAJOR_BAD;
+    goto test_cleanup;
+  }
+
+  res = (int)curl_multi_prefetch(multi, names);
+  if(res)
+    goto test_cleanup;
+
+  while(!prefetched) {
+    while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      struct curl_prefetch *p = msg->data.whatever;
+      if(msg->msg != CURLMSG_PREFETCH) {
+        res = TEST_ERR_MAJOR_BAD;
+        goto test_cleanup;
+      }
+      printf("prefetched %s: %d\n", p->name, (int)p->result);
+      prefetched++;
+    }
+
+    abort_on_test_timeout();
+
+    if(!prefetched) {
+      res = drive(multi, &w, &timeout, &running);
+      if(res)
+        goto test_cleanup;
+    }
+  }
+
+  printf("resolver sockets watched: %s\n", w.added ? "yes" : "no");
+  printf("sockets left: %d\n", w.count);
+
+  easy_init(curl);
+
+  easy_setopt(curl, CURLOPT_URL, URL);
+
+  multi_add_handle(multi, curl);
+
+  while(!done) {
+    while((msg = curl_multi_info_read(multi, &msgs)) != NULL) {
+      if(msg->msg == CURLMSG_DONE) {
+        res = (int)msg->data.result;
+        done = 1;
+      }
+    }
+
+    abort_on_test_timeout();
+
+    if(!done) {
+      res = drive(multi, &w, &timeout, &running);
+      if(res)
+        goto test_cleanup;
+    }
+  }
+
+  curl_easy_getinfo(curl, CURLINFO_DNS_CACHE_HITS, &hits);
+  printf("DNS cache hits: %ld\n", hits);
+
+test_cleanup:
+
+  if(curl) {
+    curl_multi_remove_handle(multi, curl);
+    curl_easy_cleanup(curl);
+  }
+  curl_multi_cleanup(multi);
+  curl_slist_free_all(names);
+  curl_global_cleanup();
+
+  return res;
+}
@@ -0,0 +1,204 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "test.h"
+
+#include "testutil.h"
+#include "warnless.h"
+#include "memdebug.h"
+
+#define TEST_HANG_TIMEOUT 60 * 1000
+
+#define NUM_HANDLES 4
+
+/* the bytes per second group 1 may receive */
+#define GROUP_RECV_SPEED 5000
+
+/* the size of the responses of the transfers timed under load */
+#define TIMED_SIZE 1000
+
+static size_t received[NUM_HANDLES];
+
+static size_t count_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  size_t *count = (size_t *)userp;
+  (void)ptr;
+  *count += size * nmemb;
+  return size * nmemb;
+}
+
+/* drive the transfers until the ones counted in 'first' and 'second' have
+   received 'bytes' together. The held back transfers only have a timeout to
+   wait for. */
+static int run_until(CURLM *multi, size_t *first, size_t *second,
+                     size_t bytes)
+{
+  int running;
+  int res = 0;
+
+  for(;;) {
+    struct timeval interval;
+    fd_set fdread;
+    fd_set fdwrite;
+    fd_set fdexcep;
+    long timeout = -99;
+    int maxfd = -99;
+
+    multi_perform(multi, &running);
+
+    abort_on_test_timeout();
+
+    if(!running || (*first + *second >= bytes))
+      break;
+
+    FD_ZERO(&fdread);
+    FD_ZERO(&fdwrite);
+    FD_ZERO(&fdexcep);
+
+    multi_fdset(multi, &fdread, &fdwrite, &fdexcep, &maxfd);
+
+    /* At this point, maxfd is guaranteed to be greater or equal than -1. */
+
+    multi_timeout(multi, &timeout);
+
+    /* At this point, timeout is guaranteed to be greater or equal than -1. */
+
+    if((timeout == -1L) || (timeout > 100L))
+      timeout = 100L;
+    interval.tv_sec = 0;
+    interval.tv_usec = timeout * 1000;
+
+    select_test(maxfd+1, &fdread, &fdwrite, &fdexcep, &interval);
+
+    abort_on_test_timeout();
+  }
+
+test_cleanup:
+
+  return res;
+}
+
+static int add_transfer(CURLM *multi, CURL **curl, const char *URL, int i,
+                        long weight)
+{
+  char target_url[256];
+  int res = 0;
+
+  easy_init(*curl);
+  sprintf(target_url, "%s%04i", URL, i + 1);
+  easy_setopt(*curl, CURLOPT_URL, target_url);
+  easy_setopt(*curl, CURLOPT_WRITEFUNCTION, count_cb);
+  easy_setopt(*curl, CURLOPT_WRITEDATA, &received[i]);
+  /* small reads, so that the limits are split finely */
+  easy_setopt(*curl, CURLOPT_BUFFERSIZE, 50L);
+  easy_setopt(*curl, CURLOPT_RATE_GROUP, 1L);
+  easy_setopt(*curl, CURLOPT_RATE_WEIGHT, weight);
+  multi_add_handle(multi, *curl);
+
+test_cleanup:
+
+  return res;
+}
+
+/*
+ * Two transfers of weight 16 and 48 share the download limit of group 1.
+ * Once both are busy, the second one gets three times as much of it.
+ *
+ * Then, with both still going, a transfer of weight 256 and one of weight
+ * 16 are timed one after the other, the latency of a small transfer under
+ * load. The times go to stderr.
+ */
+int test(char *URL)
+{
+  CURL *curl[NUM_HANDLES];
+  CURLM *multi = NULL;
+  size_t first;
+  size_t second;
+  size_t none = 0;
+  struct timeval start;
+  int res = 0;
+  int i;
+
+  for(i = 0; i < NUM_HANDLES; i++)
+    curl[i] = NULL;
+
+  start_test_timing();
+
+  global_init(CURL_GLOBAL_ALL);
+
+  multi_init(multi);
+
+  res = (int)curl_multi_rategroup(multi, 1, 0, GROUP_RECV_SPEED);
+  if(res)
+    goto test_cleanup;
+
+  res = add_transfer(multi, &curl[0], URL, 0, 16L);
+  if(!res)
+    res = add_transfer(multi, &curl[1], URL, 1, 48L);
+  if(res)
+    goto test_cleanup;
+
+  /* past the first burst, both are held back by now */
+  res = run_until(multi, &received[0], &received[1], GROUP_RECV_SPEED / 5);
+  if(res)
+    goto test_cleanup;
+  first = received[0];
+  second = received[1];
+
+  res = run_until(multi, &received[0], &received[1],
+                  GROUP_RECV_SPEED * 9 / 5);
+  if(res)
+    goto test_cleanup;
+  first = received[0] - first;
+  second = received[1] - second;
+
+  printf("the transfer of weight 48 got %d times as much\n",
+         first ? (int)((second * 10 / first + 5) / 10) : 0);
+
+  for(i = 2; i < NUM_HANDLES; i++) {
+    long weight = (i == 2) ? 256L : 16L;
+    start = tutil_tvnow();
+    res = add_transfer(multi, &curl[i], URL, i, weight);
+    if(!res)
+      res = run_until(multi, &received[i], &none, TIMED_SIZE);
+    if(res)
+      goto test_cleanup;
+    fprintf(stderr, "transfer of weight %ld under load: %ld ms\n", weight,
+            tutil_tvdiff(tutil_tvnow(), start));
+    printf("transfer of weight %ld got %d bytes\n", weight,
+           (int)received[i]);
+    curl_multi_remove_handle(multi, curl[i]);
+  }
+
+test_cleanup:
+
+  /* proper cleanup sequence - type PB */
+
+  for(i = 0; i < NUM_HANDLES; i++) {
+    curl_multi_remove_handle(multi, curl[i]);
+    curl_easy_cleanup(curl[i]);
+  }
+
+  curl_multi_cleanup(multi);
+  curl_global_cleanup();
+
+  return res;
+}
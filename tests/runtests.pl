@@ -69,6 +69,7 @@ BEGIN {
 use strict;
 use warnings;
 use Cwd;
+use IO::Socket::INET;
 
 # Subs imported from serverhelp module
 use serverhelp qw(
@@ -140,6 +141,8 @@ my $GOPHER6PORT;         # Gopher IPv6 server port
 my $HTTPTLSPORT;         # HTTP TLS (non-stunnel) server port
 my $HTTPTLS6PORT;        # HTTP TLS (non-stunnel) IPv6 server port
 my $HTTPPROXYPORT;       # HTTP proxy port, when using CONNECT
+my $DNSPORT;             # DNS (UDP and TCP) port
+my $SOCKSDPORT;          # SOCKS4 and SOCKS5 proxy port
 
 my $srcdir = $ENV{'srcdir'} || '.';
 my $CURL="../src/curl".exe_ext(); # what curl executable to run on the tests
@@ -157,6 +160,7 @@ my $SERVER2IN="$LOGDIR/server2.input"; # what curl sent the second server
 my $PROXYIN="$LOGDIR/proxy.input"; # what curl sent the proxy
 my $CURLLOG="$LOGDIR/curl.log"; # all command lines run
 my $FTPDCMD="$LOGDIR/ftpserver.cmd"; # copy ftp server instructions here
+my $SOCKSDCMD="$LOGDIR/socksd.cmd"; # copy socks server instructions here
 my $SERVERLOGS_LOCK="$LOGDIR/serverlogs.lock"; # server logs advisor read lock
 my $CURLCONFIG="../curl-config"; # curl-config from current build
 
@@ -212,6 +216,7 @@ my $has_ntlm_wb; # set if libcurl is built with NTLM delegation to winbind
 my $has_charconv;# set if libcurl is built with CharConv support
 my $has_tls_srp; # set if libcurl is built with TLS-SRP support
 my $has_metalink;# set if curl is built with Metalink support
+my $has_http2;   # set if libcurl is built with HTTP2 support
 
 my $has_openssl;  # built with a lib using an OpenSSL-like API
 my $has_gnutls;   # built with GnuTLS
@@ -350,7 +355,8 @@ sub init_serverpidfile_hash {
       }
     }
   }
-  for my $proto (('tftp', 'sftp', 'socks', 'ssh', 'rtsp', 'gopher', 'httptls')) {
+  for my $proto (('tftp', 'sftp', 'socks', 'ssh', 'rtsp', 'gopher', 'httptls',
+                   'dns', 'socksd')) {
     for my $ipvnum ((4, 6)) {
       for my $idnum ((1, 2)) {
         my $serv = servername_id($proto, $ipvnum, $idnum);
@@ -1086,6 +1092,89 @@ sub verifysocks {
     return $pid;
 }
 
+#######################################################################
+# Verify that the server that runs on $ip, $port is our DNS server. It
+# answers a query for "verifiedserver" with a TXT record holding its pid.
+#
+sub verifydns {
+    my ($proto, $ipvnum, $idnum, $ip, $port) = @_;
+    my $server = servername_id($proto, $ipvnum, $idnum);
+    my $pid = 0;
+
+    my $sock = IO::Socket::INET->new(Proto => 'udp',
+                                     PeerAddr => $ip,
+                                     PeerPort => $port);
+    if(!$sock) {
+        logmsg "RUN: failed to create a socket for the $server server\n";
+        return 0;
+    }
+
+    # id 0x5445, recursion desired, one question: verifiedserver IN TXT
+    my $query = pack("nnnnnn", 0x5445, 0x0100, 1, 0, 0, 0) .
+        "\x0everifiedserver\x00" . pack("nn", 16, 1);
+    my $reply;
+    my $rin = '';
+    vec($rin, fileno($sock), 1) = 1;
+    if($sock->send($query) &&
+       select($rin, undef, undef, $server_response_maxtime) > 0 &&
+       $sock->recv($reply, 512)) {
+        if($reply =~ /WE ROOLZ: (\d+)/) {
+            # this is our test server with a known pid!
+            $pid = 0+$1;
+        }
+        else {
+            logmsg "RUN: Unknown server on our $server port: $port\n";
+        }
+    }
+    close($sock);
+    return $pid;
+}
+
+#######################################################################
+# Verify that the server that runs on $ip, $port is our SOCKS server. It
+# grants a SOCKS5 connect request to "verifiedserver" and then sends its pid.
+#
+sub verifysocksd {
+    my ($proto, $ipvnum, $idnum, $ip, $port) = @_;
+    my $server = servername_id($proto, $ipvnum, $idnum);
+    my $pid = 0;
+
+    my $sock = IO::Socket::INET->new(Proto => 'tcp',
+                                     PeerAddr => $ip,
+                                     PeerPort => $port,
+                                     Timeout => $server_response_maxtime);
+    if(!$sock) {
+        logmsg "RUN: failed to connect to the $server server\n";
+        return 0;
+    }
+
+    # no authentication, then connect to verifiedserver port 0
+    my $reply = "";
+    my $buf;
+    my $rin = '';
+    vec($rin, fileno($sock), 1) = 1;
+    $sock->send("\x05\x01\x00");
+    if(select(my $rout = $rin, undef, undef, $server_response_maxtime) > 0 &&
+       $sock->sysread($buf, 2)) {
+        $sock->send("\x05\x01\x00\x03\x0everifiedserver\x00\x00");
+        while(select($rout = $rin, undef, undef,
+                     $server_response_maxtime) > 0 &&
+              $sock->sysread($buf, 512)) {
+            $reply .= $buf;
+            last if($reply =~ /\n/);
+        }
+    }
+    if($reply =~ /WE ROOLZ: (\d+)/) {
+        # this is our test server with a known pid!
+        $pid = 0+$1;
+    }
+    else {
+        logmsg "RUN: Unknown server on our $server port: $port\n";
+    }
+    close($sock);
+    return $pid;
+}
+
 #######################################################################
 # Verify that the server that runs on $ip, $port is our server.
 # Retry over several seconds before giving up.  The ssh server in
@@ -1109,6 +1198,8 @@ my %protofunc = ('http' => \&verifyhttp,
                  'tftp' => \&verifyftp,
                  'ssh' => \&verifyssh,
                  'socks' => \&verifysocks,
+                 'dns' => \&verifydns,
+                 'socksd' => \&verifysocksd,
                  'gopher' => \&verifyhttp,
                  'httptls' => \&verifyhttptls);
 
@@ -2060,6 +2151,148 @@ sub responsive_rtsp_server {
     return &responsiveserver($proto, $ipvnum, $idnum, $ip, $port);
 }
 
+#######################################################################
+# start the dns server
+#
+sub rundnsserver {
+    my ($id, $verbose) = @_;
+    my $port = $DNSPORT;
+    my $ip = $HOSTIP;
+    my $proto = 'dns';
+    my $ipvnum = 4;
+    my $idnum = ($id && ($id =~ /^(\d+)$/) && ($id > 1)) ? $id : 1;
+    my $server;
+    my $srvrname;
+    my $pidfile;
+    my $logfile;
+    my $flags = "";
+
+    $server = servername_id($proto, $ipvnum, $idnum);
+
+    $pidfile = $serverpidfile{$server};
+
+    # don't retry if the server doesn't work
+    if ($doesntrun{$pidfile}) {
+        return (0,0);
+    }
+
+    my $pid = processexists($pidfile);
+    if($pid > 0) {
+        stopserver($server, "$pid");
+    }
+    unlink($pidfile) if(-f $pidfile);
+
+    $srvrname = servername_str($proto, $ipvnum, $idnum);
+
+    $logfile = server_logfilename($LOGDIR, $proto, $ipvnum, $idnum);
+
+    $flags .= "--verbose " if($debugprotocol);
+    $flags .= "--pidfile \"$pidfile\" --logfile \"$logfile\" ";
+    $flags .= "--id $idnum " if($idnum > 1);
+    $flags .= "--ipv$ipvnum --port $port --srcdir \"$srcdir\"";
+
+    my $cmd = "$perl $srcdir/dnsserver.pl $flags";
+    my ($dnspid, $pid2) = startnew($cmd, $pidfile, 15, 0);
+
+    if($dnspid <= 0 || !kill(0, $dnspid)) {
+        # it is NOT alive
+        logmsg "RUN: failed to start the $srvrname server\n";
+        stopserver($server, "$pid2");
+        displaylogs($testnumcheck);
+        $doesntrun{$pidfile} = 1;
+        return (0,0);
+    }
+
+    # Server is up. Verify that we can speak to it.
+    my $pid3 = verifyserver($proto, $ipvnum, $idnum, $ip, $port);
+    if(!$pid3) {
+        logmsg "RUN: $srvrname server failed verification\n";
+        # failed to talk to it properly. Kill the server and return failure
+        stopserver($server, "$dnspid $pid2");
+        displaylogs($testnumcheck);
+        $doesntrun{$pidfile} = 1;
+        return (0,0);
+    }
+    $pid2 = $pid3;
+
+    if($verbose) {
+        logmsg "RUN: $srvrname server is now running PID $dnspid\n";
+    }
+
+    return ($pid2, $dnspid);
+}
+
+#######################################################################
+# start the socks server
+#
+sub runsocksdserver {
+    my ($id, $verbose) = @_;
+    my $port = $SOCKSDPORT;
+    my $ip = $HOSTIP;
+    my $proto = 'socksd';
+    my $ipvnum = 4;
+    my $idnum = ($id && ($id =~ /^(\d+)$/) && ($id > 1)) ? $id : 1;
+    my $server;
+    my $srvrname;
+    my $pidfile;
+    my $logfile;
+    my $flags = "";
+
+    $server = servername_id($proto, $ipvnum, $idnum);
+
+    $pidfile = $serverpidfile{$server};
+
+    # don't retry if the server doesn't work
+    if ($doesntrun{$pidfile}) {
+        return (0,0);
+    }
+
+    my $pid = processexists($pidfile);
+    if($pid > 0) {
+        stopserver($server, "$pid");
+    }
+    unlink($pidfile) if(-f $pidfile);
+
+    $srvrname = servername_str($proto, $ipvnum, $idnum);
+
+    $logfile = server_logfilename($LOGDIR, $proto, $ipvnum, $idnum);
+
+    $flags .= "--verbose " if($debugprotocol);
+    $flags .= "--pidfile \"$pidfile\" --logfile \"$logfile\" ";
+    $flags .= "--id $idnum " if($idnum > 1);
+    $flags .= "--ipv$ipvnum --port $port --srcdir \"$srcdir\"";
+
+    my $cmd = "$perl $srcdir/socksserver.pl $flags";
+    my ($sockspid, $pid2) = startnew($cmd, $pidfile, 15, 0);
+
+    if($sockspid <= 0 || !kill(0, $sockspid)) {
+        # it is NOT alive
+        logmsg "RUN: failed to start the $srvrname server\n";
+        stopserver($server, "$pid2");
+        displaylogs($testnumcheck);
+        $doesntrun{$pidfile} = 1;
+        return (0,0);
+    }
+
+    # Server is up. Verify that we can speak to it.
+    my $pid3 = verifyserver($proto, $ipvnum, $idnum, $ip, $port);
+    if(!$pid3) {
+        logmsg "RUN: $srvrname server failed verification\n";
+        # failed to talk to it properly. Kill the server and return failure
+        stopserver($server, "$sockspid $pid2");
+        displaylogs($testnumcheck);
+        $doesntrun{$pidfile} = 1;
+        return (0,0);
+    }
+    $pid2 = $pid3;
+
+    if($verbose) {
+        logmsg "RUN: $srvrname server is now running PID $sockspid\n";
+    }
+
+    return ($pid2, $sockspid);
+}
+
 #######################################################################
 # Single shot tftp server responsiveness test. This should only be
 # used to verify that a server present in %run hash is still functional
@@ -2082,6 +2315,28 @@ sub responsive_tftp_server {
     return &responsiveserver($proto, $ipvnum, $idnum, $ip, $port);
 }
 
+#######################################################################
+# Single shot dns server responsiveness test. This should only be
+# used to verify that a server present in %run hash is still functional
+#
+sub responsive_dns_server {
+    my ($id, $verbose) = @_;
+    my $idnum = ($id && ($id =~ /^(\d+)$/) && ($id > 1)) ? $id : 1;
+
+    return &responsiveserver('dns', 4, $idnum, $HOSTIP, $DNSPORT);
+}
+
+#######################################################################
+# Single shot socks server responsiveness test. This should only be
+# used to verify that a server present in %run hash is still functional
+#
+sub responsive_socksd_server {
+    my ($id, $verbose) = @_;
+    my $idnum = ($id && ($id =~ /^(\d+)$/) && ($id > 1)) ? $id : 1;
+
+    return &responsiveserver('socksd', 4, $idnum, $HOSTIP, $SOCKSDPORT);
+}
+
 #######################################################################
 # Single shot non-stunnel HTTP TLS extensions capable server
 # responsiveness test. This should only be used to verify that a
@@ -2327,6 +2582,10 @@ sub checksystem {
                 # Metalink enabled
                 $has_metalink=1;
             }
+            if($feat =~ /HTTP2/) {
+                # HTTP2 enabled
+                $has_http2=1;
+            }
         }
         #
         # Test harness currently uses a non-stunnel server in order to
@@ -2456,6 +2715,8 @@ sub checksystem {
     if($tftp_ipv6) {
         logmsg sprintf("TFTP-IPv6/%d ", $TFTP6PORT);
     }
+    logmsg sprintf("DNS/%d ", $DNSPORT);
+    logmsg sprintf("SOCKSD/%d ", $SOCKSDPORT);
     logmsg sprintf("\n*   GOPHER/%d ", $GOPHERPORT);
     if($gopher_ipv6) {
         logmsg sprintf("GOPHER-IPv6/%d", $GOPHERPORT);
@@ -2492,6 +2753,9 @@ sub subVariables {
 
   # ports
 
+  $$thing =~ s/%DNSPORT/$DNSPORT/g;
+  $$thing =~ s/%SOCKSDPORT/$SOCKSDPORT/g;
+
   $$thing =~ s/%FTP6PORT/$FTP6PORT/g;
   $$thing =~ s/%FTP2PORT/$FTP2PORT/g;
   $$thing =~ s/%FTPSPORT/$FTPSPORT/g;
@@ -2752,6 +3016,11 @@ sub singletest {
                 next;
             }
         }
+        elsif($f eq "HTTP2") {
+            if($has_http2) {
+                next;
+            }
+        }
         elsif($f eq "socks") {
             next;
         }
@@ -2799,6 +3068,7 @@ sub singletest {
 
     # remove test server commands file before servers are started/verified
     unlink($FTPDCMD) if(-f $FTPDCMD);
+    unlink($SOCKSDCMD) if(-f $SOCKSDCMD);
 
     # timestamp required servers verification start
     $timesrvrini{$testnum} = Time::HiRes::time() if($timestats);
@@ -2930,6 +3200,7 @@ sub singletest {
 
     # if this section exists, it might be FTP server instructions:
     my @ftpservercmd = getpart("reply", "servercmd");
+    my @sockscmd = getpart("reply", "socks");
 
     my $CURLOUT="$LOGDIR/curl$testnum.out"; # curl output if not stdout
 
@@ -2961,6 +3232,10 @@ sub singletest {
         # write the instructions to file
         writearray($FTPDCMD, \@ftpservercmd);
     }
+    if(@sockscmd) {
+        # write the socks server instructions to file
+        writearray($SOCKSDCMD, \@sockscmd);
+    }
 
     # get the command line options to use
     my @blaha;
@@ -3286,6 +3561,7 @@ sub singletest {
 
     # remove the test server commands file after each test
     unlink($FTPDCMD) if(-f $FTPDCMD);
+    unlink($SOCKSDCMD) if(-f $SOCKSDCMD);
 
     # run the postcheck command
     my @postcheck= getpart("client", "postcheck");
@@ -4025,6 +4301,34 @@ sub startservers {
                 $run{'tftp'}="$pid $pid2";
             }
         }
+        elsif($what eq "dns") {
+            if($torture && $run{'dns'} &&
+               !responsive_dns_server("", $verbose)) {
+                stopserver('dns');
+            }
+            if(!$run{'dns'}) {
+                ($pid, $pid2) = rundnsserver("", $verbose);
+                if($pid <= 0) {
+                    return "failed starting DNS server";
+                }
+                printf ("* pid dns => %d %d\n", $pid, $pid2) if($verbose);
+                $run{'dns'}="$pid $pid2";
+            }
+        }
+        elsif($what eq "socksd") {
+            if($torture && $run{'socksd'} &&
+               !responsive_socksd_server("", $verbose)) {
+                stopserver('socksd');
+            }
+            if(!$run{'socksd'}) {
+                ($pid, $pid2) = runsocksdserver("", $verbose);
+                if($pid <= 0) {
+                    return "failed starting SOCKS server";
+                }
+                printf ("* pid socksd => %d %d\n", $pid, $pid2) if($verbose);
+                $run{'socksd'}="$pid $pid2";
+            }
+        }
         elsif($what eq "tftp-ipv6") {
             if($torture && $run{'tftp-ipv6'} &&
                !responsive_tftp_server("", $verbose, "IPv6")) {
@@ -4116,7 +4420,7 @@ sub serverfortest {
                 $tlsext = uc("TLS-${3}");
             }
             if(! grep /^\Q$server\E$/, @protocols) {
-                if(substr($server,0,5) ne "socks") {
+                if((substr($server,0,5) ne "socks") && ($server ne "dns")) {
                     if($tlsext) {
                         return "curl lacks $tlsext support";
                     }
@@ -4512,6 +4816,8 @@ $GOPHER6PORT     = $base++; # Gopher IPv6 server port
 $HTTPTLSPORT     = $base++; # HTTP TLS (non-stunnel) server port
 $HTTPTLS6PORT    = $base++; # HTTP TLS (non-stunnel) IPv6 server port
 $HTTPPROXYPORT   = $base++; # HTTP proxy port, when using CONNECT
+$DNSPORT         = $base++; # DNS (UDP and TCP) port
+$SOCKSDPORT      = $base++; # SOCKS4 and SOCKS5 proxy port
 
 #######################################################################
 # clear and create logging directory:
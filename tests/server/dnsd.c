@@ -0,0 +1,814 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "server_setup.h"
+
+/* dnsd.c: a tiny scriptable DNS server for the test suite
+
+   It answers queries over UDP and TCP on the same port number. The test
+   case to use is the first number found in the first label of the name
+   asked for, so a query for "test1514.example" makes it use the <dns>
+   part of the <reply> section of test case 1514.
+
+   <dns> holds one record per line, like "A 127.0.0.1", "AAAA ::1" or
+   "CNAME other.example". The records of the asked type are returned, those
+   following a CNAME line are returned for the CNAME target. These commands
+   may be mixed with the records, one per line:
+
+   ttl [num]   - TTL of the returned records, 60 is default
+   rcode [num] - reply with this RCODE and no records
+   truncate    - set the TC bit in UDP replies, reply fully over TCP only
+   drop [num]  - silently ignore the first [num] UDP queries of the test
+
+   A query for "verifiedserver" is answered with a TXT record holding
+   "WE ROOLZ: [pid]".
+*/
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#define ENABLE_CURLX_PRINTF
+/* make the curlx header define all printf() functions to use the curlx_*
+   versions instead */
+#include "curlx.h" /* from the private lib dir */
+#include "getpart.h"
+#include "inet_pton.h"
+#include "util.h"
+#include "server_sockaddr.h"
+
+/* include memdebug.h last */
+#include "memdebug.h"
+
+#ifndef DEFAULT_LOGFILE
+#define DEFAULT_LOGFILE "log/dnsd.log"
+#endif
+
+#define DEFAULT_PORT 8991 /* UDP and TCP */
+
+#define DNS_HEADERSIZE 12
+#define DNS_UDPSIZE    512
+#define DNS_TCPSIZE    4096
+
+#define DNS_TYPE_A     1
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_TXT   16
+#define DNS_TYPE_AAAA  28
+#define DNS_CLASS_IN   1
+
+#define DNS_RCODE_FORMERR 1
+
+struct dnscmd {
+  long ttl;       /* TTL of returned records */
+  int rcode;      /* reply with this RCODE and no records if non-zero */
+  bool truncate;  /* set TC in UDP replies */
+  long drop;      /* amount of UDP queries to ignore */
+};
+
+#ifdef ENABLE_IPV6
+static bool use_ipv6 = FALSE;
+#endif
+static const char *ipv_inuse = "IPv4";
+
+const  char *serverlogfile = DEFAULT_LOGFILE;
+static char *pidname= (char *)".dnsd.pid";
+static int serverlogslocked = 0;
+static int wrotepidfile = 0;
+
+/* the test case the UDP queries were dropped for and how many were */
+static long droptest = -1;
+static long dropped = 0;
+
+/* do-nothing macro replacement for systems which lack siginterrupt() */
+
+#ifndef HAVE_SIGINTERRUPT
+#define siginterrupt(x,y) do {} while(0)
+#endif
+
+/* vars used to keep around previous signal handlers */
+
+typedef RETSIGTYPE (*SIGHANDLER_T)(int);
+
+#ifdef SIGHUP
+static SIGHANDLER_T old_sighup_handler  = SIG_ERR;
+#endif
+
+#ifdef SIGPIPE
+static SIGHANDLER_T old_sigpipe_handler = SIG_ERR;
+#endif
+
+#ifdef SIGINT
+static SIGHANDLER_T old_sigint_handler  = SIG_ERR;
+#endif
+
+#ifdef SIGTERM
+static SIGHANDLER_T old_sigterm_handler = SIG_ERR;
+#endif
+
+#if defined(SIGBREAK) && defined(WIN32)
+static SIGHANDLER_T old_sigbreak_handler = SIG_ERR;
+#endif
+
+/* var which if set indicates that the program should finish execution */
+
+SIG_ATOMIC_T got_exit_signal = 0;
+
+/* if next is set indicates the first signal handled in exit_signal_handler */
+
+static volatile int exit_signal = 0;
+
+/* signal handler that will be triggered to indicate that the program
+  should finish its execution in a controlled manner as soon as possible.
+  The first time this is called it will set got_exit_signal to one and
+  store in exit_signal the signal that triggered its execution. */
+
+static RETSIGTYPE exit_signal_handler(int signum)
+{
+  int old_errno = errno;
+  if(got_exit_signal == 0) {
+    got_exit_signal = 1;
+    exit_signal = signum;
+  }
+  (void)signal(signum, exit_signal_handler);
+  errno = old_errno;
+}
+
+static void install_signal_handlers(void)
+{
+#ifdef SIGHUP
+  /* ignore SIGHUP signal */
+  if((old_sighup_handler = signal(SIGHUP, SIG_IGN)) == SIG_ERR)
+    logmsg("cannot install SIGHUP handler: %s", strerror(errno));
+#endif
+#ifdef SIGPIPE
+  /* ignore SIGPIPE signal */
+  if((old_sigpipe_handler = signal(SIGPIPE, SIG_IGN)) == SIG_ERR)
+    logmsg("cannot install SIGPIPE handler: %s", strerror(errno));
+#endif
+#ifdef SIGINT
+  /* handle SIGINT signal with our exit_signal_handler */
+  if((old_sigint_handler = signal(SIGINT, exit_signal_handler)) == SIG_ERR)
+    logmsg("cannot install SIGINT handler: %s", strerror(errno));
+  else
+    siginterrupt(SIGINT, 1);
+#endif
+#ifdef SIGTERM
+  /* handle SIGTERM signal with our exit_signal_handler */
+  if((old_sigterm_handler = signal(SIGTERM, exit_signal_handler)) == SIG_ERR)
+    logmsg("cannot install SIGTERM handler: %s", strerror(errno));
+  else
+    siginterrupt(SIGTERM, 1);
+#endif
+#if defined(SIGBREAK) && defined(WIN32)
+  /* handle SIGBREAK signal with our exit_signal_handler */
+  if((old_sigbreak_handler = signal(SIGBREAK, exit_signal_handler)) == SIG_ERR)
+    logmsg("cannot install SIGBREAK handler: %s", strerror(errno));
+  else
+    siginterrupt(SIGBREAK, 1);
+#endif
+}
+
+static void restore_signal_handlers(void)
+{
+#ifdef SIGHUP
+  if(SIG_ERR != old_sighup_handler)
+    (void)signal(SIGHUP, old_sighup_handler);
+#endif
+#ifdef SIGPIPE
+  if(SIG_ERR != old_sigpipe_handler)
+    (void)signal(SIGPIPE, old_sigpipe_handler);
+#endif
+#ifdef SIGINT
+  if(SIG_ERR != old_sigint_handler)
+    (void)signal(SIGINT, old_sigint_handler);
+#endif
+#ifdef SIGTERM
+  if(SIG_ERR != old_sigterm_handler)
+    (void)signal(SIGTERM, old_sigterm_handler);
+#endif
+#if defined(SIGBREAK) && defined(WIN32)
+  if(SIG_ERR != old_sigbreak_handler)
+    (void)signal(SIGBREAK, old_sigbreak_handler);
+#endif
+}
+
+/*
+ * Read the uncompressed name at 'pos' in the query into 'name' as a dotted
+ * string. Returns the position following the name or 0 on error.
+ */
+static size_t readname(const unsigned char *pkt, size_t len, size_t pos,
+                       char *name, size_t namelen)
+{
+  size_t n = 0;
+
+  while(pos < len) {
+    size_t label = pkt[pos++];
+    if(!label) {
+      name[n] = '\0';
+      return pos;
+    }
+    if((label & 0xc0) || (pos + label > len) ||
+       (n + label + 2 > namelen))
+      return 0;
+    if(n)
+      name[n++] = '.';
+    memcpy(&name[n], &pkt[pos], label);
+    n += label;
+    pos += label;
+  }
+  return 0;
+}
+
+/* the first number in the first label of the name is the test number */
+static long name2test(const char *name)
+{
+  while(*name && (*name != '.')) {
+    if(ISDIGIT(*name))
+      return strtol(name, NULL, 10);
+    name++;
+  }
+  return -1;
+}
+
+/* append 'len' bytes to the reply, returns FALSE when there is no room */
+static bool putdata(unsigned char *buf, size_t *pos, size_t size,
+                    const void *data, size_t len)
+{
+  if(*pos + len > size)
+    return FALSE;
+  memcpy(&buf[*pos], data, len);
+  *pos += len;
+  return TRUE;
+}
+
+static bool put16(unsigned char *buf, size_t *pos, size_t size,
+                  unsigned int val)
+{
+  unsigned char b[2];
+  b[0] = (unsigned char)((val >> 8) & 0xff);
+  b[1] = (unsigned char)(val & 0xff);
+  return putdata(buf, pos, size, b, 2);
+}
+
+static bool put32(unsigned char *buf, size_t *pos, size_t size,
+                  unsigned long val)
+{
+  return put16(buf, pos, size, (unsigned int)((val >> 16) & 0xffff)) &&
+    put16(buf, pos, size, (unsigned int)(val & 0xffff));
+}
+
+/* append a dotted name in wire format */
+static bool putname(unsigned char *buf, size_t *pos, size_t size,
+                    const char *name)
+{
+  while(*name) {
+    const char *dot = strchr(name, '.');
+    size_t len = dot ? (size_t)(dot - name) : strlen(name);
+    unsigned char l = (unsigned char)len;
+    if(!len || (len > 63) || !putdata(buf, pos, size, &l, 1) ||
+       !putdata(buf, pos, size, name, len))
+      return FALSE;
+    name += len;
+    if(*name)
+      name++;
+  }
+  return putdata(buf, pos, size, "", 1);
+}
+
+/* append one resource record, 'owner' is the offset of its name */
+static bool putrr(unsigned char *buf, size_t *pos, size_t size,
+                  size_t owner, unsigned int type, long ttl,
+                  const void *rdata, size_t rdlen)
+{
+  return put16(buf, pos, size, (unsigned int)(0xc000 | owner)) &&
+    put16(buf, pos, size, type) &&
+    put16(buf, pos, size, DNS_CLASS_IN) &&
+    put32(buf, pos, size, (unsigned long)ttl) &&
+    put16(buf, pos, size, (unsigned int)rdlen) &&
+    putdata(buf, pos, size, rdata, rdlen);
+}
+
+/*
+ * Get the <dns> part of the test case and the commands in it. The part is
+ * returned in allocated memory, NULL if there is none.
+ */
+static char *loadtest(long testno, struct dnscmd *cmd)
+{
+  char *data = NULL;
+  size_t count;
+  char *file = test2file(testno);
+  FILE *stream;
+  int error;
+
+  cmd->ttl = 60;
+
+  stream = fopen(file, "rb");
+  if(!stream) {
+    error = errno;
+    logmsg("fopen() failed with error: %d %s", error, strerror(error));
+    logmsg("Couldn't open test file: %s", file);
+    return NULL;
+  }
+  error = getpart(&data, &count, "reply", "dns", stream);
+  fclose(stream);
+  if(error)
+    logmsg("getpart() failed with error: %d", error);
+  else if(data) {
+    char *line = data;
+    int num;
+    while(line && *line) {
+      if(1 == sscanf(line, "ttl %d", &num))
+        cmd->ttl = num;
+      else if(1 == sscanf(line, "rcode %d", &num))
+        cmd->rcode = num;
+      else if(1 == sscanf(line, "drop %d", &num))
+        cmd->drop = num;
+      else if(!strncmp(line, "truncate", 8))
+        cmd->truncate = TRUE;
+      line = strchr(line, '\n');
+      if(line)
+        line++;
+    }
+  }
+  return data;
+}
+
+/*
+ * Build the reply to the query 'q' into 'r'. Returns the size of the reply
+ * or zero if the query should not be answered.
+ */
+static size_t dnsreply(const unsigned char *q, size_t qlen,
+                       unsigned char *r, size_t rsize, bool tcp)
+{
+  char name[256];
+  char type[16];
+  char value[256];
+  size_t qend;
+  size_t pos;
+  size_t owner = DNS_HEADERSIZE;
+  unsigned int qtype;
+  unsigned int ancount = 0;
+  long testno;
+  struct dnscmd cmd;
+  char *data = NULL;
+  char *line;
+  int rcode = 0;
+  bool truncated = FALSE;
+
+  if((qlen < DNS_HEADERSIZE) || (q[2] & 0x80) || (q[4] != 0) ||
+     (q[5] != 1)) {
+    logmsg("ignoring a malformed query");
+    return 0;
+  }
+  qend = readname(q, qlen, DNS_HEADERSIZE, name, sizeof(name));
+  if(!qend || (qend + 4 > qlen)) {
+    logmsg("ignoring a query with a bad question");
+    return 0;
+  }
+  qtype = (unsigned int)((q[qend] << 8) | q[qend + 1]);
+  qend += 4;
+
+  logmsg("%s query for '%s' type %u", tcp?"TCP":"UDP", name, qtype);
+
+  memset(&cmd, 0, sizeof(cmd));
+  if(!strcmp(name, "verifiedserver"))
+    testno = 0;
+  else {
+    testno = name2test(name);
+    if(testno < 0) {
+      logmsg("no test number in '%s'", name);
+      rcode = DNS_RCODE_FORMERR;
+    }
+    else {
+      data = loadtest(testno, &cmd);
+      if(cmd.rcode)
+        rcode = cmd.rcode;
+    }
+  }
+
+  if(!tcp && cmd.drop) {
+    if(droptest != testno) {
+      droptest = testno;
+      dropped = 0;
+    }
+    if(dropped < cmd.drop) {
+      dropped++;
+      logmsg("dropping query %ld of test %ld", dropped, testno);
+      if(data)
+        free(data);
+      return 0;
+    }
+  }
+
+  /* the header and the question as they were asked */
+  pos = 0;
+  putdata(r, &pos, rsize, q, qend);
+  r[2] = (unsigned char)(0x80 | (q[2] & 0x01)); /* QR and RD */
+  r[3] = 0x80; /* RA */
+  memset(&r[6], 0, 6);
+
+  if(!testno) {
+    char weare[64];
+    size_t len = sprintf(&weare[1], "WE ROOLZ: %ld", (long)getpid());
+    weare[0] = (char)len;
+    if(putrr(r, &pos, rsize, owner, DNS_TYPE_TXT, 0, weare, len + 1))
+      ancount++;
+  }
+  else if(rcode)
+    logmsg("replying with RCODE %d", rcode);
+  else if(!tcp && cmd.truncate) {
+    logmsg("replying truncated");
+    truncated = TRUE;
+  }
+  else {
+    line = data;
+    while(line && *line && !truncated) {
+      unsigned char addr[16];
+      if(2 != sscanf(line, "%15s %255s", type, value))
+        type[0] = '\0';
+      if(!strcmp(type, "A") && (qtype == DNS_TYPE_A) &&
+         (Curl_inet_pton(AF_INET, value, addr) == 1)) {
+        if(putrr(r, &pos, rsize, owner, DNS_TYPE_A, cmd.ttl, addr, 4))
+          ancount++;
+        else
+          truncated = TRUE;
+      }
+#ifdef ENABLE_IPV6
+      else if(!strcmp(type, "AAAA") && (qtype == DNS_TYPE_AAAA) &&
+              (Curl_inet_pton(AF_INET6, value, addr) == 1)) {
+        if(putrr(r, &pos, rsize, owner, DNS_TYPE_AAAA, cmd.ttl, addr, 16))
+          ancount++;
+        else
+          truncated = TRUE;
+      }
+#endif
+      else if(!strcmp(type, "CNAME")) {
+        /* the name is written first to learn where the rdata ends up */
+        size_t rr = pos;
+        size_t rdata = pos + 12;
+        pos = rdata;
+        if(putname(r, &pos, rsize, value)) {
+          size_t rdlen = pos - rdata;
+          pos = rr;
+          put16(r, &pos, rsize, (unsigned int)(0xc000 | owner));
+          put16(r, &pos, rsize, DNS_TYPE_CNAME);
+          put16(r, &pos, rsize, DNS_CLASS_IN);
+          put32(r, &pos, rsize, (unsigned long)cmd.ttl);
+          put16(r, &pos, rsize, (unsigned int)rdlen);
+          pos += rdlen;
+          owner = rdata;
+          ancount++;
+        }
+        else {
+          pos = rr;
+          truncated = TRUE;
+        }
+      }
+      line = strchr(line, '\n');
+      if(line)
+        line++;
+    }
+  }
+
+  if(truncated)
+    r[2] |= 0x02; /* TC */
+  r[3] |= (unsigned char)(rcode & 0x0f);
+  r[6] = (unsigned char)(ancount >> 8);
+  r[7] = (unsigned char)(ancount & 0xff);
+
+  if(data)
+    free(data);
+  return pos;
+}
+
+/* receive exactly 'len' bytes, waiting at most a few seconds for them */
+static bool tcp_recv(curl_socket_t sock, unsigned char *buf, size_t len)
+{
+  while(len) {
+    fd_set fds;
+    struct timeval timeout;
+    ssize_t n;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    if(select((int)sock + 1, &fds, NULL, NULL, &timeout) <= 0)
+      return FALSE;
+    n = sread(sock, buf, len);
+    if(n <= 0)
+      return FALSE;
+    buf += n;
+    len -= (size_t)n;
+  }
+  return TRUE;
+}
+
+/* serve one query on an accepted TCP connection */
+static void tcp_query(curl_socket_t sock)
+{
+  unsigned char q[DNS_TCPSIZE];
+  unsigned char r[DNS_TCPSIZE + 2];
+  size_t qlen;
+  size_t rlen;
+
+  if(!tcp_recv(sock, q, 2))
+    return;
+  qlen = (size_t)((q[0] << 8) | q[1]);
+  if((qlen > sizeof(q)) || !tcp_recv(sock, q, qlen)) {
+    logmsg("failed to read the TCP query");
+    return;
+  }
+  rlen = dnsreply(q, qlen, &r[2], DNS_TCPSIZE, TRUE);
+  if(rlen) {
+    r[0] = (unsigned char)(rlen >> 8);
+    r[1] = (unsigned char)(rlen & 0xff);
+    if(swrite(sock, r, rlen + 2) != (ssize_t)(rlen + 2))
+      logmsg("failed to send the TCP reply");
+  }
+}
+
+static curl_socket_t dns_socket(int type, unsigned short port)
+{
+  srvr_sockaddr_union_t me;
+  curl_socket_t sock;
+  int flag = 1;
+  int rc;
+  int error;
+
+#ifdef ENABLE_IPV6
+  if(!use_ipv6)
+#endif
+    sock = socket(AF_INET, type, 0);
+#ifdef ENABLE_IPV6
+  else
+    sock = socket(AF_INET6, type, 0);
+#endif
+
+  if(CURL_SOCKET_BAD == sock) {
+    error = SOCKERRNO;
+    logmsg("Error creating socket: (%d) %s", error, strerror(error));
+    return CURL_SOCKET_BAD;
+  }
+
+  if(0 != setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+                     (void *)&flag, sizeof(flag))) {
+    error = SOCKERRNO;
+    logmsg("setsockopt(SO_REUSEADDR) failed with error: (%d) %s",
+           error, strerror(error));
+    sclose(sock);
+    return CURL_SOCKET_BAD;
+  }
+
+#ifdef ENABLE_IPV6
+  if(!use_ipv6) {
+#endif
+    memset(&me.sa4, 0, sizeof(me.sa4));
+    me.sa4.sin_family = AF_INET;
+    me.sa4.sin_addr.s_addr = INADDR_ANY;
+    me.sa4.sin_port = htons(port);
+    rc = bind(sock, &me.sa, sizeof(me.sa4));
+#ifdef ENABLE_IPV6
+  }
+  else {
+    memset(&me.sa6, 0, sizeof(me.sa6));
+    me.sa6.sin6_family = AF_INET6;
+    me.sa6.sin6_addr = in6addr_any;
+    me.sa6.sin6_port = htons(port);
+    rc = bind(sock, &me.sa, sizeof(me.sa6));
+  }
+#endif /* ENABLE_IPV6 */
+  if((0 == rc) && (SOCK_STREAM == type))
+    rc = listen(sock, 5);
+  if(0 != rc) {
+    error = SOCKERRNO;
+    logmsg("Error binding socket on port %hu: (%d) %s",
+           port, error, strerror(error));
+    sclose(sock);
+    return CURL_SOCKET_BAD;
+  }
+  return sock;
+}
+
+int main(int argc, char **argv)
+{
+  srvr_sockaddr_union_t from;
+  curl_socklen_t fromlen;
+  unsigned char q[DNS_UDPSIZE];
+  unsigned char r[DNS_UDPSIZE];
+  int arg = 1;
+  unsigned short port = DEFAULT_PORT;
+  curl_socket_t udp = CURL_SOCKET_BAD;
+  curl_socket_t tcp = CURL_SOCKET_BAD;
+  long pid;
+  int result = 0;
+
+  while(argc>arg) {
+    if(!strcmp("--version", argv[arg])) {
+      printf("dnsd IPv4%s\n",
+#ifdef ENABLE_IPV6
+             "/IPv6"
+#else
+             ""
+#endif
+             );
+      return 0;
+    }
+    else if(!strcmp("--pidfile", argv[arg])) {
+      arg++;
+      if(argc>arg)
+        pidname = argv[arg++];
+    }
+    else if(!strcmp("--logfile", argv[arg])) {
+      arg++;
+      if(argc>arg)
+        serverlogfile = argv[arg++];
+    }
+    else if(!strcmp("--ipv4", argv[arg])) {
+#ifdef ENABLE_IPV6
+      ipv_inuse = "IPv4";
+      use_ipv6 = FALSE;
+#endif
+      arg++;
+    }
+    else if(!strcmp("--ipv6", argv[arg])) {
+#ifdef ENABLE_IPV6
+      ipv_inuse = "IPv6";
+      use_ipv6 = TRUE;
+#endif
+      arg++;
+    }
+    else if(!strcmp("--port", argv[arg])) {
+      arg++;
+      if(argc>arg) {
+        char *endptr;
+        unsigned long ulnum = strtoul(argv[arg], &endptr, 10);
+        if((endptr != argv[arg] + strlen(argv[arg])) ||
+           (ulnum < 1025UL) || (ulnum > 65535UL)) {
+          fprintf(stderr, "dnsd: invalid --port argument (%s)\n",
+                  argv[arg]);
+          return 0;
+        }
+        port = curlx_ultous(ulnum);
+        arg++;
+      }
+    }
+    else if(!strcmp("--srcdir", argv[arg])) {
+      arg++;
+      if(argc>arg) {
+        path = argv[arg];
+        arg++;
+      }
+    }
+    else {
+      puts("Usage: dnsd [option]\n"
+           " --version\n"
+           " --logfile [file]\n"
+           " --pidfile [file]\n"
+           " --ipv4\n"
+           " --ipv6\n"
+           " --port [port]\n"
+           " --srcdir [path]");
+      return 0;
+    }
+  }
+
+#ifdef WIN32
+  win32_init();
+  atexit(win32_cleanup);
+#endif
+
+  install_signal_handlers();
+
+  pid = (long)getpid();
+
+  udp = dns_socket(SOCK_DGRAM, port);
+  if(CURL_SOCKET_BAD != udp)
+    tcp = dns_socket(SOCK_STREAM, port);
+  if(CURL_SOCKET_BAD == tcp) {
+    result = 1;
+    goto dnsd_cleanup;
+  }
+
+  wrotepidfile = write_pidfile(pidname);
+  if(!wrotepidfile) {
+    result = 1;
+    goto dnsd_cleanup;
+  }
+
+  logmsg("Running %s version on port UDP/TCP %d", ipv_inuse, (int)port);
+
+  for(;;) {
+    fd_set fds;
+    int maxfd = (int)((udp > tcp) ? udp : tcp);
+    int rc;
+
+    FD_ZERO(&fds);
+    FD_SET(udp, &fds);
+    FD_SET(tcp, &fds);
+    rc = select(maxfd + 1, &fds, NULL, NULL, NULL);
+    if(got_exit_signal)
+      break;
+    if(rc < 0) {
+      int error = SOCKERRNO;
+      if(EINTR == error)
+        continue;
+      logmsg("select() failed with error: (%d) %s", error, strerror(error));
+      result = 2;
+      break;
+    }
+
+    set_advisor_read_lock(SERVERLOGS_LOCK);
+    serverlogslocked = 1;
+
+    if(FD_ISSET(udp, &fds)) {
+      ssize_t n;
+      fromlen = sizeof(from);
+      n = (ssize_t)recvfrom(udp, (void *)q, sizeof(q), 0,
+                            &from.sa, &fromlen);
+      if(n > 0) {
+        size_t rlen = dnsreply(q, (size_t)n, r, sizeof(r), FALSE);
+        if(rlen)
+          sendto(udp, (void *)r, rlen, 0, &from.sa, fromlen);
+      }
+    }
+
+    if(FD_ISSET(tcp, &fds)) {
+      curl_socket_t conn = accept(tcp, NULL, NULL);
+      if(CURL_SOCKET_BAD != conn) {
+        tcp_query(conn);
+        sclose(conn);
+      }
+    }
+
+    if(serverlogslocked) {
+      serverlogslocked = 0;
+      clear_advisor_read_lock(SERVERLOGS_LOCK);
+    }
+  }
+
+dnsd_cleanup:
+
+  if(tcp != CURL_SOCKET_BAD)
+    sclose(tcp);
+
+  if(udp != CURL_SOCKET_BAD)
+    sclose(udp);
+
+  if(got_exit_signal)
+    logmsg("signalled to die");
+
+  if(wrotepidfile)
+    unlink(pidname);
+
+  if(serverlogslocked) {
+    serverlogslocked = 0;
+    clear_advisor_read_lock(SERVERLOGS_LOCK);
+  }
+
+  restore_signal_handlers();
+
+  if(got_exit_signal) {
+    logmsg("========> %s dnsd (port: %d pid: %ld) exits with signal (%d)",
+           ipv_inuse, (int)port, pid, exit_signal);
+    /*
+     * To properly set the return status of the process we
+     * must raise the same signal SIGINT or SIGTERM that we
+     * caught and let the old handler take care of it.
+     */
+    raise(exit_signal);
+  }
+
+  logmsg("========> dnsd quits");
+  return result;
+}
@@ -0,0 +1,930 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "server_setup.h"
+
+/* socksd.c: a tiny SOCKS4, SOCKS4a and SOCKS5 proxy for the test suite
+
+   It does the handshakes the SOCKS4 and SOCKS5 ways, then connects to the
+   destination and relays the data of the connection both ways. Destination
+   host names are not resolved, a connection to them is made to 127.0.0.1 as
+   that is where the test servers are.
+
+   Before each new connection is handled, instructions are read from
+   log/socksd.cmd, where the test suite copies the <socks> part of the
+   <reply> section of the test case. These are supported, one per line:
+
+   delay [ms]      - delay each reply of the handshake this long
+   user [name]     - the user name, or SOCKS4 user id, the client must use
+   password [pw]   - the password the client must use
+   reply [code]    - reply to the connect request with this code and close
+
+   A SOCKS4a or SOCKS5 connect request to the host "verifiedserver" is
+   granted and followed by "WE ROOLZ: [pid]\n" and the connection is closed.
+*/
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#define ENABLE_CURLX_PRINTF
+/* make the curlx header define all printf() functions to use the curlx_*
+   versions instead */
+#include "curlx.h" /* from the private lib dir */
+#include "util.h"
+#include "server_sockaddr.h"
+
+/* include memdebug.h last */
+#include "memdebug.h"
+
+#ifndef DEFAULT_LOGFILE
+#define DEFAULT_LOGFILE "log/socksd.log"
+#endif
+
+#ifndef DEFAULT_CMDFILE
+#define DEFAULT_CMDFILE "log/socksd.cmd"
+#endif
+
+#define DEFAULT_PORT 8992
+
+#define MAX_CONNS 16
+#define MAX_NAME 256
+
+struct sockscmd {
+  long delay;               /* milliseconds to delay each reply */
+  char user[MAX_NAME];      /* required user name, if not empty */
+  char password[MAX_NAME];  /* required password, if user is set */
+  int reply;                /* reply with this code and close, if non-zero */
+};
+
+enum sstate {
+  S_FREE,     /* the slot is not used */
+  S_REQUEST,  /* reading the SOCKS4 request or the SOCKS5 methods */
+  S_AUTH,     /* reading the SOCKS5 user name and password */
+  S_CONNECT,  /* reading the SOCKS5 connect request */
+  S_REPLY,    /* a reply is to be sent at 'sendat' */
+  S_RELAY     /* the handshake is done, relaying the data */
+};
+
+struct sconn {
+  enum sstate state;
+  enum sstate next;         /* the state after the reply is sent */
+  curl_socket_t client;
+  curl_socket_t remote;
+  unsigned char in[600];    /* handshake message read so far */
+  size_t inlen;
+  unsigned char out[600];   /* reply to send */
+  size_t outlen;
+  struct timeval sendat;    /* when to send the reply */
+  bool closeafter;          /* close once the reply is sent */
+  bool verify;              /* send the pid once the reply is sent */
+  struct sockscmd cmd;
+};
+
+#ifdef ENABLE_IPV6
+static bool use_ipv6 = FALSE;
+#endif
+static const char *ipv_inuse = "IPv4";
+
+const  char *serverlogfile = DEFAULT_LOGFILE;
+static const char *cmdfile = DEFAULT_CMDFILE;
+static char *pidname= (char *)".socksd.pid";
+static int serverlogslocked = 0;
+static int wrotepidfile = 0;
+static long pid;
+
+static struct sconn conns[MAX_CONNS];
+
+/* do-nothing macro replacement for systems which lack siginterrupt() */
+
+#ifndef HAVE_SIGINTERRUPT
+#define siginterrupt(x,y) do {} while(0)
+#endif
+
+/* vars used to keep around previous signal handlers */
+
+typedef RETSIGTYPE (*SIGHANDLER_T)(int);
+
+#ifdef SIGHUP
+static SIGHANDLER_T old_sighup_handler  = SIG_ERR;
+#endif
+
+#ifdef SIGPIPE
+static SIGHANDLER_T old_sigpipe_handler = SIG_ERR;
+#endif
+
+#ifdef SIGINT
+static SIGHANDLER_T old_sigint_handler  = SIG_ERR;
+#endif
+
+#ifdef SIGTERM
+static SIGHANDLER_T old_sigterm_handler = SIG_ERR;
+#endif
+
+#if defined(SIGBREAK) && defined(WIN32)
+static SIGHANDLER_T old_sigbreak_handler = SIG_ERR;
+#endif
+
+/* var which if set indicates that the program should finish execution */
+
+SIG_ATOMIC_T got_exit_signal = 0;
+
+/* if next is set indicates the first signal handled in exit_signal_handler */
+
+static volatile int exit_signal = 0;
+
+/* signal handler that will be triggered to indicate that the program
+  should finish its execution in a controlled manner as soon as possible.
+  The first time this is called it will set got_exit_signal to one and
+  store in exit_signal the signal that triggered its execution. */
+
+static RETSIGTYPE exit_signal_handler(int signum)
+{
+  int old_errno = errno;
+  if(got_exit_signal == 0) {
+    got_exit_signal = 1;
+    exit_signal = signum;
+  }
+  (void)signal(signum, exit_signal_handler);
+  errno = old_errno;
+}
+
+static void install_signal_handlers(void)
+{
+#ifdef SIGHUP
+  /* ignore SIGHUP signal */
+  if((old_sighup_handler = signal(SIGHUP, SIG_IGN)) == SIG_ERR)
+    logmsg("cannot install SIGHUP handler: %s", strerror(errno));
+#endif
+#ifdef SIGPIPE
+  /* ignore SIGPIPE signal */
+  if((old_sigpipe_handler = signal(SIGPIPE, SIG_IGN)) == SIG_ERR)
+    logmsg("cannot install SIGPIPE handler: %s", strerror(errno));
+#endif
+#ifdef SIGINT
+  /* handle SIGINT signal with our exit_signal_handler */
+  if((old_sigint_handler = signal(SIGINT, exit_signal_handler)) == SIG_ERR)
+    logmsg("cannot install SIGINT handler: %s", strerror(errno));
+  else
+    siginterrupt(SIGINT, 1);
+#endif
+#ifdef SIGTERM
+  /* handle SIGTERM signal with our exit_signal_handler */
+  if((old_sigterm_handler = signal(SIGTERM, exit_signal_handler)) == SIG_ERR)
+    logmsg("cannot install SIGTERM handler: %s", strerror(errno));
+  else
+    siginterrupt(SIGTERM, 1);
+#endif
+#if defined(SIGBREAK) && defined(WIN32)
+  /* handle SIGBREAK signal with our exit_signal_handler */
+  if((old_sigbreak_handler = signal(SIGBREAK, exit_signal_handler)) == SIG_ERR)
+    logmsg("cannot install SIGBREAK handler: %s", strerror(errno));
+  else
+    siginterrupt(SIGBREAK, 1);
+#endif
+}
+
+static void restore_signal_handlers(void)
+{
+#ifdef SIGHUP
+  if(SIG_ERR != old_sighup_handler)
+    (void)signal(SIGHUP, old_sighup_handler);
+#endif
+#ifdef SIGPIPE
+  if(SIG_ERR != old_sigpipe_handler)
+    (void)signal(SIGPIPE, old_sigpipe_handler);
+#endif
+#ifdef SIGINT
+  if(SIG_ERR != old_sigint_handler)
+    (void)signal(SIGINT, old_sigint_handler);
+#endif
+#ifdef SIGTERM
+  if(SIG_ERR != old_sigterm_handler)
+    (void)signal(SIGTERM, old_sigterm_handler);
+#endif
+#if defined(SIGBREAK) && defined(WIN32)
+  if(SIG_ERR != old_sigbreak_handler)
+    (void)signal(SIGBREAK, old_sigbreak_handler);
+#endif
+}
+
+static void loadcmd(struct sockscmd *cmd)
+{
+  FILE *stream;
+  char line[MAX_NAME + 32];
+
+  memset(cmd, 0, sizeof(*cmd));
+
+  stream = fopen(cmdfile, "rb");
+  if(!stream)
+    return; /* no instructions */
+
+  while(fgets(line, sizeof(line), stream)) {
+    char *eol = strpbrk(line, "\r\n");
+    if(eol)
+      *eol = '\0';
+    if(1 == sscanf(line, "delay %ld", &cmd->delay))
+      logmsg("instructed to delay replies %ld ms", cmd->delay);
+    else if(1 == sscanf(line, "reply %d", &cmd->reply))
+      logmsg("instructed to reply %d", cmd->reply);
+    else if(!strncmp(line, "user ", 5))
+      strncpy(cmd->user, line + 5, sizeof(cmd->user) - 1);
+    else if(!strncmp(line, "password ", 9))
+      strncpy(cmd->password, line + 9, sizeof(cmd->password) - 1);
+  }
+  fclose(stream);
+}
+
+static void closeconn(struct sconn *c)
+{
+  if(c->client != CURL_SOCKET_BAD)
+    sclose(c->client);
+  if(c->remote != CURL_SOCKET_BAD)
+    sclose(c->remote);
+  c->client = CURL_SOCKET_BAD;
+  c->remote = CURL_SOCKET_BAD;
+  c->state = S_FREE;
+}
+
+/* queue a reply of 'len' bytes from 'out', to be sent after the delay */
+static void reply(struct sconn *c, const unsigned char *out, size_t len,
+                  enum sstate next)
+{
+  memcpy(c->out, out, len);
+  c->outlen = len;
+  c->sendat = curlx_tvnow();
+  c->sendat.tv_sec += c->cmd.delay / 1000;
+  c->sendat.tv_usec += (c->cmd.delay % 1000) * 1000;
+  if(c->sendat.tv_usec >= 1000000) {
+    c->sendat.tv_sec++;
+    c->sendat.tv_usec -= 1000000;
+  }
+  c->next = next;
+  c->state = S_REPLY;
+  c->inlen = 0;
+}
+
+/*
+ * Connect to the destination, a host name is taken to be the local host.
+ * 'addr' is 'addrlen' bytes of IPv4 or IPv6 address or NULL for the host.
+ */
+static curl_socket_t remote_connect(const unsigned char *addr, size_t addrlen,
+                                    unsigned short port)
+{
+  srvr_sockaddr_union_t to;
+  curl_socklen_t tolen;
+  curl_socket_t sock;
+
+  memset(&to, 0, sizeof(to));
+#ifdef ENABLE_IPV6
+  if(addrlen == 16) {
+    to.sa6.sin6_family = AF_INET6;
+    memcpy(&to.sa6.sin6_addr, addr, 16);
+    to.sa6.sin6_port = htons(port);
+    tolen = sizeof(to.sa6);
+  }
+  else
+#endif
+  if(addrlen == 4) {
+    to.sa4.sin_family = AF_INET;
+    memcpy(&to.sa4.sin_addr, addr, 4);
+    to.sa4.sin_port = htons(port);
+    tolen = sizeof(to.sa4);
+  }
+  else if(!addr) {
+    to.sa4.sin_family = AF_INET;
+    to.sa4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sa4.sin_port = htons(port);
+    tolen = sizeof(to.sa4);
+  }
+  else
+    return CURL_SOCKET_BAD;
+
+  sock = socket(to.sa.sa_family, SOCK_STREAM, 0);
+  if(CURL_SOCKET_BAD == sock)
+    return CURL_SOCKET_BAD;
+
+  if(connect(sock, &to.sa, tolen)) {
+    int error = SOCKERRNO;
+    logmsg("connect() to port %hu failed: (%d) %s", port, error,
+           strerror(error));
+    sclose(sock);
+    return CURL_SOCKET_BAD;
+  }
+  return sock;
+}
+
+/*
+ * Connect to the destination of the request and reply to it. 'name' is the
+ * host name asked for, NULL if 'addr' is the address.
+ */
+static void request(struct sconn *c, int version, const char *name,
+                    const unsigned char *addr, size_t addrlen,
+                    unsigned short port)
+{
+  unsigned char out[600];
+  size_t len;
+  int code;
+
+  logmsg("SOCKS%d connect request to %s port %hu", version,
+         name ? name : (addrlen == 4) ? "IPv4 address" : "IPv6 address",
+         port);
+
+  if(name && !strcmp(name, "verifiedserver")) {
+    c->verify = TRUE;
+    code = 0;
+  }
+  else if(c->cmd.reply) {
+    code = c->cmd.reply;
+    c->closeafter = TRUE;
+  }
+  else {
+    c->remote = remote_connect(name ? NULL : addr, name ? 0 : addrlen, port);
+    code = (CURL_SOCKET_BAD == c->remote) ? -1 : 0;
+  }
+
+  if(version == 4) {
+    out[0] = 0;
+    out[1] = (unsigned char)(code ? (code > 0 ? code : 91) : 90);
+    out[2] = (unsigned char)(port >> 8);
+    out[3] = (unsigned char)(port & 0xff);
+    memset(&out[4], 0, 4);
+    if(addrlen == 4)
+      memcpy(&out[4], addr, 4);
+    len = 8;
+  }
+  else {
+    out[0] = 5;
+    out[1] = (unsigned char)(code > 0 ? code : code ? 5 : 0);
+    out[2] = 0;
+    if(name) {
+      /* a name is bound to the name, which makes the client read the
+         variable sized address */
+      size_t namelen = strlen(name);
+      out[3] = 3;
+      out[4] = (unsigned char)namelen;
+      memcpy(&out[5], name, namelen);
+      len = 5 + namelen;
+    }
+    else {
+      out[3] = (unsigned char)((addrlen == 4) ? 1 : 4);
+      memcpy(&out[4], addr, addrlen);
+      len = 4 + addrlen;
+    }
+    out[len++] = (unsigned char)(port >> 8);
+    out[len++] = (unsigned char)(port & 0xff);
+  }
+  if(code)
+    c->closeafter = TRUE;
+  reply(c, out, len, S_RELAY);
+}
+
+/*
+ * The first message: the SOCKS4 request or the SOCKS5 methods. Returns 1 if
+ * the message is complete, 0 if more is needed and -1 on error.
+ */
+static int socks_request(struct sconn *c)
+{
+  unsigned char *in = c->in;
+
+  if(in[0] == 4) {
+    unsigned char *userid = &in[8];
+    unsigned char *host = NULL;
+    unsigned char *end;
+    size_t left;
+    unsigned short port;
+
+    if(c->inlen < 9)
+      return 0;
+    if(in[1] != 1) {
+      logmsg("SOCKS4 command %d not supported", in[1]);
+      return -1;
+    }
+    end = memchr(userid, 0, c->inlen - 8);
+    if(!end)
+      return 0;
+    if(!in[4] && !in[5] && !in[6] && in[7]) {
+      /* SOCKS4a, the host name follows the user id */
+      host = end + 1;
+      left = c->inlen - (size_t)(host - in);
+      if(!left || !memchr(host, 0, left))
+        return 0;
+    }
+    if(c->cmd.user[0] && strcmp((char *)userid, c->cmd.user)) {
+      unsigned char out[8];
+      logmsg("SOCKS4 user id '%s' rejected", userid);
+      memset(out, 0, sizeof(out));
+      out[1] = 93;
+      c->closeafter = TRUE;
+      reply(c, out, sizeof(out), S_FREE);
+      return 1;
+    }
+    port = (unsigned short)((in[2] << 8) | in[3]);
+    request(c, 4, (char *)host, &in[4], 4, port);
+    return 1;
+  }
+  else if(in[0] == 5) {
+    unsigned char out[2];
+    size_t i;
+    int method = 0xff;
+
+    if((c->inlen < 2) || (c->inlen < (size_t)(2 + in[1])))
+      return 0;
+    for(i = 0; i < in[1]; i++) {
+      if((in[2 + i] == 0) && !c->cmd.user[0]) {
+        method = 0;
+        break;
+      }
+      if(in[2 + i] == 2)
+        method = 2;
+    }
+    logmsg("SOCKS5 method %d picked", method);
+    out[0] = 5;
+    out[1] = (unsigned char)method;
+    if(method == 0xff)
+      c->closeafter = TRUE;
+    reply(c, out, sizeof(out), method ? S_AUTH : S_CONNECT);
+    return 1;
+  }
+
+  logmsg("SOCKS version %d not supported", in[0]);
+  return -1;
+}
+
+/* the SOCKS5 user name and password */
+static int socks_auth(struct sconn *c)
+{
+  unsigned char *in = c->in;
+  unsigned char out[2];
+  char user[MAX_NAME];
+  char password[MAX_NAME];
+  size_t ulen;
+  size_t plen;
+
+  if((c->inlen < 2) || (c->inlen < (size_t)(3 + in[1])))
+    return 0;
+  ulen = in[1];
+  plen = in[2 + ulen];
+  if(c->inlen < 3 + ulen + plen)
+    return 0;
+  memcpy(user, &in[2], ulen);
+  user[ulen] = '\0';
+  memcpy(password, &in[3 + ulen], plen);
+  password[plen] = '\0';
+
+  out[0] = 1;
+  out[1] = 0;
+  if(c->cmd.user[0] &&
+     (strcmp(user, c->cmd.user) || strcmp(password, c->cmd.password))) {
+    logmsg("SOCKS5 user '%s' rejected", user);
+    out[1] = 1;
+    c->closeafter = TRUE;
+  }
+  reply(c, out, sizeof(out), S_CONNECT);
+  return 1;
+}
+
+/* the SOCKS5 connect request */
+static int socks_connect(struct sconn *c)
+{
+  unsigned char *in = c->in;
+  char name[MAX_NAME];
+  size_t len;
+  unsigned short port;
+
+  if(c->inlen < 5)
+    return 0;
+  if((in[0] != 5) || (in[1] != 1)) {
+    logmsg("SOCKS5 request %d %d not supported", in[0], in[1]);
+    return -1;
+  }
+  switch(in[3]) {
+  case 1:
+    len = 4 + 4 + 2;
+    break;
+  case 3:
+    len = 5 + in[4] + 2;
+    break;
+  case 4:
+    len = 4 + 16 + 2;
+    break;
+  default:
+    logmsg("SOCKS5 address type %d not supported", in[3]);
+    return -1;
+  }
+  if(c->inlen < len)
+    return 0;
+
+  port = (unsigned short)((in[len - 2] << 8) | in[len - 1]);
+  if(in[3] == 3) {
+    memcpy(name, &in[5], in[4]);
+    name[in[4]] = '\0';
+    request(c, 5, name, NULL, 0, port);
+  }
+  else
+    request(c, 5, NULL, &in[4], len - 6, port);
+  return 1;
+}
+
+/* read what there is of the handshake message */
+static void handshake(struct sconn *c)
+{
+  ssize_t n = sread(c->client, &c->in[c->inlen], sizeof(c->in) - c->inlen);
+  int rc;
+
+  if(n <= 0) {
+    closeconn(c);
+    return;
+  }
+  c->inlen += (size_t)n;
+
+  if(c->state == S_REQUEST)
+    rc = socks_request(c);
+  else if(c->state == S_AUTH)
+    rc = socks_auth(c);
+  else
+    rc = socks_connect(c);
+
+  if((rc < 0) || (!rc && (c->inlen == sizeof(c->in))))
+    closeconn(c);
+}
+
+/* send the queued reply */
+static void sendreply(struct sconn *c)
+{
+  if(swrite(c->client, c->out, c->outlen) != (ssize_t)c->outlen) {
+    logmsg("failed to send the reply");
+    closeconn(c);
+    return;
+  }
+  if(c->verify) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "WE ROOLZ: %ld\n", pid);
+    swrite(c->client, msg, strlen(msg));
+    c->closeafter = TRUE;
+  }
+  if(c->closeafter)
+    closeconn(c);
+  else
+    c->state = c->next;
+}
+
+/* pass on what there is to read from 'from' to 'to' */
+static void relay(struct sconn *c, curl_socket_t from, curl_socket_t to)
+{
+  char buf[16384];
+  ssize_t n = sread(from, buf, sizeof(buf));
+
+  if((n <= 0) || (swrite(to, buf, (size_t)n) != n))
+    closeconn(c);
+}
+
+static curl_socket_t socks_socket(unsigned short port)
+{
+  srvr_sockaddr_union_t me;
+  curl_socket_t sock;
+  int flag = 1;
+  int rc;
+  int error;
+
+#ifdef ENABLE_IPV6
+  if(!use_ipv6)
+#endif
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+#ifdef ENABLE_IPV6
+  else
+    sock = socket(AF_INET6, SOCK_STREAM, 0);
+#endif
+
+  if(CURL_SOCKET_BAD == sock) {
+    error = SOCKERRNO;
+    logmsg("Error creating socket: (%d) %s", error, strerror(error));
+    return CURL_SOCKET_BAD;
+  }
+
+  if(0 != setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+                     (void *)&flag, sizeof(flag))) {
+    error = SOCKERRNO;
+    logmsg("setsockopt(SO_REUSEADDR) failed with error: (%d) %s",
+           error, strerror(error));
+    sclose(sock);
+    return CURL_SOCKET_BAD;
+  }
+
+#ifdef ENABLE_IPV6
+  if(!use_ipv6) {
+#endif
+    memset(&me.sa4, 0, sizeof(me.sa4));
+    me.sa4.sin_family = AF_INET;
+    me.sa4.sin_addr.s_addr = INADDR_ANY;
+    me.sa4.sin_port = htons(port);
+    rc = bind(sock, &me.sa, sizeof(me.sa4));
+#ifdef ENABLE_IPV6
+  }
+  else {
+    memset(&me.sa6, 0, sizeof(me.sa6));
+    me.sa6.sin6_family = AF_INET6;
+    me.sa6.sin6_addr = in6addr_any;
+    me.sa6.sin6_port = htons(port);
+    rc = bind(sock, &me.sa, sizeof(me.sa6));
+  }
+#endif /* ENABLE_IPV6 */
+  if(0 == rc)
+    rc = listen(sock, 5);
+  if(0 != rc) {
+    error = SOCKERRNO;
+    logmsg("Error binding socket on port %hu: (%d) %s",
+           port, error, strerror(error));
+    sclose(sock);
+    return CURL_SOCKET_BAD;
+  }
+  return sock;
+}
+
+int main(int argc, char **argv)
+{
+  int arg = 1;
+  unsigned short port = DEFAULT_PORT;
+  curl_socket_t sock = CURL_SOCKET_BAD;
+  int result = 0;
+  int i;
+
+  while(argc>arg) {
+    if(!strcmp("--version", argv[arg])) {
+      printf("socksd IPv4%s\n",
+#ifdef ENABLE_IPV6
+             "/IPv6"
+#else
+             ""
+#endif
+             );
+      return 0;
+    }
+    else if(!strcmp("--pidfile", argv[arg])) {
+      arg++;
+      if(argc>arg)
+        pidname = argv[arg++];
+    }
+    else if(!strcmp("--logfile", argv[arg])) {
+      arg++;
+      if(argc>arg)
+        serverlogfile = argv[arg++];
+    }
+    else if(!strcmp("--cmdfile", argv[arg])) {
+      arg++;
+      if(argc>arg)
+        cmdfile = argv[arg++];
+    }
+    else if(!strcmp("--ipv4", argv[arg])) {
+#ifdef ENABLE_IPV6
+      ipv_inuse = "IPv4";
+      use_ipv6 = FALSE;
+#endif
+      arg++;
+    }
+    else if(!strcmp("--ipv6", argv[arg])) {
+#ifdef ENABLE_IPV6
+      ipv_inuse = "IPv6";
+      use_ipv6 = TRUE;
+#endif
+      arg++;
+    }
+    else if(!strcmp("--port", argv[arg])) {
+      arg++;
+      if(argc>arg) {
+        char *endptr;
+        unsigned long ulnum = strtoul(argv[arg], &endptr, 10);
+        if((endptr != argv[arg] + strlen(argv[arg])) ||
+           (ulnum < 1025UL) || (ulnum > 65535UL)) {
+          fprintf(stderr, "socksd: invalid --port argument (%s)\n",
+                  argv[arg]);
+          return 0;
+        }
+        port = curlx_ultous(ulnum);
+        arg++;
+      }
+    }
+    else if(!strcmp("--srcdir", argv[arg])) {
+      arg++;
+      if(argc>arg) {
+        path = argv[arg];
+        arg++;
+      }
+    }
+    else {
+      puts("Usage: socksd [option]\n"
+           " --version\n"
+           " --logfile [file]\n"
+           " --pidfile [file]\n"
+           " --cmdfile [file]\n"
+           " --ipv4\n"
+           " --ipv6\n"
+           " --port [port]\n"
+           " --srcdir [path]");
+      return 0;
+    }
+  }
+
+#ifdef WIN32
+  win32_init();
+  atexit(win32_cleanup);
+#endif
+
+  install_signal_handlers();
+
+  pid = (long)getpid();
+
+  for(i = 0; i < MAX_CONNS; i++) {
+    conns[i].state = S_FREE;
+    conns[i].client = CURL_SOCKET_BAD;
+    conns[i].remote = CURL_SOCKET_BAD;
+  }
+
+  sock = socks_socket(port);
+  if(CURL_SOCKET_BAD == sock) {
+    result = 1;
+    goto socksd_cleanup;
+  }
+
+  wrotepidfile = write_pidfile(pidname);
+  if(!wrotepidfile) {
+    result = 1;
+    goto socksd_cleanup;
+  }
+
+  logmsg("Running %s version on port %d", ipv_inuse, (int)port);
+
+  for(;;) {
+    fd_set fds;
+    curl_socket_t maxfd = sock;
+    struct timeval timeout;
+    struct timeval *tp = NULL;
+    struct timeval now = curlx_tvnow();
+    long wait = -1;
+    int rc;
+
+    FD_ZERO(&fds);
+    FD_SET(sock, &fds);
+    for(i = 0; i < MAX_CONNS; i++) {
+      struct sconn *c = &conns[i];
+      if(c->state == S_FREE)
+        continue;
+      if(c->state == S_REPLY) {
+        long left = curlx_tvdiff(c->sendat, now);
+        if(left < 0)
+          left = 0;
+        if((wait < 0) || (left < wait))
+          wait = left;
+        continue;
+      }
+      FD_SET(c->client, &fds);
+      if(c->client > maxfd)
+        maxfd = c->client;
+      if(c->state == S_RELAY) {
+        FD_SET(c->remote, &fds);
+        if(c->remote > maxfd)
+          maxfd = c->remote;
+      }
+    }
+    if(wait >= 0) {
+      timeout.tv_sec = wait / 1000;
+      timeout.tv_usec = (wait % 1000) * 1000;
+      tp = &timeout;
+    }
+
+    rc = select((int)maxfd + 1, &fds, NULL, NULL, tp);
+    if(got_exit_signal)
+      break;
+    if(rc < 0) {
+      int error = SOCKERRNO;
+      if(EINTR == error)
+        continue;
+      logmsg("select() failed with error: (%d) %s", error, strerror(error));
+      result = 2;
+      break;
+    }
+
+    set_advisor_read_lock(SERVERLOGS_LOCK);
+    serverlogslocked = 1;
+
+    now = curlx_tvnow();
+    for(i = 0; i < MAX_CONNS; i++) {
+      struct sconn *c = &conns[i];
+      switch(c->state) {
+      case S_REPLY:
+        if(curlx_tvdiff(c->sendat, now) <= 0)
+          sendreply(c);
+        break;
+      case S_REQUEST:
+      case S_AUTH:
+      case S_CONNECT:
+        if(FD_ISSET(c->client, &fds))
+          handshake(c);
+        break;
+      case S_RELAY:
+        if(FD_ISSET(c->client, &fds))
+          relay(c, c->client, c->remote);
+        if((c->state == S_RELAY) && FD_ISSET(c->remote, &fds))
+          relay(c, c->remote, c->client);
+        break;
+      default:
+        break;
+      }
+    }
+
+    if(FD_ISSET(sock, &fds)) {
+      curl_socket_t client = accept(sock, NULL, NULL);
+      if(CURL_SOCKET_BAD != client) {
+        for(i = 0; i < MAX_CONNS; i++) {
+          if(conns[i].state == S_FREE)
+            break;
+        }
+        if(i == MAX_CONNS) {
+          logmsg("too many connections");
+          sclose(client);
+        }
+        else {
+          struct sconn *c = &conns[i];
+          memset(c, 0, sizeof(*c));
+          c->client = client;
+          c->remote = CURL_SOCKET_BAD;
+          c->state = S_REQUEST;
+          loadcmd(&c->cmd);
+          logmsg("connection accepted");
+        }
+      }
+    }
+
+    if(serverlogslocked) {
+      serverlogslocked = 0;
+      clear_advisor_read_lock(SERVERLOGS_LOCK);
+    }
+  }
+
+socksd_cleanup:
+
+  for(i = 0; i < MAX_CONNS; i++) {
+    if(conns[i].state != S_FREE)
+      closeconn(&conns[i]);
+  }
+
+  if(sock != CURL_SOCKET_BAD)
+    sclose(sock);
+
+  if(got_exit_signal)
+    logmsg("signalled to die");
+
+  if(wrotepidfile)
+    unlink(pidname);
+
+  if(serverlogslocked) {
+    serverlogslocked = 0;
+    clear_advisor_read_lock(SERVERLOGS_LOCK);
+  }
+
+  restore_signal_handlers();
+
+  if(got_exit_signal) {
+    logmsg("========> %s socksd (port: %d pid: %ld) exits with signal (%d)",
+           ipv_inuse, (int)port, pid, exit_signal);
+    /*
+     * To properly set the return status of the process we
+     * must raise the same signal SIGINT or SIGTERM that we
+     * caught and let the old handler take care of it.
+     */
+    raise(exit_signal);
+  }
+
+  logmsg("========> socksd quits");
+  return result;
+}
@@ -2049,6 +2049,15 @@ int main(int argc, char *argv[])
   logmsg("Running %s %s version on port %d",
          use_gopher?"GOPHER":"HTTP", ipv_inuse, (int)port);
 
+#ifdef TCP_FASTOPEN
+  /* take data in the SYN from clients that do TCP Fast Open, when the
+     system allows it */
+  flag = 5;
+  if(0 != setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN,
+                     (void *)&flag, sizeof(flag)))
+    logmsg("====> TCP_FASTOPEN failed");
+#endif
+
   /* start accepting connections */
   rc = listen(sock, 5);
   if(0 != rc) {
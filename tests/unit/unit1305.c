@@ -41,7 +41,7 @@
 #include "memdebug.h" /* LAST include file */
 
 static struct SessionHandle *data;
-static struct curl_hash *hp;
+static struct Curl_dnscache *hp;
 static char *data_key;
 static struct Curl_dns_entry *data_node;
 
@@ -69,7 +69,7 @@ static void unit_stop( void )
   if (data_key)
     free(data_key);
 
-  Curl_hash_destroy(hp);
+  Curl_dnscache_destroy(hp);
 
   curl_easy_cleanup(data);
   curl_global_cleanup();
@@ -131,9 +131,9 @@ UNITTEST_START
     abort_unless(rc == CURLE_OK, "data node creation failed");
     key_len = strlen(data_key);
 
-    nodep = Curl_hash_add(hp, data_key, key_len+1, data_node);
+    nodep = Curl_hash_add(&hp->hash, data_key, key_len+1, data_node);
     abort_unless(nodep, "insertion into hash failed");
-    /* Freeing will now be done by Curl_hash_destroy */
+    /* Freeing will now be done by Curl_dnscache_destroy */
     data_node = NULL;
 
     /* To do: test retrieval, deletion, edge conditions */
@@ -0,0 +1,192 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "urldata.h"
+#include "hostip.h"
+#include "curl_addrinfo.h"
+#include "timeval.h"
+#include "llist.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+#include "memdebug.h" /* LAST include file */
+
+/* names in the DNS cache, and lookups of them to time */
+#define NUM_NAMES 100000
+#define NUM_LOOKUPS 200000
+
+/* names put in the global DNS cache */
+#define NUM_GLOBAL_NAMES 10000
+
+/* the longest hash list allowed in a cache with NUM_NAMES names */
+#define MAX_CHAIN 16
+
+static struct SessionHandle *data;
+static struct Curl_dnscache *cache;
+static char names[NUM_NAMES][32];
+
+static CURLcode unit_setup(void)
+{
+  data = curl_easy_init();
+  if(!data)
+    return CURLE_OUT_OF_MEMORY;
+
+  cache = Curl_mk_dnscache();
+  if(!cache) {
+    curl_easy_cleanup(data);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  data->dns.hostcache = cache;
+
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+  data->dns.hostcache = NULL;
+  Curl_dnscache_destroy(cache);
+  curl_easy_cleanup(data);
+  curl_global_cleanup();
+}
+
+static CURLcode add_name(const char *name, int port)
+{
+  struct Curl_dns_entry *dns;
+  Curl_addrinfo *addr = Curl_str2addr((char *)"127.0.0.1", port);
+
+  if(!addr)
+    return CURLE_OUT_OF_MEMORY;
+
+  dns = Curl_dnscache_add(data->dns.hostcache, addr, name, port);
+  if(!dns) {
+    Curl_freeaddrinfo(addr);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  dns->inuse--; /* only the cache holds it */
+
+  return CURLE_OK;
+}
+
+static bool cached(struct connectdata *conn, const char *name, int port)
+{
+  struct Curl_dns_entry *dns;
+
+  if(Curl_resolv(conn, name, port, &dns) != CURLRESOLV_RESOLVED)
+    return FALSE;
+
+  Curl_resolv_unlock(data, dns);
+  return TRUE;
+}
+
+static size_t longest_chain(struct curl_hash *h)
+{
+  size_t longest = 0;
+  int i;
+
+  for(i = 0; i < h->slots; i++) {
+    size_t n = Curl_llist_count(h->table[i]);
+    if(n > longest)
+      longest = n;
+  }
+  return longest;
+}
+
+UNITTEST_START
+
+  struct connectdata conn;
+  struct timeval start;
+  char longname[300];
+  char name[32];
+  long ms;
+  int i;
+
+  memset(&conn, 0, sizeof(conn));
+  conn.data = data;
+
+  for(i = 0; i < NUM_NAMES; i++) {
+    snprintf(names[i], sizeof(names[i]), "host%d.example.com", i);
+    abort_unless(!add_name(names[i], 80), "adding a name failed");
+    /* look them up in upper case */
+    snprintf(names[i], sizeof(names[i]), "HOST%d.Example.COM", i);
+  }
+
+  /* the port is part of the id */
+  abort_unless(!add_name("port.example.com", -80), "adding a name failed");
+  fail_unless(cached(&conn, "port.example.com", -80), "negative port");
+  fail_if(cached(&conn, "port.example.com", 80), "wrong port");
+
+  /* long names are not cut, they get an allocated id */
+  memset(longname, 'a', sizeof(longname) - 1);
+  longname[sizeof(longname) - 1] = '\0';
+  abort_unless(!add_name(longname, 80), "adding a name failed");
+  fail_unless(cached(&conn, longname, 80), "long name");
+  longname[260] = '\0';
+  fail_if(cached(&conn, longname, 80), "long name cut at 260");
+  longname[255] = '\0';
+  fail_if(cached(&conn, longname, 80), "long name cut at 255");
+
+  /* time the lookups of cached names */
+  data->info.dns_cache_hits = 0;
+  start = Curl_tvnow();
+  for(i = 0; i < NUM_LOOKUPS; i++) {
+    if(!cached(&conn, names[i % NUM_NAMES], 80)) {
+      fail("cached name not found");
+      break;
+    }
+  }
+  ms = Curl_tvdiff(Curl_tvnow(), start);
+  fail_unless(data->info.dns_cache_hits == NUM_LOOKUPS, "lookups missed");
+
+  /* the hash grew with the names, so its lists stay short */
+  fail_unless(longest_chain(&cache->hash) <= MAX_CHAIN, "hash lists too long");
+
+  printf("%d cached name resolves among %d names in %ld ms, %d slots\n",
+         NUM_LOOKUPS, NUM_NAMES, ms, cache->hash.slots);
+
+  /* the lock-free index of the global cache grows too */
+  data->dns.hostcache = Curl_global_host_cache_init();
+  abort_unless(data->dns.hostcache, "no global DNS cache");
+  data->dns.hostcachetype = HCACHE_GLOBAL;
+  for(i = 0; i < NUM_GLOBAL_NAMES; i++) {
+    CURLcode rc;
+    snprintf(name, sizeof(name), "global%d.example.com", i);
+    Curl_dnscache_lock(data);
+    rc = add_name(name, 80);
+    Curl_dnscache_unlock(data);
+    abort_unless(!rc, "adding a name failed");
+  }
+  fail_unless(longest_chain(&data->dns.hostcache->hash) <= MAX_CHAIN,
+              "global hash lists too long");
+  for(i = 0; i < NUM_GLOBAL_NAMES; i++) {
+    snprintf(name, sizeof(name), "GLOBAL%d.example.com", i);
+    if(!cached(&conn, name, 80)) {
+      fail("global cached name not found");
+      break;
+    }
+  }
+  data->dns.hostcache = cache;
+  data->dns.hostcachetype = HCACHE_NONE;
+
+UNITTEST_STOP
@@ -0,0 +1,196 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "urldata.h"
+#include "hostip.h"
+#include "curl_addrinfo.h"
+#include "curl_threads.h"
+#include "timeval.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+#include "memdebug.h" /* LAST include file */
+
+/* names in the global DNS cache, the threads looking them up and the
+   lookups each of them does */
+#define NUM_NAMES 100
+#define NUM_THREADS 4
+#define NUM_LOOKUPS 200000
+/* the names the writer stores again while the lookups go on, each time
+   with a new name that makes the cache and its index grow */
+#define NUM_UPDATES 2000
+
+#if defined(USE_THREADS_POSIX) || defined(USE_THREADS_WIN32)
+#define USE_THREADS
+#else
+#define CURL_STDCALL
+#endif
+
+struct worker {
+  struct SessionHandle *data;
+  long failed;
+};
+
+static struct Curl_dnscache *cache;
+static char names[NUM_NAMES][32];
+static struct worker workers[NUM_THREADS + 1]; /* the last one writes */
+
+static CURLcode unit_setup(void)
+{
+  int i;
+
+  for(i = 0; i <= NUM_THREADS; i++) {
+    workers[i].data = curl_easy_init();
+    if(!workers[i].data)
+      return CURLE_OUT_OF_MEMORY;
+  }
+
+  cache = Curl_global_host_cache_init();
+  if(!cache)
+    return CURLE_OUT_OF_MEMORY;
+
+  for(i = 0; i <= NUM_THREADS; i++) {
+    workers[i].data->dns.hostcache = cache;
+    workers[i].data->dns.hostcachetype = HCACHE_GLOBAL;
+  }
+
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+  int i;
+
+  for(i = 0; i <= NUM_THREADS; i++) {
+    if(workers[i].data) {
+      workers[i].data->dns.hostcache = NULL;
+      workers[i].data->dns.hostcachetype = HCACHE_NONE;
+      curl_easy_cleanup(workers[i].data);
+    }
+  }
+  curl_global_cleanup();
+}
+
+static bool add_name(struct SessionHandle *data, const char *name)
+{
+  struct Curl_dns_entry *dns;
+  Curl_addrinfo *addr = Curl_str2addr((char *)"127.0.0.1", 80);
+
+  if(!addr)
+    return FALSE;
+
+  Curl_dnscache_lock(data);
+  dns = Curl_dnscache_add(cache, addr, name, 80);
+  Curl_dnscache_unlock(data);
+
+  if(!dns) {
+    Curl_freeaddrinfo(addr);
+    return FALSE;
+  }
+  Curl_resolv_unlock(data, dns); /* only the cache holds it */
+
+  return TRUE;
+}
+
+static unsigned int CURL_STDCALL lookups(void *arg)
+{
+  struct worker *w = arg;
+  struct connectdata conn;
+  struct Curl_dns_entry *dns;
+  int i;
+
+  memset(&conn, 0, sizeof(conn));
+  conn.data = w->data;
+
+  for(i = 0; i < NUM_LOOKUPS; i++) {
+    if((Curl_resolv(&conn, names[i % NUM_NAMES], 80, &dns) !=
+        CURLRESOLV_RESOLVED) || !dns->addr) {
+      w->failed++;
+      continue;
+    }
+    Curl_resolv_unlock(w->data, dns);
+  }
+
+  return 0;
+}
+
+static unsigned int CURL_STDCALL updates(void *arg)
+{
+  struct worker *w = arg;
+  char name[32];
+  int i;
+
+  for(i = 0; i < NUM_UPDATES; i++) {
+    if(!add_name(w->data, names[i % NUM_NAMES]))
+      w->failed++;
+    snprintf(name, sizeof(name), "new%d.example.com", i);
+    if(!add_name(w->data, name))
+      w->failed++;
+  }
+
+  return 0;
+}
+
+UNITTEST_START
+
+  struct timeval start;
+  long ms;
+  int i;
+#ifdef USE_THREADS
+  curl_thread_t threads[NUM_THREADS + 1];
+#endif
+
+  for(i = 0; i < NUM_NAMES; i++) {
+    snprintf(names[i], sizeof(names[i]), "host%d.example.com", i);
+    abort_unless(add_name(workers[0].data, names[i]), "adding a name failed");
+  }
+
+  start = Curl_tvnow();
+#ifdef USE_THREADS
+  for(i = 0; i < NUM_THREADS; i++) {
+    threads[i] = Curl_thread_create(lookups, &workers[i]);
+    abort_unless(threads[i] != curl_thread_t_null, "no thread");
+  }
+  threads[NUM_THREADS] = Curl_thread_create(updates, &workers[NUM_THREADS]);
+  abort_unless(threads[NUM_THREADS] != curl_thread_t_null, "no thread");
+  for(i = 0; i <= NUM_THREADS; i++)
+    Curl_thread_join(&threads[i]);
+#else
+  /* one after the other then */
+  for(i = 0; i < NUM_THREADS; i++)
+    lookups(&workers[i]);
+  updates(&workers[NUM_THREADS]);
+#endif
+  ms = Curl_tvdiff(Curl_tvnow(), start);
+
+  for(i = 0; i <= NUM_THREADS; i++) {
+    fail_unless(!workers[i].failed, "lookup or update failed");
+    fail_unless(!workers[i].data->info.dns_cache_misses, "lookup missed");
+  }
+
+  printf("%d threads did %d cached name resolves in %ld ms\n",
+         NUM_THREADS, NUM_THREADS * NUM_LOOKUPS, ms);
+
+UNITTEST_STOP
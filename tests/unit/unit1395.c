@@ -0,0 +1,206 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "urldata.h"
+#include "hostip.h"
+#include "curl_addrinfo.h"
+#include "timeval.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+#include "memdebug.h" /* LAST include file */
+
+/* prunes to time, of caches this big */
+#define NUM_PRUNES 1000000
+#define SMALL_CACHE 1000
+#define LARGE_CACHE 100000
+
+static struct SessionHandle *data;
+static struct Curl_dnscache *cache;
+
+static CURLcode unit_setup(void)
+{
+  data = curl_easy_init();
+  if(!data)
+    return CURLE_OUT_OF_MEMORY;
+
+  cache = Curl_mk_dnscache();
+  if(!cache) {
+    curl_easy_cleanup(data);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  data->dns.hostcache = cache;
+  data->set.dns_cache_timeout = 60;
+  data->set.dns_cache_stale = 0;
+
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+  data->dns.hostcache = NULL;
+  Curl_dnscache_destroy(cache);
+  curl_easy_cleanup(data);
+  curl_global_cleanup();
+}
+
+/* add a name that was resolved 'age' seconds ago, still in use if 'inuse' */
+static struct Curl_dns_entry *add_name(const char *name, time_t age,
+                                       bool inuse)
+{
+  struct Curl_dns_entry *dns;
+  Curl_addrinfo *addr = Curl_str2addr((char *)"127.0.0.1", 80);
+
+  if(!addr)
+    return NULL;
+
+  dns = Curl_dnscache_add(cache, addr, name, 80);
+  if(!dns) {
+    Curl_freeaddrinfo(addr);
+    return NULL;
+  }
+  dns->timestamp -= age;
+  if(!inuse)
+    dns->inuse--; /* only the cache holds it */
+
+  return dns;
+}
+
+static int any_entry(void *user, void *entry)
+{
+  (void)user;
+  (void)entry;
+  return 1;
+}
+
+/* remove all the entries of the cache */
+static void empty_cache(void)
+{
+  Curl_hash_clean_with_criterium(&cache->hash, NULL, any_entry);
+}
+
+/* fill the cache with fresh entries and time prunes that find nothing */
+static void time_prunes(int entries)
+{
+  struct timeval start;
+  char name[32];
+  long ms;
+  int i;
+
+  for(i = 0; i < entries; i++) {
+    snprintf(name, sizeof(name), "host%d.example.com", i);
+    if(!add_name(name, 0, FALSE)) {
+      fail("adding a name failed");
+      return;
+    }
+  }
+
+  start = Curl_tvnow();
+  for(i = 0; i < NUM_PRUNES; i++)
+    Curl_hostcache_prune(data);
+  ms = Curl_tvdiff(Curl_tvnow(), start);
+  fail_unless(cache->hash.size == (size_t)entries, "entries were pruned");
+
+  printf("%d prunes of %d entries in %ld ms\n", NUM_PRUNES, entries, ms);
+
+  empty_cache();
+}
+
+/* the ids of the cached entries, oldest first */
+static void cached_names(char *buf, size_t size)
+{
+  struct Curl_dns_entry *dns;
+  size_t len = 0;
+
+  buf[0] = '\0';
+  for(dns = cache->age.newer; dns != &cache->age; dns = dns->newer) {
+    snprintf(buf + len, size - len, "%s%s", len ? " " : "", dns->id);
+    len += strlen(buf + len);
+  }
+}
+
+UNITTEST_START
+
+  struct Curl_dns_entry *used;
+  struct Curl_dns_entry *dns;
+  char names[256];
+  time_t now;
+
+  abort_unless(add_name("a.example.com", 300, FALSE), "adding a failed");
+  used = add_name("b.example.com", 200, TRUE);
+  abort_unless(used, "adding b failed");
+  abort_unless(add_name("c.example.com", 100, FALSE), "adding c failed");
+  abort_unless(add_name("d.example.com", 30, FALSE), "adding d failed");
+  abort_unless(add_name("e.example.com", 0, FALSE), "adding e failed");
+
+  /* the timed out entries go, except the one that is in use */
+  Curl_hostcache_prune(data);
+  cached_names(names, sizeof(names));
+  fail_unless(!strcmp(names, "b.example.com:80 d.example.com:80 "
+                      "e.example.com:80"), names);
+  fail_unless(cache->hash.size == 3, "wrong entry count");
+
+  /* the entry in use is still valid */
+  fail_unless(used->timestamp && used->addr, "used entry was dropped");
+
+  /* once it is no longer used, it goes with the next prune, oldest first */
+  Curl_resolv_unlock(data, used);
+  data->set.dns_cache_timeout = 20;
+  Curl_hostcache_prune(data);
+  cached_names(names, sizeof(names));
+  fail_unless(!strcmp(names, "e.example.com:80"), names);
+  fail_unless(cache->hash.size == 1, "wrong entry count");
+
+  /* entries that expire before the cache timeout go when they have expired,
+     addresses only after the time they may be used while refreshed */
+  data->set.dns_cache_timeout = 60;
+  data->set.dns_cache_stale = 30;
+  time(&now);
+  dns = add_name("f.example.com", 0, FALSE);
+  abort_unless(dns, "adding f failed");
+  Curl_dnscache_expire(cache, dns, now - 40);
+  dns = add_name("g.example.com", 0, FALSE);
+  abort_unless(dns, "adding g failed");
+  Curl_dnscache_expire(cache, dns, now - 10);
+  dns = add_name("h.example.com", 0, FALSE);
+  abort_unless(dns, "adding h failed");
+  Curl_dnscache_expire(cache, dns, now + 10);
+  dns = add_name("i.example.com", 0, FALSE);
+  abort_unless(dns, "adding i failed");
+  Curl_freeaddrinfo(dns->addr);
+  dns->addr = NULL; /* a failed lookup */
+  Curl_dnscache_expire(cache, dns, now - 10);
+  Curl_hostcache_prune(data);
+  cached_names(names, sizeof(names));
+  fail_unless(!strcmp(names, "e.example.com:80 g.example.com:80 "
+                      "h.example.com:80"), names);
+  empty_cache();
+
+  /* a prune that finds nothing outdated costs the same for any size */
+  data->set.dns_cache_stale = 0;
+  time_prunes(SMALL_CACHE);
+  time_prunes(LARGE_CACHE);
+
+UNITTEST_STOP
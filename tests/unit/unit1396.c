@@ -0,0 +1,160 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "urldata.h"
+#include "http.h"
+#include "timeval.h"
+
+#define _MPRINTF_REPLACE /* use our functions only */
+#include <curl/mprintf.h>
+
+#include "curl_memory.h"
+#include "memdebug.h" /* LAST include file */
+
+/* custom headers in the list, and header blocks to build and time */
+#define NUM_HEADERS 20
+#define NUM_BUILDS 100000
+
+static struct SessionHandle *data;
+static struct curl_slist *headers;
+
+static CURLcode unit_setup(void)
+{
+  data = curl_easy_init();
+  if(!data)
+    return CURLE_OUT_OF_MEMORY;
+  return CURLE_OK;
+}
+
+static void unit_stop(void)
+{
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(data);
+  curl_global_cleanup();
+}
+
+/* build the custom header block into 'out', which must be big enough */
+static CURLcode build(struct connectdata *conn, char *out, size_t size)
+{
+  Curl_send_buffer *req = Curl_add_buffer_init();
+  CURLcode res;
+
+  if(!req)
+    return CURLE_OUT_OF_MEMORY;
+  res = Curl_add_custom_headers(conn, req);
+  if(!res) {
+    if(req->size_used < size) {
+      memcpy(out, req->buffer, req->size_used);
+      out[req->size_used] = '\0';
+    }
+    else
+      res = CURLE_OUT_OF_MEMORY;
+  }
+  Curl_safefree(req->buffer);
+  free(req);
+  return res;
+}
+
+/* time NUM_BUILDS header blocks, rendered each time or not */
+static long timed_builds(struct connectdata *conn, bool render)
+{
+  struct timeval start = Curl_tvnow();
+  Curl_send_buffer *req;
+  int i;
+
+  for(i = 0; i < NUM_BUILDS; i++) {
+    if(render)
+      Curl_safefree(data->state.customheaders);
+    req = Curl_add_buffer_init();
+    if(!req || Curl_add_custom_headers(conn, req)) {
+      fail("building the headers failed");
+      if(req)
+        free(req);
+      break;
+    }
+    Curl_safefree(req->buffer);
+    free(req);
+  }
+  return Curl_tvdiff(Curl_tvnow(), start);
+}
+
+UNITTEST_START
+
+  struct connectdata conn;
+  struct curl_slist *list;
+  char first[4096];
+  char again[4096];
+  char line[64];
+  long rendered;
+  long kept;
+  int i;
+
+  memset(&conn, 0, sizeof(conn));
+  conn.data = data;
+
+  for(i = 0; i < NUM_HEADERS; i++) {
+    snprintf(line, sizeof(line), "X-Header-%d: value number %d", i, i);
+    list = curl_slist_append(headers, line);
+    abort_unless(list, "curl_slist_append() failed");
+    headers = list;
+  }
+  list = curl_slist_append(headers, "Host: example.com");
+  abort_unless(list, "curl_slist_append() failed");
+  data->set.headers = headers;
+
+  abort_unless(!build(&conn, first, sizeof(first)), "first build");
+  fail_unless(strstr(first, "X-Header-19: value number 19\r\n"), first);
+  fail_unless(strstr(first, "Host: example.com\r\n"), first);
+
+  /* kept, and the same */
+  fail_unless(data->state.customheaders, "headers not kept");
+  abort_unless(!build(&conn, again, sizeof(again)), "second build");
+  fail_unless(!strcmp(first, again), "kept block differs");
+
+  /* filtered under other conditions */
+  conn.allocptr.host = (char *)"Host: example.org\r\n";
+  abort_unless(!build(&conn, again, sizeof(again)), "build with a Host:");
+  fail_if(strstr(again, "Host: example.com\r\n"), "custom Host: not left out");
+  conn.allocptr.host = NULL;
+
+  /* appended to in place, the head stays the same */
+  list = curl_slist_append(headers, "X-Appended: yes");
+  abort_unless(list == headers, "curl_slist_append() failed");
+  abort_unless(!build(&conn, again, sizeof(again)), "build after append");
+  fail_unless(strstr(again, "X-Appended: yes\r\n"), "appended header missing");
+
+  /* a string replaced in place */
+  free(headers->data);
+  headers->data = strdup("X-Header-0: replaced");
+  abort_unless(headers->data, "strdup() failed");
+  abort_unless(!build(&conn, again, sizeof(again)), "build after replace");
+  fail_unless(strstr(again, "X-Header-0: replaced\r\n"), "replaced header");
+
+  /* the cost of rendering the list for every request, and of re-using the
+     kept block */
+  rendered = timed_builds(&conn, TRUE);
+  kept = timed_builds(&conn, FALSE);
+  printf("%d blocks of %d custom headers: %ld ms rendered, %ld ms kept\n",
+         NUM_BUILDS, NUM_HEADERS + 2, rendered, kept);
+
+UNITTEST_STOP
@@ -0,0 +1,172 @@
+/***************************************************************************
+ *                                  _   _ ____  _
+ *  Project                     ___| | | |  _ \| |
+ *                             / __| | | | |_) | |
+ *                            | (__| |_| |  _ <| |___
+ *                             \___|\___/|_| \_\_____|
+ *
+ * Copyright (C) 2013, Daniel Stenberg, <daniel@haxx.se>, et al.
+ *
+ * This software is licensed as described in the file COPYING, which
+ * you should have received as part of this distribution. The terms
+ * are also available at http://curl.haxx.se/docs/copyright.html.
+ *
+ * You may opt to use, copy, modify, merge, publish, distribute and/or sell
+ * copies of the Software, and permit persons to whom the Software is
+ * furnished to do so, under the terms of the COPYING file.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ***************************************************************************/
+#include "curlcheck.h"
+
+#include "urldata.h"
+#include "transfer.h"
+
+#include "curl_memory.h"
+#include "memdebug.h" /* LAST include file */
+
+static struct SessionHandle *data;
+static struct connectdata *conn;
+
+/* what the read callback hands over, one piece per call: a NULL is the end
+   of the upload and 'pause_here' pauses it */
+static const char pause_here[] = "";
+
+struct pieces {
+  const char * const *piece;
+  int calls;
+};
+
+static size_t read_cb(char *ptr, size_t size, size_t nmemb, void *userp)
+{
+  struct pieces *p = (struct pieces *)userp;
+  const char *piece = p->piece[p->calls++];
+  size_t len;
+
+  if(!piece)
+    return 0;
+  if(piece == pause_here)
+    return CURL_READFUNC_PAUSE;
+
+  len = strlen(piece);
+  if(len > size * nmemb)
+    return CURL_READFUNC_ABORT;
+  memcpy(ptr, piece, len);
+  return len;
+}
+
+static CURLcode unit_setup( void )
+{
+  data = curl_easy_init();
+  if(!data)
+    return CURLE_OUT_OF_MEMORY;
+  conn = calloc(1, sizeof(struct connectdata));
+  if(!conn) {
+    curl_easy_cleanup(data);
+    return CURLE_OUT_OF_MEMORY;
+  }
+  /* no TLS is done, it is only what makes uploads coalesce */
+  conn->data = data;
+  conn->sock[FIRSTSOCKET] = 5;
+  conn->sock[SECONDARYSOCKET] = CURL_SOCKET_BAD;
+  conn->writesockfd = conn->sock[FIRSTSOCKET];
+  conn->ssl[FIRSTSOCKET].use = TRUE;
+  conn->fread_func = read_cb;
+  return CURLE_OK;
+}
+
+static void unit_stop( void )
+{
+  free(conn);
+  curl_easy_cleanup(data);
+}
+
+/* read the first piece and the ones coalesced with it, the way
+   readwrite_upload() does, and return the number of bytes to send */
+static ssize_t fill(struct pieces *p, bool chunky, curl_off_t infilesize)
+{
+  struct SingleRequest *k = &data->req;
+  int fillcount;
+  ssize_t nread;
+
+  memset(k, 0, sizeof(*k));
+  k->uploadbuf = data->state.uploadbuffer;
+  k->upload_fromhere = k->uploadbuf;
+  k->upload_chunky = chunky;
+  data->set.infilesize = infilesize;
+  conn->fread_in = p;
+  p->calls = 0;
+
+  if(Curl_fillreadbuffer(conn, BUFSIZE, &fillcount))
+    return -1;
+  nread = fillcount;
+  if((nread > 0) && Curl_coalesce_upload(conn, &nread))
+    return -1;
+
+  return nread;
+}
+
+UNITTEST_START
+
+  static const char * const chunks[] = {
+    "one", "two", "three", NULL
+  };
+  static const char * const paused[] = {
+    "one", "two", pause_here, "three", NULL
+  };
+  static const char * const sized[] = {
+    "one", "two", "never read", NULL
+  };
+  static const char chunked[] =
+    "3\r\none\r\n3\r\ntwo\r\n5\r\nthree\r\n0\r\n\r\n";
+  static const char chunked_paused[] = "3\r\none\r\n3\r\ntwo\r\n";
+  struct pieces p;
+  ssize_t nread;
+
+  /* the chunks follow each other without the gaps left for the headers,
+     the last one ends the upload */
+  p.piece = chunks;
+  nread = fill(&p, TRUE, -1);
+  fail_unless(nread == (ssize_t)strlen(chunked), "chunked length");
+  verify_memory(data->req.upload_fromhere, chunked, strlen(chunked));
+  fail_unless(data->req.upload_done, "the last chunk ends the upload");
+  fail_unless(p.calls == 4, "read until the end");
+
+  /* without chunks, the end of the upload is remembered for the next round
+     and the callback isn't called again */
+  p.piece = chunks;
+  nread = fill(&p, FALSE, -1);
+  fail_unless(nread == 11, "plain length");
+  verify_memory(data->req.upload_fromhere, "onetwothree", 11);
+  fail_unless(data->req.upload_eof, "the end of the upload is kept");
+  fail_unless(!data->req.upload_done, "the next round finishes it");
+  fail_unless(p.calls == 4, "read until the end");
+
+  /* a pause stops the reading, with the pieces before it kept */
+  p.piece = paused;
+  nread = fill(&p, TRUE, -1);
+  fail_unless(nread == (ssize_t)strlen(chunked_paused), "paused length");
+  verify_memory(data->req.upload_fromhere, chunked_paused,
+                strlen(chunked_paused));
+  fail_unless(data->req.keepon & KEEP_SEND_PAUSE, "paused");
+  fail_unless(!data->req.upload_eof, "a pause is not the end");
+  fail_unless(p.calls == 3, "no reading after the pause");
+
+  /* nothing more is read once the known size is reached */
+  p.piece = sized;
+  nread = fill(&p, FALSE, 6);
+  fail_unless(nread == 6, "sized length");
+  verify_memory(data->req.upload_fromhere, "onetwo", 6);
+  fail_unless(p.calls == 2, "no reading past the size");
+
+  /* and without TLS every piece is sent on its own */
+  conn->ssl[FIRSTSOCKET].use = FALSE;
+  p.piece = chunks;
+  nread = fill(&p, TRUE, -1);
+  fail_unless(nread == 8, "one chunk");
+  verify_memory(data->req.upload_fromhere, "3\r\none\r\n", 8);
+  fail_unless(p.calls == 1, "one piece read");
+
+UNITTEST_STOP